@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+double bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void bench_report(const char *name, double seconds, int64_t count, int64_t bytes)
+{
+    printf("%-44s %10.1f MB/s %14.0f ops/s %10.1f ns/op\n", name,
+           bytes / seconds / (1024 * 1024), count / seconds,
+           seconds * 1e9 / count);
+}
+
+int64_t bench_output_bytes = 0;
+
+static int bench_discard_handler(oss_media_hls_file_t *file)
+{
+    bench_output_bytes += file->buffer->pos - file->buffer->start;
+    file->buffer->pos = file->buffer->start;
+    return 0;
+}
+
+oss_media_hls_file_t *bench_hls_file_create()
+{
+    oss_media_hls_file_t *file;
+
+    file = (oss_media_hls_file_t*)calloc(1, sizeof(oss_media_hls_file_t));
+    file->file = NULL;
+    file->frame_count = 0;
+    file->options.video_pid = OSS_MEDIA_DEFAULT_VIDEO_PID;
+    file->options.audio_pid = OSS_MEDIA_DEFAULT_AUDIO_PID;
+    file->options.hls_delay_ms = 700 * 90;
+    file->options.encrypt = 0;
+    file->options.handler_func = bench_discard_handler;
+    file->options.pat_interval_frame_count = OSS_MEDIA_PAT_INTERVAL_FRAME_COUNT;
+
+    file->buffer = (oss_media_hls_buf_t*)malloc(sizeof(oss_media_hls_buf_t));
+    file->buffer->buf = (uint8_t*)malloc(OSS_MEDIA_DEFAULT_WRITE_BUFFER);
+    file->buffer->start = 0;
+    file->buffer->pos = 0;
+    file->buffer->end = OSS_MEDIA_DEFAULT_WRITE_BUFFER;
+
+    return file;
+}
+
+void bench_fill_payload(uint8_t *buf, int len)
+{
+    int i;
+    uint32_t seed = 12345;
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (seed >> 16) | 0x01;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef OSS_MEDIA_BENCH_H
+#define OSS_MEDIA_BENCH_H
+
+#include <stdint.h>
+#include "src/oss_media_hls.h"
+
+/**
+ *  monotonic time in seconds.
+ */
+double bench_now();
+
+/**
+ *  print one result line, bytes and count are reported per second.
+ */
+void bench_report(const char *name, double seconds, int64_t count, int64_t bytes);
+
+/**
+ *  bytes flushed by the hls files of bench_hls_file_create.
+ */
+extern int64_t bench_output_bytes;
+
+/**
+ *  create a hls file which is not backed by oss, the flushed data is dropped.
+ */
+oss_media_hls_file_t *bench_hls_file_create();
+
+/**
+ *  fill buf with a h.264 like payload without start codes.
+ */
+void bench_fill_payload(uint8_t *buf, int len);
+
+#endif
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "src/oss_media_aes.c"
+
+#define BENCH_AES_BUF_SIZE (64 * 1024)
+#define BENCH_AES_LOOPS 4000
+
+static void bench_aes_cbc(const char *name, oss_media_aes_cbc_fn_t encrypt)
+{
+    int i;
+    double begin;
+    uint8_t key[OSS_MEDIA_AES_KEY_SIZE] = {0};
+    uint8_t iv[OSS_MEDIA_AES_BLOCK_SIZE] = {0};
+    oss_media_aes_t aes;
+    uint8_t *buf = (uint8_t*)malloc(BENCH_AES_BUF_SIZE);
+    bench_fill_payload(buf, BENCH_AES_BUF_SIZE);
+
+    oss_media_aes_init(&aes, key, iv);
+    begin = bench_now();
+    for (i = 0; i < BENCH_AES_LOOPS; i++) {
+        encrypt(&aes, buf, BENCH_AES_BUF_SIZE);
+    }
+    bench_report(name, bench_now() - begin, BENCH_AES_LOOPS,
+                 (int64_t)BENCH_AES_LOOPS * BENCH_AES_BUF_SIZE);
+
+    free(buf);
+}
+
+void bench_aes()
+{
+    pthread_once(&aes_once, oss_media_aes_setup);
+
+    bench_aes_cbc("aes-128-cbc portable", oss_media_aes_cbc_encrypt_c);
+#ifdef OSS_MEDIA_AES_NI
+    if (oss_media_aes_ni_supported()) {
+        bench_aes_cbc("aes-128-cbc aes-ni", oss_media_aes_cbc_encrypt_ni);
+    }
+#endif
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "oss_c_sdk/aos_log.h"
+#include "src/oss_media_client.h"
+
+extern void bench_hls();
+extern void bench_aes();
+extern void bench_nal();
+
+static const struct benchlist {
+    const char *benchname;
+    void (*func)(void);
+} benches[] = {
+    {"bench_hls", bench_hls},
+    {"bench_aes", bench_aes},
+    {"bench_nal", bench_nal},
+    {"LastBench", NULL}
+};
+
+int main(int argc, char *argv[])
+{
+    int i;
+    int j;
+    int found;
+
+    aos_log_set_level(AOS_LOG_OFF);
+
+    if (argc == 1) {
+        for (i = 0; benches[i].func != NULL; i++) {
+            benches[i].func();
+        }
+        return 0;
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-l")) {
+            for (j = 0; benches[j].func != NULL; j++) {
+                printf("%s\n", benches[j].benchname);
+            }
+            return 0;
+        }
+
+        found = 0;
+        for (j = 0; benches[j].func != NULL; j++) {
+            if (!strcmp(argv[i], benches[j].benchname)) {
+                benches[j].func();
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "invalid bench name: `%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "src/oss_media_hls.c"
+
+#define BENCH_CRC_BUF_SIZE (64 * 1024)
+#define BENCH_CRC_LOOPS 2000
+#define BENCH_PSI_LOOPS 2000000
+#define BENCH_VIDEO_FRAME_SIZE (16 * 1024)
+#define BENCH_VIDEO_KEY_INTERVAL 30
+#define BENCH_AUDIO_FRAME_SIZE 372
+#define BENCH_MUX_BYTES (512 * 1024 * 1024)
+#define BENCH_MUX_BATCH 256
+
+/* encryption of bench_mux */
+#define BENCH_ENCRYPT_NONE 0
+#define BENCH_ENCRYPT_AES_128 1
+#define BENCH_ENCRYPT_SAMPLE_AES 2
+
+// the bytewise crc32 used before, kept as the baseline
+static uint32_t bench_crc32_bytewise(const uint8_t *data, int length)
+{
+    static uint32_t table[256];
+    static int table_made = 0;
+    uint32_t crc32 = 0xFFFFFFFF;
+    int i, j;
+
+    if (!table_made) {
+        for (i = 0; i < 256; i++) {
+            uint32_t crc = i << 24;
+            for (j = 0; j < 8; j++) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+            }
+            table[i] = crc;
+        }
+        table_made = 1;
+    }
+
+    for (i = 0; i < length; i++) {
+        crc32 = (crc32 << 8) ^ table[((crc32 >> 24) ^ *data++) & 0xFF];
+    }
+    return crc32;
+}
+
+static void bench_crc32()
+{
+    int i;
+    double begin;
+    volatile uint32_t crc = 0;
+    uint8_t *buf = (uint8_t*)malloc(BENCH_CRC_BUF_SIZE);
+    bench_fill_payload(buf, BENCH_CRC_BUF_SIZE);
+
+    begin = bench_now();
+    for (i = 0; i < BENCH_CRC_LOOPS; i++) {
+        crc ^= bench_crc32_bytewise(buf, BENCH_CRC_BUF_SIZE);
+    }
+    bench_report("crc32 bytewise", bench_now() - begin, BENCH_CRC_LOOPS,
+                 (int64_t)BENCH_CRC_LOOPS * BENCH_CRC_BUF_SIZE);
+
+    begin = bench_now();
+    for (i = 0; i < BENCH_CRC_LOOPS; i++) {
+        crc ^= oss_media_crc32(0xFFFFFFFF, buf, BENCH_CRC_BUF_SIZE);
+    }
+    bench_report("crc32 slicing-by-8", bench_now() - begin, BENCH_CRC_LOOPS,
+                 (int64_t)BENCH_CRC_LOOPS * BENCH_CRC_BUF_SIZE);
+
+    begin = bench_now();
+    for (i = 0; i < BENCH_CRC_LOOPS; i++) {
+        crc ^= (uint32_t)oss_media_crc64(0, buf, BENCH_CRC_BUF_SIZE);
+    }
+    bench_report("crc64 slicing-by-8", bench_now() - begin, BENCH_CRC_LOOPS,
+                 (int64_t)BENCH_CRC_LOOPS * BENCH_CRC_BUF_SIZE);
+
+    free(buf);
+}
+
+static void bench_psi()
+{
+    int i;
+    double begin;
+    oss_media_hls_file_t *file = bench_hls_file_create();
+
+    // rebuild both tables for every write, as before the templates
+    begin = bench_now();
+    for (i = 0; i < BENCH_PSI_LOOPS; i++) {
+        if (file->buffer->end - file->buffer->pos < 2 * OSS_MEDIA_HLS_PACKET_SIZE) {
+            file->buffer->pos = file->buffer->start;
+        }
+        oss_media_hls_make_pat(file->buffer->buf + file->buffer->pos);
+        oss_media_hls_make_pmt(file->buffer->buf + file->buffer->pos 
+                               + OSS_MEDIA_HLS_PACKET_SIZE, &file->options,
+                               file->encrypt.audio_config);
+        file->buffer->pos += 2 * OSS_MEDIA_HLS_PACKET_SIZE;
+    }
+    bench_report("pat/pmt rebuild", bench_now() - begin, BENCH_PSI_LOOPS,
+                 (int64_t)BENCH_PSI_LOOPS * 2 * OSS_MEDIA_HLS_PACKET_SIZE);
+
+    begin = bench_now();
+    for (i = 0; i < BENCH_PSI_LOOPS; i++) {
+        oss_media_hls_write_pat_and_pmt(file);
+    }
+    bench_report("pat/pmt template", bench_now() - begin, BENCH_PSI_LOOPS,
+                 (int64_t)BENCH_PSI_LOOPS * 2 * OSS_MEDIA_HLS_PACKET_SIZE);
+
+    oss_media_hls_close(file);
+}
+
+/*
+ * mux count frames of frame_size, with batch > 0 they are handed over
+ * batch at a time by oss_media_hls_write_frames.
+ */
+static void bench_mux(const char *name, stream_type_t type,
+                      int frame_size, int encrypt, segment_format_t format,
+                      int batch)
+{
+    int i, j, count;
+    double begin;
+    oss_media_hls_frame_t frame;
+    oss_media_hls_frame_t frames[BENCH_MUX_BATCH];
+    oss_media_hls_file_t *file = bench_hls_file_create();
+    uint8_t *buf = (uint8_t*)malloc(frame_size);
+    bench_fill_payload(buf, frame_size);
+
+    // one slice after a start code, or one adts frame
+    if (type == st_h264) {
+        memcpy(buf, "\x00\x00\x00\x01", 4);
+    } else {
+        memcpy(buf, "\xff\xf1\x50\x80\x00\x1f\xfc", 7);
+        buf[3] |= frame_size >> 11;
+        buf[4] = frame_size >> 3;
+        buf[5] |= frame_size << 5;
+    }
+
+    file->options.encrypt = encrypt != BENCH_ENCRYPT_NONE;
+    file->options.sample_aes = encrypt == BENCH_ENCRYPT_SAMPLE_AES;
+    file->options.format = format;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = type;
+    count = BENCH_MUX_BYTES / frame_size;
+    bench_output_bytes = 0;
+
+    begin = bench_now();
+    for (i = 0; batch > 0 && i < count; i += j) {
+        for (j = 0; j < batch && i + j < count; j++) {
+            frames[j] = frame;
+            frames[j].pos = buf;
+            frames[j].end = buf + frame_size;
+            frames[j].key = type == st_h264 
+                            && (i + j) % BENCH_VIDEO_KEY_INTERVAL == 0;
+            frames[j].pts = (uint64_t)(i + j) * 3000;
+            frames[j].dts = frames[j].pts;
+        }
+        oss_media_hls_write_frames(frames, j, file);
+    }
+    for (i = 0; batch == 0 && i < count; i++) {
+        frame.pos = buf;
+        frame.end = buf + frame_size;
+        frame.key = type == st_h264 && i % BENCH_VIDEO_KEY_INTERVAL == 0;
+        if (type == st_h264) {
+            buf[4] = frame.key ? 0x65 : 0x41;
+        }
+        frame.pts = (uint64_t)i * 3000;
+        frame.dts = frame.pts;
+        oss_media_hls_write_frame(&frame, file);
+    }
+    oss_media_hls_flush(file);
+    bench_report(name, bench_now() - begin, count, (int64_t)count * frame_size);
+
+    // what the container adds to the frames, with the data not yet flushed
+    printf("%-44s %10.2f %%\n", "  container overhead",
+           (bench_output_bytes - (int64_t)count * frame_size) * 100.0
+           / ((int64_t)count * frame_size));
+
+    free(buf);
+    oss_media_hls_close(file);
+}
+
+static void bench_packetize()
+{
+    bench_mux("mux h264 16KB frames", st_h264, BENCH_VIDEO_FRAME_SIZE, 
+              BENCH_ENCRYPT_NONE, sf_ts, 0);
+    bench_mux("mux aac 372B frames", st_aac, BENCH_AUDIO_FRAME_SIZE, 
+              BENCH_ENCRYPT_NONE, sf_ts, 0);
+    bench_mux("mux h264 16KB frames aes-128", st_h264, 
+              BENCH_VIDEO_FRAME_SIZE, BENCH_ENCRYPT_AES_128, sf_ts, 0);
+    bench_mux("mux aac 372B frames aes-128", st_aac, 
+              BENCH_AUDIO_FRAME_SIZE, BENCH_ENCRYPT_AES_128, sf_ts, 0);
+    bench_mux("mux h264 16KB frames sample-aes", st_h264, 
+              BENCH_VIDEO_FRAME_SIZE, BENCH_ENCRYPT_SAMPLE_AES, sf_ts, 0);
+    bench_mux("mux aac 372B frames sample-aes", st_aac, 
+              BENCH_AUDIO_FRAME_SIZE, BENCH_ENCRYPT_SAMPLE_AES, sf_ts, 0);
+    bench_mux("mux h264 16KB frames fmp4", st_h264, 
+              BENCH_VIDEO_FRAME_SIZE, BENCH_ENCRYPT_NONE, sf_fmp4, 0);
+    bench_mux("mux aac 372B frames fmp4", st_aac, 
+              BENCH_AUDIO_FRAME_SIZE, BENCH_ENCRYPT_NONE, sf_fmp4, 0);
+    bench_mux("mux h264 16KB frames fmp4 aes-128", st_h264, 
+              BENCH_VIDEO_FRAME_SIZE, BENCH_ENCRYPT_AES_128, sf_fmp4, 0);
+    bench_mux("mux h264 16KB frames batch", st_h264, 
+              BENCH_VIDEO_FRAME_SIZE, BENCH_ENCRYPT_NONE, sf_ts, 
+              BENCH_MUX_BATCH);
+    bench_mux("mux aac 372B frames batch", st_aac, 
+              BENCH_AUDIO_FRAME_SIZE, BENCH_ENCRYPT_NONE, sf_ts, 
+              BENCH_MUX_BATCH);
+}
+
+void bench_hls()
+{
+    bench_crc32();
+    bench_psi();
+    bench_packetize();
+}
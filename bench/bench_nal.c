@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "src/oss_media_nal.c"
+
+#define BENCH_NAL_BUF_SIZE (4 * 1024 * 1024)
+#define BENCH_NAL_SIZE (16 * 1024)
+#define BENCH_NAL_LOOPS 64
+
+// the bytewise test the video parser used before, kept as the baseline
+static const uint8_t *bench_find_start_code_bytewise(const uint8_t *p,
+                                                     const uint8_t *end)
+{
+    for (; end - p >= 4; p++) {
+        if ((p[0] & 0x0F) == 0x00 && p[1] == 0x00 && p[2] == 0x00
+            && p[3] == 0x01)
+        {
+            return p + 1;
+        }
+    }
+    return end;
+}
+
+// slice data is close to random bytes, zeros included
+static uint8_t *bench_nal_buf_create()
+{
+    int i;
+    uint32_t seed = 12345;
+    uint8_t *buf = (uint8_t*)malloc(BENCH_NAL_BUF_SIZE);
+
+    for (i = 0; i < BENCH_NAL_BUF_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+    for (i = 0; i < BENCH_NAL_BUF_SIZE; i++) {
+        if (i % BENCH_NAL_SIZE < 4) {
+            buf[i] = i % BENCH_NAL_SIZE == 3 ? 0x01 : 0x00;
+        } else if (i >= 2 && buf[i] <= 0x03 && buf[i-1] == 0 && buf[i-2] == 0) {
+            buf[i] = 0x03;
+        }
+    }
+    return buf;
+}
+
+static void bench_find_start_code(const char *name,
+                                  oss_media_find_start_code_fn_t find)
+{
+    int i;
+    int64_t count = 0;
+    double begin;
+    const uint8_t *p, *end;
+    uint8_t *buf = bench_nal_buf_create();
+
+    end = buf + BENCH_NAL_BUF_SIZE;
+    begin = bench_now();
+    for (i = 0; i < BENCH_NAL_LOOPS; i++) {
+        for (p = find(buf, end); p < end; p = find(p + 3, end)) {
+            count++;
+        }
+    }
+    bench_report(name, bench_now() - begin, count,
+                 (int64_t)BENCH_NAL_LOOPS * BENCH_NAL_BUF_SIZE);
+
+    free(buf);
+}
+
+static void bench_find_nals()
+{
+    int i, n;
+    int64_t count = 0;
+    double begin;
+    const uint8_t *next, *end;
+    oss_media_nal_t nals[64];
+    uint8_t *buf = bench_nal_buf_create();
+
+    end = buf + BENCH_NAL_BUF_SIZE;
+    begin = bench_now();
+    for (i = 0; i < BENCH_NAL_LOOPS; i++) {
+        next = buf;
+        do {
+            n = oss_media_find_nals(next, end, nals, 64, &next);
+            count += n;
+        } while (n == 64);
+    }
+    bench_report("find nals", bench_now() - begin, count,
+                 (int64_t)BENCH_NAL_LOOPS * BENCH_NAL_BUF_SIZE);
+
+    free(buf);
+}
+
+void bench_nal()
+{
+    pthread_once(&nal_once, oss_media_nal_setup);
+
+    bench_find_start_code("find start code bytewise",
+                          bench_find_start_code_bytewise);
+    bench_find_start_code("find start code memchr",
+                          oss_media_find_start_code_c);
+#ifdef OSS_MEDIA_NAL_SIMD
+    if (__builtin_cpu_supports("sse2")) {
+        bench_find_start_code("find start code sse2",
+                              oss_media_find_start_code_sse2);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        bench_find_start_code("find start code avx2",
+                              oss_media_find_start_code_avx2);
+    }
+#endif
+    bench_find_nals();
+}
@@ -32,6 +32,7 @@ static void do_write(oss_media_hls_file_t *file) {
     file_h264 = fopen(h264_file_name, "r");
     len_h264 = fread(buf_h264, 1, max_size, file_h264);
 
+    memset(&frame, 0, sizeof(frame));
     frame.stream_type = st_h264;
     frame.pts = 0;
     frame.continuity_counter = 1;
@@ -101,6 +102,8 @@ static void write_m3u8() {
     }
 
     oss_media_hls_m3u8_info_t m3u8[3];
+
+    memset(m3u8, 0, sizeof(m3u8));
     m3u8[0].duration = 9;
     memcpy(m3u8[0].url, "video-0.ts", strlen("video-0.ts"));
     m3u8[1].duration = 10;
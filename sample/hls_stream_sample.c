@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "src/oss_media_hls_stream.h"
 #include "config.h"
@@ -26,6 +27,7 @@ static void write_only_video_vod() {
     oss_media_hls_stream_options_t options;
     oss_media_hls_stream_t *stream = NULL;
 
+    memset(&options, 0, sizeof(options));
     options.is_live = 0;
     options.bucket_name = SAMPLE_BUCKET_NAME;
     options.ts_name_prefix = "vod/video/test";
@@ -97,6 +99,7 @@ static void write_only_audio_vod() {
     oss_media_hls_stream_options_t options;
     oss_media_hls_stream_t *stream = NULL;
 
+    memset(&options, 0, sizeof(options));
     options.is_live = 0;
     options.bucket_name = SAMPLE_BUCKET_NAME;
     options.ts_name_prefix = "vod/audio/test";
@@ -168,6 +171,7 @@ static void write_video_audio_vod() {
     oss_media_hls_stream_options_t options;
     oss_media_hls_stream_t *stream = NULL;
 
+    memset(&options, 0, sizeof(options));
     options.is_live = 0;
     options.bucket_name = SAMPLE_BUCKET_NAME;
     options.ts_name_prefix = "vod/video_audio/test";
@@ -256,6 +260,7 @@ static void write_video_audio_live() {
     oss_media_hls_stream_options_t options;
     oss_media_hls_stream_t *stream = NULL;
 
+    memset(&options, 0, sizeof(options));
     options.is_live = 1;
     options.bucket_name = SAMPLE_BUCKET_NAME;
     options.ts_name_prefix = "live/video_audio/test";
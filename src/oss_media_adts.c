@@ -0,0 +1,83 @@
+#include <string.h>
+#include "oss_media_adts.h"
+
+/* sampling_frequency_index 13 and 14 are reserved, 15 is not for adts */
+#define OSS_MEDIA_ADTS_RATE_INDEXES 13
+
+/*
+ * byte 1 is 1111 ID layer(2) protection_absent, byte 2 is profile(2)
+ * sampling_frequency_index(4) private_bit channel_configuration(high 1),
+ * byte 3 starts with channel_configuration(low 2) original_copy home,
+ * then the variable header gives aac_frame_length in 13 bits.
+ */
+int oss_media_adts_frame_length(const uint8_t *p, const uint8_t *end,
+                                uint32_t *fixed)
+{
+    int length;
+
+    // the syncword and layer 0
+    if (end - p < OSS_MEDIA_ADTS_HEADER_SIZE || p[0] != 0xFF
+        || (p[1] & 0xF6) != 0xF0)
+    {
+        return -1;
+    }
+    if (((p[2] >> 2) & 0x0F) >= OSS_MEDIA_ADTS_RATE_INDEXES) {
+        return -1;
+    }
+
+    length = ((p[3] & 0x03) << 11) | (p[4] << 3) | (p[5] >> 5);
+    if (length < ((p[1] & 0x01) ? OSS_MEDIA_ADTS_HEADER_SIZE
+                                : OSS_MEDIA_ADTS_CRC_HEADER_SIZE))
+    {
+        return -1;
+    }
+
+    if (fixed != NULL) {
+        *fixed = ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8)
+                 | (p[3] & 0xF0);
+    }
+    return length;
+}
+
+int oss_media_find_adts_frames(const uint8_t *p, const uint8_t *end,
+                               oss_media_adts_t frames[], int n,
+                               const uint8_t **next)
+{
+    uint32_t fixed = 0;
+    uint32_t header;
+    int count = 0;
+    int synced = 0;
+    int length;
+
+    while (count < n && end - p >= OSS_MEDIA_ADTS_HEADER_SIZE) {
+        length = oss_media_adts_frame_length(p, end, &header);
+
+        // a frame right after another is taken, a resync needs the
+        // fixed header of the frame before to tell it from payload
+        if (length < 0 || (!synced && count > 0 && header != fixed)) {
+            synced = 0;
+            p = (const uint8_t *)memchr(p + 1, 0xFF, end - p - 1);
+            if (p == NULL) {
+                p = end;
+                break;
+            }
+            continue;
+        }
+        if (length > end - p) {
+            // cut by end, left to the next scan
+            break;
+        }
+
+        frames[count].pos = p;
+        frames[count].end = p + length;
+        fixed = header;
+        synced = 1;
+        p += length;
+        count++;
+    }
+
+    if (next != NULL) {
+        *next = p;
+    }
+    return count;
+}
@@ -0,0 +1,50 @@
+#ifndef OSS_MEDIA_ADTS_H
+#define OSS_MEDIA_ADTS_H
+
+#include <stdint.h>
+#include "oss_media_define.h"
+
+OSS_MEDIA_CPP_START
+
+/* the header without and with crc, ref: ISO/IEC 13818-7 6.2 */
+#define OSS_MEDIA_ADTS_HEADER_SIZE 7
+#define OSS_MEDIA_ADTS_CRC_HEADER_SIZE 9
+
+/**
+ *  this struct describes an adts frame found in an aac stream.
+ */
+typedef struct oss_media_adts_s {
+    const uint8_t *pos;     // the syncword
+    const uint8_t *end;     // after the last byte of the frame
+} oss_media_adts_t;
+
+/* frames found by one scan of a stream */
+#define OSS_MEDIA_ADTS_BATCH 64
+
+/**
+ *  @brief  decode the adts header at p
+ *  @param[out] fixed the fixed header, which every frame of a stream shares,
+ *              may be NULL
+ *  @return:
+ *      the frame length, the frame may go beyond end
+ *      -1 is returned if the header is invalid or cut by end
+ */
+int oss_media_adts_frame_length(const uint8_t *p, const uint8_t *end,
+                                uint32_t *fixed);
+
+/**
+ *  @brief  find adts frames in [p, end) in one pass, a frame found after
+ *          sync is lost shares the fixed header of the frame before it
+ *  @param[out] frames the frames in order, there may be bytes between two
+ *  @param[in]  n the size of frames
+ *  @param[out] next where to go on with the scan, may be NULL
+ *  @return:
+ *      the count of frames found, n if there may be more
+ */
+int oss_media_find_adts_frames(const uint8_t *p, const uint8_t *end,
+                               oss_media_adts_t frames[], int n,
+                               const uint8_t **next);
+
+OSS_MEDIA_CPP_END
+
+#endif
@@ -0,0 +1,226 @@
+#include <string.h>
+#include <pthread.h>
+#include "oss_media_aes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define OSS_MEDIA_AES_NI 1
+#endif
+
+typedef void (*oss_media_aes_cbc_fn_t)(oss_media_aes_t *aes,
+                                       uint8_t *buf, size_t len);
+
+static uint8_t aes_sbox[256];
+static uint32_t aes_table[4][256];
+static oss_media_aes_cbc_fn_t aes_cbc_encrypt;
+static pthread_once_t aes_once = PTHREAD_ONCE_INIT;
+
+#define ROTL8(x, n) ((uint8_t)(((x) << (n)) | ((x) >> (8 - (n)))))
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define LOAD32(p) (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) \
+                   | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+#define STORE32(p, v) do {                      \
+        (p)[0] = (uint8_t)((v) >> 24);          \
+        (p)[1] = (uint8_t)((v) >> 16);          \
+        (p)[2] = (uint8_t)((v) >> 8);           \
+        (p)[3] = (uint8_t)(v);                  \
+    } while (0)
+
+static void make_aes_table(void)
+{
+    uint8_t p = 1, q = 1, s, s2;
+    int i;
+
+    // sbox: affine transform of the multiplicative inverse in GF(2^8),
+    // p walks the group by 3 and q by its inverse 0xf6
+    do {
+        p = p ^ (uint8_t)(p << 1) ^ (p & 0x80 ? 0x1B : 0);
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+        aes_sbox[p] = q ^ ROTL8(q, 1) ^ ROTL8(q, 2) ^ ROTL8(q, 3)
+                      ^ ROTL8(q, 4) ^ 0x63;
+    } while (p != 1);
+    aes_sbox[0] = 0x63;
+
+    // table[0][i] is the mixed column of sbox[i], others are its rotations
+    for (i = 0; i < 256; i++) {
+        s = aes_sbox[i];
+        s2 = (uint8_t)(s << 1) ^ (s & 0x80 ? 0x1B : 0);
+        aes_table[0][i] = ((uint32_t)s2 << 24) | ((uint32_t)s << 16)
+                          | ((uint32_t)s << 8) | (uint8_t)(s2 ^ s);
+        aes_table[1][i] = ROTR32(aes_table[0][i], 8);
+        aes_table[2][i] = ROTR32(aes_table[0][i], 16);
+        aes_table[3][i] = ROTR32(aes_table[0][i], 24);
+    }
+}
+
+static void oss_media_aes_cbc_encrypt_c(oss_media_aes_t *aes,
+                                        uint8_t *buf, size_t len)
+{
+    uint32_t rk[(OSS_MEDIA_AES_ROUNDS + 1) * 4];
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    const uint32_t *k;
+    int i, r;
+
+    for (i = 0; i < (OSS_MEDIA_AES_ROUNDS + 1) * 4; i++) {
+        rk[i] = LOAD32(aes->round_key + 4 * i);
+    }
+
+    s0 = LOAD32(aes->iv);
+    s1 = LOAD32(aes->iv + 4);
+    s2 = LOAD32(aes->iv + 8);
+    s3 = LOAD32(aes->iv + 12);
+
+    for (; len >= OSS_MEDIA_AES_BLOCK_SIZE; len -= OSS_MEDIA_AES_BLOCK_SIZE) {
+        s0 ^= LOAD32(buf) ^ rk[0];
+        s1 ^= LOAD32(buf + 4) ^ rk[1];
+        s2 ^= LOAD32(buf + 8) ^ rk[2];
+        s3 ^= LOAD32(buf + 12) ^ rk[3];
+
+        k = rk + 4;
+        for (r = 1; r < OSS_MEDIA_AES_ROUNDS; r++, k += 4) {
+            t0 = aes_table[0][s0 >> 24] ^ aes_table[1][(s1 >> 16) & 0xFF]
+                 ^ aes_table[2][(s2 >> 8) & 0xFF] ^ aes_table[3][s3 & 0xFF]
+                 ^ k[0];
+            t1 = aes_table[0][s1 >> 24] ^ aes_table[1][(s2 >> 16) & 0xFF]
+                 ^ aes_table[2][(s3 >> 8) & 0xFF] ^ aes_table[3][s0 & 0xFF]
+                 ^ k[1];
+            t2 = aes_table[0][s2 >> 24] ^ aes_table[1][(s3 >> 16) & 0xFF]
+                 ^ aes_table[2][(s0 >> 8) & 0xFF] ^ aes_table[3][s1 & 0xFF]
+                 ^ k[2];
+            t3 = aes_table[0][s3 >> 24] ^ aes_table[1][(s0 >> 16) & 0xFF]
+                 ^ aes_table[2][(s1 >> 8) & 0xFF] ^ aes_table[3][s2 & 0xFF]
+                 ^ k[3];
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+
+        // last round has no mix columns
+        t0 = ((uint32_t)aes_sbox[s0 >> 24] << 24)
+             ^ ((uint32_t)aes_sbox[(s1 >> 16) & 0xFF] << 16)
+             ^ ((uint32_t)aes_sbox[(s2 >> 8) & 0xFF] << 8)
+             ^ aes_sbox[s3 & 0xFF] ^ k[0];
+        t1 = ((uint32_t)aes_sbox[s1 >> 24] << 24)
+             ^ ((uint32_t)aes_sbox[(s2 >> 16) & 0xFF] << 16)
+             ^ ((uint32_t)aes_sbox[(s3 >> 8) & 0xFF] << 8)
+             ^ aes_sbox[s0 & 0xFF] ^ k[1];
+        t2 = ((uint32_t)aes_sbox[s2 >> 24] << 24)
+             ^ ((uint32_t)aes_sbox[(s3 >> 16) & 0xFF] << 16)
+             ^ ((uint32_t)aes_sbox[(s0 >> 8) & 0xFF] << 8)
+             ^ aes_sbox[s1 & 0xFF] ^ k[2];
+        t3 = ((uint32_t)aes_sbox[s3 >> 24] << 24)
+             ^ ((uint32_t)aes_sbox[(s0 >> 16) & 0xFF] << 16)
+             ^ ((uint32_t)aes_sbox[(s1 >> 8) & 0xFF] << 8)
+             ^ aes_sbox[s2 & 0xFF] ^ k[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+
+        STORE32(buf, s0);
+        STORE32(buf + 4, s1);
+        STORE32(buf + 8, s2);
+        STORE32(buf + 12, s3);
+        buf += OSS_MEDIA_AES_BLOCK_SIZE;
+    }
+
+    STORE32(aes->iv, s0);
+    STORE32(aes->iv + 4, s1);
+    STORE32(aes->iv + 8, s2);
+    STORE32(aes->iv + 12, s3);
+}
+
+#ifdef OSS_MEDIA_AES_NI
+__attribute__((target("sse2,aes")))
+static void oss_media_aes_cbc_encrypt_ni(oss_media_aes_t *aes,
+                                         uint8_t *buf, size_t len)
+{
+    __m128i rk[OSS_MEDIA_AES_ROUNDS + 1];
+    __m128i c, m;
+    int r;
+
+    for (r = 0; r <= OSS_MEDIA_AES_ROUNDS; r++) {
+        rk[r] = _mm_loadu_si128((const __m128i *)(aes->round_key + 16 * r));
+    }
+
+    // cbc is a serial chain, keep the plaintext whitening off of it
+    c = _mm_loadu_si128((const __m128i *)aes->iv);
+    for (; len >= OSS_MEDIA_AES_BLOCK_SIZE; len -= OSS_MEDIA_AES_BLOCK_SIZE) {
+        m = _mm_xor_si128(_mm_loadu_si128((const __m128i *)buf), rk[0]);
+        c = _mm_xor_si128(c, m);
+        for (r = 1; r < OSS_MEDIA_AES_ROUNDS; r++) {
+            c = _mm_aesenc_si128(c, rk[r]);
+        }
+        c = _mm_aesenclast_si128(c, rk[OSS_MEDIA_AES_ROUNDS]);
+        _mm_storeu_si128((__m128i *)buf, c);
+        buf += OSS_MEDIA_AES_BLOCK_SIZE;
+    }
+    _mm_storeu_si128((__m128i *)aes->iv, c);
+}
+
+static int oss_media_aes_ni_supported()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ecx & bit_AES) != 0;
+}
+#endif
+
+static void oss_media_aes_setup(void)
+{
+    make_aes_table();
+
+    aes_cbc_encrypt = oss_media_aes_cbc_encrypt_c;
+#ifdef OSS_MEDIA_AES_NI
+    if (oss_media_aes_ni_supported()) {
+        aes_cbc_encrypt = oss_media_aes_cbc_encrypt_ni;
+    }
+#endif
+}
+
+void oss_media_aes_init(oss_media_aes_t *aes, const uint8_t *key,
+                        const uint8_t *iv)
+{
+    static const uint8_t rcon[OSS_MEDIA_AES_ROUNDS] = {
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36};
+    uint8_t *w = aes->round_key;
+    uint8_t t[4], b;
+    int i;
+
+    pthread_once(&aes_once, oss_media_aes_setup);
+
+    memcpy(w, key, OSS_MEDIA_AES_KEY_SIZE);
+    for (i = OSS_MEDIA_AES_KEY_SIZE; i < (int)sizeof(aes->round_key); i += 4) {
+        memcpy(t, w + i - 4, 4);
+        if (i % OSS_MEDIA_AES_KEY_SIZE == 0) {
+            b = t[0];
+            t[0] = aes_sbox[t[1]] ^ rcon[i / OSS_MEDIA_AES_KEY_SIZE - 1];
+            t[1] = aes_sbox[t[2]];
+            t[2] = aes_sbox[t[3]];
+            t[3] = aes_sbox[b];
+        }
+        w[i] = w[i - OSS_MEDIA_AES_KEY_SIZE] ^ t[0];
+        w[i + 1] = w[i + 1 - OSS_MEDIA_AES_KEY_SIZE] ^ t[1];
+        w[i + 2] = w[i + 2 - OSS_MEDIA_AES_KEY_SIZE] ^ t[2];
+        w[i + 3] = w[i + 3 - OSS_MEDIA_AES_KEY_SIZE] ^ t[3];
+    }
+
+    memcpy(aes->iv, iv, OSS_MEDIA_AES_BLOCK_SIZE);
+}
+
+void oss_media_aes_cbc_encrypt(oss_media_aes_t *aes, uint8_t *buf, size_t len)
+{
+    pthread_once(&aes_once, oss_media_aes_setup);
+    aes_cbc_encrypt(aes, buf, len);
+}
@@ -0,0 +1,43 @@
+#ifndef OSS_MEDIA_AES_H
+#define OSS_MEDIA_AES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "oss_media_define.h"
+
+OSS_MEDIA_CPP_START
+
+/* AES-128: 16 bytes key and block, 10 rounds */
+#define OSS_MEDIA_AES_KEY_SIZE 16
+#define OSS_MEDIA_AES_BLOCK_SIZE 16
+#define OSS_MEDIA_AES_ROUNDS 10
+
+/**
+ *  this struct describes an AES-128-CBC encryption context.
+ */
+typedef struct oss_media_aes_s {
+    uint8_t round_key[(OSS_MEDIA_AES_ROUNDS + 1) * OSS_MEDIA_AES_BLOCK_SIZE];
+    uint8_t iv[OSS_MEDIA_AES_BLOCK_SIZE]; // the last cipher block
+} oss_media_aes_t;
+
+/**
+ *  @brief  expand the key and set the initial vector of a cbc chain
+ *  @param[out] aes the context to initialize
+ *  @param[in]  key the 16 bytes key
+ *  @param[in]  iv the 16 bytes initial vector
+ */
+void oss_media_aes_init(oss_media_aes_t *aes, const uint8_t *key,
+                        const uint8_t *iv);
+
+/**
+ *  @brief  encrypt whole blocks in place and continue the cbc chain,
+ *          AES-NI is used when the cpu supports it
+ *  @param[in]  aes the context
+ *  @param[in]  buf the data to encrypt
+ *  @param[in]  len the data length, a multiple of OSS_MEDIA_AES_BLOCK_SIZE
+ */
+void oss_media_aes_cbc_encrypt(oss_media_aes_t *aes, uint8_t *buf, size_t len);
+
+OSS_MEDIA_CPP_END
+
+#endif
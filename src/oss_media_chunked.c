@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <oss_c_sdk/aos_log.h>
+#include "oss_media_chunked.h"
+#include "oss_media_pool.h"
+
+#define OSS_MEDIA_CHUNKED_CONNECT_TIMEOUT 10
+#define OSS_MEDIA_CHUNKED_SPEED_LIMIT 1024
+#define OSS_MEDIA_CHUNKED_SPEED_TIME 15
+
+static void oss_media_chunked_to_timespec(int64_t us, struct timespec *ts) {
+    ts->tv_sec = us / 1000000;
+    ts->tv_nsec = (us % 1000000) * 1000;
+}
+
+static int64_t oss_media_chunked_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// the next bytes of the body, 0 once the pipe is closed and empty
+static size_t oss_media_chunked_read(char *buffer, size_t size,
+                                     size_t nitems, void *arg)
+{
+    oss_media_chunked_put_t *put = (oss_media_chunked_put_t*)arg;
+    size_t n = size * nitems;
+    size_t len;
+
+    pthread_mutex_lock(&put->mutex);
+    while (put->len == 0 && !put->closed && !put->aborted) {
+        pthread_cond_wait(&put->cond, &put->mutex);
+    }
+    if (put->aborted) {
+        pthread_mutex_unlock(&put->mutex);
+        return CURL_READFUNC_ABORT;
+    }
+
+    n = n < put->len ? n : put->len;
+    len = put->size - put->head < n ? put->size - put->head : n;
+    memcpy(buffer, &put->buf[put->head], len);
+    memcpy(buffer + len, put->buf, n - len);
+    put->head = (put->head + n) % put->size;
+    put->len -= n;
+    put->sent += n;
+    pthread_cond_broadcast(&put->cond);
+    pthread_mutex_unlock(&put->mutex);
+
+    return n;
+}
+
+static size_t oss_media_chunked_discard(char *ptr, size_t size,
+                                        size_t nmemb, void *arg)
+{
+    return size * nmemb;
+}
+
+// the request ends once the put is aborted or its deadline has passed
+static int oss_media_chunked_progress(void *arg, curl_off_t dltotal,
+                                      curl_off_t dlnow, curl_off_t ultotal,
+                                      curl_off_t ulnow)
+{
+    oss_media_chunked_put_t *put = (oss_media_chunked_put_t*)arg;
+    int stop;
+
+    pthread_mutex_lock(&put->mutex);
+    stop = put->aborted || (put->deadline > 0
+                            && oss_media_chunked_now_us() >= put->deadline);
+    pthread_mutex_unlock(&put->mutex);
+
+    return stop;
+}
+
+static void *oss_media_chunked_thread(void *arg) {
+    oss_media_chunked_put_t *put = (oss_media_chunked_put_t*)arg;
+    CURLcode code;
+    long status = 0;
+
+    code = curl_easy_perform(put->curl);
+    curl_easy_getinfo(put->curl, CURLINFO_RESPONSE_CODE, &status);
+
+    pthread_mutex_lock(&put->mutex);
+    put->code = code;
+    put->status = status;
+    put->done = 1;
+    pthread_cond_broadcast(&put->cond);
+    pthread_mutex_unlock(&put->mutex);
+
+    return NULL;
+}
+
+static void oss_media_chunked_free(oss_media_chunked_put_t *put) {
+    curl_slist_free_all(put->headers);
+    if (put->curl != NULL) {
+        curl_easy_cleanup(put->curl);
+    }
+    oss_media_pool_free(put->buf);
+    pthread_cond_destroy(&put->cond);
+    pthread_mutex_destroy(&put->mutex);
+    free(put);
+}
+
+oss_media_chunked_put_t *oss_media_chunked_put_open(const char *url,
+                                                    size_t pipe_size)
+{
+    oss_media_chunked_put_t *put;
+    pthread_condattr_t attr;
+
+    put = (oss_media_chunked_put_t*)calloc(1,
+            sizeof(oss_media_chunked_put_t));
+    if (put == NULL) {
+        aos_error_log("alloc chunked put of url[%s] failed.", url);
+        return NULL;
+    }
+
+    // deadlines of writers are monotonic
+    pthread_mutex_init(&put->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&put->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    put->size = pipe_size;
+    put->buf = (uint8_t*)oss_media_pool_alloc(pipe_size);
+    put->curl = curl_easy_init();
+    // no body length and no 100-continue round trip before the body
+    put->headers = curl_slist_append(NULL, "Transfer-Encoding: chunked");
+    if (put->headers != NULL) {
+        put->headers = curl_slist_append(put->headers, "Expect:");
+    }
+    if (put->buf == NULL || put->curl == NULL || put->headers == NULL) {
+        aos_error_log("alloc chunked put of url[%s] failed.", url);
+        oss_media_chunked_free(put);
+        return NULL;
+    }
+
+    curl_easy_setopt(put->curl, CURLOPT_URL, url);
+    curl_easy_setopt(put->curl, CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(put->curl, CURLOPT_HTTPHEADER, put->headers);
+    curl_easy_setopt(put->curl, CURLOPT_READFUNCTION, oss_media_chunked_read);
+    curl_easy_setopt(put->curl, CURLOPT_READDATA, put);
+    curl_easy_setopt(put->curl, CURLOPT_WRITEFUNCTION,
+                     oss_media_chunked_discard);
+    curl_easy_setopt(put->curl, CURLOPT_USERAGENT,
+                     OSS_MEDIA_CLIENT_USER_AGENT);
+    curl_easy_setopt(put->curl, CURLOPT_CONNECTTIMEOUT,
+                     (long)OSS_MEDIA_CHUNKED_CONNECT_TIMEOUT);
+    // a body which is not written for speed time is taken as stalled too
+    curl_easy_setopt(put->curl, CURLOPT_LOW_SPEED_LIMIT,
+                     (long)OSS_MEDIA_CHUNKED_SPEED_LIMIT);
+    curl_easy_setopt(put->curl, CURLOPT_LOW_SPEED_TIME,
+                     (long)OSS_MEDIA_CHUNKED_SPEED_TIME);
+    curl_easy_setopt(put->curl, CURLOPT_XFERINFOFUNCTION,
+                     oss_media_chunked_progress);
+    curl_easy_setopt(put->curl, CURLOPT_XFERINFODATA, put);
+    curl_easy_setopt(put->curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(put->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(put->curl, CURLOPT_ERRORBUFFER, put->error);
+
+    if (0 != pthread_create(&put->thread, NULL, oss_media_chunked_thread,
+                            put))
+    {
+        aos_error_log("start chunked put of url[%s] failed.", url);
+        oss_media_chunked_free(put);
+        return NULL;
+    }
+
+    return put;
+}
+
+int64_t oss_media_chunked_put_write(oss_media_chunked_put_t *put,
+                                    const void *buf, int64_t nbyte,
+                                    int64_t deadline)
+{
+    const uint8_t *p = (const uint8_t*)buf;
+    int64_t left = nbyte;
+    size_t tail, n, len;
+    struct timespec ts;
+    int64_t ret = nbyte;
+
+    oss_media_chunked_to_timespec(deadline, &ts);
+
+    pthread_mutex_lock(&put->mutex);
+    while (left > 0) {
+        while (put->len == put->size && !put->done && !put->timed_out) {
+            if (deadline <= 0) {
+                pthread_cond_wait(&put->cond, &put->mutex);
+            } else if (ETIMEDOUT == pthread_cond_timedwait(&put->cond,
+                            &put->mutex, &ts) && put->len == put->size)
+            {
+                // what has been sent is not a whole object, it is cut
+                put->timed_out = 1;
+                put->aborted = 1;
+                pthread_cond_broadcast(&put->cond);
+            }
+        }
+        if (put->timed_out) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
+        if (put->done) {
+            aos_error_log("chunked put ended before its body, status:%ld, "
+                          "error:%s", put->status, put->error);
+            ret = -1;
+            break;
+        }
+
+        tail = (put->head + put->len) % put->size;
+        n = put->size - put->len;
+        n = (int64_t)n < left ? n : (size_t)left;
+        len = put->size - tail < n ? put->size - tail : n;
+        memcpy(&put->buf[tail], p, len);
+        memcpy(put->buf, p + len, n - len);
+        put->len += n;
+        p += n;
+        left -= n;
+        pthread_cond_broadcast(&put->cond);
+    }
+    pthread_mutex_unlock(&put->mutex);
+
+    return ret;
+}
+
+int oss_media_chunked_put_close(oss_media_chunked_put_t *put, int abort,
+                                int64_t deadline)
+{
+    int ret = 0;
+    struct timespec ts;
+
+    if (put == NULL) {
+        return 0;
+    }
+
+    oss_media_chunked_to_timespec(deadline, &ts);
+
+    pthread_mutex_lock(&put->mutex);
+    put->closed = 1;
+    put->aborted |= abort ? 1 : 0;
+    put->deadline = deadline;
+    pthread_cond_broadcast(&put->cond);
+    while (!put->done && !put->aborted && deadline > 0) {
+        if (ETIMEDOUT == pthread_cond_timedwait(&put->cond, &put->mutex, &ts)
+            && !put->done)
+        {
+            // the response may never come, the request is ended by curl
+            put->timed_out = 1;
+            put->aborted = 1;
+        }
+    }
+    pthread_mutex_unlock(&put->mutex);
+    pthread_join(put->thread, NULL);
+
+    if (put->timed_out) {
+        ret = OSS_MEDIA_TIMEOUT;
+    } else if (put->aborted) {
+        ret = -1;
+    } else if (put->code != CURLE_OK || put->status / 100 != 2) {
+        aos_error_log("chunked put failed, status:%ld, code:%d, error:%s",
+                      put->status, put->code, put->error);
+        ret = -1;
+    }
+
+    oss_media_chunked_free(put);
+    return ret;
+}
@@ -0,0 +1,75 @@
+#ifndef OSS_MEDIA_CHUNKED_H
+#define OSS_MEDIA_CHUNKED_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "oss_media_define.h"
+
+OSS_MEDIA_CPP_START
+
+/**
+ *  this struct describes a put whose body is sent in chunked transfer
+ *  encoding while it is written. the bytes go through a bounded pipe to
+ *  a thread which runs the request, a writer waits while the pipe is full.
+ */
+typedef struct oss_media_chunked_put_s {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    CURL *curl;
+    struct curl_slist *headers;
+    uint8_t *buf;           // the pipe, in the pool of oss media
+    size_t size;
+    size_t head;            // the next byte to send
+    size_t len;             // bytes in the pipe
+    int64_t sent;           // bytes taken by the request
+    int8_t closed;          // no more bytes are written
+    int8_t aborted;         // the body is cut, the object is not stored
+    int8_t done;            // the request has ended
+    int8_t timed_out;       // a write or the close exceeded its deadline
+    int64_t deadline;       // of the close, 0 means no deadline
+    CURLcode code;
+    long status;            // http status of the response, 0 if none
+    char error[CURL_ERROR_SIZE];
+} oss_media_chunked_put_t;
+
+/**
+ *  @brief  start a chunked put of url
+ *  @param[in]  url the url of the object, signed if it needs to be
+ *  @param[in]  pipe_size the bytes which may wait to be sent
+ *  @return:
+ *      the put, NULL if the request can not be started
+ */
+oss_media_chunked_put_t *oss_media_chunked_put_open(const char *url,
+                                                    size_t pipe_size);
+
+/**
+ *  @brief  write bytes of the body, which waits while the pipe is full
+ *  @param[in]  deadline monotonic time in us, 0 means no deadline
+ *  @return:
+ *      upon successful return nbyte
+ *      OSS_MEDIA_TIMEOUT is returned if the pipe is full at the deadline,
+ *      the put is aborted then and every later write times out
+ *      otherwise -1 is returned, the request has ended
+ */
+int64_t oss_media_chunked_put_write(oss_media_chunked_put_t *put,
+                                    const void *buf, int64_t nbyte,
+                                    int64_t deadline);
+
+/**
+ *  @brief  end the body and wait for the response, the put is freed
+ *  @param[in]  abort cut the body so that the object is not stored
+ *  @param[in]  deadline monotonic time in us, 0 means no deadline
+ *  @return:
+ *      upon successful completion 0 is returned, the object is stored
+ *      OSS_MEDIA_TIMEOUT is returned if a write timed out or there is no
+ *      response at the deadline, the request is aborted then
+ *      otherwise -1 is returned
+ */
+int oss_media_chunked_put_close(oss_media_chunked_put_t *put, int abort,
+                                int64_t deadline);
+
+OSS_MEDIA_CPP_END
+
+#endif
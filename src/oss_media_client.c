@@ -1,5 +1,9 @@
 #include "oss_media_client.h"
+#include "oss_media_crc.h"
+#include "oss_media_chunked.h"
+#include "oss_media_nal.h"
 #include <unistd.h>
+#include <time.h>
 
 static int oss_media_retry_cnt = 1;
 static int oss_media_sleep_us = 5000;
@@ -10,11 +14,38 @@ extern void oss_op_debug(char *op,
                          aos_table_t *req_headers, 
                          aos_table_t *resp_headers);
 
+static int64_t oss_media_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// remaining time budget of file in us, INT64_MAX if file has no deadline
+static int64_t oss_media_remaining_us(oss_media_file_t *file)
+{
+    if (file->deadline <= 0) {
+        return INT64_MAX;
+    }
+    return file->deadline - oss_media_now_us();
+}
+
+// sleep before the next try, return -1 if the deadline does not allow it
+static int oss_media_retry_wait(oss_media_file_t *file)
+{
+    if (oss_media_remaining_us(file) <= oss_media_sleep_us) {
+        return -1;
+    }
+    usleep(oss_media_sleep_us);
+    return 0;
+}
+
 static void oss_init_request_opts(aos_pool_t *pool, 
                                   oss_media_file_t *file, 
                                   oss_request_options_t **options) 
 {
     oss_request_options_t *opts;
+    int64_t remaining_us;
 
     opts = oss_request_options_create(pool);
     opts->config = oss_config_create(pool);
@@ -26,6 +57,22 @@ static void oss_init_request_opts(aos_pool_t *pool,
     opts->config->is_cname = file->is_cname;
     opts->ctl = aos_http_controller_create(pool, 0);
 
+    // limit connect and stalled transfer to the remaining time budget
+    remaining_us = oss_media_remaining_us(file);
+    if (remaining_us != INT64_MAX) {
+        int remaining_sec = remaining_us <= 1000000 ? 1 
+                            : (int)((remaining_us + 999999) / 1000000);
+        aos_http_request_options_t *ctl_opts = 
+            aos_http_request_options_create(pool);
+        if (ctl_opts->connect_timeout > remaining_sec) {
+            ctl_opts->connect_timeout = remaining_sec;
+        }
+        if (ctl_opts->speed_time > remaining_sec) {
+            ctl_opts->speed_time = remaining_sec;
+        }
+        opts->ctl->options = ctl_opts;
+    }
+
     *options = opts;
 }
 
@@ -34,6 +81,15 @@ static int64_t oss_get_content_length(const char *val)
     return val ? atoll(val) : -1;
 }
 
+static int oss_get_crc64(const char *val, uint64_t *crc64)
+{
+    if (NULL == val) {
+        return 0;
+    }
+    *crc64 = strtoull(val, NULL, 10);
+    return 1;
+}
+
 static void oss_auth(oss_media_file_t *file, 
                      int force) 
 {
@@ -59,6 +115,11 @@ static int is_readable(oss_media_file_t *file) {
     return (NULL != file->mode && 0 == strcmp("r", file->mode));
 }
 
+// only a file opened by 'c' has a put, others may be made by hand
+static int is_chunked(oss_media_file_t *file) {
+    return (NULL != file->mode && 0 == strcmp("c", file->mode));
+}
+
 int oss_media_init(aos_log_level_e log_level) {
     aos_log_set_level(log_level);
     aos_log_set_output(NULL);
@@ -74,6 +135,38 @@ void oss_media_set_retry_config(int retry, int sleep_us) {
     oss_media_sleep_us = sleep_us;
 }
 
+void oss_media_file_set_deadline(oss_media_file_t *file, int64_t timeout_ms) {
+    file->deadline = timeout_ms > 0 ? oss_media_now_us() + timeout_ms * 1000 : 0;
+}
+
+// the put is signed in its url, so that the body can be written to curl
+static int oss_media_file_start_chunked(oss_media_file_t *file) {
+    aos_pool_t *pool = NULL;
+    oss_request_options_t *opts = NULL;
+    aos_http_request_t *req = NULL;
+    aos_string_t bucket;
+    aos_string_t key;
+    char *url;
+
+    aos_pool_create(&pool, NULL);
+    oss_init_request_opts(pool, file, &opts);
+    aos_str_set(&bucket, file->bucket_name);
+    aos_str_set(&key, file->object_key);
+    req = aos_http_request_create(pool);
+    req->method = HTTP_PUT;
+
+    url = oss_gen_signed_url(opts, &bucket, &key,
+            apr_time_now() / APR_USEC_PER_SEC + OSS_MEDIA_CHUNKED_URL_EXPIRES,
+            req);
+    if (url != NULL) {
+        file->chunked = oss_media_chunked_put_open(url,
+                OSS_MEDIA_DEFAULT_CHUNKED_PIPE);
+    }
+
+    aos_pool_destroy(pool);
+    return file->chunked != NULL ? 0 : -1;
+}
+
 oss_media_file_t* oss_media_file_open(char *bucket_name,
                                       char *object_key,
                                       char *mode,
@@ -86,7 +179,8 @@ oss_media_file_t* oss_media_file_open(char *bucket_name,
     }
 
     if (!(strcmp("r", mode) == 0 || strcmp("w", mode) == 0 
-          || strcmp("a", mode) == 0 || strcmp("aw", mode) == 0)) 
+          || strcmp("a", mode) == 0 || strcmp("aw", mode) == 0
+          || strcmp("p", mode) == 0 || strcmp("c", mode) == 0)) 
     {
         free(file);
         aos_error_log("mode[%s] is wrong\n", mode);
@@ -98,12 +192,30 @@ oss_media_file_t* oss_media_file_open(char *bucket_name,
     
     file->mode = mode;
     file->_stat.pos = 0;
+    file->read_crc64 = 0;
+    file->read_crc64_pos = 0;
+    file->deadline = 0;
+    file->chunked = NULL;
 
     file->bucket_name = bucket_name;
     file->object_key = object_key;
 
-    if (strcmp("aw", mode) == 0) {
-        if ( 0 != oss_media_file_delete(file)) {
+    if (strcmp("c", mode) == 0) {
+        if (0 != oss_media_file_start_chunked(file)) {
+            aos_error_log("put file[%s] failed.\n", file->object_key);
+            free(file);
+            return NULL;
+        }
+        file->_stat.length = 0;
+        file->_stat.type = OSS_MEDIA_FILE_UNKNOWN_TYPE;
+        file->_stat.crc64 = 0;
+        file->_stat.crc64_valid = 0;
+        return file;
+    }
+
+    // every write of 'p' replaces the object, nothing to know beforehand
+    if (strcmp("aw", mode) == 0 || strcmp("p", mode) == 0) {
+        if (strcmp("aw", mode) == 0 && 0 != oss_media_file_delete(file)) {
             aos_error_log("stat file[%s] failed.\n", file->object_key);
             free(file);
             file = NULL;
@@ -111,6 +223,8 @@ oss_media_file_t* oss_media_file_open(char *bucket_name,
         }
         file->_stat.length = 0;
         file->_stat.type = OSS_MEDIA_FILE_UNKNOWN_TYPE;
+        file->_stat.crc64 = 0;
+        file->_stat.crc64_valid = 1;
         return file;
     }
 
@@ -125,6 +239,9 @@ oss_media_file_t* oss_media_file_open(char *bucket_name,
 
 void oss_media_file_close(oss_media_file_t *file) {
     if (NULL != file) {
+        if (is_chunked(file)) {
+            oss_media_chunked_put_close(file->chunked, 1, 0);
+        }
         free(file);
         file = NULL;
     }
@@ -155,6 +272,9 @@ static int oss_media_file_stat_internal(oss_media_file_t *file, oss_media_file_s
             stat->length = oss_get_content_length(
                     apr_table_get(resp_headers, "Content-Length"));
             stat->type = (char*)apr_table_get(resp_headers, "x-oss-object-type");
+            stat->crc64_valid = oss_get_crc64(
+                    apr_table_get(resp_headers, "x-oss-hash-crc64ecma"),
+                    &stat->crc64);
         }
         aos_pool_destroy(pool);
         return 0;
@@ -162,6 +282,8 @@ static int oss_media_file_stat_internal(oss_media_file_t *file, oss_media_file_s
         if (stat) {
             stat->length = 0;
             stat->type = OSS_MEDIA_FILE_UNKNOWN_TYPE;
+            stat->crc64 = 0;
+            stat->crc64_valid = 1;
         }
         aos_pool_destroy(pool);
         return 0;
@@ -179,14 +301,28 @@ int oss_media_file_stat(oss_media_file_t *file, oss_media_file_stat_t *stat) {
     int try_cnt = 1;
     int ret = 0;
     do {
+        if (oss_media_remaining_us(file) <= 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
+
         if ((ret = oss_media_file_stat_internal(file, stat, try_cnt)) != -1)
             break;
         
         if (++try_cnt > oss_media_retry_cnt)
             break;
-        usleep(oss_media_sleep_us);
+
+        if (oss_media_retry_wait(file) != 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
     } while (try_cnt < MAX_RETRY_CNT);
 
+    if (ret == OSS_MEDIA_TIMEOUT || (ret == -1 && oss_media_remaining_us(file) <= 0)) {
+        aos_error_log("stat object[%s] timeout.", file->object_key);
+        ret = OSS_MEDIA_TIMEOUT;
+    }
+
     return ret;
 }
 
@@ -225,14 +361,28 @@ int oss_media_file_delete(oss_media_file_t *file) {
     int try_cnt = 1;
     int ret = 0;
     do {
+        if (oss_media_remaining_us(file) <= 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
+
         if ((ret = oss_media_file_delete_internal(file, try_cnt)) != -1)
             break;
         
         if (++try_cnt > oss_media_retry_cnt)
             break;
-        usleep(oss_media_sleep_us);
+
+        if (oss_media_retry_wait(file) != 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
     } while (try_cnt < MAX_RETRY_CNT);
 
+    if (ret == OSS_MEDIA_TIMEOUT || (ret == -1 && oss_media_remaining_us(file) <= 0)) {
+        aos_error_log("delete object[%s] timeout.", file->object_key);
+        ret = OSS_MEDIA_TIMEOUT;
+    }
+
     return ret;
 }
 
@@ -274,6 +424,11 @@ static int64_t oss_media_file_read_internal(oss_media_file_t *file, void *buf, i
     int64_t offset = 0;
     int64_t size = 0;
     int64_t len = 0;
+    uint64_t crc64 = file->read_crc64;
+    uint64_t object_crc64 = 0;
+    int object_crc64_valid = 0;
+    // only verify when the bytes before pos have been checksumed already
+    int verify = (file->read_crc64_pos == file->_stat.pos);
     
     oss_auth(file, 0);
 
@@ -316,10 +471,37 @@ static int64_t oss_media_file_read_internal(oss_media_file_t *file, void *buf, i
     aos_list_for_each_entry(aos_buf_t, content, &buffer, node) {
         size = aos_buf_size(content);
         memcpy(buf + offset, content->pos, size);
+        if (verify) {
+            crc64 = oss_media_crc64(crc64, content->pos, size);
+        }
         offset += size;
     }
 
     len = oss_get_content_length(apr_table_get(resp_headers, "Content-Length"));
+
+    if (verify) {
+        object_crc64_valid = oss_get_crc64(
+                apr_table_get(resp_headers, "x-oss-hash-crc64ecma"), &object_crc64);
+        if (!object_crc64_valid && file->_stat.crc64_valid) {
+            object_crc64 = file->_stat.crc64;
+            object_crc64_valid = 1;
+        }
+
+        // the whole object has been read, check it against the server crc64
+        if (object_crc64_valid && file->_stat.pos + len == file->_stat.length
+            && crc64 != object_crc64)
+        {
+            aos_error_log("get object[%s] crc64 check failed. request_id:%s, "
+                          "client crc64:%" APR_UINT64_T_FMT ", "
+                          "server crc64:%" APR_UINT64_T_FMT ", try_cnt:%d",
+                          file->object_key, status->req_id, crc64,
+                          object_crc64, try_cnt);
+            aos_pool_destroy(pool);
+            return -1;
+        }
+        file->read_crc64 = crc64;
+        file->read_crc64_pos = file->_stat.pos + len;
+    }
     file->_stat.pos += len;
 
     aos_pool_destroy(pool);
@@ -335,14 +517,28 @@ int64_t oss_media_file_read(oss_media_file_t *file, void *buf, int64_t nbyte) {
     }
     
     do {
+        if (oss_media_remaining_us(file) <= 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
+
         if ((ret = oss_media_file_read_internal(file, buf, nbyte, try_cnt)) != -1)
             break;
         
         if (++try_cnt > oss_media_retry_cnt)
             break;
-        usleep(oss_media_sleep_us);
+
+        if (oss_media_retry_wait(file) != 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
     } while (try_cnt < MAX_RETRY_CNT);
 
+    if (ret == OSS_MEDIA_TIMEOUT || (ret == -1 && oss_media_remaining_us(file) <= 0)) {
+        aos_error_log("read object[%s] timeout.", file->object_key);
+        ret = OSS_MEDIA_TIMEOUT;
+    }
+
     return ret;
 }
 
@@ -356,14 +552,17 @@ int64_t oss_media_file_write_internal(oss_media_file_t *file, const void *buf, i
     aos_table_t *resp_headers = NULL;
     aos_list_t buffer;
     aos_buf_t *content = NULL;
+    uint64_t crc64 = 0;
+    uint64_t server_crc64 = 0;
 
     oss_auth(file, 0);
 
     if (!file->mode || (strcmp("w", file->mode) != 0 && 
                         strcmp("a", file->mode) != 0 &&
-                        strcmp("aw", file->mode) != 0)) 
+                        strcmp("aw", file->mode) != 0 &&
+                        strcmp("p", file->mode) != 0)) 
     {
-        aos_error_log("file mode[%s] is not [w/a]\n", file->mode);
+        aos_error_log("file mode[%s] is not [w/a/p]\n", file->mode);
         return -1;
     }
 
@@ -376,7 +575,7 @@ int64_t oss_media_file_write_internal(oss_media_file_t *file, const void *buf, i
     content = aos_buf_pack(pool, buf, nbyte);
     aos_list_add_tail(&content->node, &buffer);
 
-    if (strcmp("w", file->mode) == 0) {
+    if (strcmp("w", file->mode) == 0 || strcmp("p", file->mode) == 0) {
         status = oss_put_object_from_buffer(opts, &bucket, &key, 
                 &buffer, req_headers, &resp_headers);
         
@@ -391,7 +590,24 @@ int64_t oss_media_file_write_internal(oss_media_file_t *file, const void *buf, i
             aos_pool_destroy(pool);
             return -1;
         }
+
+        crc64 = oss_media_crc64(0, buf, nbyte);
+        if (oss_get_crc64(apr_table_get(resp_headers, "x-oss-hash-crc64ecma"),
+                          &server_crc64) && server_crc64 != crc64) 
+        {
+            aos_error_log("put object[%s] crc64 check failed. request_id:%s, "
+                          "client crc64:%" APR_UINT64_T_FMT ", "
+                          "server crc64:%" APR_UINT64_T_FMT ", try_cnt:%d",
+                          file->object_key, status->req_id, crc64,
+                          server_crc64, try_cnt);
+            aos_pool_destroy(pool);
+            return -1;
+        }
+        file->_stat.crc64 = crc64;
+        file->_stat.crc64_valid = 1;
     } else {
+        crc64 = oss_media_crc64(file->_stat.crc64, buf, nbyte);
+
         status = oss_append_object_from_buffer(opts, &bucket, &key, 
                 file->_stat.length, &buffer, req_headers, &resp_headers);
 
@@ -403,13 +619,33 @@ int64_t oss_media_file_write_internal(oss_media_file_t *file, const void *buf, i
             //if fail, always update length 
             oss_media_file_stat_t stat;
             memset(&stat, 0, sizeof(stat));
-            if (oss_media_file_stat_internal(file, &stat, 0) == 0) {
-                if (file->_stat.length + nbyte == stat.length) {
+
+            // a rejected append (e.g. PositionNotEqualToLength) reports the
+            // object state itself, only fall back to head object without it
+            stat.length = oss_get_content_length(apr_table_get(resp_headers, 
+                            "x-oss-next-append-position"));
+            if (stat.length >= 0) {
+                stat.crc64_valid = oss_get_crc64(apr_table_get(resp_headers, 
+                                "x-oss-hash-crc64ecma"), &stat.crc64);
+            }
+
+            if (stat.length >= 0 || 
+                oss_media_file_stat_internal(file, &stat, 0) == 0) 
+            {
+                // compare crc64 when both sides know it, otherwise length only
+                if (file->_stat.length + nbyte == stat.length &&
+                    (!file->_stat.crc64_valid || !stat.crc64_valid ||
+                     crc64 == stat.crc64)) 
+                {
                     ret = nbyte;
+                    stat.crc64 = crc64;
+                    stat.crc64_valid = file->_stat.crc64_valid;
                 } 
                 aos_error_log("append object failed, and reset file length. client length:%ld, server length:%ld, append size:%ld", 
                     file->_stat.length, stat.length, nbyte);
                 file->_stat.length = stat.length;
+                file->_stat.crc64 = stat.crc64;
+                file->_stat.crc64_valid = stat.crc64_valid;
             }
 
             if (ret < 0) {
@@ -429,6 +665,23 @@ int64_t oss_media_file_write_internal(oss_media_file_t *file, const void *buf, i
         }
         file->_stat.length = oss_get_content_length(apr_table_get(resp_headers, 
                         "x-oss-next-append-position"));
+
+        if (file->_stat.crc64_valid && oss_get_crc64(apr_table_get(resp_headers, 
+                        "x-oss-hash-crc64ecma"), &server_crc64) && 
+            server_crc64 != crc64) 
+        {
+            aos_error_log("append object[%s] crc64 check failed. request_id:%s, "
+                          "client crc64:%" APR_UINT64_T_FMT ", "
+                          "server crc64:%" APR_UINT64_T_FMT ", try_cnt:%d",
+                          file->object_key, status->req_id, crc64,
+                          server_crc64, try_cnt);
+            // the bytes are in the object already, a retry would append
+            // them again, so the object is left as the server reports it
+            file->_stat.crc64 = server_crc64;
+            aos_pool_destroy(pool);
+            return OSS_MEDIA_CRC64_MISMATCH;
+        }
+        file->_stat.crc64 = crc64;
     }
 
     aos_pool_destroy(pool);
@@ -438,64 +691,96 @@ int64_t oss_media_file_write_internal(oss_media_file_t *file, const void *buf, i
 int64_t oss_media_file_write(oss_media_file_t *file, const void *buf, int64_t nbyte) {
     int try_cnt = 1;
     int64_t ret = 0;
+
+    // the bytes of a chunked put are gone once written, there is no retry
+    if (is_chunked(file)) {
+        if (file->chunked == NULL) {
+            aos_error_log("put of object[%s] has ended.", file->object_key);
+            return -1;
+        }
+        ret = oss_media_chunked_put_write(file->chunked, buf, nbyte,
+                                          file->deadline);
+        if (ret == nbyte) {
+            file->_stat.length += nbyte;
+        }
+        return ret;
+    }
     
     do {
+        if (oss_media_remaining_us(file) <= 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
+
         if ((ret = oss_media_file_write_internal(file, buf, nbyte, try_cnt)) != -1)
             break;
         
         if (++try_cnt > oss_media_retry_cnt)
             break;
-        usleep(oss_media_sleep_us);
+
+        if (oss_media_retry_wait(file) != 0) {
+            ret = OSS_MEDIA_TIMEOUT;
+            break;
+        }
     } while (try_cnt < MAX_RETRY_CNT);
 
+    if (ret == OSS_MEDIA_TIMEOUT || (ret == -1 && oss_media_remaining_us(file) <= 0)) {
+        aos_error_log("write object[%s] timeout.", file->object_key);
+        ret = OSS_MEDIA_TIMEOUT;
+    }
+
+    return ret;
+}
+
+int oss_media_file_finish(oss_media_file_t *file) {
+    int ret;
+
+    if (!is_chunked(file) || file->chunked == NULL) {
+        return 0;
+    }
+
+    ret = oss_media_chunked_put_close(file->chunked, 0, file->deadline);
+    file->chunked = NULL;
+    if (ret != 0) {
+        aos_error_log("put object[%s] failed.", file->object_key);
+    }
     return ret;
 }
 
-// 00 00 00 01 65 ==> Coded slice of an IDR picture
+#define OSS_MEDIA_NAL_BATCH 64
+
+// 00 00 01 65 ==> Coded slice of an IDR picture
 int oss_media_get_h264_idr_offsets(const void *buf, 
                                    int nbyte, 
                                    int idrs[], 
                                    int nidrs, 
                                    int *size) 
 {
+    const uint8_t *start = (const uint8_t *)buf;
+    const uint8_t *next = start;
+    oss_media_nal_t nals[OSS_MEDIA_NAL_BATCH];
+    int i, n;
+
     if (size <= 0) {
         return 0;
     }
 
-    int i = 0;
-    int offset = 0;
-    int stat = 0;
     *size = 0;
-
-    while(offset < nbyte) {
-        unsigned char *pos = (unsigned char *)(buf + (offset++));
-        switch (stat) {
-            case 0:
-                stat = (*pos == 0x00) ? 1 : 0;
-                break;
-            case 1:
-                stat = (*pos == 0x00) ? 2 : 0;
-                break;
-            case 2:
-                stat = (*pos == 0x00) ? 3 : 0;
-                break;
-            case 3:
-                stat = (*pos == 0x01) ? 4 : 0;
-                break;
-            case 4:
-                if (*pos == 0x65) {
-                    idrs[i++] = offset - stat;
-                    *size = i;
-                    // max idrs
-                    if (*size >= nidrs) {
-                        return offset - stat;
-                    }
-                }
-                stat = 0;
-                break;
-            default:
-                stat = 0;
+    do {
+        n = oss_media_find_nals(next, start + nbyte, nals,
+                                OSS_MEDIA_NAL_BATCH, &next);
+        for (i = 0; i < n; i++) {
+            if (OSS_MEDIA_H264_NAL_TYPE(nals[i].head) != 5) {
+                continue;
+            }
+            // the offset of 00 00 01
+            idrs[(*size)++] = nals[i].header - 3 - start;
+            // max idrs
+            if (*size >= nidrs) {
+                return idrs[*size - 1];
+            }
         }
-    }
-    return offset - stat;
+    } while (n == OSS_MEDIA_NAL_BATCH);
+
+    return next - start;
 }
@@ -17,6 +17,8 @@ typedef struct {
     int64_t length;
     int64_t pos;
     char    *type;
+    uint64_t crc64;         // x-oss-hash-crc64ecma of the whole object
+    int8_t  crc64_valid;    // 0 if the crc64 of the object is unknown
 } oss_media_file_stat_t;
 
 /**
@@ -25,6 +27,8 @@ typedef struct {
 struct oss_media_file_s;
 typedef void (*auth_fn_t)(struct oss_media_file_s *file);
 
+struct oss_media_chunked_put_s;
+
 /**
  *  this struct describes the properties of oss media file
  */
@@ -39,6 +43,10 @@ typedef struct oss_media_file_s {
     char   *token;
     char   *mode;
     oss_media_file_stat_t _stat;
+    uint64_t read_crc64;        // crc64 of the bytes [0, read_crc64_pos) read so far
+    int64_t read_crc64_pos;
+    int64_t deadline;           // monotonic time in us, 0 means no deadline
+    struct oss_media_chunked_put_s *chunked; // 'c': the put being written
 
     time_t expiration;
     auth_fn_t auth_func;
@@ -64,6 +72,16 @@ void oss_media_destroy();
  */
 void oss_media_set_retry_config(int retry, int sleep_us);
 
+/**
+ *  @brief  set the deadline of the following operations on oss media file
+ *  @param[in]  file the oss media file
+ *  @param[in]  timeout_ms the time budget from now, the unit is ms, 0 clears the deadline.
+ *  @note   connect, transfer and retry of every operation are limited to the
+ *          remaining time budget, an operation which runs out of it returns
+ *          OSS_MEDIA_TIMEOUT instead of -1.
+ */
+void oss_media_file_set_deadline(oss_media_file_t *file, int64_t timeout_ms);
+
 /**
  *  @brief  open oss media file, this function opens the oss media file.
  *  @param[in]  bucket_name the bucket name for store file in oss
@@ -72,6 +90,11 @@ void oss_media_set_retry_config(int retry, int sleep_us);
  *      'r': file access mode of read.
  *      'w': file access mode of write.
  *      'a': file access mode of append.
+ *      'p': write by putting the object, nothing is requested at open,
+ *           every write replaces the object.
+ *      'c': write by one put in chunked transfer encoding, which starts
+ *           at open and is ended by oss_media_file_finish. writes go to
+ *           the request as they come and are not retried.
  *      notes: combined access mode is not allowd.
  *  @param[in]  auth_func the func to set access_key_id/access_key_secret
  *  @return:
@@ -84,10 +107,22 @@ oss_media_file_t* oss_media_file_open(char *bucket_name,
                                       auth_fn_t auth_func);
 
 /**
- *  @brief  close oss media file
+ *  @brief  close oss media file, the put of a 'c' file which has not been
+ *          finished is aborted and the object is not stored
  */
 void oss_media_file_close(oss_media_file_t *file);
 
+/**
+ *  @brief  end the put of a 'c' file and wait for its response, other
+ *          files have nothing to end
+ *  @return:
+ *      upon successful completion 0 is returned, the object is stored
+ *      OSS_MEDIA_TIMEOUT is returned if a write exceeded the deadline, or
+ *      the response has not come by the deadline
+ *      otherwise -1 is returned
+ */
+int oss_media_file_finish(oss_media_file_t *file);
+
 /**
  *  @bref   stat file, this function obtains information about the file.
  *  @return:
@@ -134,6 +169,8 @@ int64_t oss_media_file_read(oss_media_file_t *file, void *buf, int64_t nbyte);
  *  @brief  write to oss media file, this function write number of bytes to oss media file.
  *  @return:
  *      upon successful return the number of bytes write.
+ *      OSS_MEDIA_CRC64_MISMATCH is returned if an append was stored with
+ *      other crc64 than sent, the object is corrupt and is not retried.
  *      otherwise -1 is returned and code/message int struct of file is set to indicate the error.
  */
 int64_t oss_media_file_write(oss_media_file_t *file, const void *buf, int64_t nbyte);
@@ -0,0 +1,127 @@
+#include <pthread.h>
+#include "oss_media_crc.h"
+
+/* ECMA-182 polynomial, bit reflected, same as the one used by oss */
+#define OSS_MEDIA_CRC64_POLY 0xC96C5795D7870F42ULL
+/* MPEG-2 polynomial, not reflected */
+#define OSS_MEDIA_CRC32_POLY 0x04C11DB7
+
+static uint64_t crc64_table[8][256];
+static pthread_once_t crc64_table_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32_table[8][256];
+static pthread_once_t crc32_table_once = PTHREAD_ONCE_INIT;
+
+static void make_crc64_table(void)
+{
+    uint32_t i, k;
+    uint64_t crc;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ OSS_MEDIA_CRC64_POLY : crc >> 1;
+        }
+        crc64_table[0][i] = crc;
+    }
+
+    // slicing-by-8: table[k][i] is the crc of byte i followed by k zero bytes
+    for (i = 0; i < 256; i++) {
+        crc = crc64_table[0][i];
+        for (k = 1; k < 8; k++) {
+            crc = crc64_table[0][crc & 0xFF] ^ (crc >> 8);
+            crc64_table[k][i] = crc;
+        }
+    }
+}
+
+uint64_t oss_media_crc64(uint64_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+
+    pthread_once(&crc64_table_once, make_crc64_table);
+
+    crc = ~crc;
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc64_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8) {
+        crc ^= (uint64_t)p[0] | ((uint64_t)p[1] << 8)
+               | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+               | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40)
+               | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+        crc = crc64_table[7][crc & 0xFF]
+              ^ crc64_table[6][(crc >> 8) & 0xFF]
+              ^ crc64_table[5][(crc >> 16) & 0xFF]
+              ^ crc64_table[4][(crc >> 24) & 0xFF]
+              ^ crc64_table[3][(crc >> 32) & 0xFF]
+              ^ crc64_table[2][(crc >> 40) & 0xFF]
+              ^ crc64_table[1][(crc >> 48) & 0xFF]
+              ^ crc64_table[0][crc >> 56];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0) {
+        crc = crc64_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    return ~crc;
+}
+
+static void make_crc32_table(void)
+{
+    uint32_t i, k;
+    uint32_t crc;
+
+    for (i = 0; i < 256; i++) {
+        crc = i << 24;
+        for (k = 0; k < 8; k++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ OSS_MEDIA_CRC32_POLY : crc << 1;
+        }
+        crc32_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc = crc32_table[0][i];
+        for (k = 1; k < 8; k++) {
+            crc = crc32_table[0][crc >> 24] ^ (crc << 8);
+            crc32_table[k][i] = crc;
+        }
+    }
+}
+
+uint32_t oss_media_crc32(uint32_t crc, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint32_t next;
+
+    pthread_once(&crc32_table_once, make_crc32_table);
+
+    while (len >= 8) {
+        crc ^= ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+               | ((uint32_t)p[2] << 8) | p[3];
+        next = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16)
+               | ((uint32_t)p[6] << 8) | p[7];
+        crc = crc32_table[7][crc >> 24]
+              ^ crc32_table[6][(crc >> 16) & 0xFF]
+              ^ crc32_table[5][(crc >> 8) & 0xFF]
+              ^ crc32_table[4][crc & 0xFF]
+              ^ crc32_table[3][next >> 24]
+              ^ crc32_table[2][(next >> 16) & 0xFF]
+              ^ crc32_table[1][(next >> 8) & 0xFF]
+              ^ crc32_table[0][next & 0xFF];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0) {
+        crc = (crc << 8) ^ crc32_table[0][(crc >> 24) ^ *p++];
+        len--;
+    }
+
+    return crc;
+}
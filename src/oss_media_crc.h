@@ -0,0 +1,32 @@
+#ifndef OSS_MEDIA_CRC_H
+#define OSS_MEDIA_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "oss_media_define.h"
+
+OSS_MEDIA_CPP_START
+
+/**
+ *  @brief  update a running CRC-64/ECMA (the x-oss-hash-crc64ecma value)
+ *  @param[in]  crc the crc of the preceding data, 0 for the first block
+ *  @param[in]  buf the data to checksum
+ *  @param[in]  len the data length
+ *  @return:
+ *      the crc of the preceding data followed by buf.
+ */
+uint64_t oss_media_crc64(uint64_t crc, const void *buf, size_t len);
+
+/**
+ *  @brief  update a running CRC-32/MPEG-2 (the crc of PSI sections)
+ *  @param[in]  crc the crc of the preceding data, 0xFFFFFFFF for the first block
+ *  @param[in]  buf the data to checksum
+ *  @param[in]  len the data length
+ *  @return:
+ *      the crc of the preceding data followed by buf.
+ */
+uint32_t oss_media_crc32(uint32_t crc, const void *buf, size_t len);
+
+OSS_MEDIA_CPP_END
+
+#endif
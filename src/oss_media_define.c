@@ -9,15 +9,25 @@ char OSS_MEDIA_FILE_UNKNOWN_TYPE[] = "unknown";
 int OSS_MEDIA_FILE_NUM_PER_LIST = 1000;
 int OSS_MEDIA_INTERNAL_ERROR_CODE = 500;
 int OSS_MEDIA_OK = 200;
+int OSS_MEDIA_TIMEOUT = -2;
+int OSS_MEDIA_CRC64_MISMATCH = -3;
 int OSS_MEDIA_DEFAULT_WRITE_BUFFER = 256 * 1024; // 256K
+int OSS_MEDIA_DEFAULT_UPLOAD_BUFFERS = 2;
+int OSS_MEDIA_DEFAULT_POOL_IDLE = 16;
+int OSS_MEDIA_DEFAULT_AUDIO_PES_SIZE = 2930; // 16 ts packets with the pes header
+int OSS_MEDIA_DEFAULT_CHUNKED_PIPE = 1024 * 1024; // 1M
+int OSS_MEDIA_CHUNKED_URL_EXPIRES = 3600;
 
 int OSS_MEDIA_DEFAULT_VIDEO_PID = 256;
 int OSS_MEDIA_DEFAULT_AUDIO_PID = 257;
 
-int OSS_MEDIA_MP3_SAMPLE_RATE = 1158;
+int OSS_MEDIA_MP3_SAMPLE_RATE = 1152;
 int OSS_MEDIA_AAC_SAMPLE_RATE = 1024;
 
 int OSS_MEDIA_PAT_INTERVAL_FRAME_COUNT = 19;
 
 char OSS_MEDIA_TS_FILE_SURFIX[] = ".ts";
 char OSS_MEDIA_M3U8_FILE_SURFIX[] = ".m3u8";
+char OSS_MEDIA_KEY_FILE_SURFIX[] = ".key";
+char OSS_MEDIA_M4S_FILE_SURFIX[] = ".m4s";
+char OSS_MEDIA_INIT_FILE_NAME[] = "init.mp4";
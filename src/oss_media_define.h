@@ -18,7 +18,14 @@ extern char OSS_MEDIA_FILE_UNKNOWN_TYPE[];
 extern int OSS_MEDIA_FILE_NUM_PER_LIST;
 extern int OSS_MEDIA_INTERNAL_ERROR_CODE;
 extern int OSS_MEDIA_OK;
+extern int OSS_MEDIA_TIMEOUT;
+extern int OSS_MEDIA_CRC64_MISMATCH;
 extern int OSS_MEDIA_DEFAULT_WRITE_BUFFER;
+extern int OSS_MEDIA_DEFAULT_UPLOAD_BUFFERS;
+extern int OSS_MEDIA_DEFAULT_POOL_IDLE;
+extern int OSS_MEDIA_DEFAULT_AUDIO_PES_SIZE;
+extern int OSS_MEDIA_DEFAULT_CHUNKED_PIPE;
+extern int OSS_MEDIA_CHUNKED_URL_EXPIRES;
 
 extern int OSS_MEDIA_DEFAULT_VIDEO_PID;
 extern int OSS_MEDIA_DEFAULT_AUDIO_PID;
@@ -29,5 +36,8 @@ extern int OSS_MEDIA_PAT_INTERVAL_FRAME_COUNT;
 
 extern char OSS_MEDIA_TS_FILE_SURFIX[];
 extern char OSS_MEDIA_M3U8_FILE_SURFIX[];
+extern char OSS_MEDIA_KEY_FILE_SURFIX[];
+extern char OSS_MEDIA_M4S_FILE_SURFIX[];
+extern char OSS_MEDIA_INIT_FILE_NAME[];
     
 #endif
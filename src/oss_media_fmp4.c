@@ -0,0 +1,915 @@
+#include <string.h>
+#include <stdlib.h>
+#include "oss_media_fmp4.h"
+#include "oss_media_hls.h"
+#include "oss_media_pool.h"
+#include "oss_media_nal.h"
+
+#define OSS_MEDIA_FMP4_VIDEO 0
+#define OSS_MEDIA_FMP4_AUDIO 1
+
+/* sample flags: sync sample, and non sync sample depending on others */
+#define OSS_MEDIA_FMP4_SYNC_SAMPLE 0x02000000
+#define OSS_MEDIA_FMP4_NON_SYNC_SAMPLE 0x01010000
+
+/* durations of a last sample when its track has no previous one */
+#define OSS_MEDIA_FMP4_DEFAULT_VIDEO_DURATION 3000
+#define OSS_MEDIA_FMP4_DEFAULT_AUDIO_DURATION 1920
+
+static const uint32_t aac_sample_rates[] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000,
+    22050, 16000, 12000, 11025, 8000, 7350};
+
+static uint8_t *oss_media_fmp4_put16(uint8_t *p, uint32_t v) {
+    *p++ = v >> 8;
+    *p++ = v;
+    return p;
+}
+
+static uint8_t *oss_media_fmp4_put32(uint8_t *p, uint32_t v) {
+    *p++ = v >> 24;
+    *p++ = v >> 16;
+    *p++ = v >> 8;
+    *p++ = v;
+    return p;
+}
+
+static uint8_t *oss_media_fmp4_put64(uint8_t *p, uint64_t v) {
+    p = oss_media_fmp4_put32(p, v >> 32);
+    return oss_media_fmp4_put32(p, v);
+}
+
+// the size is set by end_box once the content is written
+static uint8_t *oss_media_fmp4_begin_box(uint8_t *p, const char *type) {
+    memcpy(p + 4, type, 4);
+    return p + 8;
+}
+
+static uint8_t *oss_media_fmp4_begin_full_box(uint8_t *p, const char *type,
+                                              uint8_t version, uint32_t flags)
+{
+    p = oss_media_fmp4_begin_box(p, type);
+    return oss_media_fmp4_put32(p, ((uint32_t)version << 24) | flags);
+}
+
+static uint8_t *oss_media_fmp4_end_box(uint8_t *box, uint8_t *p) {
+    oss_media_fmp4_put32(box, p - box);
+    return p;
+}
+
+/*
+ * a minimal bit reader for sps, emulation prevention bytes are removed
+ * before, reading past the end gives zeros.
+ */
+typedef struct oss_media_fmp4_bits_s {
+    const uint8_t *buf;
+    size_t size;
+    size_t pos;
+} oss_media_fmp4_bits_t;
+
+static uint32_t oss_media_fmp4_read_bits(oss_media_fmp4_bits_t *bits, int n) {
+    uint32_t v = 0;
+
+    while (n-- > 0) {
+        v <<= 1;
+        if (bits->pos < bits->size * 8) {
+            v |= (bits->buf[bits->pos / 8] >> (7 - bits->pos % 8)) & 1;
+        }
+        bits->pos++;
+    }
+    return v;
+}
+
+static uint32_t oss_media_fmp4_read_ue(oss_media_fmp4_bits_t *bits) {
+    int zeros = 0;
+
+    while (oss_media_fmp4_read_bits(bits, 1) == 0 && zeros < 31) {
+        zeros++;
+    }
+    return (1U << zeros) - 1 + oss_media_fmp4_read_bits(bits, zeros);
+}
+
+static int32_t oss_media_fmp4_read_se(oss_media_fmp4_bits_t *bits) {
+    uint32_t v = oss_media_fmp4_read_ue(bits);
+    return v & 1 ? (int32_t)((v + 1) / 2) : -(int32_t)(v / 2);
+}
+
+static void oss_media_fmp4_skip_scaling_list(oss_media_fmp4_bits_t *bits,
+                                             int size)
+{
+    int i;
+    int last = 8, next = 8;
+
+    for (i = 0; i < size; i++) {
+        if (next != 0) {
+            next = (last + oss_media_fmp4_read_se(bits) + 256) % 256;
+        }
+        last = next == 0 ? last : next;
+    }
+}
+
+// the picture size of the tkhd and avc1 box, ref: H.264 7.3.2.1.1
+static void oss_media_fmp4_parse_sps(oss_media_fmp4_t *fmp4) {
+    uint8_t rbsp[OSS_MEDIA_FMP4_MAX_PARAM_SET];
+    oss_media_fmp4_bits_t bits;
+    uint32_t profile, chroma_format = 1, separate_colour_plane = 0;
+    uint32_t width_mbs, height_map_units, frame_mbs_only, count;
+    uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    uint32_t crop_x, crop_y;
+    size_t i, n = 0;
+    int zeros = 0;
+
+    for (i = 1; i < fmp4->sps_size; i++) {
+        if (zeros >= 2 && fmp4->sps[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        zeros = fmp4->sps[i] == 0 ? zeros + 1 : 0;
+        rbsp[n++] = fmp4->sps[i];
+    }
+
+    bits.buf = rbsp;
+    bits.size = n;
+    bits.pos = 0;
+
+    profile = oss_media_fmp4_read_bits(&bits, 8);
+    oss_media_fmp4_read_bits(&bits, 16);            // constraints, level
+    oss_media_fmp4_read_ue(&bits);                  // sps id
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244
+        || profile == 44 || profile == 83 || profile == 86 || profile == 118
+        || profile == 128 || profile == 138 || profile == 139
+        || profile == 134 || profile == 135)
+    {
+        chroma_format = oss_media_fmp4_read_ue(&bits);
+        if (chroma_format == 3) {
+            separate_colour_plane = oss_media_fmp4_read_bits(&bits, 1);
+        }
+        oss_media_fmp4_read_ue(&bits);              // bit depth luma
+        oss_media_fmp4_read_ue(&bits);              // bit depth chroma
+        oss_media_fmp4_read_bits(&bits, 1);         // qpprime y zero
+        if (oss_media_fmp4_read_bits(&bits, 1)) {   // scaling matrix
+            for (i = 0; i < (chroma_format != 3 ? 8 : 12); i++) {
+                if (oss_media_fmp4_read_bits(&bits, 1)) {
+                    oss_media_fmp4_skip_scaling_list(&bits, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+
+    oss_media_fmp4_read_ue(&bits);                  // log2 max frame num
+    switch (oss_media_fmp4_read_ue(&bits)) {        // pic order cnt type
+        case 0:
+            oss_media_fmp4_read_ue(&bits);
+            break;
+        case 1:
+            oss_media_fmp4_read_bits(&bits, 1);
+            oss_media_fmp4_read_se(&bits);
+            oss_media_fmp4_read_se(&bits);
+            count = oss_media_fmp4_read_ue(&bits);
+            for (i = 0; i < count && i < 256; i++) {
+                oss_media_fmp4_read_se(&bits);
+            }
+            break;
+    }
+    oss_media_fmp4_read_ue(&bits);                  // max num ref frames
+    oss_media_fmp4_read_bits(&bits, 1);             // gaps allowed
+
+    width_mbs = oss_media_fmp4_read_ue(&bits) + 1;
+    height_map_units = oss_media_fmp4_read_ue(&bits) + 1;
+    frame_mbs_only = oss_media_fmp4_read_bits(&bits, 1);
+    if (!frame_mbs_only) {
+        oss_media_fmp4_read_bits(&bits, 1);         // mb adaptive
+    }
+    oss_media_fmp4_read_bits(&bits, 1);             // direct 8x8 inference
+    if (oss_media_fmp4_read_bits(&bits, 1)) {
+        crop_left = oss_media_fmp4_read_ue(&bits);
+        crop_right = oss_media_fmp4_read_ue(&bits);
+        crop_top = oss_media_fmp4_read_ue(&bits);
+        crop_bottom = oss_media_fmp4_read_ue(&bits);
+    }
+
+    if (separate_colour_plane || chroma_format == 0) {
+        crop_x = 1;
+        crop_y = 2 - frame_mbs_only;
+    } else {
+        crop_x = chroma_format == 3 ? 1 : 2;
+        crop_y = (chroma_format == 1 ? 2 : 1) * (2 - frame_mbs_only);
+    }
+
+    fmp4->width = width_mbs * 16 - crop_x * (crop_left + crop_right);
+    fmp4->height = (2 - frame_mbs_only) * height_map_units * 16
+                   - crop_y * (crop_top + crop_bottom);
+}
+
+static void oss_media_fmp4_save_param_set(oss_media_fmp4_t *fmp4,
+                                          const uint8_t *nal, size_t len)
+{
+    uint8_t type = nal[0] & 0x1F;
+
+    if (len > OSS_MEDIA_FMP4_MAX_PARAM_SET) {
+        return;
+    }
+
+    if (type == ft_sps && fmp4->sps_size == 0) {
+        memcpy(fmp4->sps, nal, len);
+        fmp4->sps_size = len;
+        oss_media_fmp4_parse_sps(fmp4);
+    } else if (type == ft_pps && fmp4->pps_size == 0) {
+        memcpy(fmp4->pps, nal, len);
+        fmp4->pps_size = len;
+    }
+}
+
+/*
+ * the annex-b frame goes straight into mdat as length prefixed nal units,
+ * this is the only copy of the frame data.
+ */
+static uint8_t *oss_media_fmp4_copy_nals(oss_media_fmp4_t *fmp4, uint8_t *out,
+                                         const uint8_t *pos, const uint8_t *end)
+{
+    const uint8_t *nal, *nal_end, *next;
+    size_t len;
+
+    nal = oss_media_find_start_code(pos, end);
+    nal = nal < end ? nal + 3 : pos;
+
+    while (nal < end) {
+        next = oss_media_find_start_code(nal, end);
+        nal_end = next;
+        while (nal_end > nal && nal_end[-1] == 0) {
+            nal_end--;
+        }
+
+        len = nal_end - nal;
+        if (len > 0) {
+            if (fmp4->sps_size == 0 || fmp4->pps_size == 0) {
+                oss_media_fmp4_save_param_set(fmp4, nal, len);
+            }
+            out = oss_media_fmp4_put32(out, len);
+            memcpy(out, nal, len);
+            out += len;
+        }
+
+        nal = next < end ? next + 3 : end;
+    }
+
+    return out;
+}
+
+static int oss_media_fmp4_parse_adts(oss_media_fmp4_t *fmp4, const uint8_t *p,
+                                     size_t len, uint32_t *header_length)
+{
+    uint32_t frame_length, profile, sample_rate, channel;
+
+    if (len < 7 || p[0] != 0xFF || (p[1] & 0xF0) != 0xF0) {
+        return -1;
+    }
+
+    frame_length = ((p[3] & 0x03) << 11) | (p[4] << 3) | (p[5] >> 5);
+    *header_length = (p[1] & 0x01) ? 7 : 9;
+    if (frame_length <= *header_length || frame_length > len) {
+        return -1;
+    }
+
+    if (fmp4->audio_config[0] == 0) {
+        profile = (p[2] >> 6) + 1;
+        sample_rate = (p[2] >> 2) & 0x0F;
+        channel = ((p[2] & 0x01) << 2) | (p[3] >> 6);
+        fmp4->audio_config[0] = (profile << 3) | (sample_rate >> 1);
+        fmp4->audio_config[1] = ((sample_rate & 0x01) << 7) | (channel << 3);
+        fmp4->sample_rate = sample_rate < sizeof(aac_sample_rates) /
+                            sizeof(aac_sample_rates[0]) ?
+                            aac_sample_rates[sample_rate] : 0;
+        fmp4->channels = channel;
+    }
+
+    return frame_length;
+}
+
+// space for a fragment starting with a sample of size bytes at most
+static int oss_media_fmp4_begin_fragment(oss_media_hls_file_t *file,
+                                         size_t size)
+{
+    oss_media_fmp4_t *fmp4 = file->fmp4;
+    oss_media_hls_buf_t *buffer = file->buffer;
+    size_t need = OSS_MEDIA_FMP4_MOOF_RESERVE + 8 + size;
+    uint8_t *buf;
+    int ret;
+
+    // data left by a failed flush goes first
+    if (buffer->end - buffer->pos < need && buffer->pos - buffer->start
+        >= OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH)
+    {
+        if ((ret = oss_media_hls_upload(file)) != 0) {
+            return ret;
+        }
+        buffer = file->buffer;
+    }
+
+    // pending data, like the tail of a cipher block, moves to the front
+    if (buffer->start > 0) {
+        memmove(buffer->buf, &buffer->buf[buffer->start],
+                buffer->pos - buffer->start);
+        file->encrypt.pos -= file->encrypt.pos >= buffer->start ?
+                             buffer->start : file->encrypt.pos;
+        buffer->pos -= buffer->start;
+        buffer->start = 0;
+    }
+
+    if (buffer->end - buffer->pos < need) {
+        buf = (uint8_t*)oss_media_pool_realloc(buffer->buf,
+                                               buffer->pos + need);
+        if (buf == NULL) {
+            aos_error_log("grow buffer to %u bytes failed.",
+                          (unsigned int)(buffer->pos + need));
+            return -1;
+        }
+        buffer->buf = buf;
+        buffer->end = buffer->pos + need;
+    }
+
+    fmp4->fragment = buffer->pos;
+    fmp4->mdat = buffer->pos + OSS_MEDIA_FMP4_MOOF_RESERVE;
+    buffer->pos = fmp4->mdat + 8;
+    return 0;
+}
+
+// the sample is made of n pieces, one after another
+static int oss_media_fmp4_add_sample(oss_media_hls_file_t *file, int track,
+                                     uint64_t dts, uint64_t pts, int key,
+                                     const oss_media_hls_payload_t pieces[],
+                                     int n)
+{
+    oss_media_fmp4_t *fmp4 = file->fmp4;
+    oss_media_fmp4_track_t *t = &fmp4->tracks[track];
+    oss_media_fmp4_sample_t *sample;
+    uint8_t *out, *sample_end;
+    size_t size = 0;
+    size_t len;
+    int ret;
+    int i;
+
+    // 3 bytes start codes grow by one byte when length prefixed
+    for (i = 0; i < n; i++) {
+        len = pieces[i].end - pieces[i].pos;
+        size += len + len / 3 + 4;
+    }
+
+    if (fmp4->sample_count == OSS_MEDIA_FMP4_MAX_SAMPLES
+        || (fmp4->sample_count > 0
+            && file->buffer->end - file->buffer->pos < size))
+    {
+        if ((ret = oss_media_hls_upload(file)) != 0) {
+            return ret;
+        }
+    }
+
+    if (fmp4->sample_count == 0) {
+        if ((ret = oss_media_fmp4_begin_fragment(file, size)) != 0) {
+            return ret;
+        }
+    }
+
+    out = &file->buffer->buf[file->buffer->pos];
+    sample_end = out;
+    for (i = 0; i < n; i++) {
+        if (track == OSS_MEDIA_FMP4_VIDEO) {
+            sample_end = oss_media_fmp4_copy_nals(fmp4, sample_end,
+                    pieces[i].pos, pieces[i].end);
+        } else {
+            len = pieces[i].end - pieces[i].pos;
+            memcpy(sample_end, pieces[i].pos, len);
+            sample_end += len;
+        }
+    }
+    file->buffer->pos += sample_end - out;
+
+    // a sample lasts until the next one of its track
+    if (t->last_sample >= 0) {
+        if (dts > t->last_dts) {
+            t->last_duration = dts - t->last_dts;
+        }
+        fmp4->samples[t->last_sample].duration = t->last_duration;
+    } else {
+        t->base_dts = dts;
+    }
+    t->seen = 1;
+    t->last_dts = dts;
+    t->last_sample = fmp4->sample_count;
+
+    sample = &fmp4->samples[fmp4->sample_count++];
+    sample->size = sample_end - out;
+    sample->duration = 0;
+    sample->cts_offset = (int32_t)(pts - dts);
+    sample->track = track;
+    sample->key = key ? 1 : 0;
+
+    return 0;
+}
+
+int oss_media_fmp4_write_frame(oss_media_hls_frame_t *frame,
+                               oss_media_hls_file_t *file)
+{
+    oss_media_fmp4_t *fmp4;
+    oss_media_hls_payload_t pieces[3];
+    oss_media_hls_payload_t sample;
+    uint32_t header_length, duration;
+    const uint8_t *pos, *next;
+    uint64_t dts;
+    int length;
+    int ret;
+    int i;
+
+    if (frame->stream_type != st_h264 && frame->stream_type != st_aac) {
+        aos_error_log("stream type[%d] is not support", frame->stream_type);
+        return -1;
+    }
+
+    if (file->options.encrypt && file->options.sample_aes) {
+        aos_error_log("SAMPLE-AES is not support by fmp4.");
+        return -1;
+    }
+
+    if (file->fmp4 == NULL) {
+        fmp4 = (oss_media_fmp4_t*)calloc(1, sizeof(oss_media_fmp4_t));
+        if (fmp4 == NULL) {
+            aos_error_log("alloc fmp4 state failed.");
+            return -1;
+        }
+        fmp4->tracks[OSS_MEDIA_FMP4_VIDEO].last_sample = -1;
+        fmp4->tracks[OSS_MEDIA_FMP4_AUDIO].last_sample = -1;
+        fmp4->sequence = 1;
+        file->fmp4 = fmp4;
+    }
+    fmp4 = file->fmp4;
+
+    pieces[0] = frame->prefix;
+    pieces[1].pos = frame->pos;
+    pieces[1].end = frame->end;
+    pieces[2] = frame->suffix;
+
+    if (frame->stream_type == st_h264) {
+        ret = oss_media_fmp4_add_sample(file, OSS_MEDIA_FMP4_VIDEO,
+                frame->dts, frame->pts, frame->key, pieces, 3);
+        if (ret == 0) {
+            frame->prefix.pos = frame->prefix.end;
+            frame->pos = frame->end;
+            frame->suffix.pos = frame->suffix.end;
+        }
+        return ret;
+    }
+
+    // every adts frame is a sample without its header, other bytes are skipped
+    dts = frame->dts;
+    for (i = 0; i < 3; i++) {
+        pos = pieces[i].pos;
+        while (pos < pieces[i].end) {
+            length = oss_media_fmp4_parse_adts(fmp4, pos, pieces[i].end - pos,
+                                               &header_length);
+            if (length < 0) {
+                next = (const uint8_t*)memchr(pos + 1, 0xFF,
+                                              pieces[i].end - pos - 1);
+                pos = next != NULL ? next : pieces[i].end;
+                continue;
+            }
+
+            sample.pos = pos + header_length;
+            sample.end = pos + length;
+            ret = oss_media_fmp4_add_sample(file, OSS_MEDIA_FMP4_AUDIO, dts,
+                                            dts, 1, &sample, 1);
+            if (ret != 0) {
+                return ret;
+            }
+
+            duration = fmp4->sample_rate > 0 ?
+                       (uint64_t)OSS_MEDIA_AAC_SAMPLE_RATE *
+                       OSS_MEDIA_FMP4_TIMESCALE / fmp4->sample_rate : 0;
+            dts += duration;
+            pos += length;
+        }
+    }
+
+    frame->prefix.pos = frame->prefix.end;
+    frame->pos = frame->end;
+    frame->suffix.pos = frame->suffix.end;
+    return 0;
+}
+
+static size_t oss_media_fmp4_trun_entry_size(int track) {
+    // duration, size, flags and cts offset for video; duration, size for audio
+    return track == OSS_MEDIA_FMP4_VIDEO ? 16 : 8;
+}
+
+static uint8_t *oss_media_fmp4_write_traf(oss_media_fmp4_t *fmp4, uint8_t *p,
+                                          int track, uint8_t *moof,
+                                          uint8_t *data)
+{
+    oss_media_fmp4_sample_t *samples = fmp4->samples;
+    uint8_t *traf, *box, *trun_count = NULL;
+    uint32_t offset = 0, count = 0;
+    int i;
+
+    traf = p;
+    p = oss_media_fmp4_begin_box(p, "traf");
+
+    // default-base-is-moof, default-sample-flags-present
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "tfhd", 0, 0x020020);
+    p = oss_media_fmp4_put32(p, track + 1);
+    p = oss_media_fmp4_put32(p, track == OSS_MEDIA_FMP4_VIDEO ?
+            OSS_MEDIA_FMP4_NON_SYNC_SAMPLE : OSS_MEDIA_FMP4_SYNC_SAMPLE);
+    p = oss_media_fmp4_end_box(box, p);
+
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "tfdt", 1, 0);
+    p = oss_media_fmp4_put64(p, fmp4->tracks[track].base_dts);
+    p = oss_media_fmp4_end_box(box, p);
+
+    // a trun for each run of samples of the track in mdat
+    box = NULL;
+    for (i = 0; i < fmp4->sample_count; i++) {
+        if (samples[i].track != track) {
+            offset += samples[i].size;
+            continue;
+        }
+
+        if (i == 0 || samples[i - 1].track != track) {
+            if (box != NULL) {
+                oss_media_fmp4_put32(trun_count, count);
+                p = oss_media_fmp4_end_box(box, p);
+            }
+            box = p;
+            if (track == OSS_MEDIA_FMP4_VIDEO) {
+                p = oss_media_fmp4_begin_full_box(p, "trun", 1, 0x000F01);
+            } else {
+                p = oss_media_fmp4_begin_full_box(p, "trun", 0, 0x000301);
+            }
+            trun_count = p;
+            p = oss_media_fmp4_put32(p, 0);
+            p = oss_media_fmp4_put32(p, data + offset - moof);
+            count = 0;
+        }
+
+        p = oss_media_fmp4_put32(p, samples[i].duration);
+        p = oss_media_fmp4_put32(p, samples[i].size);
+        if (track == OSS_MEDIA_FMP4_VIDEO) {
+            p = oss_media_fmp4_put32(p, samples[i].key ?
+                    OSS_MEDIA_FMP4_SYNC_SAMPLE : OSS_MEDIA_FMP4_NON_SYNC_SAMPLE);
+            p = oss_media_fmp4_put32(p, samples[i].cts_offset);
+        }
+        offset += samples[i].size;
+        count++;
+    }
+    oss_media_fmp4_put32(trun_count, count);
+    oss_media_fmp4_end_box(box, p);
+
+    return oss_media_fmp4_end_box(traf, p);
+}
+
+static size_t oss_media_fmp4_moof_size(const oss_media_fmp4_t *fmp4) {
+    size_t size = 8 + 16;
+    int i, track;
+
+    for (track = 0; track < 2; track++) {
+        if (fmp4->tracks[track].last_sample < 0) {
+            continue;
+        }
+        size += 48;
+        for (i = 0; i < fmp4->sample_count; i++) {
+            if (fmp4->samples[i].track != track) {
+                continue;
+            }
+            if (i == 0 || fmp4->samples[i - 1].track != track) {
+                size += 20;
+            }
+            size += oss_media_fmp4_trun_entry_size(track);
+        }
+    }
+    return size;
+}
+
+void oss_media_fmp4_end_fragment(oss_media_hls_file_t *file) {
+    oss_media_fmp4_t *fmp4 = file->fmp4;
+    oss_media_hls_buf_t *buffer = file->buffer;
+    oss_media_fmp4_track_t *t;
+    uint8_t *moof, *mdat, *p, *box;
+    unsigned int pending, start;
+    int track;
+
+    if (fmp4 == NULL || fmp4->sample_count == 0) {
+        return;
+    }
+
+    // the last sample of a track lasts as long as the one before
+    for (track = 0; track < 2; track++) {
+        t = &fmp4->tracks[track];
+        if (t->last_sample >= 0) {
+            if (t->last_duration == 0) {
+                t->last_duration = track == OSS_MEDIA_FMP4_VIDEO ?
+                                   OSS_MEDIA_FMP4_DEFAULT_VIDEO_DURATION :
+                                   OSS_MEDIA_FMP4_DEFAULT_AUDIO_DURATION;
+            }
+            fmp4->samples[t->last_sample].duration = t->last_duration;
+        }
+    }
+
+    // moof ends right where mdat begins
+    mdat = &buffer->buf[fmp4->mdat];
+    moof = mdat - oss_media_fmp4_moof_size(fmp4);
+
+    p = oss_media_fmp4_begin_box(moof, "moof");
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "mfhd", 0, 0);
+    p = oss_media_fmp4_put32(p, fmp4->sequence++);
+    p = oss_media_fmp4_end_box(box, p);
+    for (track = 0; track < 2; track++) {
+        if (fmp4->tracks[track].last_sample >= 0) {
+            p = oss_media_fmp4_write_traf(fmp4, p, track, moof, mdat + 8);
+            fmp4->tracks[track].last_sample = -1;
+        }
+    }
+    oss_media_fmp4_end_box(moof, p);
+
+    oss_media_fmp4_put32(mdat, &buffer->buf[buffer->pos] - mdat);
+    memcpy(mdat + 4, "mdat", 4);
+
+    // data before the fragment, if any, closes the gap to moof
+    pending = fmp4->fragment - buffer->start;
+    start = moof - buffer->buf - pending;
+    memmove(&buffer->buf[start], &buffer->buf[buffer->start], pending);
+    if (file->encrypt.pos >= buffer->start) {
+        file->encrypt.pos += start - buffer->start;
+    }
+    buffer->start = start;
+
+    fmp4->sample_count = 0;
+}
+
+static uint8_t *oss_media_fmp4_write_matrix(uint8_t *p) {
+    static const uint32_t matrix[] = {0x00010000, 0, 0, 0, 0x00010000, 0,
+                                      0, 0, 0x40000000};
+    int i;
+
+    for (i = 0; i < 9; i++) {
+        p = oss_media_fmp4_put32(p, matrix[i]);
+    }
+    return p;
+}
+
+static uint8_t *oss_media_fmp4_write_avc1(const oss_media_fmp4_t *fmp4,
+                                          uint8_t *p)
+{
+    uint8_t *avc1, *box;
+
+    avc1 = p;
+    p = oss_media_fmp4_begin_box(p, "avc1");
+    memset(p, 0, 6);
+    p = oss_media_fmp4_put16(p + 6, 1);             // data reference index
+    memset(p, 0, 16);
+    p = oss_media_fmp4_put16(p + 16, fmp4->width);
+    p = oss_media_fmp4_put16(p, fmp4->height);
+    p = oss_media_fmp4_put32(p, 0x00480000);        // 72 dpi
+    p = oss_media_fmp4_put32(p, 0x00480000);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put16(p, 1);                 // frame count
+    memset(p, 0, 32);                               // compressor name
+    p = oss_media_fmp4_put16(p + 32, 0x0018);       // depth
+    p = oss_media_fmp4_put16(p, 0xFFFF);
+
+    box = p;
+    p = oss_media_fmp4_begin_box(p, "avcC");
+    *p++ = 1;                                       // version
+    *p++ = fmp4->sps[1];                            // profile
+    *p++ = fmp4->sps[2];                            // compatibility
+    *p++ = fmp4->sps[3];                            // level
+    *p++ = 0xFF;                                    // 4 bytes nal length
+    *p++ = 0xE1;                                    // one sps
+    p = oss_media_fmp4_put16(p, fmp4->sps_size);
+    memcpy(p, fmp4->sps, fmp4->sps_size);
+    p += fmp4->sps_size;
+    *p++ = 1;                                       // one pps
+    p = oss_media_fmp4_put16(p, fmp4->pps_size);
+    memcpy(p, fmp4->pps, fmp4->pps_size);
+    p += fmp4->pps_size;
+    p = oss_media_fmp4_end_box(box, p);
+
+    return oss_media_fmp4_end_box(avc1, p);
+}
+
+static uint8_t *oss_media_fmp4_write_mp4a(const oss_media_fmp4_t *fmp4,
+                                          uint8_t *p)
+{
+    uint8_t *mp4a, *box;
+
+    mp4a = p;
+    p = oss_media_fmp4_begin_box(p, "mp4a");
+    memset(p, 0, 6);
+    p = oss_media_fmp4_put16(p + 6, 1);             // data reference index
+    memset(p, 0, 8);
+    p = oss_media_fmp4_put16(p + 8, fmp4->channels ? fmp4->channels : 2);
+    p = oss_media_fmp4_put16(p, 16);                // sample size
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put32(p, fmp4->sample_rate <= 0xFFFF ?
+                                fmp4->sample_rate << 16 : 0);
+
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "esds", 0, 0);
+    *p++ = 0x03;                                    // ES_Descriptor
+    *p++ = 25;
+    p = oss_media_fmp4_put16(p, OSS_MEDIA_FMP4_AUDIO_TRACK);
+    *p++ = 0;
+    *p++ = 0x04;                                    // DecoderConfigDescriptor
+    *p++ = 17;
+    *p++ = 0x40;                                    // mpeg-4 audio
+    *p++ = 0x15;                                    // audio stream
+    *p++ = 0;                                       // buffer size
+    p = oss_media_fmp4_put16(p, 0);
+    p = oss_media_fmp4_put32(p, 0);                 // max bitrate
+    p = oss_media_fmp4_put32(p, 0);                 // avg bitrate
+    *p++ = 0x05;                                    // DecoderSpecificInfo
+    *p++ = 2;
+    *p++ = fmp4->audio_config[0];
+    *p++ = fmp4->audio_config[1];
+    *p++ = 0x06;                                    // SLConfigDescriptor
+    *p++ = 1;
+    *p++ = 0x02;
+    p = oss_media_fmp4_end_box(box, p);
+
+    return oss_media_fmp4_end_box(mp4a, p);
+}
+
+static uint8_t *oss_media_fmp4_write_trak(const oss_media_fmp4_t *fmp4,
+                                          uint8_t *p, int track)
+{
+    int video = track == OSS_MEDIA_FMP4_VIDEO;
+    uint8_t *trak, *mdia, *minf, *dinf, *stbl, *box;
+
+    trak = p;
+    p = oss_media_fmp4_begin_box(p, "trak");
+
+    // enabled and in movie
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "tkhd", 0, 0x000003);
+    p = oss_media_fmp4_put32(p, 0);                 // creation time
+    p = oss_media_fmp4_put32(p, 0);                 // modification time
+    p = oss_media_fmp4_put32(p, track + 1);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put32(p, 0);                 // duration
+    memset(p, 0, 8);
+    p = oss_media_fmp4_put16(p + 8, 0);             // layer
+    p = oss_media_fmp4_put16(p, 0);                 // alternate group
+    p = oss_media_fmp4_put16(p, video ? 0 : 0x0100); // volume
+    p = oss_media_fmp4_put16(p, 0);
+    p = oss_media_fmp4_write_matrix(p);
+    p = oss_media_fmp4_put32(p, video ? (uint32_t)fmp4->width << 16 : 0);
+    p = oss_media_fmp4_put32(p, video ? (uint32_t)fmp4->height << 16 : 0);
+    p = oss_media_fmp4_end_box(box, p);
+
+    mdia = p;
+    p = oss_media_fmp4_begin_box(p, "mdia");
+
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "mdhd", 0, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put32(p, OSS_MEDIA_FMP4_TIMESCALE);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put16(p, 0x55C4);            // "und"
+    p = oss_media_fmp4_put16(p, 0);
+    p = oss_media_fmp4_end_box(box, p);
+
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "hdlr", 0, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    memcpy(p, video ? "vide" : "soun", 4);
+    memset(p + 4, 0, 12);
+    p += 16;
+    strcpy((char*)p, video ? "VideoHandler" : "SoundHandler");
+    p += strlen("VideoHandler") + 1;
+    p = oss_media_fmp4_end_box(box, p);
+
+    minf = p;
+    p = oss_media_fmp4_begin_box(p, "minf");
+    box = p;
+    if (video) {
+        p = oss_media_fmp4_begin_full_box(p, "vmhd", 0, 1);
+        memset(p, 0, 8);
+        p += 8;
+    } else {
+        p = oss_media_fmp4_begin_full_box(p, "smhd", 0, 0);
+        p = oss_media_fmp4_put32(p, 0);
+    }
+    p = oss_media_fmp4_end_box(box, p);
+
+    dinf = p;
+    p = oss_media_fmp4_begin_box(p, "dinf");
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "dref", 0, 0);
+    p = oss_media_fmp4_put32(p, 1);
+    p = oss_media_fmp4_put32(p, 12);                // self contained url
+    memcpy(p, "url ", 4);
+    p = oss_media_fmp4_put32(p + 4, 1);
+    p = oss_media_fmp4_end_box(box, p);
+    p = oss_media_fmp4_end_box(dinf, p);
+
+    // samples are all in fragments, the tables are empty
+    stbl = p;
+    p = oss_media_fmp4_begin_box(p, "stbl");
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "stsd", 0, 0);
+    p = oss_media_fmp4_put32(p, 1);
+    if (video) {
+        p = oss_media_fmp4_write_avc1(fmp4, p);
+    } else {
+        p = oss_media_fmp4_write_mp4a(fmp4, p);
+    }
+    p = oss_media_fmp4_end_box(box, p);
+
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "stts", 0, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_end_box(box, p);
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "stsc", 0, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_end_box(box, p);
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "stsz", 0, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_end_box(box, p);
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "stco", 0, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_end_box(box, p);
+    p = oss_media_fmp4_end_box(stbl, p);
+
+    p = oss_media_fmp4_end_box(minf, p);
+    p = oss_media_fmp4_end_box(mdia, p);
+    return oss_media_fmp4_end_box(trak, p);
+}
+
+int oss_media_fmp4_make_init(const oss_media_fmp4_t *fmp4, uint8_t *buf) {
+    uint8_t *p = buf;
+    uint8_t *moov, *mvex, *box;
+    int tracks[2];
+    int i, count = 0;
+
+    if (fmp4 == NULL) {
+        return -1;
+    }
+    if (fmp4->sps_size > 0 && fmp4->pps_size > 0) {
+        tracks[count++] = OSS_MEDIA_FMP4_VIDEO;
+    }
+    if (fmp4->audio_config[0] != 0) {
+        tracks[count++] = OSS_MEDIA_FMP4_AUDIO;
+    }
+    if (count == 0) {
+        return -1;
+    }
+
+    box = p;
+    p = oss_media_fmp4_begin_box(p, "ftyp");
+    memcpy(p, "iso6", 4);
+    p = oss_media_fmp4_put32(p + 4, 0);
+    memcpy(p, "iso6mp41", 8);
+    p = oss_media_fmp4_end_box(box, p + 8);
+
+    moov = p;
+    p = oss_media_fmp4_begin_box(p, "moov");
+
+    box = p;
+    p = oss_media_fmp4_begin_full_box(p, "mvhd", 0, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put32(p, 0);
+    p = oss_media_fmp4_put32(p, 1000);              // timescale
+    p = oss_media_fmp4_put32(p, 0);                 // duration
+    p = oss_media_fmp4_put32(p, 0x00010000);        // rate
+    p = oss_media_fmp4_put16(p, 0x0100);            // volume
+    memset(p, 0, 10);
+    p = oss_media_fmp4_write_matrix(p + 10);
+    memset(p, 0, 24);
+    p = oss_media_fmp4_put32(p + 24, OSS_MEDIA_FMP4_AUDIO_TRACK + 1);
+    p = oss_media_fmp4_end_box(box, p);
+
+    for (i = 0; i < count; i++) {
+        p = oss_media_fmp4_write_trak(fmp4, p, tracks[i]);
+    }
+
+    mvex = p;
+    p = oss_media_fmp4_begin_box(p, "mvex");
+    for (i = 0; i < count; i++) {
+        box = p;
+        p = oss_media_fmp4_begin_full_box(p, "trex", 0, 0);
+        p = oss_media_fmp4_put32(p, tracks[i] + 1);
+        p = oss_media_fmp4_put32(p, 1);             // sample description
+        p = oss_media_fmp4_put32(p, 0);
+        p = oss_media_fmp4_put32(p, 0);
+        p = oss_media_fmp4_put32(p, 0);
+        p = oss_media_fmp4_end_box(box, p);
+    }
+    p = oss_media_fmp4_end_box(mvex, p);
+
+    p = oss_media_fmp4_end_box(moov, p);
+    return p - buf;
+}
@@ -0,0 +1,99 @@
+#ifndef OSS_MEDIA_FMP4_H
+#define OSS_MEDIA_FMP4_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "oss_media_define.h"
+
+OSS_MEDIA_CPP_START
+
+/* tracks of fMP4 segments, both in the 90kHz clock of pts */
+#define OSS_MEDIA_FMP4_VIDEO_TRACK 1
+#define OSS_MEDIA_FMP4_AUDIO_TRACK 2
+#define OSS_MEDIA_FMP4_TIMESCALE 90000
+
+/* samples of one fragment, the fragment is ended when it is full */
+#define OSS_MEDIA_FMP4_MAX_SAMPLES 256
+/* the largest sps/pps kept for the init segment */
+#define OSS_MEDIA_FMP4_MAX_PARAM_SET 256
+/* space for moof in front of mdat: every sample in its own trun at most */
+#define OSS_MEDIA_FMP4_MOOF_RESERVE (24 + 2 * 48 + OSS_MEDIA_FMP4_MAX_SAMPLES * 36)
+/* the largest init segment */
+#define OSS_MEDIA_FMP4_MAX_INIT_SIZE (1024 + 2 * OSS_MEDIA_FMP4_MAX_PARAM_SET)
+
+/**
+ *  this struct describes a sample of the fragment being written.
+ */
+typedef struct oss_media_fmp4_sample_s {
+    uint32_t size;
+    uint32_t duration;      // 0 until the next sample of the track
+    int32_t cts_offset;     // pts - dts
+    uint8_t track;          // 0 video, 1 audio
+    uint8_t key:1;
+} oss_media_fmp4_sample_t;
+
+/**
+ *  this struct describes the timing of a track.
+ */
+typedef struct oss_media_fmp4_track_s {
+    uint8_t seen:1;
+    uint64_t base_dts;      // dts of the first sample in the fragment
+    uint64_t last_dts;
+    uint32_t last_duration;
+    int32_t last_sample;    // the previous sample in the fragment, -1 if none
+} oss_media_fmp4_track_t;
+
+/**
+ *  this struct describes the fMP4 state of a hls file, the codec
+ *  configuration comes from the first sps/pps and adts header.
+ */
+typedef struct oss_media_fmp4_s {
+    oss_media_fmp4_track_t tracks[2];
+    uint8_t sps[OSS_MEDIA_FMP4_MAX_PARAM_SET];
+    uint16_t sps_size;
+    uint8_t pps[OSS_MEDIA_FMP4_MAX_PARAM_SET];
+    uint16_t pps_size;
+    uint16_t width;
+    uint16_t height;
+    uint8_t audio_config[2];    // AudioSpecificConfig
+    uint32_t sample_rate;
+    uint8_t channels;
+    oss_media_fmp4_sample_t samples[OSS_MEDIA_FMP4_MAX_SAMPLES];
+    int sample_count;
+    unsigned int fragment;      // buffer position where the fragment starts
+    unsigned int mdat;          // buffer position of the mdat header
+    uint32_t sequence;
+} oss_media_fmp4_t;
+
+struct oss_media_hls_file_s;
+struct oss_media_hls_frame_s;
+
+/**
+ *  @brief  add a frame to the fragment being written, annex-b nal units
+ *          are stored length prefixed and adts headers are dropped
+ *  @return:
+ *      upon successful completion 0 is returned
+ *      OSS_MEDIA_TIMEOUT is returned if flushing data exceeds write_timeout_ms
+ *      otherwise -1 is returned
+ */
+int oss_media_fmp4_write_frame(struct oss_media_hls_frame_s *frame,
+                               struct oss_media_hls_file_s *file);
+
+/**
+ *  @brief  write the moof and mdat header of the fragment being written,
+ *          the fragment is ready for the handler afterwards
+ */
+void oss_media_fmp4_end_fragment(struct oss_media_hls_file_s *file);
+
+/**
+ *  @brief  make the init segment of the tracks seen so far
+ *  @param[in]  fmp4 the state of a hls file which has written frames
+ *  @param[out] buf the init segment, OSS_MEDIA_FMP4_MAX_INIT_SIZE bytes
+ *  @return:
+ *      the length of the init segment, -1 if no track has been seen
+ */
+int oss_media_fmp4_make_init(const oss_media_fmp4_t *fmp4, uint8_t *buf);
+
+OSS_MEDIA_CPP_END
+
+#endif
@@ -3,6 +3,10 @@
 #include <stdio.h>
 #include "oss_media_hls.h"
 #include "oss_media_client.h"
+#include "oss_media_crc.h"
+#include "oss_media_fmp4.h"
+#include "oss_media_pool.h"
+#include "oss_media_nal.h"
 
 /* delay: 700ms */
 #define OSS_MEDIA_HLS_HLS_DELAY (700 * 90)
@@ -11,32 +15,15 @@
 #define OSS_MEDIA_PAT_PID 0
 #define OSS_MEDIA_PMT_PID 4097
 
-static uint32_t crc_table[256];
-
-static void make_crc_table(void)
-{
-    uint32_t i;
-    for(i = 0; i < 256; i++ ) {
-        uint32_t crc = 0;
-        uint32_t j;
-        for(j = (i << 24) | 0x800000; j != 0x80000000; j <<= 1 ) {
-            crc = (crc << 1) ^ (((crc ^ j) & 0x80000000) ? 0x04c11db7 : 0);
-        }
-
-        crc_table[i] = crc;
-    }    
-}
+/* SAMPLE-AES: a slice keeps 32 bytes clear, then 1 of every 10 blocks is
+   encrypted, slices not longer than 48 bytes stay clear */
+#define OSS_MEDIA_SAMPLE_AES_NAL_LEADER 32
+#define OSS_MEDIA_SAMPLE_AES_NAL_SKIP 144
+/* SAMPLE-AES: the adts header and 16 bytes stay clear */
+#define OSS_MEDIA_SAMPLE_AES_ADTS_LEADER 16
 
 static uint32_t calculate_crc32(uint8_t *data, int32_t length) {
-    static int table_made = 0;
-    if (!table_made) make_crc_table();
-
-    uint32_t i;
-    uint32_t crc32 = 0xFFFFFFFF;
-    for (i = 0; i < length; i++) {
-        crc32 = (crc32 << 8 ) ^ crc_table[((crc32 >> 24) ^ *data++) & 0xFF];
-    }
-    return crc32;
+    return oss_media_crc32(0xFFFFFFFF, data, length);
 }
 
 static uint8_t *oss_media_hls_write_pcr(uint8_t *p, uint64_t pcr) {
@@ -67,9 +54,6 @@ static uint8_t *oss_media_hls_write_pts(uint8_t *p, uint32_t fb, uint64_t pts) {
     return p;
 }
 
-static void oss_media_hls_encrypt_packet(oss_media_hls_file_t *file, uint8_t *packet) {
-}
-
 static uint8_t *oss_media_hls_write_hls_header(uint8_t *p, int16_t pid)
 {
     uint8_t sync_byte = 0x47;
@@ -103,25 +87,134 @@ static uint8_t* oss_media_hls_set_crc32(uint8_t *start, uint8_t *p) {
     return p;
 }
 
+static void oss_media_hls_start_encrypt(oss_media_hls_file_t *file) {
+    if (!file->encrypt.started) {
+        oss_media_aes_init(&file->encrypt.aes, file->options.key,
+                           file->options.iv);
+        file->encrypt.pos = file->buffer->start;
+        file->encrypt.started = 1;
+    }
+}
+
+static int oss_media_hls_ossfile_handler(oss_media_hls_file_t *file);
+static int oss_media_hls_start_uploader(oss_media_hls_file_t *file);
+static int oss_media_hls_upload_async(oss_media_hls_file_t *file,
+                                      unsigned int end);
+
+/*
+ * [start, pos) of the buffer goes to the handler, [pos, end) is kept after
+ * the data which the handler leaves. custom handlers are always called in
+ * place, nothing is known about their thread safety.
+ */
+static int oss_media_hls_hand_over(oss_media_hls_file_t *file,
+                                   unsigned int end, int async)
+{
+    oss_media_hls_buf_t *buffer = file->buffer;
+    unsigned int pos = buffer->pos;
+    int ret;
+
+    if (async && file->options.upload_buffers > 1
+        && file->options.handler_func == oss_media_hls_ossfile_handler
+        && (file->uploader != NULL || 0 == oss_media_hls_start_uploader(file)))
+    {
+        return oss_media_hls_upload_async(file, end);
+    }
+
+    ret = file->options.handler_func(file);
+    memmove(&buffer->buf[buffer->pos], &buffer->buf[pos], end - pos);
+    buffer->pos += end - pos;
+    return ret;
+}
+
+/*
+ * the handler of an encrypted file only gets whole cipher blocks, the tail
+ * of a partial block stays in the buffer until more data or the padding.
+ * SAMPLE-AES files are encrypted per frame and go to the handler as is.
+ */
+static int oss_media_hls_call_handler(oss_media_hls_file_t *file, int async) {
+    oss_media_hls_buf_t *buffer = file->buffer;
+    unsigned int end, tail;
+    int ret;
+
+    if (!file->options.encrypt || file->options.sample_aes) {
+        return oss_media_hls_hand_over(file, buffer->pos, async);
+    }
+
+    oss_media_hls_start_encrypt(file);
+
+    end = buffer->pos;
+    tail = (end - file->encrypt.pos) % OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH;
+    oss_media_aes_cbc_encrypt(&file->encrypt.aes, 
+                              &buffer->buf[file->encrypt.pos],
+                              end - tail - file->encrypt.pos);
+
+    buffer->pos = end - tail;
+    ret = oss_media_hls_hand_over(file, end, async);
+
+    // data before pos is encrypted, whether the handler consumed it or not
+    file->encrypt.pos = file->buffer->pos - tail;
+
+    return ret;
+}
+
+/*
+ * playlists of many segments and parts may outgrow the m3u8 buffer, a
+ * single put file grows until it is complete.
+ */
+static int oss_media_hls_reserve(oss_media_hls_file_t *file,
+                                 unsigned int len)
+{
+    oss_media_hls_buf_t *buffer = file->buffer;
+    unsigned int size;
+    uint8_t *buf;
+
+    if (buffer->end - buffer->pos < len) {
+        size = buffer->end * 2 > buffer->pos + len ? 
+               buffer->end * 2 : buffer->pos + len;
+        buf = (uint8_t*)oss_media_pool_realloc(buffer->buf, size);
+        if (buf == NULL) {
+            aos_error_log("grow buffer of file[%s] to %u bytes failed.",
+                          file->file->object_key, size);
+            return -1;
+        }
+        buffer->buf = buf;
+        buffer->end = size;
+    }
+    return 0;
+}
+
+/*
+ * a timeout within a frame does not cut it, the buffer grows and keeps the
+ * data for the next flush, the timeout is told once the frame is written.
+ */
 static int oss_media_handle_file(oss_media_hls_file_t *file) {
+    int ret;
+    if (file->options.single_put) {
+        return oss_media_hls_reserve(file, OSS_MEDIA_HLS_PACKET_SIZE);
+    }
     if (file->buffer->end - file->buffer->pos < OSS_MEDIA_HLS_PACKET_SIZE) {
-        if (file->options.handler_func(file) != 0) {
+        if ((ret = oss_media_hls_call_handler(file, 1)) != 0) {
             aos_error_log("execute handler func failed.");
-            return -1;
+            if (ret != OSS_MEDIA_TIMEOUT) {
+                return -1;
+            }
+            file->timed_out = 1;
+            return oss_media_hls_reserve(file, OSS_MEDIA_HLS_PACKET_SIZE);
         }
     }
     return 0;
 }
 
-static int oss_media_hls_write_pat(oss_media_hls_file_t *file) {
-    // write data to oss when buffer is full
-    if (0 != oss_media_handle_file(file)) {
-        aos_error_log("execute handler func failed.");
-        return -1;
+// the timeout within the frames just written, if any, is told now
+static int oss_media_hls_take_timeout(oss_media_hls_file_t *file, int ret) {
+    if (ret == 0 && file->timed_out) {
+        ret = OSS_MEDIA_TIMEOUT;
     }
+    file->timed_out = 0;
+    return ret;
+}
 
-    // init pos parameter
-    uint8_t *start = file->buffer->buf + file->buffer->pos;
+static void oss_media_hls_make_pat(uint8_t *start) {
     uint8_t *p = start;
 
     // HLS header
@@ -164,21 +257,25 @@ static int oss_media_hls_write_pat(oss_media_hls_file_t *file) {
     while (p - start < OSS_MEDIA_HLS_PACKET_SIZE) {
         *p++ = 0xff;
     }
-    file->buffer->pos += OSS_MEDIA_HLS_PACKET_SIZE;
-    
-    return 0;
 }
 
-static int oss_media_hls_write_pmt(oss_media_hls_file_t *file) {
-    // write data to oss when buffer is full
-    if (0 != oss_media_handle_file(file)) {
-        aos_error_log("execute handler func failed.");
-        return -1;
-    }
+// private_data_indicator_descriptor of SAMPLE-AES elementary streams
+static uint8_t *oss_media_hls_write_private_data_indicator(uint8_t *p,
+                                                           const char *id)
+{
+    *p++ = 0x0f;                        // tag
+    *p++ = 4;                           // length
+    memcpy(p, id, 4);
+    return p + 4;
+}
 
-    // init pos parameter
-    uint8_t *start = file->buffer->buf + file->buffer->pos;
+static void oss_media_hls_make_pmt(uint8_t *start,
+                                   const oss_media_hls_options_t *options,
+                                   const uint8_t *audio_config)
+{
     uint8_t *p = start;
+    uint8_t *section, *es_info;
+    int sample_aes = options->encrypt && options->sample_aes;
 
     // HLS header
     p = oss_media_hls_write_hls_header(p, OSS_MEDIA_PMT_PID);
@@ -188,7 +285,7 @@ static int oss_media_hls_write_pmt(oss_media_hls_file_t *file) {
     uint8_t section_syntax_indicator = 1;
     uint8_t zero = 0;
     uint8_t reserved_1 = 3;
-    uint16_t section_length = 23;
+    uint16_t section_length = 0;
     uint16_t program_number = 1;
     uint8_t reserved_2 = 3;
     uint8_t version_number = 0;
@@ -196,11 +293,13 @@ static int oss_media_hls_write_pmt(oss_media_hls_file_t *file) {
     uint8_t section_number = 0;
     uint8_t last_section_number = 0;
     uint8_t reserved_3 = 7;
-    uint16_t pcr_pid = file->options.video_pid;
+    uint16_t pcr_pid = options->audio_only ? 
+                       options->audio_pid : options->video_pid;
     uint8_t reserved_4 = 15;
     uint16_t program_info_length = 0;
 
     *p++ = table_id;
+    section = p;
     *p++ = (section_syntax_indicator << 7) | (zero << 6) | (reserved_1 << 4)
            | ((section_length >> 8) & 0x0F);
     *p++ = section_length & 0xFF;
@@ -216,34 +315,76 @@ static int oss_media_hls_write_pmt(oss_media_hls_file_t *file) {
     *p++ = program_info_length & 0xFF;
 
     // set video stream info
-    {
-        uint8_t stream_type = 0x1b;
+    if (!options->audio_only) {
+        uint8_t stream_type = options->video_type == st_h265 ? 0x24 :
+                              sample_aes ? 0xdb : 0x1b;
         uint8_t reserved_5 = 7;
-        uint16_t elementary_pid = file->options.video_pid;
+        uint16_t elementary_pid = options->video_pid;
         uint8_t reserved_6 = 15;
-        uint16_t ES_info_length = 0;
+        uint16_t ES_info_length;
 
         *p++ = stream_type;
         *p++ = (reserved_5 << 5) | ((elementary_pid >> 8) & 0x1F);
         *p++ = elementary_pid & 0xFF;
-        *p++ = (reserved_6 << 4) | ((ES_info_length >> 4) & 0x0F);
-        *p++ = ES_info_length & 0xFF;
+        p += 2;
+        es_info = p;
+
+        if (sample_aes && options->video_type == st_h264) {
+            p = oss_media_hls_write_private_data_indicator(p, "zavc");
+        }
+
+        ES_info_length = p - es_info;
+        es_info[-2] = (reserved_6 << 4) | ((ES_info_length >> 8) & 0x0F);
+        es_info[-1] = ES_info_length & 0xFF;
     }
 
     // set audio stream info
     {
-        uint8_t stream_type = 0x0f;
+        uint8_t stream_type = options->audio_type == st_mp3 ? 0x03 :
+                              sample_aes ? 0xcf : 0x0f;
         uint8_t reserved_5 = 7;
-        uint16_t elementary_pid = file->options.audio_pid;
+        uint16_t elementary_pid = options->audio_pid;
         uint8_t reserved_6 = 15;
-        uint16_t ES_info_length = 0;
+        uint16_t ES_info_length;
 
         *p++ = stream_type;
         *p++ = (reserved_5 << 5) | ((elementary_pid >> 8) & 0x1F);
         *p++ = elementary_pid & 0xFF;
-        *p++ = (reserved_6 << 4) | ((ES_info_length >> 4) & 0x0F);
-        *p++ = ES_info_length & 0xFF;
+        p += 2;
+        es_info = p;
+
+        if (sample_aes && options->audio_type == st_aac) {
+            p = oss_media_hls_write_private_data_indicator(p, "aacd");
+        }
+
+        // registration_descriptor with the audio setup information,
+        // known once the first adts frame has been seen
+        if (sample_aes && options->audio_type == st_aac
+            && audio_config[0] != 0)
+        {
+            *p++ = 0x05;                    // tag
+            *p++ = 12 + OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE; // length
+            memcpy(p, "apad", 4);           // format identifier
+            p += 4;
+            memcpy(p, "zaac", 4);           // audio type
+            p += 4;
+            *p++ = 0;                       // priming
+            *p++ = 0;
+            *p++ = 1;                       // version
+            *p++ = OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE;
+            memcpy(p, audio_config, OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE);
+            p += OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE;
+        }
+
+        ES_info_length = p - es_info;
+        es_info[-2] = (reserved_6 << 4) | ((ES_info_length >> 8) & 0x0F);
+        es_info[-1] = ES_info_length & 0xFF;
     }
+
+    // section length counts from after itself to the end of CRC32
+    section_length = p + 4 - (section + 2);
+    section[0] |= (section_length >> 8) & 0x0F;
+    section[1] = section_length & 0xFF;
     
     // set CRC32
     p = oss_media_hls_set_crc32(start, p);
@@ -252,11 +393,80 @@ static int oss_media_hls_write_pmt(oss_media_hls_file_t *file) {
     while (p - start < OSS_MEDIA_HLS_PACKET_SIZE) {
         *p++ = 0xff;
     }
+}
+
+static int oss_media_hls_is_sample_aes(oss_media_hls_file_t *file) {
+    return file->options.encrypt && file->options.sample_aes;
+}
+
+static void oss_media_hls_build_psi(oss_media_hls_file_t *file) {
+    oss_media_hls_make_pat(file->psi.pat);
+    oss_media_hls_make_pmt(file->psi.pmt, &file->options,
+                           file->encrypt.audio_config);
+    file->psi.video_pid = file->options.video_pid;
+    file->psi.audio_pid = file->options.audio_pid;
+    file->psi.video_type = file->options.video_type;
+    file->psi.audio_type = file->options.audio_type;
+    file->psi.sample_aes = oss_media_hls_is_sample_aes(file);
+    file->psi.audio_only = file->options.audio_only;
+    memcpy(file->psi.audio_config, file->encrypt.audio_config,
+           OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE);
+}
+
+// rebuild PAT/PMT only when the options they depend on have been changed
+static void oss_media_hls_update_psi(oss_media_hls_file_t *file) {
+    if (file->psi.video_pid != file->options.video_pid
+        || file->psi.audio_pid != file->options.audio_pid
+        || file->psi.video_type != file->options.video_type
+        || file->psi.audio_type != file->options.audio_type
+        || file->psi.sample_aes != oss_media_hls_is_sample_aes(file)
+        || file->psi.audio_only != file->options.audio_only
+        || memcmp(file->psi.audio_config, file->encrypt.audio_config,
+                  OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE) != 0)
+    {
+        oss_media_hls_build_psi(file);
+    }
+}
+
+static void oss_media_hls_put_psi(oss_media_hls_file_t *file,
+                                  const uint8_t *packet,
+                                  uint8_t *continuity_counter)
+{
+    uint8_t *p = file->buffer->buf + file->buffer->pos;
+
+    memcpy(p, packet, OSS_MEDIA_HLS_PACKET_SIZE);
+    p[3] = (p[3] & 0xF0) | ((*continuity_counter)++ & 0x0F);
     file->buffer->pos += OSS_MEDIA_HLS_PACKET_SIZE;
+    file->length += OSS_MEDIA_HLS_PACKET_SIZE;
+}
+
+static int oss_media_hls_write_psi(oss_media_hls_file_t *file,
+                                   const uint8_t *packet,
+                                   uint8_t *continuity_counter)
+{
+    // write data to oss when buffer is full
+    if (0 != oss_media_handle_file(file)) {
+        aos_error_log("execute handler func failed.");
+        return -1;
+    }
+
+    oss_media_hls_put_psi(file, packet, continuity_counter);
 
     return 0;
 }
 
+static int oss_media_hls_write_pat(oss_media_hls_file_t *file) {
+    oss_media_hls_update_psi(file);
+    return oss_media_hls_write_psi(file, file->psi.pat, 
+                                   &file->psi.pat_continuity_counter);
+}
+
+static int oss_media_hls_write_pmt(oss_media_hls_file_t *file) {
+    oss_media_hls_update_psi(file);
+    return oss_media_hls_write_psi(file, file->psi.pmt, 
+                                   &file->psi.pmt_continuity_counter);
+}
+
 static int oss_media_hls_write_pat_and_pmt(oss_media_hls_file_t *file) {
     if (0 != oss_media_hls_write_pat(file)) {
         aos_error_log("write pat table failed.");
@@ -268,58 +478,345 @@ static int oss_media_hls_write_pat_and_pmt(oss_media_hls_file_t *file) {
         return -1;
     }
 
-    if (file->options.encrypt) {
-        uint8_t *pos;
-        pos = &file->buffer->buf[file->buffer->pos];
-        pos -= OSS_MEDIA_HLS_PACKET_SIZE;
-        oss_media_hls_encrypt_packet(file, pos);
-        pos -= OSS_MEDIA_HLS_PACKET_SIZE;
-        oss_media_hls_encrypt_packet(file, pos);
-    }
-
     return 0;
 }
 
-static int oss_media_hls_ossfile_handler(oss_media_hls_file_t *file) {
+// the response of a chunked put is waited for in the same time budget
+static int oss_media_hls_finish_file(oss_media_hls_file_t *file) {
+    int ret;
+
+    oss_media_file_set_deadline(file->file, file->options.write_timeout_ms);
+    ret = oss_media_file_finish(file->file);
+    oss_media_file_set_deadline(file->file, 0);
+    return ret;
+}
+
+static int64_t oss_media_hls_write_file(oss_media_hls_file_t *file,
+                                        oss_media_file_t *oss_file,
+                                        const uint8_t *data,
+                                        int64_t length)
+{
+    int64_t write_size;
+
+    oss_media_file_set_deadline(oss_file, file->options.write_timeout_ms);
+    write_size = oss_media_file_write(oss_file, data, length);
+    oss_media_file_set_deadline(oss_file, 0);
+
+    if (write_size == OSS_MEDIA_TIMEOUT) {
+        aos_error_log("write data to oss file[%s] timeout, length:%ld.",
+                      oss_file->object_key, length);
+    } else if (write_size != length) {
+        aos_error_log("write data to oss file[%s] failed.",
+                      oss_file->object_key);
+    }
+    return write_size;
+}
+
+/*
+ * a partial segment gets the same data as its segment, so one decision
+ * holds for both. data is only dropped on a timeout before any of them
+ * has it, the part only gets the bytes it does not have yet. the state is
+ * in the buffer, which the upload thread owns while it is queued.
+ */
+static int oss_media_hls_write_buffer(oss_media_hls_file_t *file,
+                                      oss_media_hls_buf_t *buffer)
+{
     int64_t length;
     int64_t write_size;
 
-    length = file->buffer->pos - file->buffer->start;
+    length = buffer->pos - buffer->start;
     if (length <= 0) {
         return 0;
     }
 
-    write_size = oss_media_file_write(file->file,
-            &file->buffer->buf[file->buffer->start], length);
+    if (file->part_file != NULL && buffer->part_len < length) {
+        write_size = oss_media_hls_write_file(file, file->part_file,
+                &buffer->buf[buffer->start + buffer->part_len],
+                length - buffer->part_len);
+        if (write_size == OSS_MEDIA_TIMEOUT && file->options.drop_on_timeout
+            && buffer->part_len == 0)
+        {
+            buffer->pos = buffer->start;
+            return 0;
+        }
+        if (write_size != length - buffer->part_len) {
+            return write_size == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+        }
+        buffer->part_len = length;
+    }
+
+    write_size = oss_media_hls_write_file(file, file->file,
+            &buffer->buf[buffer->start], length);
+    if (write_size == OSS_MEDIA_TIMEOUT && file->options.drop_on_timeout
+        && buffer->part_len == 0)
+    {
+        buffer->pos = buffer->start;
+        return 0;
+    }
     if (write_size != length) {
-        aos_error_log("write data to oss file[%s] failed.",
+        return write_size == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+
+    buffer->part_len = 0;
+    buffer->pos = buffer->start;
+    
+    return 0;
+}
+
+static int oss_media_hls_ossfile_handler(oss_media_hls_file_t *file) {
+    return oss_media_hls_write_buffer(file, file->buffer);
+}
+
+static void oss_media_hls_free_buffer(oss_media_hls_buf_t *buffer) {
+    if (buffer != NULL) {
+        oss_media_pool_free(buffer->buf);
+        free(buffer);
+    }
+}
+
+/*
+ * the buffer at the head of the queue is appended to oss, it is kept
+ * there after a failure until the caller has been told, then retried.
+ * file, part_file and options are read unlocked, the caller leaves them
+ * alone while buffers are queued.
+ */
+static void *oss_media_hls_upload_thread(void *arg) {
+    oss_media_hls_file_t *file = (oss_media_hls_file_t*)arg;
+    oss_media_hls_uploader_t *uploader = file->uploader;
+    oss_media_hls_buf_t *buffer;
+    int ret;
+
+    pthread_mutex_lock(&uploader->mutex);
+    while (1) {
+        while (!uploader->stop
+               && (uploader->queue_size == 0 || uploader->error != 0))
+        {
+            pthread_cond_wait(&uploader->cond, &uploader->mutex);
+        }
+        if (uploader->stop) {
+            break;
+        }
+
+        buffer = uploader->queue[0];
+        pthread_mutex_unlock(&uploader->mutex);
+        ret = oss_media_hls_write_buffer(file, buffer);
+        pthread_mutex_lock(&uploader->mutex);
+
+        if (ret == 0) {
+            uploader->queue_size--;
+            memmove(uploader->queue, uploader->queue + 1,
+                    sizeof(oss_media_hls_buf_t*) * uploader->queue_size);
+            uploader->spare[uploader->spare_size++] = buffer;
+        } else {
+            uploader->error = ret;
+        }
+        pthread_cond_broadcast(&uploader->cond);
+    }
+    pthread_mutex_unlock(&uploader->mutex);
+
+    return NULL;
+}
+
+static void oss_media_hls_stop_uploader(oss_media_hls_file_t *file) {
+    int i;
+    oss_media_hls_uploader_t *uploader = file->uploader;
+
+    if (uploader == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&uploader->mutex);
+    uploader->stop = 1;
+    pthread_cond_broadcast(&uploader->cond);
+    pthread_mutex_unlock(&uploader->mutex);
+    pthread_join(uploader->thread, NULL);
+
+    for (i = 0; i < uploader->queue_size; i++) {
+        oss_media_hls_free_buffer(uploader->queue[i]);
+    }
+    for (i = 0; i < uploader->spare_size; i++) {
+        oss_media_hls_free_buffer(uploader->spare[i]);
+    }
+    pthread_cond_destroy(&uploader->cond);
+    pthread_mutex_destroy(&uploader->mutex);
+    free(uploader);
+    file->uploader = NULL;
+}
+
+static int oss_media_hls_start_uploader(oss_media_hls_file_t *file) {
+    int i;
+    int count = file->options.upload_buffers;
+    oss_media_hls_uploader_t *uploader;
+    oss_media_hls_buf_t *buffer;
+
+    if (count > OSS_MEDIA_HLS_MAX_UPLOAD_BUFFERS) {
+        count = OSS_MEDIA_HLS_MAX_UPLOAD_BUFFERS;
+    }
+
+    uploader = (oss_media_hls_uploader_t*)calloc(1, 
+            sizeof(oss_media_hls_uploader_t));
+    if (uploader == NULL) {
+        aos_error_log("alloc uploader of oss file[%s] failed.",
                       file->file->object_key);
         return -1;
     }
 
-    file->buffer->pos = file->buffer->start;
-    
+    // the buffer of the file is one of them
+    for (i = 1; i < count; i++) {
+        buffer = (oss_media_hls_buf_t*)malloc(sizeof(oss_media_hls_buf_t));
+        if (buffer != NULL) {
+            buffer->buf = (uint8_t*)oss_media_pool_alloc(
+                    OSS_MEDIA_DEFAULT_WRITE_BUFFER);
+        }
+        if (buffer == NULL || buffer->buf == NULL) {
+            aos_error_log("alloc upload buffer of oss file[%s] failed.",
+                          file->file->object_key);
+            free(buffer);
+            break;
+        }
+        buffer->start = 0;
+        buffer->pos = 0;
+        buffer->end = OSS_MEDIA_DEFAULT_WRITE_BUFFER;
+        buffer->part_len = 0;
+        uploader->spare[uploader->spare_size++] = buffer;
+    }
+
+    pthread_mutex_init(&uploader->mutex, NULL);
+    pthread_cond_init(&uploader->cond, NULL);
+    file->uploader = uploader;
+
+    if (uploader->spare_size == 0 || 0 != pthread_create(&uploader->thread,
+                NULL, oss_media_hls_upload_thread, file))
+    {
+        aos_error_log("start uploader of oss file[%s] failed.",
+                      file->file->object_key);
+        // nothing to join, the buffers are freed as if it had stopped
+        for (i = 0; i < uploader->spare_size; i++) {
+            oss_media_hls_free_buffer(uploader->spare[i]);
+        }
+        pthread_cond_destroy(&uploader->cond);
+        pthread_mutex_destroy(&uploader->mutex);
+        free(uploader);
+        file->uploader = NULL;
+        return -1;
+    }
+
     return 0;
 }
 
-static int oss_media_hls_need_write_pat_and_pmt(oss_media_hls_file_t *file) 
+// the full buffer is queued and a spare one taken, its data follows in oss
+static int oss_media_hls_upload_async(oss_media_hls_file_t *file,
+                                      unsigned int end)
+{
+    oss_media_hls_uploader_t *uploader = file->uploader;
+    oss_media_hls_buf_t *buffer = file->buffer;
+    oss_media_hls_buf_t *spare;
+    int ret;
+
+    if (buffer->pos == buffer->start) {
+        buffer->pos = end;
+        return 0;
+    }
+
+    pthread_mutex_lock(&uploader->mutex);
+    while (uploader->spare_size == 0 && uploader->error == 0) {
+        pthread_cond_wait(&uploader->cond, &uploader->mutex);
+    }
+
+    ret = uploader->error;
+    if (ret == 0) {
+        spare = uploader->spare[--uploader->spare_size];
+        spare->start = 0;
+        spare->pos = end - buffer->pos;
+        memcpy(spare->buf, &buffer->buf[buffer->pos], spare->pos);
+        uploader->queue[uploader->queue_size++] = buffer;
+        file->buffer = spare;
+    } else {
+        // the failure is told once, the upload is tried again afterwards
+        uploader->error = 0;
+        buffer->pos = end;
+    }
+    pthread_cond_broadcast(&uploader->cond);
+    pthread_mutex_unlock(&uploader->mutex);
+
+    return ret;
+}
+
+static int oss_media_hls_wait_uploads(oss_media_hls_file_t *file) {
+    oss_media_hls_uploader_t *uploader = file->uploader;
+    int ret;
+
+    if (uploader == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&uploader->mutex);
+    while (uploader->queue_size > 0 && uploader->error == 0) {
+        pthread_cond_wait(&uploader->cond, &uploader->mutex);
+    }
+    ret = uploader->error;
+    uploader->error = 0;
+    pthread_cond_broadcast(&uploader->cond);
+    pthread_mutex_unlock(&uploader->mutex);
+
+    return ret;
+}
+
+static int oss_media_hls_is_iframe(oss_media_hls_frame_t *frame,
+                                   oss_media_hls_file_t *file)
+{
+    return file->options.record_iframes && frame->key
+           && (frame->stream_type == st_h264 || frame->stream_type == st_h265);
+}
+
+// a recorded key frame gets its own PAT/PMT, so its range can be decoded
+static int oss_media_hls_need_write_pat_and_pmt(oss_media_hls_frame_t *frame,
+                                                oss_media_hls_file_t *file) 
+{
+    return file->frame_count % file->options.pat_interval_frame_count == 0
+           || oss_media_hls_is_iframe(frame, file);
+}
+
+static int oss_media_hls_add_iframe(oss_media_hls_frame_t *frame,
+                                    uint64_t offset,
+                                    oss_media_hls_file_t *file)
 {
-    return file->frame_count % file->options.pat_interval_frame_count == 0;
+    int32_t capacity;
+    oss_media_hls_iframe_t *iframes;
+
+    if (file->iframe_count == file->iframe_capacity) {
+        capacity = file->iframe_capacity > 0 ? file->iframe_capacity * 2 : 16;
+        iframes = (oss_media_hls_iframe_t*)realloc(file->iframes,
+                sizeof(oss_media_hls_iframe_t) * capacity);
+        if (iframes == NULL) {
+            aos_error_log("alloc iframes of ts file failed.");
+            return -1;
+        }
+        file->iframes = iframes;
+        file->iframe_capacity = capacity;
+    }
+
+    iframes = &file->iframes[file->iframe_count++];
+    iframes->pts = frame->pts;
+    iframes->offset = offset;
+    iframes->length = file->length - offset;
+    return 0;
 }
 
 static int oss_media_hls_ends_with(const char *str, const char *surfix) {
     return strncmp(str + strlen(str) - strlen(surfix), surfix, strlen(surfix)) == 0;
 }
 
-oss_media_hls_file_t* oss_media_hls_open(char *bucket_name,
-                                       char *object_key,
-                                       auth_fn_t auth_func)
+static oss_media_hls_file_t* oss_media_hls_open_file(char *bucket_name,
+                                                    char *object_key,
+                                                    char *mode,
+                                                    auth_fn_t auth_func)
 {
     oss_media_hls_file_t* file;
     
     file = (oss_media_hls_file_t*)malloc(sizeof(oss_media_hls_file_t));
     
-    file->file = oss_media_file_open(bucket_name, object_key, "aw", auth_func); //delete file and append write
+    file->file = oss_media_file_open(bucket_name, object_key, mode, auth_func);
     if (file->file == NULL) {
         aos_error_log("open oss media file failed.");
         free(file);
@@ -329,153 +826,785 @@ oss_media_hls_file_t* oss_media_hls_open(char *bucket_name,
     file->frame_count = 0;
     file->options.video_pid = OSS_MEDIA_DEFAULT_VIDEO_PID;
     file->options.audio_pid = OSS_MEDIA_DEFAULT_AUDIO_PID;
+    file->options.video_type = st_h264;
+    file->options.audio_type = st_aac;
     file->options.hls_delay_ms = OSS_MEDIA_HLS_HLS_DELAY;
+    file->options.format = sf_ts;
     file->options.encrypt = 0;
+    file->options.sample_aes = 0;
     file->options.handler_func = oss_media_hls_ossfile_handler;
     file->options.pat_interval_frame_count = OSS_MEDIA_PAT_INTERVAL_FRAME_COUNT;
+    file->options.write_timeout_ms = 0;
+    file->options.drop_on_timeout = 0;
+    file->options.upload_buffers = OSS_MEDIA_DEFAULT_UPLOAD_BUFFERS;
+    file->options.audio_pes_duration_ms = 0;
+    file->options.audio_pes_size = OSS_MEDIA_DEFAULT_AUDIO_PES_SIZE;
+    file->options.byte_range = 0;
+    file->options.record_iframes = 0;
+    file->options.audio_only = 0;
+    file->options.single_put = 0;
+    file->options.chunked = 0;
+    memset(file->options.key, 0, sizeof(file->options.key));
+    memset(file->options.iv, 0, sizeof(file->options.iv));
+
+    file->encrypt.pos = 0;
+    file->encrypt.started = 0;
+    file->encrypt.sample_buf = NULL;
+    file->encrypt.nal_buf = NULL;
+    file->encrypt.sample_buf_size = 0;
+    memset(file->encrypt.audio_config, 0, sizeof(file->encrypt.audio_config));
+    file->m3u8_key_uri[0] = '\0';
+    file->m3u8_key_sample_aes = 0;
+    file->m3u8_map_uri[0] = '\0';
+    file->m3u8_sequence = 0;
+    file->fmp4 = NULL;
+    file->part_file = NULL;
+    file->uploader = NULL;
+    memset(&file->audio_pes, 0, sizeof(file->audio_pes));
+    file->length = 0;
+    file->iframes = NULL;
+    file->iframe_count = 0;
+    file->iframe_capacity = 0;
+    file->timed_out = 0;
+
+    file->psi.pat_continuity_counter = 0;
+    file->psi.pmt_continuity_counter = 0;
+    oss_media_hls_build_psi(file);
     
     file->buffer = (oss_media_hls_buf_t*)malloc(sizeof(oss_media_hls_buf_t));
     file->buffer->start = 0;
     file->buffer->pos = 0;
+    file->buffer->part_len = 0;
         
     if (oss_media_hls_ends_with(object_key, OSS_MEDIA_M3U8_FILE_SURFIX)) {
-        file->buffer->buf = (uint8_t*)malloc(OSS_MEDIA_DEFAULT_WRITE_BUFFER / 32);
+        file->buffer->buf = (uint8_t*)oss_media_pool_alloc(
+                OSS_MEDIA_DEFAULT_WRITE_BUFFER / 32);
         file->buffer->end = OSS_MEDIA_DEFAULT_WRITE_BUFFER / 32;
     } else {
-        file->buffer->buf = (uint8_t*)malloc(OSS_MEDIA_DEFAULT_WRITE_BUFFER);
+        file->buffer->buf = (uint8_t*)oss_media_pool_alloc(
+                OSS_MEDIA_DEFAULT_WRITE_BUFFER);
         file->buffer->end = OSS_MEDIA_DEFAULT_WRITE_BUFFER;
     }
 
     return file;
 }
 
-int oss_media_hls_write_frame(oss_media_hls_frame_t *frame,
-                             oss_media_hls_file_t *file)
+oss_media_hls_file_t* oss_media_hls_open(char *bucket_name,
+                                       char *object_key,
+                                       auth_fn_t auth_func)
 {
-    uint32_t pes_size, header_size, body_size, in_size, stuff_size, flags;
-    uint8_t  packet[OSS_MEDIA_HLS_PACKET_SIZE], *p, *base;
-    uint32_t first;
-    uint32_t pid;
-    
-    // write pat and pmt table
-    if (oss_media_hls_need_write_pat_and_pmt(file)) {
-        oss_media_hls_write_pat_and_pmt(file);
-    }
-    
-    // get pid
-    if (frame->stream_type == st_h264) {
-        pid = file->options.video_pid;
-    } else if (frame->stream_type == st_aac) {
-        pid = file->options.audio_pid;
-    } else {
-        aos_error_log("stream type[%d] is not support", frame->stream_type);
-        return -1;
-    }
+    //delete file and append write
+    return oss_media_hls_open_file(bucket_name, object_key, "aw", auth_func);
+}
 
-    first = 1;
-    memset(packet, 0x00, OSS_MEDIA_HLS_PACKET_SIZE);
-    while (frame->pos < frame->end) {
-        // flush if buffer is full.
-        if (0 != oss_media_handle_file(file)) {
-            aos_error_log("execute handler func failed.");
-            return -1;
-        }
+oss_media_hls_file_t* oss_media_hls_open_chunked(char *bucket_name,
+                                                char *object_key,
+                                                auth_fn_t auth_func)
+{
+    oss_media_hls_file_t* file;
 
-        p = packet;
+    file = oss_media_hls_open_file(bucket_name, object_key, "c", auth_func);
+    if (file != NULL) {
+        file->options.chunked = 1;
+    }
+    return file;
+}
 
-        *p++ = 0x47;                        // sync byte
-        *p++ = pid >> 8;                    // pid
-        if (first) {
-            *(p - 1) |= 0x40;               // first payload
-        }
-        *p++ = pid;                         // pid
-        *p++ = 0x10 | (frame->continuity_counter++ & 0x0F);
-        
-        if (first) {
-            if (frame->key) {
-                packet[3] |= 0x20;          // adaptation
-                *p++ = 7;                   // size
-                *p++ = 0x50;                // random access + pcr
-                
-                p = oss_media_hls_write_pcr(p, 
-                        frame->dts - file->options.hls_delay_ms);
-            }
-            
-            /* pes header */
-            *p++ = 0x00;                   //-------------------------
-            *p++ = 0x00;                   // packet start code pref
-            *p++ = 0x01;                   //-------------------------
-            *p++ = frame->stream_type == st_h264 ? 0xe0 : 0xc0;
-            
-            header_size = 5;
-            flags = 0x80;                   // pts
-            if (frame->stream_type == st_h264) {
-                header_size += 5;
-                flags |= 0x40;              // dts
-            }
+oss_media_hls_file_t* oss_media_hls_open_single_put(char *bucket_name,
+                                                    char *object_key,
+                                                    auth_fn_t auth_func)
+{
+    oss_media_hls_file_t* file;
 
-            pes_size = (frame->end - frame->pos) + header_size + 3;
-            if (pes_size > 0xFFFF) {
-                pes_size = 0;
-            }
+    file = oss_media_hls_open_file(bucket_name, object_key, "p", auth_func);
+    if (file != NULL) {
+        file->options.single_put = 1;
+    }
+    return file;
+}
 
-            *p++ = pes_size >> 8;      // pes length
-            *p++ = pes_size;           // pes length
-            *p++ = 0x80;               // flags
-            *p++ = flags;              // flags
-            *p++ = header_size;        // pes header size;
+static uint32_t oss_media_hls_payload_size(oss_media_hls_frame_t *frame) {
+    return (frame->prefix.end - frame->prefix.pos) + (frame->end - frame->pos)
+           + (frame->suffix.end - frame->suffix.pos);
+}
 
-            p = oss_media_hls_write_pts(p, flags >> 6, 
-                    frame->pts + file->options.hls_delay_ms); 
+// copy the next size bytes of prefix, [pos, end) and suffix
+static uint8_t *oss_media_hls_copy_payload(oss_media_hls_frame_t *frame,
+                                           uint8_t *p, uint32_t size)
+{
+    uint32_t len;
+
+    if (frame->prefix.pos < frame->prefix.end) {
+        len = frame->prefix.end - frame->prefix.pos;
+        len = len < size ? len : size;
+        memcpy(p, frame->prefix.pos, len);
+        frame->prefix.pos += len;
+        p += len;
+        size -= len;
+    }
 
-            if (frame->stream_type == st_h264) {
-                p = oss_media_hls_write_pts(p, 1, 
-                        frame->dts + file->options.hls_delay_ms); 
-            }
-            
-            first = 0;
-        }
+    len = frame->end - frame->pos;
+    len = len < size ? len : size;
+    memcpy(p, frame->pos, len);
+    frame->pos += len;
+    p += len;
+    size -= len;
+
+    if (size > 0) {
+        memcpy(p, frame->suffix.pos, size);
+        frame->suffix.pos += size;
+        p += size;
+    }
 
-        body_size = packet + sizeof(packet) - p;
-        in_size = frame->end - frame->pos;
+    return p;
+}
 
-        // fill data
-        if (in_size >= body_size) {
-            memcpy(p, frame->pos, body_size);
-            p += body_size;
-            frame->pos += body_size;
-        } else {
-            stuff_size = body_size - in_size;
-
-            if (packet[3] & 0x20) { // has adaptation
-                base = &packet[5] + packet[4];
-                p = memmove(base + stuff_size, base, p - base);
-                memset(base, 0xFF, stuff_size);
-                packet[4] += stuff_size;
-            } else {                // no  adaptation
-                packet[3] |= 0x20;
-                p = memmove(&packet[4] + stuff_size, &packet[4], p - &packet[4]);
-                packet[4] = stuff_size - 1;
-                if (stuff_size >=2) {
-                    packet[5] = 0;
-                    memset(&packet[6], 0xFF, stuff_size - 2);
-                }
-            }
-            
-            memcpy(&packet[OSS_MEDIA_HLS_PACKET_SIZE] - in_size, frame->pos, in_size);
-            frame->pos = frame->end;
-        }
-        
-        // encrypt
-        if (file->options.encrypt) {
-            oss_media_hls_encrypt_packet(file, packet);
-        }
+static int oss_media_hls_is_video(const oss_media_hls_frame_t *frame) {
+    return frame->stream_type == st_h264 || frame->stream_type == st_h265;
+}
 
-        memcpy(&file->buffer->buf[file->buffer->pos], packet, sizeof(packet));
-        file->buffer->pos += sizeof(packet);
-    }
+// pid and pes header of the frame, -1 if its stream type is not support
+static int oss_media_hls_get_pes_header(oss_media_hls_frame_t *frame,
+                                        oss_media_hls_file_t *file,
+                                        uint32_t *pid,
+                                        uint32_t *header_size,
+                                        uint32_t *flags)
+{
+    if (oss_media_hls_is_video(frame)) {
+        *pid = file->options.video_pid;
+    } else if (frame->stream_type == st_aac || frame->stream_type == st_mp3) {
+        *pid = file->options.audio_pid;
+    } else {
+        aos_error_log("stream type[%d] is not support", frame->stream_type);
+        return -1;
+    }
+
+    *header_size = 5;
+    *flags = 0x80;                          // pts
+    if (oss_media_hls_is_video(frame)) {
+        *header_size += 5;
+        *flags |= 0x40;                     // dts
+    }
+
+    return 0;
+}
+
+// the packets of a pes, the first one also has the headers
+static uint32_t oss_media_hls_count_packets(oss_media_hls_frame_t *frame,
+                                            uint32_t header_size)
+{
+    uint32_t in_size = oss_media_hls_payload_size(frame);
+    uint32_t first_size = OSS_MEDIA_HLS_PACKET_SIZE - 4 - 9 - header_size
+                          - (frame->key ? 8 : 0);
+
+    if (in_size == 0) {
+        return 0;
+    }
+    if (in_size <= first_size) {
+        return 1;
+    }
+    return 1 + (in_size - first_size + OSS_MEDIA_HLS_PACKET_SIZE - 5) 
+               / (OSS_MEDIA_HLS_PACKET_SIZE - 4);
+}
+
+// write the next packet of the frame, the buffer has room for it
+static void oss_media_hls_write_packet(oss_media_hls_frame_t *frame,
+                                       oss_media_hls_file_t *file,
+                                       uint32_t pid,
+                                       uint32_t header_size,
+                                       uint32_t flags,
+                                       uint32_t first)
+{
+    uint32_t pes_size, body_size, in_size, stuff_size;
+    uint32_t adaptation_size, pes_header_size;
+    uint8_t  *packet, *p;
+
+    // the packet is built in place, so size everything up front
+    adaptation_size = 0;
+    pes_header_size = 0;
+    if (first) {
+        if (frame->key) {
+            adaptation_size = 8;        // size + flags + pcr
+        }
+        pes_header_size = 9 + header_size;
+    }
+
+    body_size = OSS_MEDIA_HLS_PACKET_SIZE - 4 
+                - adaptation_size - pes_header_size;
+    in_size = oss_media_hls_payload_size(frame);
+    stuff_size = in_size < body_size ? body_size - in_size : 0;
+
+    packet = &file->buffer->buf[file->buffer->pos];
+    p = packet;
+
+    *p++ = 0x47;                        // sync byte
+    *p++ = (pid >> 8) | (first ? 0x40 : 0x00); // first payload + pid
+    *p++ = pid;                         // pid
+    *p++ = (adaptation_size || stuff_size ? 0x30 : 0x10)
+           | (frame->continuity_counter++ & 0x0F);
+
+    if (adaptation_size) {
+        *p++ = 7 + stuff_size;          // size
+        *p++ = 0x50;                    // random access + pcr
+        p = oss_media_hls_write_pcr(p, 
+                frame->dts - file->options.hls_delay_ms);
+        memset(p, 0xFF, stuff_size);
+        p += stuff_size;
+    } else if (stuff_size) {
+        *p++ = stuff_size - 1;          // size
+        if (stuff_size >= 2) {
+            *p++ = 0;                   // no flags
+            memset(p, 0xFF, stuff_size - 2);
+            p += stuff_size - 2;
+        }
+    }
+
+    if (first) {
+        /* pes header */
+        *p++ = 0x00;                   //-------------------------
+        *p++ = 0x00;                   // packet start code pref
+        *p++ = 0x01;                   //-------------------------
+        *p++ = oss_media_hls_is_video(frame) ? 0xe0 : 0xc0;
+        
+        pes_size = in_size + header_size + 3;
+        if (pes_size > 0xFFFF) {
+            pes_size = 0;
+        }
+
+        *p++ = pes_size >> 8;      // pes length
+        *p++ = pes_size;           // pes length
+        *p++ = 0x80;               // flags
+        *p++ = flags;              // flags
+        *p++ = header_size;        // pes header size;
+
+        p = oss_media_hls_write_pts(p, flags >> 6, 
+                frame->pts + file->options.hls_delay_ms); 
+
+        if (oss_media_hls_is_video(frame)) {
+            p = oss_media_hls_write_pts(p, 1, 
+                    frame->dts + file->options.hls_delay_ms); 
+        }
+    }
+
+    // fill data, the headers and stuffing leave room for the payload only
+    body_size = packet + OSS_MEDIA_HLS_PACKET_SIZE - p;
+    oss_media_hls_copy_payload(frame, p, body_size);
+
+    file->buffer->pos += OSS_MEDIA_HLS_PACKET_SIZE;
+    file->length += OSS_MEDIA_HLS_PACKET_SIZE;
+}
+
+static int oss_media_hls_write_pes(oss_media_hls_frame_t *frame,
+                                   oss_media_hls_file_t *file)
+{
+    uint32_t header_size, flags;
+    uint32_t first;
+    uint32_t pid;
+    uint64_t offset = file->length;
+    int ret;
+    
+    // write pat and pmt table
+    if (oss_media_hls_need_write_pat_and_pmt(frame, file)) {
+        oss_media_hls_write_pat_and_pmt(file);
+    }
+    
+    if (0 != oss_media_hls_get_pes_header(frame, file, &pid,
+                                          &header_size, &flags))
+    {
+        return -1;
+    }
+
+    first = 1;
+    while (oss_media_hls_payload_size(frame) > 0) {
+        // flush if buffer is full.
+        if (0 != (ret = oss_media_handle_file(file))) {
+            aos_error_log("execute handler func failed.");
+            return ret;
+        }
+
+        oss_media_hls_write_packet(frame, file, pid, header_size, flags, 
+                                   first);
+        first = 0;
+    }
     file->frame_count++;
 
+    if (oss_media_hls_is_iframe(frame, file)) {
+        return oss_media_hls_add_iframe(frame, offset, file);
+    }
+    return 0;
+}
+
+static int oss_media_hls_is_audio_packed(oss_media_hls_frame_t *frame,
+                                         oss_media_hls_file_t *file)
+{
+    return file->options.audio_pes_duration_ms > 0
+           && (frame->stream_type == st_aac || frame->stream_type == st_mp3);
+}
+
+// write the audio frames packed so far as one pes
+static int oss_media_hls_end_audio_pes(oss_media_hls_file_t *file) {
+    oss_media_hls_audio_pes_t *pes = &file->audio_pes;
+    oss_media_hls_frame_t frame;
+    int ret;
+
+    if (pes->len == 0) {
+        return 0;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = pes->stream_type;
+    frame.pts = pes->pts;
+    frame.dts = pes->pts;
+    frame.key = pes->key;
+    frame.continuity_counter = pes->continuity_counter;
+    frame.pos = pes->buf;
+    frame.end = pes->buf + pes->len;
+
+    // the frames are lost with an error, like the pes of a frame is
+    ret = oss_media_hls_write_pes(&frame, file);
+    pes->len = 0;
+    pes->continuity_counter = frame.continuity_counter;
+    return ret;
+}
+
+/*
+ * a short audio frame in a pes of its own is mostly ts header and
+ * stuffing, frames which follow each other are packed into one pes.
+ */
+static int oss_media_hls_pack_audio(oss_media_hls_frame_t *frame,
+                                    oss_media_hls_file_t *file)
+{
+    oss_media_hls_audio_pes_t *pes = &file->audio_pes;
+    oss_media_hls_frame_t packed;
+    uint32_t size = oss_media_hls_payload_size(frame);
+    uint8_t *buf;
+    int ret;
+
+    if (pes->len > 0
+        && (frame->stream_type != pes->stream_type
+            || frame->pts - pes->pts
+               >= file->options.audio_pes_duration_ms * 90ULL
+            || pes->len + size > file->options.audio_pes_size))
+    {
+        if (0 != (ret = oss_media_hls_end_audio_pes(file))) {
+            return ret;
+        }
+    }
+
+    if (size > file->options.audio_pes_size) {
+        return oss_media_hls_write_pes(frame, file);
+    }
+
+    if (pes->size < file->options.audio_pes_size) {
+        buf = (uint8_t*)oss_media_pool_realloc(pes->buf,
+                                               file->options.audio_pes_size);
+        if (buf == NULL) {
+            aos_error_log("alloc audio pes buffer failed.");
+            return -1;
+        }
+        pes->buf = buf;
+        pes->size = file->options.audio_pes_size;
+    }
+
+    if (pes->len == 0) {
+        pes->stream_type = frame->stream_type;
+        pes->pts = frame->pts;
+        pes->key = frame->key;
+        pes->continuity_counter = frame->continuity_counter;
+    }
+    oss_media_hls_copy_payload(frame, pes->buf + pes->len, size);
+    pes->len += size;
+
+    // the counter of the caller goes on from where the pes will end
+    memset(&packed, 0, sizeof(packed));
+    packed.pos = pes->buf;
+    packed.end = pes->buf + pes->len;
+    packed.key = pes->key;
+    frame->continuity_counter = pes->continuity_counter
+                                + oss_media_hls_count_packets(&packed, 5);
+    return 0;
+}
+
+static int oss_media_hls_write_es(oss_media_hls_frame_t *frame,
+                                  oss_media_hls_file_t *file)
+{
+    if (oss_media_hls_is_audio_packed(frame, file)) {
+        return oss_media_hls_pack_audio(frame, file);
+    }
+    return oss_media_hls_write_pes(frame, file);
+}
+
+static int oss_media_hls_reserve_sample_buf(oss_media_hls_file_t *file,
+                                            size_t size)
+{
+    uint8_t *sample_buf, *nal_buf;
+
+    if (file->encrypt.sample_buf_size >= size) {
+        return 0;
+    }
+
+    sample_buf = (uint8_t*)realloc(file->encrypt.sample_buf, size);
+    if (sample_buf == NULL) {
+        return -1;
+    }
+    file->encrypt.sample_buf = sample_buf;
+
+    nal_buf = (uint8_t*)realloc(file->encrypt.nal_buf, size);
+    if (nal_buf == NULL) {
+        return -1;
+    }
+    file->encrypt.nal_buf = nal_buf;
+
+    file->encrypt.sample_buf_size = size;
+    return 0;
+}
+
+/*
+ * zero bytes are rare in slice data, so the escape scanners below jump
+ * between them with memchr and look at the two bytes after each one.
+ */
+
+// drop the 03 of every 00 00 03, returns the length left
+static size_t oss_media_hls_unescape_nal(uint8_t *dst, const uint8_t *src,
+                                         size_t len)
+{
+    const uint8_t *p = src, *run = src, *end = src + len;
+    uint8_t *out = dst;
+
+    while (end - p >= 3) {
+        p = (const uint8_t *)memchr(p, 0, end - p - 2);
+        if (p == NULL) {
+            break;
+        }
+        if (p[1] == 0 && p[2] == 3) {
+            memcpy(out, run, p + 2 - run);
+            out += p + 2 - run;
+            run = p + 3;
+            p += 3;
+        } else {
+            p++;
+        }
+    }
+    memcpy(out, run, end - run);
+    out += end - run;
+
+    return out - dst;
+}
+
+// insert 03 after every 00 00 followed by 00, 01, 02 or 03
+static uint8_t *oss_media_hls_escape_nal(uint8_t *dst, const uint8_t *src,
+                                         size_t len)
+{
+    const uint8_t *p = src, *run = src, *end = src + len;
+
+    while (end - p >= 3) {
+        p = (const uint8_t *)memchr(p, 0, end - p - 2);
+        if (p == NULL) {
+            break;
+        }
+        if (p[1] == 0 && p[2] <= 3) {
+            memcpy(dst, run, p + 2 - run);
+            dst += p + 2 - run;
+            *dst++ = 0x03;
+            run = p + 2;
+            p += 2;
+        } else {
+            p++;
+        }
+    }
+    memcpy(dst, run, end - run);
+
+    return dst + (end - run);
+}
+
+// each slice restarts the cbc chain, the clear blocks are skipped by it
+static void oss_media_hls_encrypt_nal(oss_media_hls_file_t *file,
+                                      uint8_t *p, size_t len)
+{
+    size_t skip;
+
+    if (len <= OSS_MEDIA_SAMPLE_AES_NAL_LEADER + OSS_MEDIA_AES_BLOCK_SIZE) {
+        return;
+    }
+
+    memcpy(file->encrypt.aes.iv, file->options.iv, OSS_MEDIA_AES_BLOCK_SIZE);
+    p += OSS_MEDIA_SAMPLE_AES_NAL_LEADER;
+    len -= OSS_MEDIA_SAMPLE_AES_NAL_LEADER;
+
+    while (len > 0) {
+        if (len > OSS_MEDIA_AES_BLOCK_SIZE) {
+            oss_media_aes_cbc_encrypt(&file->encrypt.aes, p,
+                                      OSS_MEDIA_AES_BLOCK_SIZE);
+            p += OSS_MEDIA_AES_BLOCK_SIZE;
+            len -= OSS_MEDIA_AES_BLOCK_SIZE;
+        }
+        skip = len < OSS_MEDIA_SAMPLE_AES_NAL_SKIP ? 
+               len : OSS_MEDIA_SAMPLE_AES_NAL_SKIP;
+        p += skip;
+        len -= skip;
+    }
+}
+
+static uint8_t *oss_media_hls_sample_encrypt_h264(oss_media_hls_file_t *file,
+                                                  const uint8_t *pos,
+                                                  const uint8_t *end)
+{
+    uint8_t *out = file->encrypt.sample_buf;
+    const uint8_t *nal, *nal_end, *next;
+    uint8_t type;
+    size_t len;
+
+    // copy the leading bytes and the first start code as they are
+    nal = oss_media_find_start_code(pos, end);
+    nal = nal < end ? nal + 3 : end;
+    memcpy(out, pos, nal - pos);
+    out += nal - pos;
+
+    while (nal < end) {
+        next = oss_media_find_start_code(nal, end);
+        nal_end = next;
+        while (nal_end > nal && nal_end[-1] == 0) {
+            nal_end--;
+        }
+
+        type = nal[0] & 0x1F;
+        len = nal_end - nal;
+        if ((type == ft_non_idr || type == ft_idr) && len 
+            > OSS_MEDIA_SAMPLE_AES_NAL_LEADER + OSS_MEDIA_AES_BLOCK_SIZE)
+        {
+            // encrypt the rbsp and escape the result again, the cipher
+            // may produce start codes
+            len = oss_media_hls_unescape_nal(file->encrypt.nal_buf, nal, len);
+            oss_media_hls_encrypt_nal(file, file->encrypt.nal_buf, len);
+            out = oss_media_hls_escape_nal(out, file->encrypt.nal_buf, len);
+        } else {
+            memcpy(out, nal, len);
+            out += len;
+        }
+
+        // trailing zeros and the next start code
+        next = next < end ? next + 3 : end;
+        memcpy(out, nal_end, next - nal_end);
+        out += next - nal_end;
+        nal = next;
+    }
+
+    return out;
+}
+
+static uint8_t *oss_media_hls_sample_encrypt_aac(oss_media_hls_file_t *file,
+                                                 const uint8_t *pos,
+                                                 const uint8_t *end)
+{
+    uint8_t *p = file->encrypt.sample_buf;
+    uint8_t *out = p + (end - pos);
+    uint32_t frame_length, header_length, profile, sample_rate, channel;
+    size_t len;
+
+    memcpy(p, pos, end - pos);
+
+    while (out - p >= 7 && p[0] == 0xFF && (p[1] & 0xF0) == 0xF0) {
+        frame_length = ((p[3] & 0x03) << 11) | (p[4] << 3) | (p[5] >> 5);
+        header_length = (p[1] & 0x01) ? 7 : 9;
+        if (frame_length < header_length || frame_length > (size_t)(out - p)) {
+            break;
+        }
+
+        if (file->encrypt.audio_config[0] == 0) {
+            // AudioSpecificConfig: object type, sample rate, channel
+            profile = (p[2] >> 6) + 1;
+            sample_rate = (p[2] >> 2) & 0x0F;
+            channel = ((p[2] & 0x01) << 2) | (p[3] >> 6);
+            file->encrypt.audio_config[0] = (profile << 3) | (sample_rate >> 1);
+            file->encrypt.audio_config[1] = ((sample_rate & 0x01) << 7)
+                                            | (channel << 3);
+        }
+
+        // each frame restarts the cbc chain, the partial block stays clear
+        if (frame_length > header_length + OSS_MEDIA_SAMPLE_AES_ADTS_LEADER) {
+            len = frame_length - header_length 
+                  - OSS_MEDIA_SAMPLE_AES_ADTS_LEADER;
+            memcpy(file->encrypt.aes.iv, file->options.iv, 
+                   OSS_MEDIA_AES_BLOCK_SIZE);
+            oss_media_aes_cbc_encrypt(&file->encrypt.aes,
+                    p + header_length + OSS_MEDIA_SAMPLE_AES_ADTS_LEADER,
+                    len - len % OSS_MEDIA_AES_BLOCK_SIZE);
+        }
+        p += frame_length;
+    }
+
+    return out;
+}
+
+static int oss_media_hls_mux_frame(oss_media_hls_frame_t *frame,
+                                   oss_media_hls_file_t *file)
+{
+    uint8_t *pos = frame->pos;
+    uint8_t *end = frame->end;
+    int ret;
+
+    if (file->options.format == sf_fmp4) {
+        return oss_media_fmp4_write_frame(frame, file);
+    }
+
+    if (!oss_media_hls_is_sample_aes(file)) {
+        return oss_media_hls_write_es(frame, file);
+    }
+
+    // mux an encrypted copy of [pos, end), escaping may grow h.264 by half
+    // at most. prefix and suffix stay clear
+    if (0 != oss_media_hls_reserve_sample_buf(file, 
+                    (end - pos) + (end - pos) / 2 + 3))
+    {
+        aos_error_log("alloc sample aes buffer failed.");
+        return -1;
+    }
+
+    oss_media_hls_start_encrypt(file);
+
+    frame->pos = file->encrypt.sample_buf;
+    if (frame->stream_type == st_h264) {
+        frame->end = oss_media_hls_sample_encrypt_h264(file, pos, end);
+    } else if (frame->stream_type == st_aac) {
+        frame->end = oss_media_hls_sample_encrypt_aac(file, pos, end);
+    } else {
+        frame->pos = pos;
+        aos_error_log("stream type[%d] is not support", frame->stream_type);
+        return -1;
+    }
+
+    ret = oss_media_hls_write_es(frame, file);
+
+    frame->pos = ret == 0 ? end : pos;
+    frame->end = end;
+    return ret;
+}
+
+// a chunked put gets the muxed data at once rather than when it is full
+static int oss_media_hls_send(oss_media_hls_file_t *file) {
+    int ret;
+
+    if (!file->options.chunked) {
+        return 0;
+    }
+    if ((ret = oss_media_hls_call_handler(file, 0)) != 0) {
+        aos_error_log("execute handler func failed.");
+        return ret == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+    return 0;
+}
+
+int oss_media_hls_write_frame(oss_media_hls_frame_t *frame,
+                              oss_media_hls_file_t *file)
+{
+    int ret = oss_media_hls_take_timeout(file,
+                                         oss_media_hls_mux_frame(frame, file));
+    return ret == 0 ? oss_media_hls_send(file) : ret;
+}
+
+int oss_media_hls_write_frames(oss_media_hls_frame_t frames[], int n,
+                               oss_media_hls_file_t *file)
+{
+    oss_media_hls_frame_t *frame;
+    uint32_t header_size, flags, pid;
+    size_t size;
+    int psi;
+    int ret;
+    int i;
+    uint64_t offset;
+
+    // fmp4, SAMPLE-AES and packed audio rewrite frames, they go one by one
+    if (file->options.format == sf_fmp4 || oss_media_hls_is_sample_aes(file)
+        || file->options.audio_pes_duration_ms > 0)
+    {
+        for (i = 0; i < n; i++) {
+            if (0 != (ret = oss_media_hls_write_frame(&frames[i], file))) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        frame = &frames[i];
+        if (0 != oss_media_hls_get_pes_header(frame, file, &pid,
+                                              &header_size, &flags))
+        {
+            return -1;
+        }
+
+        psi = oss_media_hls_need_write_pat_and_pmt(frame, file);
+        size = (oss_media_hls_count_packets(frame, header_size) + psi * 2)
+               * OSS_MEDIA_HLS_PACKET_SIZE;
+
+        // room for the whole frame is made at once, unless it never fits
+        if (file->options.single_put) {
+            if (0 != oss_media_hls_reserve(file, size)) {
+                return -1;
+            }
+        } else if (file->buffer->end - file->buffer->pos < size) {
+            if (0 != (ret = oss_media_hls_call_handler(file, 1))) {
+                aos_error_log("execute handler func failed.");
+                if (ret != OSS_MEDIA_TIMEOUT
+                    || 0 != oss_media_hls_reserve(file, size))
+                {
+                    return -1;
+                }
+                file->timed_out = 1;
+            }
+            if (file->buffer->end - file->buffer->pos < size) {
+                ret = oss_media_hls_take_timeout(file,
+                        oss_media_hls_write_pes(frame, file));
+                if (ret != 0) {
+                    return ret;
+                }
+                continue;
+            }
+        }
+
+        offset = file->length;
+        if (psi) {
+            oss_media_hls_update_psi(file);
+            oss_media_hls_put_psi(file, file->psi.pat,
+                                  &file->psi.pat_continuity_counter);
+            oss_media_hls_put_psi(file, file->psi.pmt,
+                                  &file->psi.pmt_continuity_counter);
+        }
+
+        if (oss_media_hls_payload_size(frame) > 0) {
+            oss_media_hls_write_packet(frame, file, pid, header_size, 
+                                       flags, 1);
+        }
+        while (oss_media_hls_payload_size(frame) > 0) {
+            oss_media_hls_write_packet(frame, file, pid, header_size, 
+                                       flags, 0);
+        }
+        file->frame_count++;
+
+        if (oss_media_hls_is_iframe(frame, file)
+            && 0 != oss_media_hls_add_iframe(frame, offset, file))
+        {
+            return -1;
+        }
+        if (file->timed_out) {
+            return oss_media_hls_take_timeout(file, 0);
+        }
+    }
+
+    return oss_media_hls_send(file);
+}
+
+static int oss_media_hls_append_m3u8(oss_media_hls_file_t *file,
+                                     const char *item, int len)
+{
+    oss_media_hls_buf_t *buffer = file->buffer;
+
+    if (0 != oss_media_hls_reserve(file, len)) {
+        return -1;
+    }
+
+    memcpy(&buffer->buf[buffer->pos], item, len);
+    buffer->pos += len;
     return 0;
 }
 
@@ -487,19 +1616,260 @@ void oss_media_hls_begin_m3u8(int32_t max_duration,
     static const char *header = "#EXTM3U\n"
                                 "#EXT-X-TARGETDURATION:%d\n"
                                 "#EXT-X-MEDIA-SEQUENCE:%d\n"
-                                "#EXT-X-VERSION:3\n";
+                                "#EXT-X-VERSION:%d\n";
         
-    char m3u8_header[strlen(header) + 12];
-    len = sprintf(m3u8_header, header, max_duration, sequence);
-    
-    memcpy(&file->buffer->buf[file->buffer->pos], m3u8_header, len);
-    file->buffer->pos += len;
+    char m3u8_header[strlen(header) + 24];
+    // EXT-X-MAP of media playlists without I-frames needs version 6,
+    // EXT-X-BYTERANGE version 4
+    len = sprintf(m3u8_header, header, max_duration, sequence,
+                  file->options.format == sf_fmp4 ? 6 
+                  : (file->options.byte_range ? 4 : 3));
+    oss_media_hls_append_m3u8(file, m3u8_header, len);
+
+    // a new playlist starts without key and map
+    file->m3u8_key_uri[0] = '\0';
+    file->m3u8_key_sample_aes = 0;
+    file->m3u8_map_uri[0] = '\0';
+    file->m3u8_sequence = sequence;
+}
+
+void oss_media_hls_begin_ll_m3u8(int32_t max_duration,
+                                 int32_t sequence,
+                                 float part_target,
+                                 oss_media_hls_file_t *file)
+{
+    int len;
+    char item[128];
+
+    oss_media_hls_begin_m3u8(max_duration, sequence, file);
+
+    // players stay 3 parts behind the live edge, as the spec recommends
+    len = sprintf(item, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.3f\n"
+                  "#EXT-X-PART-INF:PART-TARGET=%.3f\n",
+                  part_target * 3, part_target);
+    oss_media_hls_append_m3u8(file, item, len);
+}
+
+void oss_media_hls_begin_iframe_m3u8(int32_t max_duration,
+                                     int32_t sequence,
+                                     oss_media_hls_file_t *file)
+{
+    static const char *iframes_only = "#EXT-X-I-FRAMES-ONLY\n";
+
+    file->options.byte_range = 1;
+    oss_media_hls_begin_m3u8(max_duration, sequence, file);
+    oss_media_hls_append_m3u8(file, iframes_only, strlen(iframes_only));
+}
+
+int oss_media_hls_write_master_m3u8(int size,
+                                    oss_media_hls_variant_t variants[],
+                                    oss_media_hls_file_t *file)
+{
+    int i;
+    int len;
+    static const char *header = "#EXTM3U\n";
+    char item[OSS_MEDIA_M3U8_URL_LENGTH + 160];
+
+    if (0 != oss_media_hls_append_m3u8(file, header, strlen(header))) {
+        return -1;
+    }
+
+    for (i = 0; i < size; i++) {
+        len = sprintf(item, "#EXT-X-STREAM-INF:BANDWIDTH=%d", 
+                      variants[i].bandwidth);
+        if (variants[i].codecs[0] != '\0') {
+            len += sprintf(item + len, ",CODECS=\"%s\"", variants[i].codecs);
+        }
+        if (variants[i].resolution[0] != '\0') {
+            len += sprintf(item + len, ",RESOLUTION=%s", 
+                           variants[i].resolution);
+        }
+        len += sprintf(item + len, "\n%s\n", variants[i].url);
+        if (0 != oss_media_hls_append_m3u8(file, item, len)) {
+            return -1;
+        }
+    }
+
+    return oss_media_hls_flush(file);
 }
 
 void oss_media_hls_end_m3u8(oss_media_hls_file_t *file) {
     static const char *end = "#EXT-X-ENDLIST\n";
-    memcpy(&file->buffer->buf[file->buffer->pos], end, strlen(end));
-    file->buffer->pos += strlen(end);
+    oss_media_hls_append_m3u8(file, end, strlen(end));
+}
+
+// the EXT-X-MAP and EXT-X-KEY lines which apply from this segment on
+static int oss_media_hls_write_m3u8_tags(const char *map_uri,
+                                         const char *key_uri,
+                                         int sample_aes,
+                                         oss_media_hls_file_t *file)
+{
+    int len;
+    char item[OSS_MEDIA_M3U8_URL_LENGTH + 48];
+
+    if (map_uri[0] != '\0' && strcmp(map_uri, file->m3u8_map_uri) != 0) {
+        len = sprintf(item, "#EXT-X-MAP:URI=\"%s\"\n", map_uri);
+        if (0 != oss_media_hls_append_m3u8(file, item, len)) {
+            return -1;
+        }
+        strcpy(file->m3u8_map_uri, map_uri);
+    }
+
+    if (strcmp(key_uri, file->m3u8_key_uri) != 0
+        || (key_uri[0] != '\0' && sample_aes != file->m3u8_key_sample_aes))
+    {
+        if (key_uri[0] != '\0') {
+            len = sprintf(item, "#EXT-X-KEY:METHOD=%s,URI=\"%s\"\n",
+                          sample_aes ? "SAMPLE-AES" : "AES-128", key_uri);
+        } else {
+            len = sprintf(item, "#EXT-X-KEY:METHOD=NONE\n");
+        }
+        if (0 != oss_media_hls_append_m3u8(file, item, len)) {
+            return -1;
+        }
+        strcpy(file->m3u8_key_uri, key_uri);
+        file->m3u8_key_sample_aes = sample_aes;
+    }
+
+    return 0;
+}
+
+static int oss_media_hls_write_info_tags(oss_media_hls_m3u8_info_t *m3u8,
+                                         oss_media_hls_file_t *file)
+{
+    return oss_media_hls_write_m3u8_tags(m3u8->map_uri, m3u8->key_uri,
+                                         m3u8->sample_aes, file);
+}
+
+static int oss_media_hls_write_segment_tags(
+        const oss_media_hls_window_t *window,
+        const oss_media_hls_segment_t *segment,
+        oss_media_hls_file_t *file)
+{
+    return oss_media_hls_write_m3u8_tags(window->map_uri,
+            segment->key_uri != NULL ? segment->key_uri : "",
+            segment->sample_aes, file);
+}
+
+// room for the lines of all segments is made at once
+static int oss_media_hls_reserve_m3u8_lines(int size,
+                                            oss_media_hls_m3u8_info_t m3u8[],
+                                            oss_media_hls_file_t *file)
+{
+    int i;
+    unsigned int len = 0;
+
+    for (i = 0; i < size; i++) {
+        len += strnlen(m3u8[i].url, OSS_MEDIA_M3U8_URL_LENGTH) + 100;
+    }
+    return oss_media_hls_reserve(file, len);
+}
+
+static int oss_media_hls_write_m3u8_segment(oss_media_hls_m3u8_info_t *m3u8,
+                                            oss_media_hls_file_t *file)
+{
+    int len;
+    char line[OSS_MEDIA_M3U8_URL_LENGTH + 100];
+
+    if (m3u8->range_length > 0) {
+        len = snprintf(line, sizeof(line), 
+                "#EXTINF:%.3f,\n#EXT-X-BYTERANGE:%" APR_UINT64_T_FMT
+                "@%" APR_UINT64_T_FMT "\n%s\n", m3u8->duration,
+                m3u8->range_length, m3u8->range_offset, m3u8->url);
+    } else {
+        len = snprintf(line, sizeof(line), "#EXTINF:%.3f,\n%s\n",
+                       m3u8->duration, m3u8->url);
+    }
+    if (len >= (int)sizeof(line)) {
+        aos_error_log("m3u8 item of url[%s] is too long.", m3u8->url);
+        return -1;
+    }
+    return oss_media_hls_append_m3u8(file, line, len);
+}
+
+static int oss_media_hls_write_m3u8_part(oss_media_hls_part_info_t *part,
+                                         oss_media_hls_file_t *file)
+{
+    int len;
+    char item[OSS_MEDIA_M3U8_URL_LENGTH + 64];
+
+    len = sprintf(item, "#EXT-X-PART:DURATION=%.3f,URI=\"%s\"%s\n",
+                  part->duration, part->url,
+                  part->independent ? ",INDEPENDENT=YES" : "");
+    return oss_media_hls_append_m3u8(file, item, len);
+}
+
+// the lines of a window segment are made from the url prefix and index
+static int oss_media_hls_write_window_segment(
+        const oss_media_hls_window_t *window,
+        const oss_media_hls_segment_t *segment,
+        oss_media_hls_file_t *file)
+{
+    int len;
+    char index[24] = "";
+    char line[OSS_MEDIA_M3U8_URL_LENGTH * 2 + 80];
+
+    if (segment->index >= 0) {
+        sprintf(index, "%" APR_INT64_T_FMT, segment->index);
+    }
+    if (segment->range_length > 0) {
+        len = snprintf(line, sizeof(line),
+                "#EXTINF:%.3f,\n#EXT-X-BYTERANGE:%" APR_UINT64_T_FMT
+                "@%" APR_UINT64_T_FMT "\n%s%s%s\n", segment->duration,
+                segment->range_length, segment->range_offset,
+                window->url_prefix, index, window->url_suffix);
+    } else {
+        len = snprintf(line, sizeof(line), "#EXTINF:%.3f,\n%s%s%s\n",
+                       segment->duration, window->url_prefix, index,
+                       window->url_suffix);
+    }
+    if (len >= (int)sizeof(line)) {
+        aos_error_log("m3u8 item of url[%s%s%s] is too long.",
+                      window->url_prefix, index, window->url_suffix);
+        return -1;
+    }
+    return oss_media_hls_append_m3u8(file, line, len);
+}
+
+// the lines of a window segment are no longer than this
+static unsigned int oss_media_hls_window_line_size(
+        const oss_media_hls_window_t *window)
+{
+    return strlen(window->url_prefix) + strlen(window->url_suffix) + 100;
+}
+
+// the EXT-X-PART lines of the segment of sequence, from parts[*next] on
+static int oss_media_hls_write_m3u8_parts(int64_t sequence, int *next,
+                                          int part_size,
+                                          oss_media_hls_part_info_t parts[],
+                                          oss_media_hls_file_t *file)
+{
+    int j;
+
+    // parts come before the segment they make up
+    for (j = *next; j < part_size && parts[j].sequence <= sequence; j++) {
+        if (parts[j].sequence == sequence
+            && 0 != oss_media_hls_write_m3u8_part(&parts[j], file))
+        {
+            return -1;
+        }
+    }
+    *next = j;
+    return 0;
+}
+
+static int oss_media_hls_write_m3u8_preload(const char *preload_uri,
+                                            oss_media_hls_file_t *file)
+{
+    int len;
+    char item[OSS_MEDIA_M3U8_URL_LENGTH + 48];
+
+    if (preload_uri == NULL || preload_uri[0] == '\0') {
+        return 0;
+    }
+    len = sprintf(item, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\"\n",
+                  preload_uri);
+    return oss_media_hls_append_m3u8(file, item, len);
 }
 
 int oss_media_hls_write_m3u8(int size,
@@ -507,21 +1877,330 @@ int oss_media_hls_write_m3u8(int size,
                             oss_media_hls_file_t *file)
 {
     int i;
-    int len;
+
+    if (0 != oss_media_hls_reserve_m3u8_lines(size, m3u8, file)) {
+        return -1;
+    }
     for (i = 0;i < size; i++) {
-        char item[256 + 32];
-        len = sprintf(item, "#EXTINF:%.3f,\n%s\n", m3u8[i].duration, m3u8[i].url);
-        memcpy(&file->buffer->buf[file->buffer->pos], item, len);
-        file->buffer->pos += len;
+        if (0 != oss_media_hls_write_info_tags(&m3u8[i], file)
+            || 0 != oss_media_hls_write_m3u8_segment(&m3u8[i], file))
+        {
+            return -1;
+        }
     }
     
     return oss_media_hls_flush(file);
 }
 
+int oss_media_hls_write_ll_m3u8(int size,
+                                oss_media_hls_m3u8_info_t m3u8[],
+                                int part_size,
+                                oss_media_hls_part_info_t parts[],
+                                const char *preload_uri,
+                                oss_media_hls_file_t *file)
+{
+    int i, j = 0;
+
+    if (0 != oss_media_hls_reserve_m3u8_lines(size, m3u8, file)) {
+        return -1;
+    }
+    for (i = 0; i < size; i++) {
+        if (0 != oss_media_hls_write_info_tags(&m3u8[i], file)
+            || 0 != oss_media_hls_write_m3u8_parts(file->m3u8_sequence + i,
+                        &j, part_size, parts, file))
+        {
+            return -1;
+        }
+
+        if (m3u8[i].url[0] != '\0'
+            && 0 != oss_media_hls_write_m3u8_segment(&m3u8[i], file))
+        {
+            return -1;
+        }
+    }
+
+    if (0 != oss_media_hls_write_m3u8_preload(preload_uri, file)) {
+        return -1;
+    }
+    return oss_media_hls_flush(file);
+}
+
+int oss_media_hls_window_init(oss_media_hls_window_t *window,
+                              int32_t capacity)
+{
+    memset(window, 0, sizeof(oss_media_hls_window_t));
+    window->segments = (oss_media_hls_segment_t*)malloc(
+            sizeof(oss_media_hls_segment_t) * capacity);
+    if (window->segments == NULL) {
+        aos_error_log("alloc window of %d segments failed.", capacity);
+        return -1;
+    }
+    window->capacity = capacity;
+    return 0;
+}
+
+/*
+ * the segments of a key are next to each other, a key uri is freed when
+ * the last of them is dropped, unless it is the one of the newest.
+ */
+static void oss_media_hls_window_drop(oss_media_hls_window_t *window) {
+    const char *key_uri = window->segments[window->head].key_uri;
+
+    window->head = (window->head + 1) % window->capacity;
+    window->count--;
+
+    if (key_uri != NULL && key_uri != window->key_uri
+        && (window->count == 0
+            || key_uri != window->segments[window->head].key_uri))
+    {
+        free((char*)key_uri);
+    }
+}
+
+void oss_media_hls_window_destroy(oss_media_hls_window_t *window) {
+    while (window->count > 0) {
+        oss_media_hls_window_drop(window);
+    }
+    free(window->key_uri);
+    free(window->segments);
+    window->key_uri = NULL;
+    window->segments = NULL;
+}
+
+int oss_media_hls_window_grow(oss_media_hls_window_t *window,
+                              int32_t capacity)
+{
+    int32_t i;
+    oss_media_hls_segment_t *segments;
+
+    if (capacity <= window->capacity) {
+        return 0;
+    }
+    segments = (oss_media_hls_segment_t*)malloc(
+            sizeof(oss_media_hls_segment_t) * capacity);
+    if (segments == NULL) {
+        aos_error_log("alloc window of %d segments failed.", capacity);
+        return -1;
+    }
+
+    for (i = 0; i < window->count; i++) {
+        segments[i] = *oss_media_hls_window_at(window, i);
+    }
+    free(window->segments);
+    window->segments = segments;
+    window->capacity = capacity;
+    window->head = 0;
+    return 0;
+}
+
+void oss_media_hls_window_pop(oss_media_hls_window_t *window) {
+    oss_media_hls_window_drop(window);
+}
+
+oss_media_hls_segment_t *oss_media_hls_window_push(
+        oss_media_hls_window_t *window, const char *key_uri)
+{
+    oss_media_hls_segment_t *segment;
+    char *copy = key_uri != NULL ? window->key_uri : NULL;
+
+    // a key shared again after a clear segment is copied again, so that
+    // the segments of each copy stay next to each other
+    if (key_uri != NULL && (copy == NULL || strcmp(copy, key_uri) != 0)) {
+        copy = strdup(key_uri);
+        if (copy == NULL) {
+            aos_error_log("alloc key uri[%s] failed.", key_uri);
+            return NULL;
+        }
+    }
+
+    if (window->count == window->capacity) {
+        oss_media_hls_window_drop(window);
+    }
+
+    // the last key is dropped with its segments from now on
+    if (copy != window->key_uri) {
+        if (window->count == 0 || window->key_uri
+            != oss_media_hls_window_at(window, window->count - 1)->key_uri)
+        {
+            free(window->key_uri);
+        }
+        window->key_uri = copy;
+    }
+
+    segment = oss_media_hls_window_at(window, window->count++);
+    memset(segment, 0, sizeof(oss_media_hls_segment_t));
+    segment->key_uri = copy;
+    return segment;
+}
+
+oss_media_hls_segment_t *oss_media_hls_window_at(
+        const oss_media_hls_window_t *window, int32_t i)
+{
+    return &window->segments[(window->head + i) % window->capacity];
+}
+
+int oss_media_hls_write_window_m3u8(const oss_media_hls_window_t *window,
+                                    oss_media_hls_file_t *file)
+{
+    int i;
+    const oss_media_hls_segment_t *segment;
+
+    if (0 != oss_media_hls_reserve(file,
+                window->count * oss_media_hls_window_line_size(window)))
+    {
+        return -1;
+    }
+    for (i = 0; i < window->count; i++) {
+        segment = oss_media_hls_window_at(window, i);
+        if (0 != oss_media_hls_write_segment_tags(window, segment, file)
+            || 0 != oss_media_hls_write_window_segment(window, segment, file))
+        {
+            return -1;
+        }
+    }
+
+    return oss_media_hls_flush(file);
+}
+
+int oss_media_hls_write_window_ll_m3u8(const oss_media_hls_window_t *window,
+                                       const oss_media_hls_segment_t *pending,
+                                       int part_size,
+                                       oss_media_hls_part_info_t parts[],
+                                       const char *preload_uri,
+                                       oss_media_hls_file_t *file)
+{
+    int i, j = 0;
+    const oss_media_hls_segment_t *segment;
+
+    if (0 != oss_media_hls_reserve(file,
+                window->count * oss_media_hls_window_line_size(window)))
+    {
+        return -1;
+    }
+    for (i = 0; i < window->count; i++) {
+        segment = oss_media_hls_window_at(window, i);
+        if (0 != oss_media_hls_write_segment_tags(window, segment, file)
+            || 0 != oss_media_hls_write_m3u8_parts(file->m3u8_sequence + i,
+                        &j, part_size, parts, file)
+            || 0 != oss_media_hls_write_window_segment(window, segment, file))
+        {
+            return -1;
+        }
+    }
+
+    if (pending != NULL
+        && (0 != oss_media_hls_write_segment_tags(window, pending, file)
+            || 0 != oss_media_hls_write_m3u8_parts(file->m3u8_sequence + i,
+                        &j, part_size, parts, file)))
+    {
+        return -1;
+    }
+
+    if (0 != oss_media_hls_write_m3u8_preload(preload_uri, file)) {
+        return -1;
+    }
+    return oss_media_hls_flush(file);
+}
+
+int oss_media_hls_upload(oss_media_hls_file_t *file) {
+    int ret;
+    oss_media_fmp4_end_fragment(file);
+    if ((ret = oss_media_hls_call_handler(file, 1)) != 0) {
+        return ret == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+    return 0;
+}
+
+// appends are in order, the buffers being uploaded go first
+static int oss_media_hls_hand_over_all(oss_media_hls_file_t *file) {
+    int ret;
+    if ((ret = oss_media_hls_wait_uploads(file)) == 0) {
+        ret = oss_media_hls_call_handler(file, 0);
+    }
+    if (ret != 0) {
+        return ret == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+    // the data of a timeout within a frame is uploaded now
+    file->timed_out = 0;
+    return 0;
+}
+
 int oss_media_hls_flush(oss_media_hls_file_t *file) {
-    if (file->options.handler_func(file) != 0) {
+    int ret;
+    oss_media_fmp4_end_fragment(file);
+    ret = oss_media_hls_end_audio_pes(file);
+    // a single put file is only handed over as a whole
+    if (ret == 0 && !file->options.single_put) {
+        ret = oss_media_hls_hand_over_all(file);
+    }
+    if (ret != 0) {
+        return ret == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+    return 0;
+}
+
+// pad the last block of an encrypted file with PKCS#7
+static int oss_media_hls_finish_encrypt(oss_media_hls_file_t *file) {
+    uint8_t pad;
+    int ret;
+
+    if (!file->options.encrypt || file->options.sample_aes
+        || (!file->encrypt.started && file->buffer->pos == file->buffer->start))
+    {
+        return 0;
+    }
+
+    if (0 != (ret = oss_media_handle_file(file))) {
+        return ret;
+    }
+
+    oss_media_hls_start_encrypt(file);
+    pad = OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH - (file->buffer->pos 
+            - file->encrypt.pos) % OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH;
+    memset(&file->buffer->buf[file->buffer->pos], pad, pad);
+    file->buffer->pos += pad;
+
+    return 0;
+}
+
+int oss_media_hls_set_part_file(oss_media_hls_file_t *file,
+                                oss_media_file_t *part_file)
+{
+    int queued = 0;
+    oss_media_hls_uploader_t *uploader = file->uploader;
+
+    if (uploader != NULL) {
+        pthread_mutex_lock(&uploader->mutex);
+        queued = uploader->queue_size;
+        pthread_mutex_unlock(&uploader->mutex);
+    }
+
+    // the upload thread writes the queued buffers to the part they are for
+    if (queued > 0 || file->buffer->part_len > 0) {
+        aos_error_log("part of oss file[%s] is replaced before a flush.",
+                      file->file->object_key);
         return -1;
     }
+
+    file->part_file = part_file;
+    return 0;
+}
+
+int oss_media_hls_end_segment(oss_media_hls_file_t *file) {
+    int ret;
+
+    oss_media_fmp4_end_fragment(file);
+    if ((ret = oss_media_hls_end_audio_pes(file)) != 0
+        || (ret = oss_media_hls_finish_encrypt(file)) != 0
+        || (ret = oss_media_hls_hand_over_all(file)) != 0
+        || (ret = oss_media_hls_finish_file(file)) != 0)
+    {
+        return ret == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+
+    // every byte range is played on its own
+    file->frame_count = 0;
+    file->encrypt.started = 0;
     return 0;
 }
 
@@ -532,15 +2211,26 @@ int oss_media_hls_close(oss_media_hls_file_t *file) {
         return 0;
     }
     
-    if (oss_media_hls_flush(file) != 0) {
+    oss_media_fmp4_end_fragment(file);
+    if ((ret = oss_media_hls_end_audio_pes(file)) != 0) {
+        aos_error_log("write audio pes failed.");
+    } else if ((ret = oss_media_hls_finish_encrypt(file)) != 0) {
+        aos_error_log("finish encrypt file failed.");
+    } else if ((ret = oss_media_hls_hand_over_all(file)) != 0) {
         aos_error_log("flush file failed.");
-        ret = -1;
+    } else if ((ret = oss_media_hls_finish_file(file)) != 0) {
+        aos_error_log("put file failed.");
     }
         
+    oss_media_hls_stop_uploader(file);
     oss_media_file_close(file->file);
 
-    free(file->buffer->buf);
-    free(file->buffer);
+    oss_media_hls_free_buffer(file->buffer);
+    free(file->encrypt.sample_buf);
+    free(file->encrypt.nal_buf);
+    free(file->fmp4);
+    free(file->iframes);
+    oss_media_pool_free(file->audio_pes.buf);
 
     free(file);
     file = NULL;
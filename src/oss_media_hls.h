@@ -2,16 +2,24 @@
 #define OSS_MEDIA_HLS_H
 
 #include <stdint.h>
+#include <pthread.h>
 #include "oss_media_client.h"
+#include "oss_media_aes.h"
 
 /* packet size: 188 bytes */
 #define OSS_MEDIA_HLS_PACKET_SIZE 188
-/* encrypt key size: 32 bytes */
-#define OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE 32
+/* encrypt key size: 16 bytes, AES-128 */
+#define OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE 16
+/* encrypt iv size: 16 bytes */
+#define OSS_MEDIA_HLS_ENCRYPT_IV_SIZE 16
 /* encrypt packet length */
 #define OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH 16
+/* SAMPLE-AES audio setup information: the 2 bytes AudioSpecificConfig */
+#define OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE 2
 
 #define OSS_MEDIA_M3U8_URL_LENGTH 256
+/* the most buffers of a file, one is written while the others upload */
+#define OSS_MEDIA_HLS_MAX_UPLOAD_BUFFERS 8
 
 /**
  *  this enum describes the stream type.
@@ -19,7 +27,8 @@
 typedef enum {
     st_h264,
     st_aac,
-    st_mp3
+    st_mp3,
+    st_h265
 } stream_type_t;
 
 /**
@@ -37,7 +46,26 @@ typedef enum {
 } frame_type_t;
 
 /**
- *  this struct describes the hls frame infomation.
+ *  this enum describes the segment format.
+ */
+typedef enum {
+    sf_ts,      // MPEG-TS
+    sf_fmp4     // fragmented MP4, with an init segment for EXT-X-MAP
+} segment_format_t;
+
+/**
+ *  this struct describes a piece of frame data kept apart from the frame,
+ *  it holds whole nal units or adts frames. an empty piece is zeroed.
+ */
+typedef struct oss_media_hls_payload_s {
+    const uint8_t *pos;
+    const uint8_t *end;
+} oss_media_hls_payload_t;
+
+/**
+ *  this struct describes the hls frame infomation. the data of a frame
+ *  is prefix, [pos, end) and suffix, in this order, they are muxed
+ *  without being copied together first. zero the unused fields.
  */
 typedef struct oss_media_hls_frame_s {
     stream_type_t stream_type;
@@ -48,6 +76,8 @@ typedef struct oss_media_hls_frame_s {
     uint8_t  key:1;
     uint8_t *pos;
     uint8_t *end;
+    oss_media_hls_payload_t prefix;     // like an aud nal, clear in SAMPLE-AES
+    oss_media_hls_payload_t suffix;
 } oss_media_hls_frame_t;
 
 /**
@@ -62,19 +92,89 @@ typedef int (*file_handler_fn_t) (struct oss_media_hls_file_s *file);
 typedef struct oss_media_hls_m3u8_info_s {
     float duration;
     char url[OSS_MEDIA_M3U8_URL_LENGTH];
+    char key_uri[OSS_MEDIA_M3U8_URL_LENGTH]; // empty if ts is not encrypted
+    uint8_t sample_aes:1;                    // key_uri is a SAMPLE-AES key
+    char map_uri[OSS_MEDIA_M3U8_URL_LENGTH]; // the init segment of fmp4
+    uint64_t range_offset;                   // with range_length, the bytes
+    uint64_t range_length;                   // of url, 0 means all of it
 } oss_media_hls_m3u8_info_t;
 
+/**
+ *  this struct describes a segment of a playlist window. its url is the
+ *  url prefix of the window, the index and the url suffix.
+ */
+typedef struct oss_media_hls_segment_s {
+    int64_t index;              // -1 if the url has none, as byte ranges
+    float duration;
+    uint64_t range_offset;      // with range_length, the bytes
+    uint64_t range_length;      // of url, 0 means all of it
+    const char *key_uri;        // NULL if ts is not encrypted
+    uint8_t sample_aes:1;       // key_uri is a SAMPLE-AES key
+} oss_media_hls_segment_t;
+
+/**
+ *  this struct describes the segments of a playlist in a ring, the oldest
+ *  one is dropped in O(1) for a new one. the segments share the url parts,
+ *  the init segment, and one copy of each key uri.
+ */
+typedef struct oss_media_hls_window_s {
+    oss_media_hls_segment_t *segments;
+    int32_t capacity;
+    int32_t head;               // the oldest segment
+    int32_t count;
+    char url_prefix[OSS_MEDIA_M3U8_URL_LENGTH];
+    char url_suffix[16];
+    char map_uri[OSS_MEDIA_M3U8_URL_LENGTH]; // the init segment of fmp4
+    char *key_uri;              // of the newest segment, owned
+} oss_media_hls_window_t;
+
+/**
+ *  this struct describes a partial segment of LL-HLS.
+ */
+typedef struct oss_media_hls_part_info_s {
+    float duration;
+    char url[OSS_MEDIA_M3U8_URL_LENGTH];
+    uint8_t independent:1;      // the part has an idr frame
+    int64_t sequence;           // media sequence of the parent segment
+} oss_media_hls_part_info_t;
+
+/**
+ *  this struct describes a variant stream of a master playlist.
+ */
+typedef struct oss_media_hls_variant_s {
+    int32_t bandwidth;          // peak bits per second
+    char codecs[64];            // empty if not known
+    char resolution[16];        // empty for audio only
+    char url[OSS_MEDIA_M3U8_URL_LENGTH]; // the media playlist
+} oss_media_hls_variant_t;
+
 /**
  *  this struct describes the hls options.
  */
 typedef struct oss_media_hls_options_s {
     uint16_t video_pid;
     uint16_t audio_pid;
+    stream_type_t video_type;   // st_h264 or st_h265, for the PMT
+    stream_type_t audio_type;   // st_aac or st_mp3, for the PMT
     uint32_t hls_delay_ms;
+    segment_format_t format;
     uint8_t encrypt:1;
-    char    key[OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE];
+    uint8_t sample_aes:1;   // with encrypt, only encrypt the samples of ts
+    uint8_t key[OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE];
+    uint8_t iv[OSS_MEDIA_HLS_ENCRYPT_IV_SIZE];
     file_handler_fn_t handler_func;
     uint16_t pat_interval_frame_count;
+    uint32_t write_timeout_ms;
+    uint8_t drop_on_timeout:1; // a timed out flush is dropped, for files as
+                               // m3u8 which every flush writes whole
+    uint8_t upload_buffers; // with 2 or more, full buffers upload in background
+    uint32_t audio_pes_duration_ms; // ts: audio frames within it share a pes
+    uint32_t audio_pes_size;        // the most bytes of frames in such a pes
+    uint8_t byte_range:1;   // m3u8: segments are byte ranges, version 4
+    uint8_t record_iframes:1; // ts: key frames start with PAT/PMT, iframes
+    uint8_t audio_only:1;   // ts: the PMT has no video, the PCR is on audio
+    uint8_t single_put:1;   // ts: kept in memory, handed over once at its end
+    uint8_t chunked:1;      // ts: handed over after every frame
 } oss_media_hls_options_t;
 
 /**
@@ -85,16 +185,109 @@ typedef struct oss_media_hls_buf_s {
     unsigned int pos;
     unsigned int start;
     unsigned int end;
+    unsigned int part_len;  // LL-HLS: the bytes after start the part has
 } oss_media_hls_buf_t;
 
 /**
- *  this struct describes the hls file.
+ *  this struct describes the prebuilt PAT/PMT packets of hls file.
+ */
+typedef struct oss_media_hls_psi_s {
+    uint8_t pat[OSS_MEDIA_HLS_PACKET_SIZE];
+    uint8_t pmt[OSS_MEDIA_HLS_PACKET_SIZE];
+    uint16_t video_pid;
+    uint16_t audio_pid;
+    stream_type_t video_type;
+    stream_type_t audio_type;
+    uint8_t sample_aes;
+    uint8_t audio_only;
+    uint8_t audio_config[OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE];
+    uint8_t pat_continuity_counter;
+    uint8_t pmt_continuity_counter;
+} oss_media_hls_psi_t;
+
+/**
+ *  this struct describes the AES-128-CBC state of an encrypted hls file.
+ */
+typedef struct oss_media_hls_encrypt_s {
+    oss_media_aes_t aes;
+    unsigned int pos;   // the buffer data before pos is encrypted
+    uint8_t started:1;
+    uint8_t *sample_buf;    // SAMPLE-AES: the encrypted copy of a frame
+    uint8_t *nal_buf;       // SAMPLE-AES: a nal without emulation prevention
+    size_t sample_buf_size;
+    uint8_t audio_config[OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE]; // from first adts
+} oss_media_hls_encrypt_t;
+
+/**
+ *  this struct describes the background upload of a hls file. full buffers
+ *  are appended in order by a thread, frames go on into a spare buffer.
+ */
+typedef struct oss_media_hls_uploader_s {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    oss_media_hls_buf_t *queue[OSS_MEDIA_HLS_MAX_UPLOAD_BUFFERS]; // in order
+    int queue_size;
+    oss_media_hls_buf_t *spare[OSS_MEDIA_HLS_MAX_UPLOAD_BUFFERS];
+    int spare_size;
+    int error;          // the failed upload, returned by the next call
+    uint8_t stop:1;
+} oss_media_hls_uploader_t;
+
+/**
+ *  this struct describes the audio frames being packed into one pes, the
+ *  pes is written when the next frame does not fit or the file is flushed.
+ */
+typedef struct oss_media_hls_audio_pes_s {
+    uint8_t *buf;           // in the pool of oss media
+    uint32_t size;
+    uint32_t len;           // 0 if no frame is pending
+    stream_type_t stream_type;
+    uint64_t pts;           // of the first frame
+    uint8_t key:1;
+    uint32_t continuity_counter;    // of the first packet of the pes
+} oss_media_hls_audio_pes_t;
+
+/**
+ *  this struct describes a key frame of ts, the bytes from its PAT/PMT
+ *  to its last packet are a segment of an I-frame playlist.
+ */
+typedef struct oss_media_hls_iframe_s {
+    int64_t pts;
+    uint64_t offset;        // in the file
+    uint32_t length;
+} oss_media_hls_iframe_t;
+
+struct oss_media_fmp4_s;
+
+/**
+ *  this struct describes the hls file. from the time a full buffer is
+ *  queued for the upload thread until a flush has waited for the queue,
+ *  the thread owns the queued buffers and reads file, part_file and
+ *  options, the caller must not change them meanwhile. part_file is set
+ *  by oss_media_hls_set_part_file, which checks that.
  */
 typedef struct oss_media_hls_file_s {
     oss_media_file_t *file;
     oss_media_hls_buf_t *buffer;
     oss_media_hls_options_t options;
     int64_t frame_count;
+    oss_media_hls_psi_t psi;
+    oss_media_hls_encrypt_t encrypt;
+    char m3u8_key_uri[OSS_MEDIA_M3U8_URL_LENGTH]; // the last EXT-X-KEY written
+    uint8_t m3u8_key_sample_aes;
+    char m3u8_map_uri[OSS_MEDIA_M3U8_URL_LENGTH]; // the last EXT-X-MAP written
+    int64_t m3u8_sequence;          // media sequence of the playlist
+    oss_media_file_t *part_file;    // LL-HLS: the part also written to
+    struct oss_media_fmp4_s *fmp4;  // fmp4 state, allocated by the first frame
+    oss_media_hls_uploader_t *uploader; // started by the first full buffer
+    oss_media_hls_audio_pes_t audio_pes;
+    uint64_t length;                // bytes of ts packets written
+    oss_media_hls_iframe_t *iframes; // recorded since the caller took them
+    int32_t iframe_count;
+    int32_t iframe_capacity;
+    uint8_t timed_out;              // an upload timed out within a frame,
+                                    // only used by the muxing thread
 } oss_media_hls_file_t;
 
 /**
@@ -109,15 +302,70 @@ oss_media_hls_file_t* oss_media_hls_open(char *bucket_name,
                                          auth_fn_t auth_func);
 
 /**
- *  write hls frame.
+ *  open hls file with options.single_put, nothing is requested to oss at
+ *  open. the buffer grows with the ts data instead of being flushed, the
+ *  whole file is put to oss in one request by oss_media_hls_end_segment
+ *  or oss_media_hls_close, so a retried put writes the same object. only
+ *  for ts files which are not byte ranges and have no partial segments.
+ *
+ *  return values:
+ *      On success, a pointer to the oss_media_hls_file_t
+ *      otherwise, a null pointer is returned
+ */
+oss_media_hls_file_t* oss_media_hls_open_single_put(char *bucket_name,
+                                                    char *object_key,
+                                                    auth_fn_t auth_func);
+
+/**
+ *  open hls file with options.chunked, one put in chunked transfer
+ *  encoding is started at open. the data of every frame is handed over
+ *  once it is muxed, so it is on the wire while the file is written. the
+ *  put is ended by oss_media_hls_end_segment or oss_media_hls_close, the
+ *  object is not stored if it fails. only for ts files which are not
+ *  byte ranges and have no partial segments.
+ *
+ *  return values:
+ *      On success, a pointer to the oss_media_hls_file_t
+ *      otherwise, a null pointer is returned
+ */
+oss_media_hls_file_t* oss_media_hls_open_chunked(char *bucket_name,
+                                                char *object_key,
+                                                auth_fn_t auth_func);
+
+/**
+ *  write hls frame. with options.sample_aes, only the slices of h.264
+ *  and the raw data of adts frames are encrypted, as SAMPLE-AES defines.
+ *  with options.format sf_fmp4, the frame is added to a moof/mdat fragment.
+ *  with options.audio_pes_duration_ms, aac and mp3 frames are packed into
+ *  one pes until it spans that duration or audio_pes_size bytes, the
+ *  continuity counter of the frame is set as if its pes had been written.
+ *  a frame is not cut by an upload which exceeds write_timeout_ms, the
+ *  buffer grows and its data is uploaded by the next flush.
  *
  *  return values:
  *      upon successful completion 0 is returned
+ *      OSS_MEDIA_TIMEOUT is returned if flushing data exceeds write_timeout_ms,
+ *      the frame has been written
  *      otherwise -1 is returned
  */
 int oss_media_hls_write_frame(oss_media_hls_frame_t *frame,
                               oss_media_hls_file_t *file);
 
+/**
+ *  write n hls frames in one go, the output is the same as writing them
+ *  one by one. the buffer space of a frame is made once rather than per
+ *  packet, fmp4 and SAMPLE-AES files write the frames one by one. if a
+ *  frame fails, the frames before it have been written, a frame in which
+ *  an upload times out is written as well.
+ *
+ *  return values:
+ *      upon successful completion 0 is returned
+ *      OSS_MEDIA_TIMEOUT is returned if flushing data exceeds write_timeout_ms
+ *      otherwise -1 is returned
+ */
+int oss_media_hls_write_frames(oss_media_hls_frame_t frames[], int n,
+                               oss_media_hls_file_t *file);
+
 /**
  *  write m3u8 head infomation.
  *
@@ -130,7 +378,9 @@ void oss_media_hls_begin_m3u8(int32_t max_duration,
                               oss_media_hls_file_t *file);
 
 /**
- *  write m3u8 infomation.
+ *  write m3u8 infomation, an EXT-X-KEY line is written before the
+ *  first ts whose key_uri or method differs from the previous one,
+ *  and an EXT-X-MAP line before the first segment with a new map_uri.
  *
  *  return values:
  *      upon successful completion 0 is returned
@@ -140,6 +390,120 @@ int oss_media_hls_write_m3u8(int size,
                              oss_media_hls_m3u8_info_t m3u8[],
                              oss_media_hls_file_t *file);
 
+/**
+ *  @brief  set up an empty window of capacity segments
+ *  @return:
+ *      upon successful completion 0 is returned
+ *      otherwise -1 is returned
+ */
+int oss_media_hls_window_init(oss_media_hls_window_t *window,
+                              int32_t capacity);
+
+/**
+ *  free the segments and key uris of window.
+ */
+void oss_media_hls_window_destroy(oss_media_hls_window_t *window);
+
+/**
+ *  @brief  add a segment as the newest, the oldest is dropped if the
+ *          window is full
+ *  @param[in]  key_uri copied unless it is the one of the newest segment,
+ *              NULL if ts is not encrypted
+ *  @return:
+ *      the segment to fill in, key_uri is set
+ *      NULL is returned if the key uri can not be copied
+ */
+oss_media_hls_segment_t *oss_media_hls_window_push(
+        oss_media_hls_window_t *window, const char *key_uri);
+
+/**
+ *  @brief  make room for capacity segments, which keep their order
+ *  @return:
+ *      upon successful completion 0 is returned
+ *      otherwise -1 is returned, the window is as it was
+ */
+int oss_media_hls_window_grow(oss_media_hls_window_t *window,
+                              int32_t capacity);
+
+/**
+ *  drop the oldest segment of window, which must not be empty.
+ */
+void oss_media_hls_window_pop(oss_media_hls_window_t *window);
+
+/**
+ *  the i-th oldest segment of window.
+ */
+oss_media_hls_segment_t *oss_media_hls_window_at(
+        const oss_media_hls_window_t *window, int32_t i);
+
+/**
+ *  write the segments of window as oss_media_hls_write_m3u8 does.
+ *
+ *  return values:
+ *      upon successful completion 0 is returned
+ *      otherwise -1 is returned
+ */
+int oss_media_hls_write_window_m3u8(const oss_media_hls_window_t *window,
+                                    oss_media_hls_file_t *file);
+
+/**
+ *  write m3u8 head infomation of LL-HLS, with EXT-X-SERVER-CONTROL
+ *  and EXT-X-PART-INF.
+ */
+void oss_media_hls_begin_ll_m3u8(int32_t max_duration,
+                                 int32_t sequence,
+                                 float part_target,
+                                 oss_media_hls_file_t *file);
+
+/**
+ *  write m3u8 infomation of LL-HLS, the EXT-X-PART lines of parts[] are
+ *  written before the segment of their sequence. a last m3u8[] with an
+ *  empty url is the segment being written, only its parts are listed.
+ *  preload_uri, if not NULL, is the next part for EXT-X-PRELOAD-HINT.
+ *
+ *  return values:
+ *      upon successful completion 0 is returned
+ *      otherwise -1 is returned
+ */
+int oss_media_hls_write_ll_m3u8(int size,
+                                oss_media_hls_m3u8_info_t m3u8[],
+                                int part_size,
+                                oss_media_hls_part_info_t parts[],
+                                const char *preload_uri,
+                                oss_media_hls_file_t *file);
+
+/**
+ *  write the segments of window as oss_media_hls_write_ll_m3u8 does.
+ *  pending, if not NULL, is the segment being written after them, only
+ *  its parts are listed.
+ */
+int oss_media_hls_write_window_ll_m3u8(const oss_media_hls_window_t *window,
+                                       const oss_media_hls_segment_t *pending,
+                                       int part_size,
+                                       oss_media_hls_part_info_t parts[],
+                                       const char *preload_uri,
+                                       oss_media_hls_file_t *file);
+
+/**
+ *  write m3u8 head infomation of an I-frame playlist, with
+ *  EXT-X-I-FRAMES-ONLY. options.byte_range of file is set.
+ */
+void oss_media_hls_begin_iframe_m3u8(int32_t max_duration,
+                                     int32_t sequence,
+                                     oss_media_hls_file_t *file);
+
+/**
+ *  write a master playlist with an EXT-X-STREAM-INF for each variant, and
+ *  flush it.
+ *
+ *  return values:
+ *      upon successful completion 0 is returned
+ *      otherwise -1 is returned
+ */
+int oss_media_hls_write_master_m3u8(int size,
+                                    oss_media_hls_variant_t variants[],
+                                    oss_media_hls_file_t *file);
+
 /**
  *  write m3u8 end infomation for vod
  *
@@ -150,16 +514,60 @@ int oss_media_hls_write_m3u8(int size,
 void oss_media_hls_end_m3u8(oss_media_hls_file_t *file);
 
 /**
- *  flush hls data to oss.
+ *  hand the data written so far to the handler since the buffer is full,
+ *  the fmp4 fragment being written is ended first. with
+ *  options.upload_buffers and the default handler, a thread appends it
+ *  to oss and a spare buffer is taken, the caller only waits when every
+ *  buffer is being uploaded. file and part_file must not change until a
+ *  flush.
  *
  *  return values:
  *      upon successful completion 0 is returned
+ *      OSS_MEDIA_TIMEOUT is returned if an upload exceeds write_timeout_ms
+ *      otherwise -1 is returned
+ */
+int oss_media_hls_upload(oss_media_hls_file_t *file);
+
+/**
+ *  flush hls data to oss, the fmp4 fragment being written is ended first
+ *  and the buffers being uploaded in background are waited for. the data
+ *  of options.single_put is kept until the end of the file.
+ *
+ *  return values:
+ *      upon successful completion 0 is returned
+ *      OSS_MEDIA_TIMEOUT is returned if flushing data exceeds write_timeout_ms
  *      otherwise -1 is returned
  */
 int oss_media_hls_flush(oss_media_hls_file_t *file);
 
 /**
- *  close hls file.
+ *  set the part which the data of file is also written to, for LL-HLS,
+ *  NULL for none. the data written before goes to the part it was written
+ *  for, so the part is only replaced after a flush of file.
+ *
+ *  return values:
+ *      upon successful completion 0 is returned
+ *      otherwise -1 is returned, data of the part is still to be uploaded
+ */
+int oss_media_hls_set_part_file(oss_media_hls_file_t *file,
+                                oss_media_file_t *part_file);
+
+/**
+ *  end a segment within the file and flush it, the last block of an
+ *  AES-128 file is padded. the next frame starts a segment with PAT/PMT
+ *  and a cbc chain from options.key and options.iv, which may be changed
+ *  in between. used by segments which are byte ranges of one object.
+ *
+ *  return values:
+ *      upon successful completion 0 is returned
+ *      OSS_MEDIA_TIMEOUT is returned if flushing data exceeds write_timeout_ms
+ *      otherwise -1 is returned
+ */
+int oss_media_hls_end_segment(oss_media_hls_file_t *file);
+
+/**
+ *  close hls file, the last block of an encrypted file is padded
+ *  with PKCS#7 before the final flush.
  *
  *  return values:
  *      upon successful completion 0 is returned
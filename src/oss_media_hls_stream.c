@@ -1,4 +1,13 @@
 #include "oss_media_hls_stream.h"
+#include "oss_media_fmp4.h"
+#include "oss_media_nal.h"
+
+static char* oss_media_create_ts_full_url(aos_pool_t *pool,
+        oss_media_file_t *file);
+static int oss_media_create_url(char *url, oss_media_file_t *file,
+                                oss_media_hls_stream_t *stream);
+static char *oss_media_get_segment_surfix(
+        const oss_media_hls_stream_options_t *options);
 
 static int16_t oss_media_get_digit_num(int32_t value)
 {
@@ -18,14 +27,22 @@ static char *oss_media_create_new_ts_file_name(
         
     int16_t pos_digit_num = oss_media_get_digit_num(stream->ts_file_index);
     char pos_str[pos_digit_num + 1];
+    char *surfix = oss_media_get_segment_surfix(options);
+
+    // "<ts_name_prefix>.ts" has all segments, the index is only counted
+    if (options->byte_range) {
+        stream->ts_file_index++;
+        return apr_psprintf(stream->pool, "%s%s", options->ts_name_prefix,
+                            surfix);
+    }
+
     sprintf(pos_str, "%"APR_INT64_T_FMT, stream->ts_file_index++);
     
     return apr_psprintf(stream->pool, "%.*s%.*s%.*s",
                         (int)strlen(options->ts_name_prefix), 
                         options->ts_name_prefix,
                         (int)strlen(pos_str), pos_str,
-                        (int)strlen(OSS_MEDIA_TS_FILE_SURFIX), 
-                        OSS_MEDIA_TS_FILE_SURFIX);
+                        (int)strlen(surfix), surfix);
 }
 
 void deep_copy_hls_stream_options(oss_media_hls_stream_options_t* dst,
@@ -40,6 +57,21 @@ void deep_copy_hls_stream_options(oss_media_hls_stream_options_t* dst,
     dst->audio_sample_rate = src->audio_sample_rate;
     dst->hls_time = src->hls_time;
     dst->hls_list_size = src->hls_list_size;
+    dst->encrypt = src->encrypt;
+    dst->sample_aes = src->sample_aes;
+    dst->key_rotate_segments = src->key_rotate_segments;
+    dst->key_func = src->key_func;
+    dst->format = src->format;
+    dst->part_time_ms = src->part_time_ms;
+    dst->video_type = src->video_type;
+    dst->audio_type = src->audio_type;
+    dst->audio_pes_duration_ms = src->audio_pes_duration_ms;
+    dst->byte_range = src->byte_range;
+    dst->iframe_m3u8_name = src->iframe_m3u8_name != NULL ? 
+                            strdup(src->iframe_m3u8_name) : NULL;
+    dst->audio_only = src->audio_only;
+    dst->single_put = src->single_put;
+    dst->chunked = src->chunked;
 }
 
 void free_options(oss_media_hls_stream_options_t *options)
@@ -53,25 +85,392 @@ void free_options(oss_media_hls_stream_options_t *options)
         free(options->ts_name_prefix);
     if (options->m3u8_name != NULL)
         free(options->m3u8_name);
+    if (options->iframe_m3u8_name != NULL)
+        free(options->iframe_m3u8_name);
 
     free(options);
 }
 
+/*
+ * a live segment must not block the ingest longer than its own duration,
+ * OSS_MEDIA_TIMEOUT is returned instead. a playlist which can not be
+ * uploaded in time is dropped, the next one replaces it whole, while ts
+ * data is kept for the next flush and its segment is not listed until then.
+ */
+static void oss_media_set_live_write_timeout(
+        const oss_media_hls_stream_options_t *options,
+        oss_media_hls_file_t *file,
+        int is_playlist)
+{
+    if (options->is_live && options->hls_time > 0) {
+        file->options.write_timeout_ms = options->hls_time * 1000;
+        file->options.drop_on_timeout = is_playlist ? 1 : 0;
+    }
+}
+
+static stream_type_t oss_media_get_audio_type(
+        const oss_media_hls_stream_options_t *options)
+{
+    return options->audio_type == st_mp3 ? st_mp3 : st_aac;
+}
+
+static void oss_media_set_segment_format(
+        const oss_media_hls_stream_options_t *options,
+        oss_media_hls_file_t *file)
+{
+    file->options.format = options->format;
+    file->options.video_type = options->video_type;
+    file->options.audio_type = oss_media_get_audio_type(options);
+    file->options.audio_pes_duration_ms = options->audio_pes_duration_ms > 0 ?
+                                          options->audio_pes_duration_ms : 0;
+    file->options.byte_range = options->byte_range ? 1 : 0;
+    file->options.record_iframes = options->iframe_m3u8_name != NULL ? 1 : 0;
+    file->options.audio_only = options->audio_only ? 1 : 0;
+}
+
+static int oss_media_is_low_latency(
+        const oss_media_hls_stream_options_t *options)
+{
+    return options->is_live && options->part_time_ms > 0;
+}
+
+static oss_media_hls_file_t *oss_media_open_ts_file(char *ts_file_name,
+        auth_fn_t auth_func, const oss_media_hls_stream_options_t *options)
+{
+    if (options->single_put) {
+        return oss_media_hls_open_single_put(options->bucket_name,
+                                             ts_file_name, auth_func);
+    }
+    if (options->chunked) {
+        return oss_media_hls_open_chunked(options->bucket_name,
+                                          ts_file_name, auth_func);
+    }
+    return oss_media_hls_open(options->bucket_name, ts_file_name, auth_func);
+}
+
+static char *oss_media_get_segment_surfix(
+        const oss_media_hls_stream_options_t *options)
+{
+    return options->format == sf_fmp4 ? 
+           OSS_MEDIA_M4S_FILE_SURFIX : OSS_MEDIA_TS_FILE_SURFIX;
+}
+
+/*
+ * the default key is random and saved as "<ts_name_prefix><sequence>.key",
+ * access to it is controlled by the acl of the bucket.
+ */
+static int oss_media_create_key(int64_t sequence,
+                                auth_fn_t auth_func,
+                                oss_media_hls_stream_t *stream)
+{
+    int ret = -1;
+    char *key_name;
+    aos_pool_t *sub_pool;
+    oss_media_file_t *file;
+    oss_media_hls_key_t *key = &stream->key;
+
+    if (APR_SUCCESS != apr_generate_random_bytes(key->key, sizeof(key->key))) {
+        aos_error_log("generate random key failed.");
+        return -1;
+    }
+
+    aos_pool_create(&sub_pool, stream->pool);
+    key_name = apr_psprintf(sub_pool, "%s%"APR_INT64_T_FMT"%s",
+                            stream->options->ts_name_prefix, sequence,
+                            OSS_MEDIA_KEY_FILE_SURFIX);
+
+    file = oss_media_file_open(stream->options->bucket_name, key_name, 
+                               "w", auth_func);
+    if (file == NULL) {
+        aos_error_log("open key file[%s] failed.", key_name);
+        aos_pool_destroy(sub_pool);
+        return -1;
+    }
+
+    if (oss_media_file_write(file, key->key, sizeof(key->key)) 
+        != sizeof(key->key))
+    {
+        aos_error_log("write key file[%s] failed.", key_name);
+    } else {
+        ret = oss_media_create_url(key->uri, file, stream);
+    }
+
+    oss_media_file_close(file);
+    aos_pool_destroy(sub_pool);
+    return ret;
+}
+
+/*
+ * ts files are encrypted with AES-128 or SAMPLE-AES and their media sequence
+ * number as iv, which is what players use when EXT-X-KEY has no IV attribute.
+ */
+static int oss_media_set_ts_encrypt(auth_fn_t auth_func,
+                                    oss_media_hls_stream_t *stream)
+{
+    int i;
+    int ret;
+    int64_t sequence = stream->ts_file_index - 1;
+    const oss_media_hls_stream_options_t *options = stream->options;
+    oss_media_hls_file_t *file = stream->ts_file;
+
+    if (!options->encrypt) {
+        return 0;
+    }
+
+    if (stream->key_sequence == -1 || (options->key_rotate_segments > 0 
+        && sequence - stream->key_sequence >= options->key_rotate_segments))
+    {
+        if (options->key_func != NULL) {
+            ret = options->key_func(sequence, &stream->key);
+        } else {
+            ret = oss_media_create_key(sequence, auth_func, stream);
+        }
+        if (ret != 0) {
+            aos_error_log("create key for ts file[%s] failed.",
+                          file->file->object_key);
+            return -1;
+        }
+        stream->key_sequence = sequence;
+    }
+
+    file->options.encrypt = 1;
+    file->options.sample_aes = options->sample_aes ? 1 : 0;
+    memcpy(file->options.key, stream->key.key, sizeof(file->options.key));
+    memset(file->options.iv, 0, sizeof(file->options.iv));
+    for (i = 0; i < 8; i++) {
+        file->options.iv[sizeof(file->options.iv) - 1 - i] = sequence >> (8 * i);
+    }
+
+    return 0;
+}
+
+// pts and dts start at 5000, the counter at 1
+static oss_media_hls_frame_t *oss_media_create_frame(stream_type_t type) {
+    oss_media_hls_frame_t *frame;
+
+    frame = (oss_media_hls_frame_t*)malloc(sizeof(oss_media_hls_frame_t));
+    memset(frame, 0, sizeof(oss_media_hls_frame_t));
+    frame->stream_type = type;
+    frame->frame_type = ft_unspecified;
+    frame->continuity_counter = 1;
+    frame->key = 1;
+    frame->pts = 5000;
+    frame->dts = 5000;
+    return frame;
+}
+
+/*
+ * LL-HLS parts are saved as "<ts_name_prefix><sequence>.<part>.ts", they
+ * get the same data as the segment which is written along with them.
+ */
+static int oss_media_create_part_file_name(char *name,
+                                           int64_t sequence,
+                                           int32_t part,
+                                           const oss_media_hls_stream_t *stream)
+{
+    int len = snprintf(name, OSS_MEDIA_M3U8_URL_LENGTH,
+                       "%s%"APR_INT64_T_FMT".%d%s",
+                       stream->options->ts_name_prefix, sequence, part,
+                       oss_media_get_segment_surfix(stream->options));
+    if (len >= OSS_MEDIA_M3U8_URL_LENGTH) {
+        aos_error_log("part name of ts file[%s] is too long.",
+                      stream->ts_file->file->object_key);
+        return -1;
+    }
+    return 0;
+}
+
+static int oss_media_create_part_url(char *url,
+                                     int64_t sequence,
+                                     int32_t part,
+                                     oss_media_hls_stream_t *stream)
+{
+    char name[OSS_MEDIA_M3U8_URL_LENGTH];
+    oss_media_file_t file = *stream->ts_file->file;
+
+    if (0 != oss_media_create_part_file_name(name, sequence, part, stream)) {
+        return -1;
+    }
+    file.object_key = name;
+    return oss_media_create_url(url, &file, stream);
+}
+
+static int oss_media_open_part(oss_media_hls_stream_t *stream) {
+    oss_media_file_t *file;
+
+    if (0 != oss_media_create_part_file_name(stream->part_name,
+                    stream->ts_file_index - 1, stream->part_index, stream))
+    {
+        return -1;
+    }
+
+    file = oss_media_file_open(stream->options->bucket_name, stream->part_name,
+                               "aw", stream->ts_file->file->auth_func);
+    if (file == NULL) {
+        aos_error_log("open part file[%s] failed.", stream->part_name);
+        return -1;
+    }
+
+    if (0 != oss_media_hls_set_part_file(stream->ts_file, file)) {
+        oss_media_file_close(file);
+        return -1;
+    }
+    // every part of ts starts with PAT/PMT
+    stream->ts_file->frame_count = 0;
+    stream->current_part_begin_pts = -1;
+    stream->part_independent = 0;
+    return 0;
+}
+
+static int oss_media_end_part(float duration, oss_media_hls_stream_t *stream) {
+    int ret = -1;
+    int32_t capacity;
+    oss_media_hls_part_info_t *parts;
+    oss_media_file_t *file = stream->ts_file->part_file;
+
+    if (file == NULL) {
+        return 0;
+    }
+    if (0 != oss_media_hls_set_part_file(stream->ts_file, NULL)) {
+        return -1;
+    }
+
+    // no frame since the part was opened, there is nothing to list
+    if (stream->current_part_begin_pts == -1) {
+        oss_media_file_close(file);
+        return 0;
+    }
+
+    if (stream->part_count == stream->part_capacity) {
+        capacity = stream->part_capacity > 0 ? stream->part_capacity * 2 : 16;
+        parts = (oss_media_hls_part_info_t*)realloc(stream->parts,
+                sizeof(oss_media_hls_part_info_t) * capacity);
+        if (parts == NULL) {
+            aos_error_log("alloc parts of m3u8 file failed.");
+            oss_media_file_close(file);
+            return -1;
+        }
+        stream->parts = parts;
+        stream->part_capacity = capacity;
+    }
+
+    parts = &stream->parts[stream->part_count];
+    if (0 == oss_media_create_url(parts->url, file, stream)) {
+        stream->part_count++;
+        parts->duration = duration;
+        parts->independent = stream->part_independent || !stream->has_video;
+        parts->sequence = stream->ts_file_index - 1;
+        stream->part_index++;
+        ret = 0;
+    }
+
+    oss_media_file_close(file);
+    return ret;
+}
+
+// only the parts of the last segment and the segment being written are kept
+static void oss_media_drop_parts(int64_t sequence,
+                                 oss_media_hls_stream_t *stream)
+{
+    int32_t i = 0;
+
+    while (i < stream->part_count && stream->parts[i].sequence < sequence) {
+        i++;
+    }
+    memmove(stream->parts, stream->parts + i,
+            sizeof(oss_media_hls_part_info_t) * (stream->part_count - i));
+    stream->part_count -= i;
+}
+
 oss_media_hls_stream_t* oss_media_hls_stream_open(auth_fn_t auth_func,
         const oss_media_hls_stream_options_t *options)
 {
     oss_media_hls_stream_t *stream;
+
+    // a part can not be decrypted without the cbc chain of the parts before
+    if (oss_media_is_low_latency(options) && options->encrypt
+        && !options->sample_aes)
+    {
+        aos_error_log("partial segments are not support with AES-128.");
+        return NULL;
+    }
+
+    // parts are objects of their own, they can not be ranges of the segment
+    if (oss_media_is_low_latency(options) && options->byte_range) {
+        aos_error_log("partial segments are not support with byte ranges.");
+        return NULL;
+    }
+
+    // a segment is one put, parts and ranges go to oss on their own
+    if ((options->single_put || options->chunked)
+        && (options->format == sf_fmp4 || options->byte_range
+            || oss_media_is_low_latency(options)
+            || (options->single_put && options->chunked)))
+    {
+        aos_error_log("single or chunked put is only support in ts without "
+                      "partial segments or byte ranges.");
+        return NULL;
+    }
+
+    // ranges of fmp4 need the init segment, of AES-128 the cbc chain
+    if (options->iframe_m3u8_name != NULL && (options->format == sf_fmp4
+            || (options->encrypt && !options->sample_aes)))
+    {
+        aos_error_log("i-frame playlists are only support in clear or "
+                      "SAMPLE-AES ts.");
+        return NULL;
+    }
+
+    // fmp4 has no hvc1 sample entry, SAMPLE-AES no hevc ts format
+    if (options->video_type == st_h265
+        && (options->format == sf_fmp4
+            || (options->encrypt && options->sample_aes)))
+    {
+        aos_error_log("hevc is only support in clear or AES-128 ts.");
+        return NULL;
+    }
+
+    // neither has a format for mp3
+    if (oss_media_get_audio_type(options) == st_mp3
+        && (options->format == sf_fmp4
+            || (options->encrypt && options->sample_aes)))
+    {
+        aos_error_log("mp3 is only support in clear or AES-128 ts.");
+        return NULL;
+    }
+
     stream = (oss_media_hls_stream_t*)malloc(sizeof(oss_media_hls_stream_t));
     stream->options = (oss_media_hls_stream_options_t*)malloc(sizeof(oss_media_hls_stream_options_t));
     deep_copy_hls_stream_options(stream->options, options);
     stream->ts_file_index = 0;
     stream->current_file_begin_pts = -1;
+    memset(&stream->key, 0, sizeof(stream->key));
+    stream->key_sequence = -1;
+    stream->map_uri[0] = '\0';
+    stream->parts = NULL;
+    stream->part_count = 0;
+    stream->part_capacity = 0;
+    stream->part_index = 0;
+    stream->current_part_begin_pts = -1;
+    stream->part_independent = 0;
+    stream->has_video = 0;
+    memset(&stream->url_prefix, 0, sizeof(stream->url_prefix));
+    stream->range_offset = 0;
+    stream->adts_count = 0;
+    stream->adts_index = 0;
+    stream->adts_end = NULL;
+    stream->iframe_m3u8_file = NULL;
+    memset(&stream->iframe_window, 0, sizeof(stream->iframe_window));
+    stream->iframe_segment_counts = NULL;
+    stream->iframe_segment_head = 0;
+    stream->iframe_segments = 0;
+    stream->iframe_sequence = 0;
+    stream->next_segment_pts = -1;
 
     aos_pool_create(&stream->pool, NULL);
 
     char *ts_file_name = oss_media_create_new_ts_file_name(options, stream);
-    stream->ts_file = oss_media_hls_open(options->bucket_name, 
-            ts_file_name, auth_func);
+    stream->ts_file = oss_media_open_ts_file(ts_file_name, auth_func, options);
     if (stream->ts_file == NULL) {
         aos_error_log("open ts file[%s] failed.", ts_file_name);
         free_options(stream->options);
@@ -89,37 +488,96 @@ oss_media_hls_stream_t* oss_media_hls_stream_open(auth_fn_t auth_func,
         return NULL;
     }
 
+    if (options->iframe_m3u8_name != NULL) {
+        stream->iframe_m3u8_file = oss_media_hls_open(options->bucket_name,
+                options->iframe_m3u8_name, auth_func);
+        if (stream->iframe_m3u8_file == NULL) {
+            aos_error_log("open m3u8 file[%s] failed.",
+                          options->iframe_m3u8_name);
+            oss_media_hls_close(stream->m3u8_file);
+            oss_media_hls_close(stream->ts_file);
+            aos_pool_destroy(stream->pool);
+            free_options(stream->options);
+            free(stream);
+            return NULL;
+        }
+        oss_media_set_live_write_timeout(options, stream->iframe_m3u8_file, 1);
+        if (options->is_live) {
+            stream->iframe_m3u8_file->file->mode = "w";
+            stream->iframe_segment_counts = (int32_t*)malloc(
+                    sizeof(int32_t) * options->hls_list_size);
+        }
+        if ((options->is_live && stream->iframe_segment_counts == NULL)
+            || 0 != oss_media_hls_window_init(&stream->iframe_window,
+                    options->is_live ? options->hls_list_size : 1))
+        {
+            aos_error_log("alloc iframes of m3u8 file[%s] failed.",
+                          options->iframe_m3u8_name);
+            free(stream->iframe_segment_counts);
+            oss_media_hls_window_destroy(&stream->iframe_window);
+            oss_media_hls_close(stream->iframe_m3u8_file);
+            oss_media_hls_close(stream->m3u8_file);
+            oss_media_hls_close(stream->ts_file);
+            aos_pool_destroy(stream->pool);
+            free_options(stream->options);
+            free(stream);
+            return NULL;
+        }
+    }
+
+    oss_media_set_live_write_timeout(options, stream->ts_file, 0);
+    oss_media_set_live_write_timeout(options, stream->m3u8_file, 1);
+    oss_media_set_segment_format(options, stream->ts_file);
+    oss_media_set_segment_format(options, stream->m3u8_file);
+
+    if (0 != oss_media_set_ts_encrypt(auth_func, stream)) {
+        aos_error_log("set encrypt of ts file[%s] failed.", ts_file_name);
+        oss_media_hls_close(stream->iframe_m3u8_file);
+        free(stream->iframe_segment_counts);
+        oss_media_hls_window_destroy(&stream->iframe_window);
+        oss_media_hls_close(stream->m3u8_file);
+        oss_media_hls_close(stream->ts_file);
+        aos_pool_destroy(stream->pool);
+        free_options(stream->options);
+        free(stream);
+        return NULL;
+    }
+
+    if (oss_media_is_low_latency(options) && 0 != oss_media_open_part(stream)) {
+        aos_error_log("open part of ts file[%s] failed.", ts_file_name);
+        oss_media_hls_close(stream->iframe_m3u8_file);
+        free(stream->iframe_segment_counts);
+        oss_media_hls_window_destroy(&stream->iframe_window);
+        oss_media_hls_close(stream->m3u8_file);
+        oss_media_hls_close(stream->ts_file);
+        aos_pool_destroy(stream->pool);
+        free_options(stream->options);
+        free(stream);
+        return NULL;
+    }
+
     // update m3u8 file mode to 'w' for live scene
     if (options->is_live) {
         stream->m3u8_file->file->mode = "w";
-        stream->m3u8_infos = (oss_media_hls_m3u8_info_t*)malloc(
-                sizeof(oss_media_hls_m3u8_info_t) * options->hls_list_size);
-    } else {
-        stream->m3u8_infos = (oss_media_hls_m3u8_info_t*)malloc(
-                sizeof(oss_media_hls_m3u8_info_t));
+    }
+    if (0 != oss_media_hls_window_init(&stream->m3u8_window,
+                    options->is_live ? options->hls_list_size : 1))
+    {
+        oss_media_hls_close(stream->iframe_m3u8_file);
+        free(stream->iframe_segment_counts);
+        oss_media_hls_window_destroy(&stream->iframe_window);
+        free(stream->parts);
+        oss_media_hls_close(stream->m3u8_file);
+        oss_media_hls_close(stream->ts_file);
+        aos_pool_destroy(stream->pool);
+        free_options(stream->options);
+        free(stream);
+        return NULL;
     }
 
-    stream->video_frame = 
-        (oss_media_hls_frame_t*)malloc(sizeof(oss_media_hls_frame_t));
-    stream->video_frame->stream_type = st_h264;
-    stream->video_frame->frame_type = ft_unspecified;
-    stream->video_frame->continuity_counter = 1;
-    stream->video_frame->key = 1;
-    stream->video_frame->pts = 5000;
-    stream->video_frame->dts = 5000;
-    stream->video_frame->pos = NULL;
-    stream->video_frame->end = NULL;
-
+    stream->video_frame = oss_media_create_frame(options->video_type);
     stream->audio_frame = 
-        (oss_media_hls_frame_t*)malloc(sizeof(oss_media_hls_frame_t));
-    stream->audio_frame->stream_type = st_aac;
-    stream->audio_frame->frame_type = ft_unspecified;
-    stream->audio_frame->continuity_counter = 1;
-    stream->audio_frame->key = 1;
-    stream->audio_frame->pts = 5000;
-    stream->audio_frame->dts = 5000;
-    stream->audio_frame->pos = NULL;
-    stream->audio_frame->end = NULL;
+        oss_media_create_frame(oss_media_get_audio_type(options));
 
     return stream;
 }
@@ -154,106 +612,447 @@ static char* oss_media_create_ts_full_url(aos_pool_t *pool,
                         (int)strlen(req.uri), req.uri);
 }
 
-static void oss_media_set_m3u8_info(int32_t pos,
-                                    float duration,
-                                    oss_media_hls_stream_t *stream)
+/*
+ * the url of an object is the prefix of its bucket and its key, the prefix
+ * is made by the oss sdk once instead of for every segment and part.
+ */
+static int oss_media_create_url(char *url, oss_media_file_t *file,
+                                oss_media_hls_stream_t *stream)
 {
+    oss_media_hls_url_prefix_t *cache = &stream->url_prefix;
+    oss_media_file_t prefix_file;
     aos_pool_t *sub_pool;
-    aos_pool_create(&sub_pool, stream->pool);
-    char *ts_url = oss_media_create_ts_full_url(sub_pool, stream->ts_file->file);
-    memcpy(stream->m3u8_infos[pos].url, ts_url, strlen(ts_url) + 1);
-    aos_pool_destroy(sub_pool);
-    
-    stream->m3u8_infos[pos].duration = duration;
+    char *prefix;
+
+    if (cache->endpoint == NULL || cache->is_cname != file->is_cname
+        || strcmp(cache->endpoint, file->endpoint) != 0
+        || strcmp(cache->bucket_name, file->bucket_name) != 0)
+    {
+        prefix_file = *file;
+        prefix_file.object_key = "";
+        aos_pool_create(&sub_pool, stream->pool);
+        prefix = oss_media_create_ts_full_url(sub_pool, &prefix_file);
+        if (strlen(prefix) >= sizeof(cache->prefix)) {
+            aos_error_log("url prefix[%s] is too long.", prefix);
+            aos_pool_destroy(sub_pool);
+            return -1;
+        }
+        strcpy(cache->prefix, prefix);
+        aos_pool_destroy(sub_pool);
+
+        cache->endpoint = apr_psprintf(stream->pool, "%s", file->endpoint);
+        cache->bucket_name = apr_psprintf(stream->pool, "%s", file->bucket_name);
+        cache->is_cname = file->is_cname;
+    }
+
+    if (snprintf(url, OSS_MEDIA_M3U8_URL_LENGTH, "%s%s", cache->prefix,
+                 file->object_key) >= OSS_MEDIA_M3U8_URL_LENGTH)
+    {
+        aos_error_log("url of object[%s] is too long.", file->object_key);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * the segment being written joins the window, the oldest one is dropped
+ * once the window is full. the url is kept as the window url prefix and
+ * suffix around the index, the same for every segment of the stream.
+ */
+static int oss_media_set_m3u8_info(float duration,
+                                   oss_media_hls_stream_t *stream)
+{
+    oss_media_hls_window_t *window = &stream->m3u8_window;
+    oss_media_hls_segment_t *segment;
+    oss_media_hls_file_t *file = stream->ts_file;
+    char url[OSS_MEDIA_M3U8_URL_LENGTH];
+
+    if (0 != oss_media_create_url(url, file->file, stream)) {
+        return -1;
+    }
+    if (snprintf(window->url_prefix, sizeof(window->url_prefix), "%s%s",
+                 stream->url_prefix.prefix, stream->options->ts_name_prefix)
+        >= (int)sizeof(window->url_prefix))
+    {
+        aos_error_log("url prefix of ts[%s] is too long.",
+                      stream->options->ts_name_prefix);
+        return -1;
+    }
+    strcpy(window->url_suffix, oss_media_get_segment_surfix(stream->options));
+    strcpy(window->map_uri, stream->map_uri);
+
+    segment = oss_media_hls_window_push(window,
+            file->options.encrypt ? stream->key.uri : NULL);
+    if (segment == NULL) {
+        return -1;
+    }
+    segment->duration = duration;
+    if (stream->options->byte_range) {
+        segment->index = -1;
+        segment->range_offset = stream->range_offset;
+        segment->range_length = file->file->_stat.length - stream->range_offset;
+    } else {
+        segment->index = stream->ts_file_index - 1;
+    }
+    segment->sample_aes = file->options.encrypt && file->options.sample_aes;
+    return 0;
+}
+
+/*
+ * the key frames of the segment just flushed, each lasts until the next
+ * one or the end of the segment. a live playlist lists those of the
+ * segments in the m3u8, a vod one is appended with the new ones only.
+ * they are ranges of the segment, with its url in the m3u8 window.
+ */
+static int oss_media_add_iframes(float duration,
+                                 oss_media_hls_stream_t *stream)
+{
+    int32_t i, n;
+    int32_t capacity;
+    int64_t pts, end_pts;
+    oss_media_hls_segment_t *segment;
+    oss_media_hls_window_t *window = &stream->iframe_window;
+    const oss_media_hls_segment_t *parent = oss_media_hls_window_at(
+            &stream->m3u8_window, stream->m3u8_window.count - 1);
+    oss_media_hls_file_t *file = stream->ts_file;
+    int32_t size = stream->options->hls_list_size;
+
+    if (!stream->options->is_live) {
+        n = window->count;
+    } else if (stream->iframe_segments == size) {
+        n = stream->iframe_segment_counts[stream->iframe_segment_head];
+        stream->iframe_segment_head = (stream->iframe_segment_head + 1) % size;
+        stream->iframe_segments--;
+        stream->iframe_sequence += n;
+    } else {
+        n = 0;
+    }
+    for (i = 0; i < n; i++) {
+        oss_media_hls_window_pop(window);
+    }
+
+    n = window->count + file->iframe_count;
+    if (n > window->capacity) {
+        capacity = window->capacity > 0 ? window->capacity : 16;
+        while (capacity < n) {
+            capacity *= 2;
+        }
+        if (0 != oss_media_hls_window_grow(window, capacity)) {
+            return -1;
+        }
+    }
+
+    strcpy(window->url_prefix, stream->m3u8_window.url_prefix);
+    strcpy(window->url_suffix, stream->m3u8_window.url_suffix);
+    strcpy(window->map_uri, stream->m3u8_window.map_uri);
+    end_pts = stream->current_file_begin_pts + (int64_t)(duration * 90000);
+    for (i = 0; i < file->iframe_count; i++) {
+        segment = oss_media_hls_window_push(window, parent->key_uri);
+        if (segment == NULL) {
+            return -1;
+        }
+        pts = i + 1 < file->iframe_count ? file->iframes[i + 1].pts : end_pts;
+        segment->index = parent->index;
+        segment->duration = (pts - file->iframes[i].pts) / 90000.0;
+        segment->range_offset = file->iframes[i].offset;
+        segment->range_length = file->iframes[i].length;
+        segment->sample_aes = parent->sample_aes;
+    }
+
+    if (stream->options->is_live) {
+        stream->iframe_segment_counts[(stream->iframe_segment_head
+                + stream->iframe_segments++) % size] = file->iframe_count;
+    }
+    file->iframe_count = 0;
+    return 0;
+}
+
+static int oss_media_write_iframe_m3u8(oss_media_hls_stream_t *stream) {
+    oss_media_hls_file_t *file = stream->iframe_m3u8_file;
+
+    if (stream->options->is_live) {
+        oss_media_hls_begin_iframe_m3u8(stream->options->hls_time,
+                                        stream->iframe_sequence, file);
+    } else if (stream->iframe_window.count == 0) {
+        return 0;
+    } else if (file->file->_stat.length == 0) {
+        oss_media_hls_begin_iframe_m3u8(stream->options->hls_time, 0, file);
+    }
+
+    return oss_media_hls_write_window_m3u8(&stream->iframe_window, file);
+}
+
+static int oss_media_write_ll_m3u8(const oss_media_hls_segment_t *pending,
+                                   int64_t preload_sequence,
+                                   int32_t preload_part,
+                                   oss_media_hls_stream_t *stream)
+{
+    char preload_url[OSS_MEDIA_M3U8_URL_LENGTH];
+
+    if (0 != oss_media_create_part_url(preload_url, preload_sequence,
+                                       preload_part, stream))
+    {
+        preload_url[0] = '\0';
+    }
+    return oss_media_hls_write_window_ll_m3u8(&stream->m3u8_window, pending,
+                                              stream->part_count, stream->parts,
+                                              preload_url, stream->m3u8_file);
 }
 
 static int oss_media_write_m3u8(float duration,
                                 oss_media_hls_stream_t *stream)
 {
-    int i;
-    int32_t pos;
-    int32_t cur_m3u8_count;
-    
+    int64_t sequence;
+
+    if (0 != oss_media_set_m3u8_info(duration, stream)) {
+        return -1;
+    }
+
     if (stream->options->is_live) {
-        int32_t hls_list_size = stream->options->hls_list_size;
-        cur_m3u8_count = hls_list_size > stream->ts_file_index ? 
-                         stream->ts_file_index : hls_list_size;
-        
-        oss_media_hls_begin_m3u8(stream->options->hls_time,
-                                stream->ts_file_index - cur_m3u8_count,
-                                stream->m3u8_file);
-        
-        if (stream->ts_file_index > hls_list_size) {
-            for (i = 0; i < hls_list_size - 1; i++) {
-                stream->m3u8_infos[i].duration = stream->m3u8_infos[i + 1].duration;
-                memcpy(stream->m3u8_infos[i].url, stream->m3u8_infos[i+1].url,
-                       OSS_MEDIA_M3U8_URL_LENGTH);
-            }
-        }
-    } else {
-        if (stream->m3u8_file->file->_stat.length == 0) {
-            oss_media_hls_begin_m3u8(stream->options->hls_time, 0,
+        sequence = stream->ts_file_index - stream->m3u8_window.count;
+        if (oss_media_is_low_latency(stream->options)) {
+            oss_media_hls_begin_ll_m3u8(stream->options->hls_time, sequence,
+                    stream->options->part_time_ms / 1000.0,
                     stream->m3u8_file);
+        } else {
+            oss_media_hls_begin_m3u8(stream->options->hls_time, sequence,
+                                    stream->m3u8_file);
         }
+    } else if (stream->m3u8_file->file->_stat.length == 0) {
+        oss_media_hls_begin_m3u8(stream->options->hls_time, 0,
+                                stream->m3u8_file);
+    }
+
+    // the first part of the next segment comes next
+    if (oss_media_is_low_latency(stream->options)) {
+        return oss_media_write_ll_m3u8(NULL, stream->ts_file_index, 0, stream);
+    }
+    
+    return oss_media_hls_write_window_m3u8(&stream->m3u8_window,
+                                           stream->m3u8_file);
+}
+
+// a part ended within a segment, the segment being written is listed last
+static int oss_media_write_part_m3u8(oss_media_hls_stream_t *stream) {
+    int64_t sequence = stream->ts_file_index - 1;
+    oss_media_hls_file_t *file = stream->ts_file;
+    oss_media_hls_segment_t pending;
+
+    oss_media_hls_begin_ll_m3u8(stream->options->hls_time,
+                                sequence - stream->m3u8_window.count,
+                                stream->options->part_time_ms / 1000.0,
+                                stream->m3u8_file);
+
+    // it has parts only, the key and init segment of its tags are current
+    memset(&pending, 0, sizeof(pending));
+    pending.index = sequence;
+    pending.key_uri = file->options.encrypt ? stream->key.uri : NULL;
+    pending.sample_aes = file->options.encrypt && file->options.sample_aes;
+    strcpy(stream->m3u8_window.map_uri, stream->map_uri);
+
+    return oss_media_write_ll_m3u8(&pending, sequence, stream->part_index,
+                                   stream);
+}
+
+static int close_and_open_new_file(oss_media_hls_stream_t *stream) {
+    int ret;
+    uint8_t audio_config[OSS_MEDIA_HLS_AUDIO_CONFIG_SIZE];
+    oss_media_file_t *part_file;
+    
+    // temp store auth_func point
+    auth_fn_t auth_func = stream->ts_file->file->auth_func;
+
+    // the next PMT of SAMPLE-AES describes the audio from its first packet
+    memcpy(audio_config, stream->ts_file->encrypt.audio_config,
+           sizeof(audio_config));
+
+    // the part is ended by the flush, unless that failed
+    part_file = stream->ts_file->part_file;
+
+    // close current hls file
+    ret = oss_media_hls_close(stream->ts_file);
+    oss_media_file_close(part_file);
+    if (ret != 0) {
+        aos_error_log("close ts file failed.");
+        stream->ts_file = NULL;
+        return ret;
+    }
+
+    // open next ts file
+    char *ts_file_name = oss_media_create_new_ts_file_name(stream->options, stream);
+    stream->ts_file = oss_media_open_ts_file(ts_file_name, auth_func,
+                                             stream->options);
+    if (stream->ts_file == NULL) {
+        aos_error_log("open ts file[%s] failed.", ts_file_name);
+        return -1;
+    }
+    oss_media_set_live_write_timeout(stream->options, stream->ts_file, 0);
+    oss_media_set_segment_format(stream->options, stream->ts_file);
+    stream->current_file_begin_pts = -1;
+
+    if (0 != oss_media_set_ts_encrypt(auth_func, stream)) {
+        aos_error_log("set encrypt of ts file[%s] failed.", ts_file_name);
+        return -1;
+    }
+    memcpy(stream->ts_file->encrypt.audio_config, audio_config,
+           sizeof(audio_config));
+
+    if (oss_media_is_low_latency(stream->options)) {
+        stream->part_index = 0;
+        oss_media_drop_parts(stream->ts_file_index - 2, stream);
+        if (0 != oss_media_open_part(stream)) {
+            aos_error_log("open part of ts file[%s] failed.", ts_file_name);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * the next segment is appended to the same object, so it costs no request
+ * to oss. it starts where the flushed one ends.
+ */
+static int oss_media_next_range(oss_media_hls_stream_t *stream) {
+    stream->range_offset = stream->ts_file->file->_stat.length;
+    stream->ts_file_index++;
+    stream->current_file_begin_pts = -1;
+
+    if (0 != oss_media_set_ts_encrypt(stream->ts_file->file->auth_func,
+                                      stream))
+    {
+        aos_error_log("set encrypt of ts file[%s] failed.",
+                      stream->ts_file->file->object_key);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * the init segment of fmp4 is saved as "<ts_name_prefix>init.mp4" once,
+ * from the codec configuration of the first segment.
+ */
+static int oss_media_create_init_segment(oss_media_hls_stream_t *stream) {
+    int ret = -1;
+    int len;
+    char *init_name;
+    aos_pool_t *sub_pool;
+    oss_media_file_t *file;
+    uint8_t buf[OSS_MEDIA_FMP4_MAX_INIT_SIZE];
+
+    len = oss_media_fmp4_make_init(stream->ts_file->fmp4, buf);
+    if (len < 0) {
+        aos_error_log("no track for init segment.");
+        return -1;
+    }
 
-        cur_m3u8_count = 1;
+    aos_pool_create(&sub_pool, stream->pool);
+    init_name = apr_psprintf(sub_pool, "%s%s", stream->options->ts_name_prefix,
+                             OSS_MEDIA_INIT_FILE_NAME);
+
+    file = oss_media_file_open(stream->options->bucket_name, init_name, 
+                               "w", stream->ts_file->file->auth_func);
+    if (file == NULL) {
+        aos_error_log("open init file[%s] failed.", init_name);
+        aos_pool_destroy(sub_pool);
+        return -1;
     }
 
-    pos = cur_m3u8_count - 1;
-    oss_media_set_m3u8_info(pos, duration, stream);
-    
-    return oss_media_hls_write_m3u8(cur_m3u8_count, stream->m3u8_infos,
-                                   stream->m3u8_file);
+    if (oss_media_file_write(file, buf, len) != len) {
+        aos_error_log("write init file[%s] failed.", init_name);
+    } else {
+        ret = oss_media_create_url(stream->map_uri, file, stream);
+    }
+
+    oss_media_file_close(file);
+    aos_pool_destroy(sub_pool);
+    return ret;
 }
 
-static int close_and_open_new_file(oss_media_hls_stream_t *stream) {
+static int oss_media_hls_stream_flush(float duration,
+                                     oss_media_hls_stream_t *stream)
+{
     int ret;
-    
-    // temp store auth_func point
-    auth_fn_t auth_func = stream->ts_file->file->auth_func;
 
-    // close current hls file
-    ret = oss_media_hls_close(stream->ts_file);
+    // flush hls file, the put of a single put or chunked segment is ended
+    if (stream->options->byte_range || stream->options->single_put
+        || stream->options->chunked)
+    {
+        ret = oss_media_hls_end_segment(stream->ts_file);
+    } else {
+        ret = oss_media_hls_flush(stream->ts_file);
+    }
     if (ret != 0) {
-        aos_error_log("close ts file failed.");
-        stream->ts_file = NULL;
-        return ret;
+        aos_error_log("write ts file[%s] failed.",
+                      stream->ts_file->file->object_key);
+        return ret == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
     }
 
-    // open next ts file
-    char *ts_file_name = oss_media_create_new_ts_file_name(stream->options, stream);
-    stream->ts_file = oss_media_hls_open(stream->options->bucket_name, 
-            ts_file_name, auth_func);
-    if (stream->ts_file == NULL) {
-        aos_error_log("open ts file[%s] failed.", ts_file_name);
+    if (0 != oss_media_end_part(duration - (stream->current_part_begin_pts
+                    - stream->current_file_begin_pts) / 90000.0, stream))
+    {
+        aos_error_log("end part of ts file[%s] failed.",
+                      stream->ts_file->file->object_key);
         return -1;
     }
-    stream->current_file_begin_pts = -1;
 
+    if (stream->options->format == sf_fmp4 && stream->map_uri[0] == '\0') {
+        if (0 != oss_media_create_init_segment(stream)) {
+            aos_error_log("write init segment of m3u8 file[%s] failed.",
+                          stream->m3u8_file->file->object_key);
+            return -1;
+        }
+    }
+        
+    // write m3u8 index
+    ret = oss_media_write_m3u8(duration, stream);
+    if (ret != 0) {
+        aos_error_log("write m3u8 file[%s] failed.",
+                      stream->m3u8_file->file->object_key);
+        return -1;
+    }
+
+    if (stream->iframe_m3u8_file != NULL
+        && (0 != oss_media_add_iframes(duration, stream)
+            || 0 != oss_media_write_iframe_m3u8(stream)))
+    {
+        aos_error_log("write m3u8 file[%s] failed.",
+                      stream->iframe_m3u8_file->file->object_key);
+        return -1;
+    }
+    
     return 0;
 }
 
-static int oss_media_hls_stream_flush(float duration,
-                                     oss_media_hls_stream_t *stream)
+// the part ends within the segment, the next one starts with frame
+static int oss_media_hls_stream_flush_part(oss_media_hls_frame_t *frame,
+                                           oss_media_hls_stream_t *stream)
 {
     int ret;
+    float duration = (frame->pts - stream->current_part_begin_pts) / 90000.0;
 
-    // flush hls file
     ret = oss_media_hls_flush(stream->ts_file);
     if (ret != 0) {
         aos_error_log("write ts file[%s] failed.",
                       stream->ts_file->file->object_key);
+        return ret == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+
+    if (0 != oss_media_end_part(duration, stream)
+        || 0 != oss_media_open_part(stream))
+    {
+        aos_error_log("end part of ts file[%s] failed.",
+                      stream->ts_file->file->object_key);
         return -1;
     }
-        
-    // write m3u8 index
-    ret = oss_media_write_m3u8(duration, stream);
+
+    ret = oss_media_write_part_m3u8(stream);
     if (ret != 0) {
         aos_error_log("write m3u8 file[%s] failed.",
                       stream->m3u8_file->file->object_key);
         return -1;
     }
-    
+
     return 0;
 }
 
@@ -278,11 +1077,16 @@ static int oss_media_get_samples_per_frame(const oss_media_hls_stream_t *stream)
         OSS_MEDIA_MP3_SAMPLE_RATE : OSS_MEDIA_AAC_SAMPLE_RATE;
 }
 
+static int oss_media_is_video(const oss_media_hls_frame_t *frame)
+{
+    return frame->stream_type == st_h264 || frame->stream_type == st_h265;
+}
+
 static int64_t oss_media_get_inc_pts(oss_media_hls_frame_t *frame,
                                      oss_media_hls_stream_t *stream)
 {
     int64_t samples_per_frame;
-    if (frame->stream_type == st_h264) {
+    if (oss_media_is_video(frame)) {
         return 90000 / stream->options->video_frame_rate;
     } else {
         samples_per_frame = oss_media_get_samples_per_frame(stream);
@@ -290,51 +1094,122 @@ static int64_t oss_media_get_inc_pts(oss_media_hls_frame_t *frame,
     } 
 }
 
+/*
+ * a part is cut before the video frame which would make it longer than
+ * part_time_ms, or earlier at an idr frame so that the next part starts
+ * with it.
+ */
+static int oss_media_need_flush_part(oss_media_hls_frame_t *frame,
+                                     oss_media_hls_stream_t *stream)
+{
+    int64_t elapsed;
+    int64_t part_time = (int64_t)stream->options->part_time_ms * 90;
+
+    if (!oss_media_is_low_latency(stream->options)
+        || !oss_media_is_video(frame)
+        || stream->current_part_begin_pts == -1)
+    {
+        return 0;
+    }
+
+    elapsed = frame->pts - stream->current_part_begin_pts;
+    if (elapsed <= 0) {
+        return 0;
+    }
+
+    if (frame->key && elapsed * 2 >= part_time) {
+        return 1;
+    }
+
+    return elapsed + oss_media_get_inc_pts(frame, stream) > part_time;
+}
+
+/*
+ * a segment or part whose ts data timed out is not listed, it goes on with
+ * the frame and is cut at a later one, once its data is uploaded. the
+ * timeout is returned after the frame. a segment ended by one put or as
+ * a byte range can not go on, its timeout is returned at once.
+ */
 static int oss_media_write_stream_frame(oss_media_hls_frame_t *frame,
                                         oss_media_hls_stream_t *stream)
 {
+    int ret;
+    int timed_out = 0;
+    int can_go_on = !stream->options->byte_range
+                    && !stream->options->single_put
+                    && !stream->options->chunked;
+
     if (stream->current_file_begin_pts == -1) {
         stream->current_file_begin_pts = frame->pts;
     }
 
+    // an audio only rendition follows the cuts of the video one
     float duration = (frame->pts - stream->current_file_begin_pts) / 90000.0;
-    if (oss_media_need_flush(duration, stream->options->hls_time, frame))
+    if (oss_media_need_flush(duration, stream->options->hls_time, frame)
+        || (stream->next_segment_pts != -1
+            && (int64_t)frame->pts >= stream->next_segment_pts))
     {
-        if(0 != oss_media_hls_stream_flush(duration, stream)) {
+        ret = oss_media_hls_stream_flush(duration, stream);
+        if (ret == OSS_MEDIA_TIMEOUT && can_go_on) {
+            timed_out = 1;
+        } else if (ret != 0) {
             aos_error_log("flush stream data failed.");
-            return -1;
+            return ret;
+        } else {
+            stream->next_segment_pts = -1;
+            if (0 != (stream->options->byte_range
+                      ? oss_media_next_range(stream)
+                      : close_and_open_new_file(stream)))
+            {
+                aos_error_log("close file and open new file failed.");
+                return -1;
+            }
         }
-
-        if (0 != close_and_open_new_file(stream)) {
-            aos_error_log("close file and open new file failed.");
-            return -1;
+    } else if (oss_media_need_flush_part(frame, stream)) {
+        ret = oss_media_hls_stream_flush_part(frame, stream);
+        if (ret == OSS_MEDIA_TIMEOUT && can_go_on) {
+            timed_out = 1;
+        } else if (ret != 0) {
+            aos_error_log("flush stream part failed.");
+            return ret;
         }
     }
 
-    uint8_t *buf = NULL;
-    uint8_t* org_end = frame->end;
-    if (frame->frame_type != ft_aud) {
+    if (stream->current_part_begin_pts == -1) {
+        stream->current_part_begin_pts = frame->pts;
+    }
+    if (oss_media_is_video(frame)) {
+        stream->has_video = 1;
+        stream->part_independent |= frame->key;
+    }
+
+    static const uint8_t aud_nal[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10};
+    static const uint8_t hevc_aud_nal[] = {0x00, 0x00, 0x00, 0x01,
+                                           0x46, 0x01, 0x50};
+    if (frame->frame_type != ft_aud && frame->stream_type == st_h265) {
+        frame->prefix.pos = hevc_aud_nal;
+        frame->prefix.end = hevc_aud_nal + sizeof(hevc_aud_nal);
+    } else if (frame->frame_type != ft_aud) {
         //add aud nal at the front
-        uint8_t aud_nal[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10};
-        int len = frame->end - frame->pos;
-        buf = (uint8_t*)malloc(sizeof(aud_nal) + len);    
-        memcpy(buf, aud_nal, sizeof(aud_nal));
-        memcpy(buf + sizeof(aud_nal), frame->pos, len);
-        frame->pos = buf;
-        frame->end = buf + sizeof(aud_nal) + len;
+        frame->prefix.pos = aud_nal;
+        frame->prefix.end = aud_nal + sizeof(aud_nal);
+    } else {
+        frame->prefix.pos = NULL;
+        frame->prefix.end = NULL;
     }
+    frame->suffix.pos = NULL;
+    frame->suffix.end = NULL;
 
-    int ret = oss_media_hls_write_frame(frame, stream->ts_file);
+    ret = oss_media_hls_write_frame(frame, stream->ts_file);
     if (ret != 0) {
         aos_error_log("write frame failed.");
     }
 
-    frame->end = org_end;
+    frame->prefix.pos = NULL;
+    frame->prefix.end = NULL;
     frame->pos = frame->end;
-    if (buf != NULL)
-        free(buf);
 
-    return ret;
+    return ret == 0 && timed_out ? OSS_MEDIA_TIMEOUT : ret;
 }
 
 static int oss_media_extract_frame(uint8_t *buf, 
@@ -354,16 +1229,38 @@ static int oss_media_extract_frame(uint8_t *buf,
     return 0;
 }
 
+// hevc nal unit types, ref: H.265 table 7-1
+#define HEVC_NAL_RASL_R 9
+#define HEVC_NAL_BLA_W_LP 16
+#define HEVC_NAL_CRA 21
+#define HEVC_NAL_VPS 32
+#define HEVC_NAL_AUD 35
+#define HEVC_NAL_SEI_PREFIX 39
+
+// an hevc frame starting with an aud needs no other, irap frames are key
+static void oss_media_set_hevc_frame_type(const uint8_t *start, int irap,
+                                          oss_media_hls_frame_t *frame)
+{
+    uint8_t head = *OSS_MEDIA_NAL_HEADER(start);
+
+    frame->frame_type = OSS_MEDIA_H265_NAL_TYPE(head) == HEVC_NAL_AUD ?
+                        ft_aud : ft_unspecified;
+    frame->key = irap;
+}
+
 static int oss_media_get_video_frame(uint8_t *buf, uint64_t len,
                                      oss_media_hls_stream_t *stream)
 {
-    int i = 0;
+    int64_t i = 0;
     int64_t cur_pos = -1;
     int64_t last_pos = -1;
     int64_t inc_pts = 0;
     uint8_t nal_type;
+    oss_media_nal_t nal;
+    const uint8_t *p;
     int frame_start_found = 0;
     int frame_end_found = 0;
+    int irap = 0;
     oss_media_hls_frame_t *frame = stream->video_frame;
 
     if (len <= 0) {
@@ -379,12 +1276,52 @@ static int oss_media_get_video_frame(uint8_t *buf, uint64_t len,
     last_pos = frame->pos - buf;
     cur_pos = last_pos;
     inc_pts = oss_media_get_inc_pts(frame, stream);
-    //ref: ffmpeg h264_find_frame_end()
-    for (i = frame->end - buf; i < len - 5; i++) {
-        if ((buf[i] & 0x0F) == 0x00 && buf[i+1] == 0x00
-            && buf[i+2] == 0x00 && buf[i+3] == 0x01)
-        {
-            nal_type = buf[i+4] & 0x1F;
+    //ref: ffmpeg h264_find_frame_end() and hevc_find_frame_end()
+    for (p = frame->end; oss_media_find_nals(p, buf + len, &nal, 1, NULL) == 1;
+         p = nal.header)
+    {
+        // a nal is judged with the bytes after its header
+        i = nal.start - buf;
+        if (i + 5 >= (int64_t)len) {
+            break;
+        }
+
+        if (frame->stream_type == st_h265) {
+            nal_type = OSS_MEDIA_H265_NAL_TYPE(nal.head);
+            if ((nal_type >= HEVC_NAL_VPS && nal_type <= HEVC_NAL_AUD)
+                || nal_type == HEVC_NAL_SEI_PREFIX
+                || (nal_type >= 41 && nal_type <= 44)
+                || (nal_type >= 48 && nal_type <= 55))
+            {
+                if (frame_start_found) {
+                    frame_start_found = 0;
+                    frame_end_found = 1;
+                }
+            } else if (nal_type <= HEVC_NAL_RASL_R
+                       || (nal_type >= HEVC_NAL_BLA_W_LP
+                           && nal_type <= HEVC_NAL_CRA))
+            {
+                // first_slice_segment_in_pic_flag
+                if (nal.header + 2 < buf + len && (nal.header[2] & 0x80)) {
+                    if (frame_start_found) {
+                        frame_start_found = 0;
+                        frame_end_found = 1;
+                    } else {
+                        frame_start_found = 1;
+                    }
+                }
+                if (!frame_end_found && nal_type >= HEVC_NAL_BLA_W_LP) {
+                    irap = 1;
+                }
+            }
+
+            if (frame_end_found) {
+                frame_end_found = 0;
+                cur_pos = i;
+                oss_media_set_hevc_frame_type(buf + last_pos, irap, frame);
+            }
+        } else {
+            nal_type = OSS_MEDIA_H264_NAL_TYPE(nal.head);
             if (nal_type == ft_sei || nal_type == ft_sps
                 || nal_type == ft_pps || nal_type == ft_aud) {
                 if (frame_start_found) {
@@ -403,7 +1340,8 @@ static int oss_media_get_video_frame(uint8_t *buf, uint64_t len,
             if (frame_end_found) {
                 frame_end_found = 0;
                 cur_pos = i;
-                frame->frame_type = buf[last_pos+4] & 0x1F;
+                frame->frame_type = OSS_MEDIA_H264_NAL_TYPE(
+                        *OSS_MEDIA_NAL_HEADER(buf + last_pos));
                 frame->key = frame->frame_type == ft_idr;
             }
         }
@@ -413,9 +1351,36 @@ static int oss_media_get_video_frame(uint8_t *buf, uint64_t len,
         }
     }
 
+    if (frame->stream_type == st_h265 && last_pos != -1
+        && len - last_pos > 5)
+    {
+        oss_media_set_hevc_frame_type(buf + last_pos, irap, frame);
+    }
     return oss_media_extract_frame(buf, last_pos, len, inc_pts, frame);
 }
 
+// the next adts frame after the audio frame, the frames are found in batches
+static const oss_media_adts_t *oss_media_next_adts_frame(uint8_t *buf,
+        uint64_t len, oss_media_hls_stream_t *stream)
+{
+    const uint8_t *from = stream->audio_frame->end;
+
+    if (stream->adts_end != buf + len
+        || stream->adts_index == stream->adts_count
+        || stream->adts_frames[stream->adts_index].pos < from)
+    {
+        stream->adts_count = oss_media_find_adts_frames(from, buf + len,
+                stream->adts_frames, OSS_MEDIA_ADTS_BATCH, NULL);
+        stream->adts_index = 0;
+        stream->adts_end = buf + len;
+    }
+
+    if (stream->adts_index == stream->adts_count) {
+        return NULL;
+    }
+    return &stream->adts_frames[stream->adts_index++];
+}
+
 static int get_bits(uint8_t *buf, int start, int n)
 {
     int i = start;
@@ -429,20 +1394,64 @@ static int get_bits(uint8_t *buf, int start, int n)
     return res;
 }
 
-#define AAC_ADTS_HEADER_SIZE 7
+#define MP3_HEADER_SIZE 4
 
-static int get_aac_frame_length(uint8_t *buf, uint64_t len)
+/*
+ * the length of the mpeg audio frame at buf and the samples in it,
+ * ref: ISO/IEC 11172-3 2.4.2.3 and ISO/IEC 13818-3 2.4.2.3
+ */
+static int get_mp3_frame_length(uint8_t *buf, uint64_t len,
+                                int *samples, int *sample_rate)
 {
-    if (len < AAC_ADTS_HEADER_SIZE) {
+    static const int bitrates[2][3][15] = {
+        {   // mpeg-1, layer 1, 2 and 3
+            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}
+        },
+        {   // mpeg-2 and 2.5
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}
+        }
+    };
+    static const int sample_rates[3] = {44100, 48000, 32000};
+    int version, layer, bitrate_index, rate_index, padding;
+    int lsf, bitrate, frame_length;
+
+    if (len < MP3_HEADER_SIZE) {
+        return -1;
+    }
+
+    version = get_bits(buf, 11, 2);         // 0 is 2.5, 2 is 2, 3 is 1
+    layer = 4 - get_bits(buf, 13, 2);
+    bitrate_index = get_bits(buf, 16, 4);
+    rate_index = get_bits(buf, 20, 2);
+    padding = get_bits(buf, 22, 1);
+    if (version == 1 || layer == 4 || bitrate_index == 0
+        || bitrate_index == 15 || rate_index == 3)
+    {
+        aos_debug_log("invalid mp3 header %02x%02x", buf[1], buf[2]);
         return -1;
     }
 
-    int frame_length = get_bits(buf, 30, 13);
-    if (frame_length > len || frame_length < AAC_ADTS_HEADER_SIZE) {
+    lsf = version != 3;
+    bitrate = bitrates[lsf][layer - 1][bitrate_index] * 1000;
+    *sample_rate = sample_rates[rate_index] >> (version == 3 ? 0 :
+                                                version == 2 ? 1 : 2);
+    if (layer == 1) {
+        *samples = 384;
+        frame_length = (12 * bitrate / *sample_rate + padding) * 4;
+    } else {
+        *samples = layer == 3 && lsf ? 576 : 1152;
+        frame_length = *samples / 8 * bitrate / *sample_rate + padding;
+    }
+
+    if (frame_length > len) {
         aos_debug_log("invalid frame length %d", frame_length);
         return -1;
     }
-    aos_debug_log("aac frame length %d", frame_length);
+    aos_debug_log("mp3 frame length %d", frame_length);
     return frame_length;
 }
 
@@ -453,6 +1462,8 @@ static int oss_media_get_audio_frame(uint8_t *buf, uint64_t len,
     int64_t cur_pos = -1;
     int64_t last_pos = -1;
     int64_t inc_pts = 0;
+    int samples, sample_rate;
+    const oss_media_adts_t *adts;
     oss_media_hls_frame_t *frame = NULL;
 
     if (len <= 0) {
@@ -469,11 +1480,18 @@ static int oss_media_get_audio_frame(uint8_t *buf, uint64_t len,
 
     last_pos = frame->pos - buf;
     inc_pts = oss_media_get_inc_pts(frame, stream);    
+    if (frame->stream_type != st_mp3) {
+        adts = oss_media_next_adts_frame(buf, len, stream);
+        cur_pos = adts != NULL ? adts->end - buf : (int64_t)len;
+        return oss_media_extract_frame(buf, last_pos, cur_pos, inc_pts, frame);
+    }
+
     for (i = frame->end - buf; i < len - 1; i++) {
-        if (buf[i] == 0xFF && (buf[i+1] & 0xF0) == 0xF0)
-        {
-            int length = get_aac_frame_length(&buf[i], len - i);
+        if (buf[i] == 0xFF && (buf[i+1] & 0xE0) == 0xE0) {
+            int length = get_mp3_frame_length(&buf[i], len - i,
+                                              &samples, &sample_rate);
             if (length > 0) {
+                inc_pts = 90000LL * samples / sample_rate;
                 i += length;
                 cur_pos = i;
             }
@@ -498,19 +1516,29 @@ static void oss_media_sync_pts_dts(oss_media_hls_stream_t *stream)
     }
 }
 
-int oss_media_hls_stream_write(uint8_t *video_buf,
-                              uint64_t video_len,
-                              uint8_t *audio_buf,
-                              uint64_t audio_len,
-                              oss_media_hls_stream_t *stream)
+// writes a frame split from the input, 0 is returned on success
+typedef int (*frame_fn_t) (oss_media_hls_frame_t *frame, void *arg);
+
+// split the input into frames in pts order, stream keeps the parsing state
+static int oss_media_demux(uint8_t *video_buf,
+                           uint64_t video_len,
+                           uint8_t *audio_buf,
+                           uint64_t audio_len,
+                           oss_media_hls_stream_t *stream,
+                           frame_fn_t write_func,
+                           void *arg)
 {
     oss_media_hls_frame_t *audio_frame = stream->audio_frame;
     oss_media_hls_frame_t *video_frame = stream->video_frame;
+    oss_media_hls_frame_t *frame;
+    int timed_out = 0;
     
     video_frame->end = video_buf;
     video_frame->pos = video_buf;
     audio_frame->end = audio_buf;
     audio_frame->pos = audio_buf;
+    stream->adts_count = 0;
+    stream->adts_index = 0;
 
     oss_media_sync_pts_dts(stream);
 
@@ -520,35 +1548,49 @@ int oss_media_hls_stream_write(uint8_t *video_buf,
         int get_video_ret = oss_media_get_video_frame(video_buf, video_len, stream);
         int get_audio_ret = oss_media_get_audio_frame(audio_buf, audio_len, stream);
 
+        // the audio frame of the same pts goes next
         if (get_video_ret && get_audio_ret) {
-            if (video_frame->pts < audio_frame->pts) {
-                ret = oss_media_write_stream_frame(video_frame, stream);
-            } else if (video_frame->pts == audio_frame->pts) {
-                ret = oss_media_write_stream_frame(video_frame, stream);
-                ret = ret && oss_media_write_stream_frame(audio_frame, stream);
-            } else {
-                ret = oss_media_write_stream_frame(audio_frame, stream);
-            }
-        } else if (get_video_ret && !get_audio_ret) {
-            ret = oss_media_write_stream_frame(video_frame, stream);
-        } else if (!get_video_ret && get_audio_ret) {
-            ret = oss_media_write_stream_frame(audio_frame, stream);
+            frame = video_frame->pts <= audio_frame->pts ? video_frame
+                                                         : audio_frame;
+        } else if (get_video_ret) {
+            frame = video_frame;
+        } else if (get_audio_ret) {
+            frame = audio_frame;
         } else {
             break;
         }
+        ret = write_func(frame, arg);
         
-        if (ret != 0) {
+        // the input goes on after a timeout which the frame got through
+        if (ret == OSS_MEDIA_TIMEOUT && frame->pos == frame->end) {
+            timed_out = 1;
+        } else if (ret != 0) {
             aos_error_log("write stream frame failed.");
             return ret;
         }
     }
 
-    return 0;
+    return timed_out ? OSS_MEDIA_TIMEOUT : 0;
+}
+
+static int oss_media_write_frame_fn(oss_media_hls_frame_t *frame, void *arg) {
+    return oss_media_write_stream_frame(frame, (oss_media_hls_stream_t*)arg);
+}
+
+int oss_media_hls_stream_write(uint8_t *video_buf,
+                              uint64_t video_len,
+                              uint8_t *audio_buf,
+                              uint64_t audio_len,
+                              oss_media_hls_stream_t *stream)
+{
+    return oss_media_demux(video_buf, video_len, audio_buf, audio_len, stream,
+                           oss_media_write_frame_fn, stream);
 }
 
 int oss_media_hls_stream_close(oss_media_hls_stream_t *stream) {
     int ret = 0;
     float duration = 0.0;
+    oss_media_file_t *part_file;
     if (stream->audio_frame->pts > stream->current_file_begin_pts) {
         duration = (stream->audio_frame->pts - 
                     stream->current_file_begin_pts) / 90000.0;
@@ -568,10 +1610,12 @@ int oss_media_hls_stream_close(oss_media_hls_stream_t *stream) {
         }
     }
 
+    part_file = stream->ts_file != NULL ? stream->ts_file->part_file : NULL;
     if (oss_media_hls_close(stream->ts_file) != 0) {
         aos_error_log("close ts file failed.");
         ret = -1;
     }
+    oss_media_file_close(part_file);
 
     // write end flag to m3u8 file and close for vod ts
     if (!stream->options->is_live) {
@@ -583,9 +1627,26 @@ int oss_media_hls_stream_close(oss_media_hls_stream_t *stream) {
         ret = -1;
     }
 
+    if (stream->iframe_m3u8_file != NULL) {
+        if (!stream->options->is_live) {
+            if (stream->iframe_m3u8_file->file->_stat.length == 0) {
+                oss_media_hls_begin_iframe_m3u8(stream->options->hls_time, 0,
+                                                stream->iframe_m3u8_file);
+            }
+            oss_media_hls_end_m3u8(stream->iframe_m3u8_file);
+        }
+        if (oss_media_hls_close(stream->iframe_m3u8_file) != 0) {
+            aos_error_log("close m3u8 file failed.");
+            ret = -1;
+        }
+    }
+
     aos_pool_destroy(stream->pool);
     
-    free(stream->m3u8_infos);
+    oss_media_hls_window_destroy(&stream->m3u8_window);
+    free(stream->parts);
+    oss_media_hls_window_destroy(&stream->iframe_window);
+    free(stream->iframe_segment_counts);
     free(stream->audio_frame);
     free(stream->video_frame);
 
@@ -595,3 +1656,308 @@ int oss_media_hls_stream_close(oss_media_hls_stream_t *stream) {
     
     return ret;
 }
+
+/*
+ * the codec of EXT-X-STREAM-INF from the sps in a frame, ref: RFC 6381
+ * and ISO/IEC 14496-15 E.3.
+ */
+static void oss_media_get_video_codec(const oss_media_hls_frame_t *frame,
+                                      char *codec, size_t size)
+{
+    static const char *profile_spaces[] = {"", "A", "B", "C"};
+    const uint8_t *nal = frame->pos;
+    const uint8_t *end = frame->end;
+    uint8_t rbsp[16];
+    uint32_t compat, reversed = 0;
+    size_t i, n, len;
+    int h265 = frame->stream_type == st_h265;
+    int zeros;
+
+    while ((nal = oss_media_find_start_code(nal, end)) + 3 < end) {
+        nal += 3;
+        if ((h265 ? (nal[0] >> 1) & 0x3F : nal[0] & 0x1F) != (h265 ? 33 : 7)) {
+            continue;
+        }
+
+        // the first bytes of the sps, without emulation prevention
+        n = 0;
+        zeros = 0;
+        for (i = h265 ? 2 : 1; nal + i < end && n < sizeof(rbsp); i++) {
+            if (zeros >= 2 && nal[i] == 0x03) {
+                zeros = 0;
+                continue;
+            }
+            zeros = nal[i] == 0 ? zeros + 1 : 0;
+            rbsp[n++] = nal[i];
+        }
+
+        if (!h265 && n >= 3) {
+            snprintf(codec, size, "avc1.%02x%02x%02x",
+                     rbsp[0], rbsp[1], rbsp[2]);
+        } else if (h265 && n >= 13) {
+            // profile_tier_level, the compatibility flags in reverse order
+            compat = (rbsp[2] << 24) | (rbsp[3] << 16) | (rbsp[4] << 8)
+                     | rbsp[5];
+            for (i = 0; i < 32; i++) {
+                reversed |= ((compat >> i) & 1) << (31 - i);
+            }
+            len = snprintf(codec, size, "hvc1.%s%d.%X.%c%d",
+                           profile_spaces[rbsp[1] >> 6], rbsp[1] & 0x1F,
+                           reversed, rbsp[1] & 0x20 ? 'H' : 'L', rbsp[12]);
+
+            // constraint bytes, without the trailing zero ones
+            for (n = 12; n > 6 && rbsp[n - 1] == 0; n--) {
+            }
+            for (i = 6; i < n && len < size; i++) {
+                len += snprintf(codec + len, size - len, ".%02X", rbsp[i]);
+            }
+        }
+        return;
+    }
+}
+
+static void oss_media_get_audio_codec(const oss_media_hls_frame_t *frame,
+                                      char *codec, size_t size)
+{
+    if (frame->stream_type == st_mp3) {
+        snprintf(codec, size, "mp4a.40.34");
+    } else if (frame->end - frame->pos >= 3) {
+        // the audio object type is the adts profile plus one
+        snprintf(codec, size, "mp4a.40.%d", (frame->pos[2] >> 6) + 1);
+    }
+}
+
+static int oss_media_write_master_m3u8(oss_media_hls_packager_t *packager) {
+    int32_t i;
+    const char *video_codec;
+    oss_media_hls_variant_t *variant;
+
+    for (i = 0; i < packager->rendition_count; i++) {
+        variant = &packager->variants[i];
+        video_codec = packager->streams[i]->options->audio_only ? 
+                      "" : packager->video_codec;
+        snprintf(variant->codecs, sizeof(variant->codecs), "%s%s%s",
+                 video_codec,
+                 video_codec[0] != '\0' && packager->audio_codec[0] != '\0' ?
+                 "," : "", packager->audio_codec);
+    }
+
+    packager->master_written = 1;
+    return oss_media_hls_write_master_m3u8(packager->rendition_count,
+                                           packager->variants,
+                                           packager->master_file);
+}
+
+/*
+ * a frame of the input goes to every rendition which takes its kind, with
+ * the continuity counter of the rendition. the audio only renditions cut
+ * segments at the first audio frame after the cut of the video one.
+ */
+static int oss_media_packager_write_frame(oss_media_hls_frame_t *frame,
+                                          void *arg)
+{
+    int32_t i;
+    int ret = 0;
+    int timed_out = 0;
+    uint32_t continuity_counter;
+    oss_media_hls_packager_t *packager = (oss_media_hls_packager_t*)arg;
+    oss_media_hls_stream_t *stream;
+    oss_media_hls_frame_t *target;
+    int video = oss_media_is_video(frame);
+
+    if (packager->segment_begin_pts == -1) {
+        packager->segment_begin_pts = frame->pts;
+    }
+
+    if (oss_media_need_flush((frame->pts - packager->segment_begin_pts)
+                             / 90000.0,
+                             packager->source_options.hls_time, frame))
+    {
+        packager->segment_begin_pts = frame->pts;
+        for (i = 0; i < packager->rendition_count; i++) {
+            if (packager->streams[i]->options->audio_only) {
+                packager->streams[i]->next_segment_pts = frame->pts;
+            }
+        }
+
+        if (!packager->master_written
+            && 0 != oss_media_write_master_m3u8(packager))
+        {
+            aos_error_log("write m3u8 file[%s] failed.",
+                          packager->master_file->file->object_key);
+            return -1;
+        }
+    }
+
+    // the sps is in the first frames, which the parser does not mark key
+    if (video && packager->video_codec[0] == '\0') {
+        oss_media_get_video_codec(frame, packager->video_codec,
+                                  sizeof(packager->video_codec));
+    } else if (!video && packager->audio_codec[0] == '\0') {
+        oss_media_get_audio_codec(frame, packager->audio_codec,
+                                  sizeof(packager->audio_codec));
+    }
+
+    // a rendition which timed out got the frame, the others get it too
+    for (i = 0; i < packager->rendition_count; i++) {
+        stream = packager->streams[i];
+        if (video && stream->options->audio_only) {
+            continue;
+        }
+
+        target = video ? stream->video_frame : stream->audio_frame;
+        continuity_counter = target->continuity_counter;
+        *target = *frame;
+        target->continuity_counter = continuity_counter;
+        ret = oss_media_write_stream_frame(target, stream);
+        if (ret == OSS_MEDIA_TIMEOUT && target->pos == target->end) {
+            timed_out = 1;
+        } else if (ret != 0) {
+            return ret;
+        }
+    }
+
+    frame->pos = frame->end;
+    return timed_out ? OSS_MEDIA_TIMEOUT : 0;
+}
+
+static void oss_media_free_packager(oss_media_hls_packager_t *packager,
+                                    int *ret)
+{
+    int32_t i;
+
+    for (i = 0; i < packager->rendition_count; i++) {
+        if (packager->streams[i] != NULL
+            && 0 != oss_media_hls_stream_close(packager->streams[i]))
+        {
+            aos_error_log("close stream of rendition failed.");
+            *ret = -1;
+        }
+    }
+
+    if (oss_media_hls_close(packager->master_file) != 0) {
+        aos_error_log("close m3u8 file failed.");
+        *ret = -1;
+    }
+
+    free(packager->source.video_frame);
+    free(packager->source.audio_frame);
+    free(packager->streams);
+    free(packager->variants);
+    free(packager);
+}
+
+oss_media_hls_packager_t* oss_media_hls_packager_open(auth_fn_t auth_func,
+        const oss_media_hls_packager_options_t *options)
+{
+    int32_t i;
+    int ret = 0;
+    int32_t video_count = 0;
+    oss_media_hls_packager_t *packager;
+    oss_media_hls_stream_options_t stream_options;
+    const oss_media_hls_rendition_t *rendition;
+
+    if (options->rendition_count <= 0) {
+        aos_error_log("no rendition for m3u8 file[%s].",
+                      options->master_m3u8_name);
+        return NULL;
+    }
+
+    // video renditions would get the same frames under other bandwidths
+    for (i = 0; i < options->rendition_count; i++) {
+        if (!options->renditions[i].audio_only) {
+            video_count++;
+        }
+    }
+    if (video_count > 1) {
+        aos_error_log("more than one video rendition for m3u8 file[%s].",
+                      options->master_m3u8_name);
+        return NULL;
+    }
+
+    packager = (oss_media_hls_packager_t*)malloc(
+            sizeof(oss_media_hls_packager_t));
+    memset(packager, 0, sizeof(oss_media_hls_packager_t));
+    packager->streams = (oss_media_hls_stream_t**)calloc(
+            options->rendition_count, sizeof(oss_media_hls_stream_t*));
+    packager->variants = (oss_media_hls_variant_t*)calloc(
+            options->rendition_count, sizeof(oss_media_hls_variant_t));
+    packager->rendition_count = options->rendition_count;
+    packager->segment_begin_pts = -1;
+
+    // the source only parses, it needs the frame rates and types
+    packager->source_options = options->stream;
+    packager->source.options = &packager->source_options;
+    packager->source.video_frame = 
+        oss_media_create_frame(options->stream.video_type);
+    packager->source.audio_frame = 
+        oss_media_create_frame(oss_media_get_audio_type(&options->stream));
+
+    for (i = 0; i < options->rendition_count; i++) {
+        rendition = &options->renditions[i];
+        stream_options = options->stream;
+        stream_options.ts_name_prefix = rendition->ts_name_prefix;
+        stream_options.m3u8_name = rendition->m3u8_name;
+        stream_options.iframe_m3u8_name = NULL;
+        stream_options.audio_only = rendition->audio_only;
+
+        packager->streams[i] = oss_media_hls_stream_open(auth_func,
+                                                         &stream_options);
+        if (packager->streams[i] == NULL
+            || 0 != oss_media_create_url(packager->variants[i].url,
+                            packager->streams[i]->m3u8_file->file,
+                            packager->streams[i]))
+        {
+            aos_error_log("open stream of m3u8 file[%s] failed.",
+                          rendition->m3u8_name);
+            oss_media_free_packager(packager, &ret);
+            return NULL;
+        }
+
+        packager->variants[i].bandwidth = rendition->bandwidth;
+        if (rendition->resolution != NULL && !rendition->audio_only) {
+            snprintf(packager->variants[i].resolution,
+                     sizeof(packager->variants[i].resolution), "%s",
+                     rendition->resolution);
+        }
+    }
+
+    packager->master_file = oss_media_hls_open(options->stream.bucket_name, 
+            options->master_m3u8_name, auth_func);
+    if (packager->master_file == NULL) {
+        aos_error_log("open m3u8 file[%s] failed.", options->master_m3u8_name);
+        oss_media_free_packager(packager, &ret);
+        return NULL;
+    }
+    oss_media_set_live_write_timeout(&options->stream, packager->master_file,
+                                     1);
+
+    return packager;
+}
+
+int oss_media_hls_packager_write(uint8_t *video_buf,
+                                 uint64_t video_len,
+                                 uint8_t *audio_buf,
+                                 uint64_t audio_len,
+                                 oss_media_hls_packager_t *packager)
+{
+    return oss_media_demux(video_buf, video_len, audio_buf, audio_len,
+                           &packager->source, oss_media_packager_write_frame,
+                           packager);
+}
+
+int oss_media_hls_packager_close(oss_media_hls_packager_t *packager) {
+    int ret = 0;
+
+    // the input ended within the first segments
+    if (!packager->master_written
+        && 0 != oss_media_write_master_m3u8(packager))
+    {
+        aos_error_log("write m3u8 file[%s] failed.",
+                      packager->master_file->file->object_key);
+        ret = -1;
+    }
+
+    oss_media_free_packager(packager, &ret);
+    return ret;
+}
@@ -2,6 +2,22 @@
 #define OSS_MEDIA_HLS_STREAM_H
 
 #include "oss_media_hls.h"
+#include "oss_media_adts.h"
+
+/**
+ *  this struct describes the AES-128 key of ts files and the uri
+ *  which players fetch it from.
+ */
+typedef struct oss_media_hls_key_s {
+    uint8_t key[OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE];
+    char uri[OSS_MEDIA_M3U8_URL_LENGTH];
+} oss_media_hls_key_t;
+
+/**
+ *  this typedef define the key_fn_t, it provides the key of the ts files
+ *  from media sequence on, 0 is returned on success.
+ */
+typedef int (*key_fn_t) (int64_t sequence, oss_media_hls_key_t *key);
 
 /**
  * this struct describes the properties of hls stream options
@@ -15,8 +31,33 @@ typedef struct oss_media_hls_stream_options_s {
     int32_t audio_sample_rate;
     int32_t hls_time;
     int32_t hls_list_size;
+    int8_t encrypt;                 // AES-128 encrypt ts files
+    int8_t sample_aes;              // with encrypt, SAMPLE-AES instead
+    int32_t key_rotate_segments;    // new key every n ts files, 0 keeps one key
+    key_fn_t key_func;              // NULL saves random keys next to ts files
+    segment_format_t format;        // sf_fmp4 writes .m4s and init.mp4
+    int32_t part_time_ms;           // live LL-HLS parts, 0 disables them
+    stream_type_t video_type;       // st_h264 or st_h265
+    stream_type_t audio_type;       // st_mp3, otherwise aac
+    int32_t audio_pes_duration_ms;  // ts audio frames within it share a pes
+    int8_t byte_range;              // segments are byte ranges of one object
+    char *iframe_m3u8_name;         // NULL, or the I-frame playlist of ts
+    int8_t audio_only;              // video frames are not written
+    int8_t single_put;              // ts files are put whole at rollover
+    int8_t chunked;                 // ts files are streamed by one put each
 } oss_media_hls_stream_options_t;
 
+/**
+ * this struct describes the url prefix of objects in the bucket, which is
+ * made again only when the endpoint or bucket of files changes.
+ */
+typedef struct oss_media_hls_url_prefix_s {
+    char *endpoint;                 // in the pool of stream, NULL if not made
+    char *bucket_name;
+    int is_cname;
+    char prefix[OSS_MEDIA_M3U8_URL_LENGTH];
+} oss_media_hls_url_prefix_t;
+
 /**
  * this struct describes the properties of hls stream
  */
@@ -26,12 +67,78 @@ typedef struct oss_media_hls_stream_s {
     oss_media_hls_file_t *m3u8_file;
     oss_media_hls_frame_t *video_frame;
     oss_media_hls_frame_t *audio_frame;
-    oss_media_hls_m3u8_info_t *m3u8_infos;
+    oss_media_hls_window_t m3u8_window; // the segments of the m3u8
     int64_t ts_file_index;
     int64_t current_file_begin_pts;
     aos_pool_t *pool;
+    oss_media_hls_key_t key;
+    int64_t key_sequence;           // the first ts of key, -1 means no key
+    char map_uri[OSS_MEDIA_M3U8_URL_LENGTH]; // the fmp4 init segment
+    oss_media_hls_part_info_t *parts; // of the last and the current segment
+    int32_t part_count;
+    int32_t part_capacity;
+    int32_t part_index;             // the part being written in the segment
+    int64_t current_part_begin_pts;
+    int8_t part_independent;
+    int8_t has_video;
+    char part_name[OSS_MEDIA_M3U8_URL_LENGTH];
+    oss_media_hls_url_prefix_t url_prefix;
+    uint64_t range_offset;          // byte_range: the segment being written
+    oss_media_hls_file_t *iframe_m3u8_file;  // NULL without the option
+    oss_media_hls_window_t iframe_window;    // of the segments listed
+    int32_t *iframe_segment_counts; // live: a ring of the iframes of each
+    int32_t iframe_segment_head;    // segment listed, from the oldest one
+    int32_t iframe_segments;
+    int64_t iframe_sequence;        // media sequence of the oldest iframe
+    int64_t next_segment_pts;       // -1, or a segment starts from it on
+    oss_media_adts_t adts_frames[OSS_MEDIA_ADTS_BATCH]; // after audio_frame
+    int32_t adts_count;
+    int32_t adts_index;             // the next of adts_frames
+    const uint8_t *adts_end;        // the end of the audio scanned
 } oss_media_hls_stream_t;
 
+/**
+ * this struct describes a rendition of an abr packager, a stream whose
+ * media playlist is listed in the master playlist.
+ */
+typedef struct oss_media_hls_rendition_s {
+    char *ts_name_prefix;
+    char *m3u8_name;
+    int8_t audio_only;              // only the audio of the input
+    int32_t bandwidth;              // peak bits per second
+    char *resolution;               // like "1280x720", NULL if not listed
+} oss_media_hls_rendition_t;
+
+/**
+ * this struct describes the options of an abr packager, the renditions
+ * share the options of stream except the names.
+ */
+typedef struct oss_media_hls_packager_options_s {
+    oss_media_hls_stream_options_t stream;
+    char *master_m3u8_name;
+    oss_media_hls_rendition_t *renditions;
+    int32_t rendition_count;
+} oss_media_hls_packager_options_t;
+
+/**
+ * this struct describes an abr packager, the input is parsed once and its
+ * frames are written to every rendition, which cut segments together. at
+ * most one rendition has video, the others are audio only, since the input
+ * has one video bitrate.
+ */
+typedef struct oss_media_hls_packager_s {
+    oss_media_hls_stream_t source;  // parses the input, opens no file
+    oss_media_hls_stream_options_t source_options;
+    oss_media_hls_stream_t **streams;
+    oss_media_hls_variant_t *variants;
+    int32_t rendition_count;
+    oss_media_hls_file_t *master_file;
+    int8_t master_written;
+    int64_t segment_begin_pts;
+    char video_codec[32];           // empty until a key frame has an sps
+    char audio_codec[16];           // empty until the first audio frame
+} oss_media_hls_packager_t;
+
 /**
  *  @brief  open oss media hls stream, this function opens the oss hls stream.
  *  @param[in]  auth_func the func to set access_key_id/access_key_secret
@@ -44,14 +151,17 @@ oss_media_hls_stream_t* oss_media_hls_stream_open(auth_fn_t auth_func,
         const oss_media_hls_stream_options_t *options);
 
 /**
- *  @brief  write h.264 and aac data
- *  @param[in]  video_buf the data of h.264 video
+ *  @brief  write h.264 or h.265 and aac or mp3 data
+ *  @param[in]  video_buf the data of h.264 or h.265 video, by video_type
  *  @param[in]  video_len the dta lenght of h.264 video
- *  @param[in]  audio_buf the data of aac video
+ *  @param[in]  audio_buf the data of aac or mp3 audio, by audio_type
  *  @param[in]  audio_len the dta lenght of aac video
  *  @param[in]  stream    the hls stream for store h.264 and aac data
  *  @return:
  *      upon successful completion 0 is returned.
+ *      OSS_MEDIA_TIMEOUT is returned if a live segment could not be uploaded
+ *      within hls_time, the data is written and kept, the segment is listed
+ *      once it is uploaded by a later cut.
  *      otherwise, -1 is returned and code/messaage in struct of file is set to indicate the error. 
  */
 int oss_media_hls_stream_write(uint8_t *video_buf,
@@ -68,4 +178,38 @@ int oss_media_hls_stream_write(uint8_t *video_buf,
  */
 int oss_media_hls_stream_close(oss_media_hls_stream_t *stream);
 
+/**
+ *  @brief  open an abr packager, with a stream for each rendition
+ *  @param[in]  auth_func the func to set access_key_id/access_key_secret
+ *  @param[in]  options the options of the renditions and master playlist
+ *  @return:
+ *      On success, a pointer to the oss_media_hls_packager_t
+ *      otherwise, a null pointer is returned, also if more than one
+ *      rendition is not audio only
+ */
+oss_media_hls_packager_t* oss_media_hls_packager_open(auth_fn_t auth_func,
+        const oss_media_hls_packager_options_t *options);
+
+/**
+ *  @brief  write h.264 or h.265 and aac or mp3 data to every rendition,
+ *          like oss_media_hls_stream_write. the master playlist is written
+ *          when the first segments end, with the codecs found until then.
+ *  @return:
+ *      upon successful completion 0 is returned.
+ *      otherwise, -1 is returned
+ */
+int oss_media_hls_packager_write(uint8_t *video_buf,
+                                 uint64_t video_len,
+                                 uint8_t *audio_buf,
+                                 uint64_t audio_len,
+                                 oss_media_hls_packager_t *packager);
+
+/**
+ *  @brief  close the streams of an abr packager
+ *  @return:
+ *      upon successful completion 0 is returned.
+ *      otherwise, -1 is returned
+ */
+int oss_media_hls_packager_close(oss_media_hls_packager_t *packager);
+
 #endif
@@ -0,0 +1,142 @@
+#include <string.h>
+#include <pthread.h>
+#include "oss_media_nal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OSS_MEDIA_NAL_SIMD 1
+#endif
+
+typedef const uint8_t *(*oss_media_find_start_code_fn_t)(const uint8_t *p,
+                                                         const uint8_t *end);
+
+static oss_media_find_start_code_fn_t find_start_code;
+static pthread_once_t nal_once = PTHREAD_ONCE_INIT;
+
+/*
+ * zero bytes are rare in slice data, so the portable scanner jumps between
+ * them with memchr and looks at the two bytes after each one.
+ */
+static const uint8_t *oss_media_find_start_code_c(const uint8_t *p,
+                                                  const uint8_t *end)
+{
+    while (end - p >= 3) {
+        p = (const uint8_t *)memchr(p, 0, end - p - 2);
+        if (p == NULL) {
+            break;
+        }
+        if (p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+        p++;
+    }
+    return end;
+}
+
+#ifdef OSS_MEDIA_NAL_SIMD
+/*
+ * the vector scanners test every position of a block at once, byte i
+ * starts a code if bytes i and i + 1 are zero and byte i + 2 is one.
+ * the tail shorter than a block is left to the portable scanner.
+ */
+__attribute__((target("sse2")))
+static const uint8_t *oss_media_find_start_code_sse2(const uint8_t *p,
+                                                     const uint8_t *end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i z0, z1, o2;
+    int mask;
+
+    while (end - p >= 16 + 2) {
+        z0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero);
+        z1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), zero);
+        o2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), one);
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(z0, z1), o2));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return oss_media_find_start_code_c(p, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *oss_media_find_start_code_avx2(const uint8_t *p,
+                                                     const uint8_t *end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i z0, z1, o2;
+    unsigned int mask;
+
+    while (end - p >= 32 + 2) {
+        z0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), zero);
+        z1 = _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(p + 1)), zero);
+        o2 = _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)(p + 2)), one);
+        mask = (unsigned int)_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_and_si256(z0, z1), o2));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return oss_media_find_start_code_sse2(p, end);
+}
+#endif
+
+static void oss_media_nal_setup(void)
+{
+    find_start_code = oss_media_find_start_code_c;
+#ifdef OSS_MEDIA_NAL_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find_start_code = oss_media_find_start_code_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        find_start_code = oss_media_find_start_code_sse2;
+    }
+#endif
+}
+
+const uint8_t *oss_media_find_start_code(const uint8_t *p,
+                                         const uint8_t *end)
+{
+    pthread_once(&nal_once, oss_media_nal_setup);
+    return find_start_code(p, end);
+}
+
+int oss_media_find_nals(const uint8_t *p, const uint8_t *end,
+                        oss_media_nal_t nals[], int n,
+                        const uint8_t **next)
+{
+    const uint8_t *begin = p;
+    const uint8_t *code;
+    int count = 0;
+
+    pthread_once(&nal_once, oss_media_nal_setup);
+
+    while (count < n) {
+        code = find_start_code(p, end);
+        if (end - code <= 3) {
+            // 00 00 01 without its header yet, or no code at all
+            p = code < end && code > begin && code[-1] == 0 ? code - 1 : code;
+            while (p > begin && end - p < 3 && p[-1] == 0) {
+                p--;
+            }
+            break;
+        }
+
+        nals[count].start = code > begin && code[-1] == 0 ? code - 1 : code;
+        nals[count].header = code + 3;
+        nals[count].head = code[3];
+        p = code + 3;
+        count++;
+    }
+
+    if (next != NULL) {
+        *next = p;
+    }
+    return count;
+}
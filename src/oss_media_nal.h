@@ -0,0 +1,50 @@
+#ifndef OSS_MEDIA_NAL_H
+#define OSS_MEDIA_NAL_H
+
+#include <stdint.h>
+#include "oss_media_define.h"
+
+OSS_MEDIA_CPP_START
+
+/* the type in the first byte of a nal header */
+#define OSS_MEDIA_H264_NAL_TYPE(head) ((head) & 0x1F)
+#define OSS_MEDIA_H265_NAL_TYPE(head) (((head) >> 1) & 0x3F)
+
+/* the nal header after the start code at p, 00 00 01 or 00 00 00 01 */
+#define OSS_MEDIA_NAL_HEADER(p) ((p)[2] == 0x01 ? (p) + 3 : (p) + 4)
+
+/**
+ *  this struct describes a nal unit found in an annex-b stream.
+ */
+typedef struct oss_media_nal_s {
+    const uint8_t *start;   // the start code, with a leading zero if any
+    const uint8_t *header;  // the nal header, after the start code
+    uint8_t head;           // the first byte of the header
+} oss_media_nal_t;
+
+/**
+ *  @brief  find the next 00 00 01 start code, SSE2 or AVX2 is used when
+ *          the cpu supports it
+ *  @return:
+ *      the position of the start code in [p, end), or end
+ */
+const uint8_t *oss_media_find_start_code(const uint8_t *p,
+                                         const uint8_t *end);
+
+/**
+ *  @brief  find nal units in [p, end) in bulk, a nal is found once its
+ *          header byte is in the range
+ *  @param[out] nals the nal units in order
+ *  @param[in]  n the size of nals
+ *  @param[out] next where to go on with the scan, a start code cut by end
+ *              is left to it, may be NULL
+ *  @return:
+ *      the count of nal units found, n if there may be more
+ */
+int oss_media_find_nals(const uint8_t *p, const uint8_t *end,
+                        oss_media_nal_t nals[], int n,
+                        const uint8_t **next);
+
+OSS_MEDIA_CPP_END
+
+#endif
@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "oss_media_pool.h"
+
+/*
+ * every buffer has a header in front which tells its class, idle buffers
+ * of a class are linked through their headers.
+ */
+typedef struct oss_media_pool_block_s {
+    struct oss_media_pool_block_s *next;
+    size_t size;        // bytes after the header
+    int index;          // the size class, -1 if not pooled
+} oss_media_pool_block_t;
+
+/* the header keeps the buffer aligned like malloc does */
+#define OSS_MEDIA_POOL_HEADER_SIZE \
+    ((sizeof(oss_media_pool_block_t) + 15) & ~(size_t)15)
+
+typedef struct oss_media_pool_class_s {
+    pthread_mutex_t mutex;
+    oss_media_pool_block_t *idle_list;
+    unsigned int in_use;
+    unsigned int idle;
+    unsigned int peak;
+    unsigned int max_idle;
+} oss_media_pool_class_t;
+
+static oss_media_pool_class_t pool_classes[OSS_MEDIA_POOL_CLASSES];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void init_pool(void)
+{
+    int i;
+
+    for (i = 0; i < OSS_MEDIA_POOL_CLASSES; i++) {
+        pthread_mutex_init(&pool_classes[i].mutex, NULL);
+        pool_classes[i].idle_list = NULL;
+        pool_classes[i].in_use = 0;
+        pool_classes[i].idle = 0;
+        pool_classes[i].peak = 0;
+        pool_classes[i].max_idle = OSS_MEDIA_DEFAULT_POOL_IDLE;
+    }
+}
+
+static size_t class_size(int index)
+{
+    return (size_t)1 << (OSS_MEDIA_POOL_MIN_SHIFT + index);
+}
+
+// the smallest class which size fits in, -1 if it is larger than all
+static int class_index(size_t size)
+{
+    int i;
+
+    for (i = 0; i < OSS_MEDIA_POOL_CLASSES; i++) {
+        if (size <= class_size(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static oss_media_pool_block_t *new_block(size_t size, int index)
+{
+    oss_media_pool_block_t *block;
+
+    block = (oss_media_pool_block_t*)malloc(OSS_MEDIA_POOL_HEADER_SIZE + size);
+    if (block != NULL) {
+        block->next = NULL;
+        block->size = size;
+        block->index = index;
+    }
+    return block;
+}
+
+static void *block_data(oss_media_pool_block_t *block)
+{
+    return (uint8_t*)block + OSS_MEDIA_POOL_HEADER_SIZE;
+}
+
+static oss_media_pool_block_t *data_block(void *buf)
+{
+    return (oss_media_pool_block_t*)((uint8_t*)buf - OSS_MEDIA_POOL_HEADER_SIZE);
+}
+
+void *oss_media_pool_alloc(size_t size)
+{
+    oss_media_pool_class_t *c;
+    oss_media_pool_block_t *block;
+    int index;
+
+    pthread_once(&pool_once, init_pool);
+
+    index = class_index(size);
+    if (index < 0) {
+        block = new_block(size, -1);
+        return block != NULL ? block_data(block) : NULL;
+    }
+
+    c = &pool_classes[index];
+    pthread_mutex_lock(&c->mutex);
+    block = c->idle_list;
+    if (block != NULL) {
+        c->idle_list = block->next;
+        c->idle--;
+    }
+    // counted before malloc so that the lock is not held for it
+    c->in_use++;
+    if (c->in_use > c->peak) {
+        c->peak = c->in_use;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    if (block == NULL) {
+        block = new_block(class_size(index), index);
+        if (block == NULL) {
+            pthread_mutex_lock(&c->mutex);
+            c->in_use--;
+            pthread_mutex_unlock(&c->mutex);
+            return NULL;
+        }
+    }
+
+    return block_data(block);
+}
+
+void *oss_media_pool_realloc(void *buf, size_t size)
+{
+    oss_media_pool_block_t *block;
+    void *grown;
+
+    if (buf == NULL) {
+        return oss_media_pool_alloc(size);
+    }
+
+    block = data_block(buf);
+    if (size <= block->size) {
+        return buf;
+    }
+
+    grown = oss_media_pool_alloc(size);
+    if (grown == NULL) {
+        return NULL;
+    }
+    memcpy(grown, buf, block->size);
+    oss_media_pool_free(buf);
+    return grown;
+}
+
+void oss_media_pool_free(void *buf)
+{
+    oss_media_pool_class_t *c;
+    oss_media_pool_block_t *block;
+
+    if (buf == NULL) {
+        return;
+    }
+
+    block = data_block(buf);
+    if (block->index < 0) {
+        free(block);
+        return;
+    }
+
+    c = &pool_classes[block->index];
+    pthread_mutex_lock(&c->mutex);
+    c->in_use--;
+    if (c->idle < c->max_idle) {
+        block->next = c->idle_list;
+        c->idle_list = block;
+        c->idle++;
+        block = NULL;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    free(block);
+}
+
+int oss_media_pool_reserve(size_t size, unsigned int max_idle,
+                           unsigned int prefault)
+{
+    oss_media_pool_class_t *c;
+    oss_media_pool_block_t *block;
+    oss_media_pool_block_t *list = NULL;
+    oss_media_pool_block_t *extra = NULL;
+    unsigned int count = 0;
+    int index;
+    int ret = 0;
+
+    pthread_once(&pool_once, init_pool);
+
+    index = class_index(size);
+    if (index < 0) {
+        return -1;
+    }
+    c = &pool_classes[index];
+
+    // touch every page, so the first segments do not page fault
+    prefault = prefault < max_idle ? prefault : max_idle;
+    while (count < prefault) {
+        block = new_block(class_size(index), index);
+        if (block == NULL) {
+            ret = -1;
+            break;
+        }
+        memset(block_data(block), 0, block->size);
+        block->next = list;
+        list = block;
+        count++;
+    }
+
+    pthread_mutex_lock(&c->mutex);
+    c->max_idle = max_idle;
+    while (list != NULL) {
+        block = list;
+        list = block->next;
+        block->next = c->idle_list;
+        c->idle_list = block;
+        c->idle++;
+    }
+    // a lower cap drops the idle buffers above it
+    while (c->idle > c->max_idle) {
+        block = c->idle_list;
+        c->idle_list = block->next;
+        c->idle--;
+        block->next = extra;
+        extra = block;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    while (extra != NULL) {
+        block = extra;
+        extra = block->next;
+        free(block);
+    }
+
+    return ret;
+}
+
+void oss_media_pool_get_stats(oss_media_pool_stats_t
+                              stats[OSS_MEDIA_POOL_CLASSES])
+{
+    oss_media_pool_class_t *c;
+    int i;
+
+    pthread_once(&pool_once, init_pool);
+
+    for (i = 0; i < OSS_MEDIA_POOL_CLASSES; i++) {
+        c = &pool_classes[i];
+        pthread_mutex_lock(&c->mutex);
+        stats[i].size = class_size(i);
+        stats[i].in_use = c->in_use;
+        stats[i].idle = c->idle;
+        stats[i].peak = c->peak;
+        stats[i].max_idle = c->max_idle;
+        pthread_mutex_unlock(&c->mutex);
+    }
+}
+
+void oss_media_pool_trim(void)
+{
+    oss_media_pool_class_t *c;
+    oss_media_pool_block_t *block, *list;
+    int i;
+
+    pthread_once(&pool_once, init_pool);
+
+    for (i = 0; i < OSS_MEDIA_POOL_CLASSES; i++) {
+        c = &pool_classes[i];
+        pthread_mutex_lock(&c->mutex);
+        list = c->idle_list;
+        c->idle_list = NULL;
+        c->idle = 0;
+        pthread_mutex_unlock(&c->mutex);
+
+        while (list != NULL) {
+            block = list;
+            list = block->next;
+            free(block);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef OSS_MEDIA_POOL_H
+#define OSS_MEDIA_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "oss_media_define.h"
+
+OSS_MEDIA_CPP_START
+
+/* size classes of pooled buffers, 4KB, 8KB, ... 4MB */
+#define OSS_MEDIA_POOL_MIN_SHIFT 12
+#define OSS_MEDIA_POOL_CLASSES 11
+
+/**
+ *  this struct describes the buffers of a size class.
+ */
+typedef struct oss_media_pool_stats_s {
+    size_t size;            // bytes of a buffer in the class
+    unsigned int in_use;    // buffers handed out
+    unsigned int idle;      // buffers kept for reuse
+    unsigned int peak;      // the most buffers in use at once
+    unsigned int max_idle;  // more idle buffers are freed
+} oss_media_pool_stats_t;
+
+/**
+ *  @brief  get a buffer from the process wide pool, sizes up to the
+ *          largest class are rounded up to their class and reused,
+ *          larger ones are malloced
+ *  @return:
+ *      the buffer, NULL if there is no memory
+ */
+void *oss_media_pool_alloc(size_t size);
+
+/**
+ *  @brief  grow a buffer of the pool, the data is kept
+ *  @param[in]  buf a buffer of the pool or NULL
+ *  @param[in]  size the bytes needed
+ *  @return:
+ *      the buffer, NULL if there is no memory and buf is unchanged
+ */
+void *oss_media_pool_realloc(void *buf, size_t size);
+
+/**
+ *  @brief  give a buffer back to the pool, NULL is ignored
+ */
+void oss_media_pool_free(void *buf);
+
+/**
+ *  @brief  set how many idle buffers of a size class are kept, and
+ *          prefault some of them so that they are ready in memory
+ *  @param[in]  size the size of the buffers, like oss_media_pool_alloc
+ *  @param[in]  max_idle the cap of idle buffers of the class
+ *  @param[in]  prefault the idle buffers to make now, up to max_idle
+ *  @return:
+ *      upon successful completion 0 is returned
+ *      otherwise -1 is returned, the size is too large or no memory
+ */
+int oss_media_pool_reserve(size_t size, unsigned int max_idle,
+                           unsigned int prefault);
+
+/**
+ *  @brief  get the stats of every size class, from the smallest
+ */
+void oss_media_pool_get_stats(oss_media_pool_stats_t
+                              stats[OSS_MEDIA_POOL_CLASSES]);
+
+/**
+ *  @brief  free the idle buffers of all size classes
+ */
+void oss_media_pool_trim(void);
+
+OSS_MEDIA_CPP_END
+
+#endif
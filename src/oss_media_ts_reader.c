@@ -0,0 +1,595 @@
+#include <stdlib.h>
+#include <string.h>
+#include "oss_media_ts_reader.h"
+#include "oss_media_crc.h"
+#include "oss_media_pool.h"
+
+#define OSS_MEDIA_TS_SYNC_BYTE 0x47
+#define OSS_MEDIA_TS_PAT_PID 0
+#define OSS_MEDIA_TS_PAT_TABLE_ID 0x00
+#define OSS_MEDIA_TS_PMT_TABLE_ID 0x02
+/* the first pes buffer, it grows with the largest frame */
+#define OSS_MEDIA_TS_PES_BUFFER_SIZE (64 * 1024)
+
+static void oss_media_ts_reader_init_pes(oss_media_ts_reader_pes_t *pes) {
+    pes->pid = 0;
+    pes->stream_type = st_h264;
+    pes->buf = NULL;
+    pes->size = 0;
+    pes->len = 0;
+    pes->pes_len = 0;
+    pes->pts = 0;
+    pes->dts = 0;
+    pes->started = 0;
+    pes->key = 0;
+    pes->continuity_counter = -1;
+}
+
+static oss_media_ts_reader_t *oss_media_ts_reader_create() {
+    oss_media_ts_reader_t *reader;
+
+    reader = (oss_media_ts_reader_t*)malloc(sizeof(oss_media_ts_reader_t));
+    if (reader == NULL) {
+        aos_error_log("malloc ts reader failed.");
+        return NULL;
+    }
+
+    reader->file = NULL;
+    reader->data = NULL;
+    reader->pos = 0;
+    reader->len = 0;
+    reader->buf = NULL;
+    reader->eof = 0;
+    reader->pmt_pid = 0;
+    reader->pat_continuity_counter = -1;
+    reader->pmt_continuity_counter = -1;
+    oss_media_ts_reader_init_pes(&reader->video);
+    oss_media_ts_reader_init_pes(&reader->audio);
+    reader->ready = NULL;
+    memset(&reader->stats, 0, sizeof(reader->stats));
+
+    return reader;
+}
+
+oss_media_ts_reader_t *oss_media_ts_reader_open(const uint8_t *buf,
+                                                uint64_t len)
+{
+    oss_media_ts_reader_t *reader = oss_media_ts_reader_create();
+
+    if (reader != NULL) {
+        reader->data = buf;
+        reader->len = len;
+        reader->eof = 1;
+    }
+    return reader;
+}
+
+oss_media_ts_reader_t *oss_media_ts_reader_open_file(oss_media_file_t *file) {
+    oss_media_ts_reader_t *reader = oss_media_ts_reader_create();
+
+    if (reader == NULL) {
+        return NULL;
+    }
+
+    // a partial packet is kept in front of the bytes read next
+    reader->buf = (uint8_t*)oss_media_pool_alloc(
+            OSS_MEDIA_TS_READER_READ_SIZE + OSS_MEDIA_HLS_PACKET_SIZE + 1);
+    if (reader->buf == NULL) {
+        aos_error_log("malloc ts reader buffer failed.");
+        free(reader);
+        return NULL;
+    }
+    reader->file = file;
+    reader->data = reader->buf;
+
+    return reader;
+}
+
+// read more bytes of the file after those left in the buffer
+static int oss_media_ts_reader_fill(oss_media_ts_reader_t *reader) {
+    uint64_t left = reader->len - reader->pos;
+    int64_t n;
+
+    if (reader->file == NULL) {
+        reader->eof = 1;
+        return 0;
+    }
+
+    memmove(reader->buf, reader->buf + reader->pos, left);
+    reader->pos = 0;
+    reader->len = left;
+
+    n = oss_media_file_read(reader->file, reader->buf + left,
+                            OSS_MEDIA_TS_READER_READ_SIZE);
+    if (n < 0) {
+        aos_error_log("read ts file[%s] failed.", reader->file->object_key);
+        return n == OSS_MEDIA_TIMEOUT ? OSS_MEDIA_TIMEOUT : -1;
+    }
+
+    // the range of a read is cut at the end of the object
+    reader->len += n;
+    reader->eof = n < OSS_MEDIA_TS_READER_READ_SIZE;
+    return 0;
+}
+
+/*
+ * the next sync byte which is followed by another one a packet later,
+ * memchr of libc is vectorized, so bytes which are not 0x47 are skipped
+ * many at once.
+ */
+static const uint8_t *oss_media_ts_reader_find_sync(const uint8_t *p,
+                                                    const uint8_t *end)
+{
+    while ((p = (const uint8_t*)memchr(p, OSS_MEDIA_TS_SYNC_BYTE, end - p))
+           != NULL)
+    {
+        if (end - p <= OSS_MEDIA_HLS_PACKET_SIZE
+            || p[OSS_MEDIA_HLS_PACKET_SIZE] == OSS_MEDIA_TS_SYNC_BYTE)
+        {
+            return p;
+        }
+        p++;
+    }
+    return end;
+}
+
+// 1 if a whole packet is at pos, 0 at the end of the stream
+static int oss_media_ts_reader_sync(oss_media_ts_reader_t *reader) {
+    const uint8_t *p;
+    int ret;
+
+    for (;;) {
+        if (reader->len - reader->pos >= OSS_MEDIA_HLS_PACKET_SIZE) {
+            // packets in sync are checked without scanning
+            p = reader->data + reader->pos;
+            if (p[0] == OSS_MEDIA_TS_SYNC_BYTE
+                && (reader->len - reader->pos == OSS_MEDIA_HLS_PACKET_SIZE
+                    || p[OSS_MEDIA_HLS_PACKET_SIZE] == OSS_MEDIA_TS_SYNC_BYTE))
+            {
+                return 1;
+            }
+            p = oss_media_ts_reader_find_sync(p, reader->data + reader->len);
+            reader->stats.skipped_bytes += p - (reader->data + reader->pos);
+            reader->pos = p - reader->data;
+            continue;
+        }
+
+        if (reader->eof) {
+            reader->stats.skipped_bytes += reader->len - reader->pos;
+            reader->pos = reader->len;
+            return 0;
+        }
+        if (0 != (ret = oss_media_ts_reader_fill(reader))) {
+            return ret;
+        }
+    }
+}
+
+// 1 if packets before this one were lost, -1 if it repeats the last one
+static int oss_media_ts_reader_check_continuity(int8_t *last, uint8_t cc,
+                                                int discontinuity)
+{
+    int ret = 0;
+
+    if (*last >= 0 && !discontinuity) {
+        if (cc == *last) {
+            return -1;
+        }
+        if (cc != ((*last + 1) & 0x0F)) {
+            ret = 1;
+        }
+    }
+    *last = cc;
+    return ret;
+}
+
+static uint64_t oss_media_ts_reader_read_pts(const uint8_t *p) {
+    return (uint64_t)(p[0] & 0x0E) << 29 | (uint64_t)p[1] << 22
+           | (uint64_t)(p[2] & 0xFE) << 14 | (uint64_t)p[3] << 7
+           | p[4] >> 1;
+}
+
+/*
+ * the section of a pat or pmt which starts in this packet, NULL if it is
+ * broken. sections longer than a packet are not support, the muxer of hls
+ * never writes them.
+ */
+static const uint8_t *oss_media_ts_reader_get_section(
+        oss_media_ts_reader_t *reader,
+        const uint8_t *p,
+        const uint8_t *end,
+        uint8_t table_id,
+        int *len)
+{
+    uint32_t section_length, crc32;
+
+    if (p >= end) {
+        return NULL;
+    }
+    p += 1 + p[0];                      // pointer field
+    if (end - p < 3 || p[0] != table_id) {
+        return NULL;
+    }
+
+    section_length = ((p[1] & 0x0F) << 8) | p[2];
+    if (section_length < 9 || end - p < 3 + section_length) {
+        return NULL;
+    }
+
+    *len = 3 + section_length;
+    crc32 = (uint32_t)p[*len - 4] << 24 | (uint32_t)p[*len - 3] << 16
+            | (uint32_t)p[*len - 2] << 8 | p[*len - 1];
+    if (crc32 != oss_media_crc32(0xFFFFFFFF, p, *len - 4)) {
+        reader->stats.crc_errors++;
+        return NULL;
+    }
+
+    return p;
+}
+
+static void oss_media_ts_reader_parse_pat(oss_media_ts_reader_t *reader,
+                                          const uint8_t *p,
+                                          const uint8_t *end)
+{
+    const uint8_t *section;
+    int len, i;
+    uint16_t program_number, pid;
+
+    section = oss_media_ts_reader_get_section(reader, p, end,
+            OSS_MEDIA_TS_PAT_TABLE_ID, &len);
+    if (section == NULL) {
+        return;
+    }
+
+    // the pmt of the first program, number 0 is the network pid
+    for (i = 8; i + 4 <= len - 4; i += 4) {
+        program_number = (section[i] << 8) | section[i + 1];
+        pid = ((section[i + 2] & 0x1F) << 8) | section[i + 3];
+        if (program_number != 0) {
+            if (reader->pmt_pid != pid) {
+                reader->pmt_pid = pid;
+                reader->pmt_continuity_counter = -1;
+            }
+            return;
+        }
+    }
+}
+
+static void oss_media_ts_reader_set_stream(oss_media_ts_reader_pes_t *pes,
+                                           uint16_t pid,
+                                           stream_type_t stream_type)
+{
+    if (pes->pid != pid) {
+        pes->pid = pid;
+        pes->started = 0;
+        pes->len = 0;
+        pes->continuity_counter = -1;
+    }
+    pes->stream_type = stream_type;
+}
+
+static void oss_media_ts_reader_parse_pmt(oss_media_ts_reader_t *reader,
+                                          const uint8_t *p,
+                                          const uint8_t *end)
+{
+    const uint8_t *section, *es;
+    int len, video = 0, audio = 0;
+    uint16_t pid, info_length;
+
+    section = oss_media_ts_reader_get_section(reader, p, end,
+            OSS_MEDIA_TS_PMT_TABLE_ID, &len);
+    if (section == NULL) {
+        return;
+    }
+
+    info_length = ((section[10] & 0x0F) << 8) | section[11];
+    es = section + 12 + info_length;
+
+    // the first video and audio streams of the program
+    while (es + 5 <= section + len - 4) {
+        pid = ((es[1] & 0x1F) << 8) | es[2];
+        switch (es[0]) {
+        case 0x1b:                      // h264
+        case 0xdb:                      // h264 of SAMPLE-AES
+            if (!video++) {
+                oss_media_ts_reader_set_stream(&reader->video, pid, st_h264);
+            }
+            break;
+        case 0x24:                      // hevc
+            if (!video++) {
+                oss_media_ts_reader_set_stream(&reader->video, pid, st_h265);
+            }
+            break;
+        case 0x0f:                      // aac in adts
+        case 0xcf:                      // aac of SAMPLE-AES
+            if (!audio++) {
+                oss_media_ts_reader_set_stream(&reader->audio, pid, st_aac);
+            }
+            break;
+        case 0x03:                      // mpeg-1 audio
+        case 0x04:                      // mpeg-2 audio
+            if (!audio++) {
+                oss_media_ts_reader_set_stream(&reader->audio, pid, st_mp3);
+            }
+            break;
+        default:
+            break;
+        }
+        es += 5 + (((es[3] & 0x0F) << 8) | es[4]);
+    }
+}
+
+// pts, dts and length of the pes, p is moved to its payload
+static int oss_media_ts_reader_parse_pes_header(oss_media_ts_reader_pes_t *pes,
+                                                const uint8_t **p,
+                                                const uint8_t *end)
+{
+    const uint8_t *h = *p;
+    uint32_t packet_length, header_size;
+
+    if (end - h < 9 || h[0] != 0x00 || h[1] != 0x00 || h[2] != 0x01) {
+        return -1;
+    }
+
+    packet_length = (h[4] << 8) | h[5];
+    header_size = h[8];
+    if (end - h < 9 + header_size
+        || (packet_length != 0 && packet_length < 3 + header_size))
+    {
+        return -1;
+    }
+
+    pes->pts = 0;
+    if ((h[7] & 0x80) && header_size >= 5) {
+        pes->pts = oss_media_ts_reader_read_pts(h + 9);
+    }
+    pes->dts = pes->pts;
+    if ((h[7] & 0xC0) == 0xC0 && header_size >= 10) {
+        pes->dts = oss_media_ts_reader_read_pts(h + 14);
+    }
+
+    // a length of 0 is allowed for video, the pes ends with the next one
+    pes->pes_len = packet_length ? packet_length - 3 - header_size : 0;
+    *p = h + 9 + header_size;
+    return 0;
+}
+
+static int oss_media_ts_reader_append(oss_media_ts_reader_pes_t *pes,
+                                      const uint8_t *p,
+                                      uint32_t n)
+{
+    uint32_t size;
+    uint8_t *buf;
+
+    if (pes->pes_len != 0 && pes->len + n > pes->pes_len) {
+        n = pes->pes_len - pes->len;
+    }
+
+    if (pes->size - pes->len < n) {
+        size = pes->size ? pes->size * 2 : OSS_MEDIA_TS_PES_BUFFER_SIZE;
+        if (size < pes->len + n) {
+            size = pes->len + n;
+        }
+        buf = (uint8_t*)oss_media_pool_realloc(pes->buf, size);
+        if (buf == NULL) {
+            aos_error_log("grow pes buffer to %u bytes failed.", size);
+            return -1;
+        }
+        pes->buf = buf;
+        pes->size = size;
+    }
+
+    memcpy(pes->buf + pes->len, p, n);
+    pes->len += n;
+    return 0;
+}
+
+// the stream of a pid, NULL if it is not in the pmt
+static oss_media_ts_reader_pes_t *oss_media_ts_reader_get_pes(
+        oss_media_ts_reader_t *reader, uint16_t pid)
+{
+    if (reader->video.pid != 0 && reader->video.pid == pid) {
+        return &reader->video;
+    }
+    if (reader->audio.pid != 0 && reader->audio.pid == pid) {
+        return &reader->audio;
+    }
+    return NULL;
+}
+
+/*
+ * a pes of unknown length ends with the first packet of the next one,
+ * that packet is left for the next read, after the frame is returned.
+ */
+static oss_media_ts_reader_pes_t *oss_media_ts_reader_pending(
+        oss_media_ts_reader_t *reader, const uint8_t *packet)
+{
+    oss_media_ts_reader_pes_t *pes;
+
+    if (!(packet[1] & 0x40)) {
+        return NULL;
+    }
+    pes = oss_media_ts_reader_get_pes(reader,
+            ((packet[1] & 0x1F) << 8) | packet[2]);
+    if (pes == NULL || !pes->started || pes->len == 0) {
+        return NULL;
+    }
+
+    // a pes of known length is cut short, some packets have been lost
+    if (pes->pes_len != 0) {
+        pes->started = 0;
+        pes->len = 0;
+        return NULL;
+    }
+    return pes;
+}
+
+// the packet is parsed, *ready is set to a pes which is complete
+static int oss_media_ts_reader_parse_packet(oss_media_ts_reader_t *reader,
+                                            const uint8_t *packet,
+                                            oss_media_ts_reader_pes_t **ready)
+{
+    const uint8_t *p = packet + 4;
+    const uint8_t *end = packet + OSS_MEDIA_HLS_PACKET_SIZE;
+    oss_media_ts_reader_pes_t *pes;
+    uint16_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+    int first = packet[1] & 0x40;
+    uint8_t adaptation_field_control = (packet[3] >> 4) & 0x03;
+    uint8_t cc = packet[3] & 0x0F;
+    int key = 0, discontinuity = 0;
+    int ret;
+
+    *ready = NULL;
+    reader->stats.packets++;
+
+    // transport error
+    if (packet[1] & 0x80) {
+        return 0;
+    }
+
+    if (adaptation_field_control & 0x02) {
+        if (p[0] > 0) {
+            discontinuity = p[1] & 0x80;
+            key = p[1] & 0x40;
+        }
+        p += 1 + p[0];
+        if (p > end) {
+            return 0;
+        }
+    }
+
+    // the continuity counter counts packets with payload only
+    if (!(adaptation_field_control & 0x01)) {
+        return 0;
+    }
+
+    if (pid == OSS_MEDIA_TS_PAT_PID) {
+        if (first && 0 <= oss_media_ts_reader_check_continuity(
+                &reader->pat_continuity_counter, cc, discontinuity))
+        {
+            oss_media_ts_reader_parse_pat(reader, p, end);
+        }
+        return 0;
+    }
+
+    if (reader->pmt_pid != 0 && pid == reader->pmt_pid) {
+        if (first && 0 <= oss_media_ts_reader_check_continuity(
+                &reader->pmt_continuity_counter, cc, discontinuity))
+        {
+            oss_media_ts_reader_parse_pmt(reader, p, end);
+        }
+        return 0;
+    }
+
+    pes = oss_media_ts_reader_get_pes(reader, pid);
+    if (pes == NULL) {
+        return 0;
+    }
+
+    ret = oss_media_ts_reader_check_continuity(&pes->continuity_counter,
+                                               cc, discontinuity);
+    if (ret < 0) {
+        return 0;
+    }
+    if (ret > 0) {
+        reader->stats.continuity_errors++;
+        pes->started = 0;
+        pes->len = 0;
+    }
+
+    if (first) {
+        if (0 != oss_media_ts_reader_parse_pes_header(pes, &p, end)) {
+            pes->started = 0;
+            return 0;
+        }
+        pes->started = 1;
+        pes->key = key ? 1 : 0;
+        pes->len = 0;
+    } else if (!pes->started) {
+        // the start of this pes has been lost
+        return 0;
+    }
+
+    if (0 != oss_media_ts_reader_append(pes, p, end - p)) {
+        return -1;
+    }
+
+    if (pes->pes_len != 0 && pes->len == pes->pes_len) {
+        *ready = pes;
+    }
+    return 0;
+}
+
+static void oss_media_ts_reader_set_frame(oss_media_ts_reader_pes_t *pes,
+                                          oss_media_hls_frame_t *frame)
+{
+    frame->stream_type = pes->stream_type;
+    frame->pts = pes->pts;
+    frame->dts = pes->dts;
+    frame->key = pes->key;
+    frame->pos = pes->buf;
+    frame->end = pes->buf + pes->len;
+}
+
+int oss_media_ts_reader_read_frame(oss_media_ts_reader_t *reader,
+                                   oss_media_hls_frame_t *frame)
+{
+    oss_media_ts_reader_pes_t *pes;
+    const uint8_t *packet;
+    int ret;
+
+    memset(frame, 0, sizeof(oss_media_hls_frame_t));
+
+    // the frame returned last is not needed anymore
+    if (reader->ready != NULL) {
+        reader->ready->started = 0;
+        reader->ready->len = 0;
+        reader->ready = NULL;
+    }
+
+    for (;;) {
+        ret = oss_media_ts_reader_sync(reader);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (ret == 0) {
+            // the last pes of unknown length ends with the stream
+            if (reader->video.started && reader->video.len > 0
+                && reader->video.pes_len == 0)
+            {
+                pes = &reader->video;
+            } else if (reader->audio.started && reader->audio.len > 0
+                       && reader->audio.pes_len == 0)
+            {
+                pes = &reader->audio;
+            } else {
+                return 0;
+            }
+        } else {
+            packet = reader->data + reader->pos;
+            pes = oss_media_ts_reader_pending(reader, packet);
+            if (pes == NULL) {
+                reader->pos += OSS_MEDIA_HLS_PACKET_SIZE;
+                if (0 != oss_media_ts_reader_parse_packet(reader, packet,
+                                                          &pes))
+                {
+                    return -1;
+                }
+            }
+        }
+
+        if (pes != NULL) {
+            reader->ready = pes;
+            oss_media_ts_reader_set_frame(pes, frame);
+            return 1;
+        }
+    }
+}
+
+void oss_media_ts_reader_close(oss_media_ts_reader_t *reader) {
+    oss_media_pool_free(reader->video.buf);
+    oss_media_pool_free(reader->audio.buf);
+    oss_media_pool_free(reader->buf);
+    free(reader);
+}
@@ -0,0 +1,104 @@
+#ifndef OSS_MEDIA_TS_READER_H
+#define OSS_MEDIA_TS_READER_H
+
+#include <stdint.h>
+#include "oss_media_hls.h"
+
+OSS_MEDIA_CPP_START
+
+/* bytes read from an oss media file at once, whole packets */
+#define OSS_MEDIA_TS_READER_READ_SIZE (OSS_MEDIA_HLS_PACKET_SIZE * 1024)
+
+/**
+ *  this struct describes an elementary stream of the program, its pes
+ *  packets are put together in buf until the next one starts.
+ */
+typedef struct oss_media_ts_reader_pes_s {
+    uint16_t pid;               // 0 if the pmt has no such stream
+    stream_type_t stream_type;
+    uint8_t *buf;               // in the pool of oss media
+    uint32_t size;
+    uint32_t len;
+    uint32_t pes_len;           // 0 if not told by the pes header
+    uint64_t pts;
+    uint64_t dts;
+    int8_t started;             // a pes is being put together
+    int8_t key;                 // random access of the first packet
+    int8_t continuity_counter;  // -1 until the first packet
+} oss_media_ts_reader_pes_t;
+
+/**
+ *  this struct describes the statistics of a ts reader.
+ */
+typedef struct oss_media_ts_reader_stats_s {
+    uint64_t packets;           // ts packets parsed
+    uint64_t skipped_bytes;     // bytes skipped to find a sync byte
+    uint32_t continuity_errors; // packets lost on a pid, its pes is dropped
+    uint32_t crc_errors;        // pat or pmt dropped for a bad crc32
+} oss_media_ts_reader_stats_t;
+
+/**
+ *  this struct describes a reader of ts, which demuxes the frames of the
+ *  program from a buffer or an oss media file.
+ */
+typedef struct oss_media_ts_reader_s {
+    oss_media_file_t *file;     // NULL if reading a buffer
+    const uint8_t *data;        // the buffer or buf
+    uint64_t pos;
+    uint64_t len;
+    uint8_t *buf;               // the bytes read from file
+    int8_t eof;                 // no more bytes after len
+
+    uint16_t pmt_pid;           // 0 until the pat has been read
+    int8_t pat_continuity_counter;
+    int8_t pmt_continuity_counter;
+    oss_media_ts_reader_pes_t video;
+    oss_media_ts_reader_pes_t audio;
+    oss_media_ts_reader_pes_t *ready;   // a pes to be returned next
+
+    oss_media_ts_reader_stats_t stats;
+} oss_media_ts_reader_t;
+
+/**
+ *  @brief  open a ts reader on a buffer
+ *  @param[in]  buf the ts data, it is not copied and must outlive the reader
+ *  @param[in]  len the length of buf
+ *  @return:
+ *      the reader, NULL if there is no memory
+ */
+oss_media_ts_reader_t *oss_media_ts_reader_open(const uint8_t *buf,
+                                                uint64_t len);
+
+/**
+ *  @brief  open a ts reader on an oss media file, which is read from its
+ *          current position as frames are read
+ *  @param[in]  file the oss media file opened with 'r', it is not closed
+ *              by the reader
+ *  @return:
+ *      the reader, NULL if there is no memory
+ */
+oss_media_ts_reader_t *oss_media_ts_reader_open_file(oss_media_file_t *file);
+
+/**
+ *  @brief  read the next frame of the program, in the order their pes
+ *          end in the ts. stream_type, pts, dts, key, pos and end of the
+ *          frame are set, the other fields are zeroed. the data of the
+ *          frame belongs to the reader and is valid until the next read,
+ *          frames of SAMPLE-AES are not decrypted.
+ *  @return:
+ *      upon successful completion 1 is returned with a frame
+ *      0 is returned if there is no frame anymore
+ *      OSS_MEDIA_TIMEOUT is returned if reading the file timed out
+ *      otherwise -1 is returned, the file can not be read or no memory
+ */
+int oss_media_ts_reader_read_frame(oss_media_ts_reader_t *reader,
+                                   oss_media_hls_frame_t *frame);
+
+/**
+ *  @brief  close the ts reader
+ */
+void oss_media_ts_reader_close(oss_media_ts_reader_t *reader);
+
+OSS_MEDIA_CPP_END
+
+#endif
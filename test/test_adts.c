@@ -0,0 +1,96 @@
+#include "CuTest.h"
+#include <string.h>
+#include "src/oss_media_adts.c"
+
+// an adts header without crc of a frame of length bytes
+static void test_adts_header(uint8_t *p, int length, uint8_t rate_index)
+{
+    p[0] = 0xFF;
+    p[1] = 0xF1;
+    p[2] = 0x40 | (rate_index << 2);
+    p[3] = 0x80 | ((length >> 11) & 0x03);
+    p[4] = (length >> 3) & 0xFF;
+    p[5] = ((length & 0x07) << 5) | 0x1F;
+    p[6] = 0xFC;
+}
+
+void test_oss_media_adts_frame_length(CuTest *tc) {
+    uint8_t buf[16];
+    uint32_t fixed = 0;
+
+    memset(buf, 0x5a, sizeof(buf));
+    test_adts_header(buf, 372, 6);
+    CuAssertIntEquals(tc, 372,
+            oss_media_adts_frame_length(buf, buf + sizeof(buf), &fixed));
+    CuAssertIntEquals(tc, 0xF15880, fixed);
+
+    // a header cut by end
+    CuAssertIntEquals(tc, -1, oss_media_adts_frame_length(buf, buf + 6, NULL));
+
+    // reserved sampling frequency index
+    test_adts_header(buf, 372, 13);
+    CuAssertIntEquals(tc, -1,
+            oss_media_adts_frame_length(buf, buf + sizeof(buf), NULL));
+
+    // layer of mpeg audio
+    test_adts_header(buf, 372, 6);
+    buf[1] = 0xF3;
+    CuAssertIntEquals(tc, -1,
+            oss_media_adts_frame_length(buf, buf + sizeof(buf), NULL));
+
+    // with crc the header has 9 bytes
+    test_adts_header(buf, 8, 6);
+    CuAssertIntEquals(tc, 8,
+            oss_media_adts_frame_length(buf, buf + sizeof(buf), NULL));
+    buf[1] = 0xF0;
+    CuAssertIntEquals(tc, -1,
+            oss_media_adts_frame_length(buf, buf + sizeof(buf), NULL));
+}
+
+void test_oss_media_find_adts_frames(CuTest *tc) {
+    uint8_t buf[80];
+    oss_media_adts_t frames[4];
+    const uint8_t *next;
+    int n;
+
+    memset(buf, 0x5a, sizeof(buf));
+    test_adts_header(buf, 10, 6);
+    test_adts_header(buf + 10, 12, 6);
+    // garbage, then a false sync with another fixed header
+    buf[22] = 0x00;
+    test_adts_header(buf + 25, 9, 3);
+    test_adts_header(buf + 40, 11, 6);
+    // cut by end
+    test_adts_header(buf + 60, 30, 6);
+
+    n = oss_media_find_adts_frames(buf, buf + sizeof(buf), frames, 4, &next);
+    CuAssertIntEquals(tc, 3, n);
+    CuAssertPtrEquals(tc, buf, (void*)frames[0].pos);
+    CuAssertPtrEquals(tc, buf + 10, (void*)frames[0].end);
+    CuAssertPtrEquals(tc, buf + 10, (void*)frames[1].pos);
+    CuAssertPtrEquals(tc, buf + 22, (void*)frames[1].end);
+    CuAssertPtrEquals(tc, buf + 40, (void*)frames[2].pos);
+    CuAssertPtrEquals(tc, buf + 51, (void*)frames[2].end);
+    CuAssertPtrEquals(tc, buf + 60, (void*)next);
+
+    // a full batch goes on after the last frame
+    n = oss_media_find_adts_frames(buf, buf + sizeof(buf), frames, 2, &next);
+    CuAssertIntEquals(tc, 2, n);
+    CuAssertPtrEquals(tc, buf + 22, (void*)next);
+
+    // the first frame needs no other to agree with
+    n = oss_media_find_adts_frames(buf + 22, buf + sizeof(buf), frames, 4,
+                                   &next);
+    CuAssertIntEquals(tc, 1, n);
+    CuAssertPtrEquals(tc, buf + 25, (void*)frames[0].pos);
+}
+
+CuSuite *test_adts()
+{
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, test_oss_media_adts_frame_length);
+    SUITE_ADD_TEST(suite, test_oss_media_find_adts_frames);
+
+    return suite;
+}
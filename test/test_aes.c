@@ -0,0 +1,97 @@
+#include "CuTest.h"
+#include <string.h>
+#include "test.h"
+#include "src/oss_media_aes.c"
+
+// NIST SP 800-38A F.2.1 CBC-AES128.Encrypt
+static const uint8_t cbc_key[] = {
+    0x2b,0x7e,0x15,0x16,0x28,0xae,0xd2,0xa6,
+    0xab,0xf7,0x15,0x88,0x09,0xcf,0x4f,0x3c};
+static const uint8_t cbc_iv[] = {
+    0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,
+    0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f};
+static const uint8_t cbc_plain[] = {
+    0x6b,0xc1,0xbe,0xe2,0x2e,0x40,0x9f,0x96,0xe9,0x3d,0x7e,0x11,0x73,0x93,0x17,0x2a,
+    0xae,0x2d,0x8a,0x57,0x1e,0x03,0xac,0x9c,0x9e,0xb7,0x6f,0xac,0x45,0xaf,0x8e,0x51,
+    0x30,0xc8,0x1c,0x46,0xa3,0x5c,0xe4,0x11,0xe5,0xfb,0xc1,0x19,0x1a,0x0a,0x52,0xef,
+    0xf6,0x9f,0x24,0x45,0xdf,0x4f,0x9b,0x17,0xad,0x2b,0x41,0x7b,0xe6,0x6c,0x37,0x10};
+static const uint8_t cbc_cipher[] = {
+    0x76,0x49,0xab,0xac,0x81,0x19,0xb2,0x46,0xce,0xe9,0x8e,0x9b,0x12,0xe9,0x19,0x7d,
+    0x50,0x86,0xcb,0x9b,0x50,0x72,0x19,0xee,0x95,0xdb,0x11,0x3a,0x91,0x76,0x78,0xb2,
+    0x73,0xbe,0xd6,0xb8,0xe3,0xc1,0x74,0x3b,0x71,0x16,0xe6,0x9e,0x22,0x22,0x95,0x16,
+    0x3f,0xf1,0xca,0xa1,0x68,0x1f,0xac,0x09,0x12,0x0e,0xca,0x30,0x75,0x86,0xe1,0xa7};
+
+static void check_cbc_encrypt(CuTest *tc, oss_media_aes_cbc_fn_t encrypt) {
+    oss_media_aes_t aes;
+    uint8_t buf[sizeof(cbc_plain)];
+
+    oss_media_aes_init(&aes, cbc_key, cbc_iv);
+    memcpy(buf, cbc_plain, sizeof(buf));
+    encrypt(&aes, buf, sizeof(buf));
+
+    CuAssertTrue(tc, 0 == memcmp(cbc_cipher, buf, sizeof(buf)));
+    CuAssertTrue(tc, 0 == memcmp(cbc_cipher + sizeof(buf) - 16, aes.iv, 16));
+}
+
+void test_oss_media_aes_encrypt_block(CuTest *tc) {
+    // FIPS-197 C.1, a single block with a zero iv is the plain cipher
+    uint8_t key[16];
+    uint8_t iv[16] = {0};
+    uint8_t buf[16];
+    uint8_t expected[] = {0x69,0xc4,0xe0,0xd8,0x6a,0x7b,0x04,0x30,
+                          0xd8,0xcd,0xb7,0x80,0x70,0xb4,0xc5,0x5a};
+    oss_media_aes_t aes;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        key[i] = i;
+        buf[i] = (i << 4) | i;
+    }
+
+    oss_media_aes_init(&aes, key, iv);
+    oss_media_aes_cbc_encrypt(&aes, buf, sizeof(buf));
+    CuAssertTrue(tc, 0 == memcmp(expected, buf, sizeof(buf)));
+}
+
+void test_oss_media_aes_cbc_encrypt(CuTest *tc) {
+    check_cbc_encrypt(tc, oss_media_aes_cbc_encrypt);
+}
+
+void test_oss_media_aes_cbc_encrypt_with_portable(CuTest *tc) {
+    check_cbc_encrypt(tc, oss_media_aes_cbc_encrypt_c);
+}
+
+void test_oss_media_aes_cbc_encrypt_with_aes_ni(CuTest *tc) {
+#ifdef OSS_MEDIA_AES_NI
+    if (oss_media_aes_ni_supported()) {
+        check_cbc_encrypt(tc, oss_media_aes_cbc_encrypt_ni);
+    }
+#endif
+}
+
+void test_oss_media_aes_cbc_encrypt_with_running(CuTest *tc) {
+    oss_media_aes_t aes;
+    uint8_t buf[sizeof(cbc_plain)];
+
+    // the chain continues across calls
+    oss_media_aes_init(&aes, cbc_key, cbc_iv);
+    memcpy(buf, cbc_plain, sizeof(buf));
+    oss_media_aes_cbc_encrypt(&aes, buf, 16);
+    oss_media_aes_cbc_encrypt(&aes, buf + 16, 0);
+    oss_media_aes_cbc_encrypt(&aes, buf + 16, sizeof(buf) - 16);
+
+    CuAssertTrue(tc, 0 == memcmp(cbc_cipher, buf, sizeof(buf)));
+}
+
+CuSuite *test_aes()
+{
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, test_oss_media_aes_encrypt_block);
+    SUITE_ADD_TEST(suite, test_oss_media_aes_cbc_encrypt);
+    SUITE_ADD_TEST(suite, test_oss_media_aes_cbc_encrypt_with_portable);
+    SUITE_ADD_TEST(suite, test_oss_media_aes_cbc_encrypt_with_aes_ni);
+    SUITE_ADD_TEST(suite, test_oss_media_aes_cbc_encrypt_with_running);
+
+    return suite;
+}
@@ -9,6 +9,14 @@ extern CuSuite *test_server();
 extern CuSuite *test_sts();
 extern CuSuite *test_hls();
 extern CuSuite *test_hls_stream();
+extern CuSuite *test_crc();
+extern CuSuite *test_aes();
+extern CuSuite *test_fmp4();
+extern CuSuite *test_pool();
+extern CuSuite *test_ts_reader();
+extern CuSuite *test_chunked();
+extern CuSuite *test_nal();
+extern CuSuite *test_adts();
 
 static const struct testlist {
     const char *testname;
@@ -19,6 +27,14 @@ static const struct testlist {
     {"test_sts", test_sts},
     {"test_hls", test_hls},
     {"test_hls_stream", test_hls_stream},
+    {"test_crc", test_crc},
+    {"test_aes", test_aes},
+    {"test_fmp4", test_fmp4},
+    {"test_pool", test_pool},
+    {"test_ts_reader", test_ts_reader},
+    {"test_chunked", test_chunked},
+    {"test_nal", test_nal},
+    {"test_adts", test_adts},
     {"LastTest", NULL}
 };
 
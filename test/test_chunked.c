@@ -0,0 +1,316 @@
+#include "CuTest.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "test.h"
+#include "config.h"
+#include "src/oss_media_chunked.c"
+#include "src/oss_media_client.h"
+#include "src/oss_media_hls.h"
+
+#define TEST_CHUNKED_BODY_SIZE (64 * 1024)
+#define TEST_CHUNKED_PIPE_SIZE 1000
+
+/*
+ * a local stand-in of oss, which takes one put and tells what it has got.
+ * the body is read after hold is cleared, the response has status.
+ */
+typedef struct test_stand_in_s {
+    pthread_t thread;
+    int fd;
+    int port;
+    int status;
+    int read_body;
+    volatile int hold;
+    char request[4096];
+    uint8_t body[TEST_CHUNKED_BODY_SIZE * 2];
+    uint8_t discard[TEST_CHUNKED_BODY_SIZE * 2]; // what body has no room for
+    volatile int body_len;
+    int complete;           // the last chunk has been read
+} test_stand_in_t;
+
+static test_stand_in_t stand_in;
+
+static void *test_stand_in_thread(void *arg) {
+    test_stand_in_t *s = (test_stand_in_t*)arg;
+    char line[64];
+    char response[128];
+    uint8_t *to;
+    int conn, len, size, n;
+    FILE *in;
+
+    // an aborted put may never connect, the stand-in is stopped then
+    conn = accept(s->fd, NULL, NULL);
+    if (conn < 0) {
+        return NULL;
+    }
+    in = fdopen(conn, "r");
+    len = 0;
+    while (len < (int)sizeof(s->request) - 1 && fgets(s->request + len,
+                sizeof(s->request) - len, in) != NULL)
+    {
+        if (0 == strcmp(s->request + len, "\r\n")) {
+            break;
+        }
+        len += strlen(s->request + len);
+    }
+
+    while (s->hold) {
+        usleep(1000);
+    }
+
+    while (s->read_body && fgets(line, sizeof(line), in) != NULL) {
+        size = strtol(line, NULL, 16);
+        if (size == 0) {
+            s->complete = 1;
+            break;
+        }
+        to = s->body_len + size <= (int)sizeof(s->body) ?
+             s->body + s->body_len : s->discard;
+        n = fread(to, 1, size, in);
+        if (to != s->discard) {
+            s->body_len += n;
+        }
+        if (n != size || fgets(line, sizeof(line), in) == NULL) {
+            break;
+        }
+    }
+
+    len = sprintf(response, "HTTP/1.1 %d Stand In\r\nContent-Length: 0\r\n"
+                  "Connection: close\r\n\r\n", s->status);
+    write(conn, response, len);
+    fclose(in);
+    return NULL;
+}
+
+static void test_stand_in_start(int status, int read_body, int hold) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&stand_in, 0, sizeof(stand_in));
+    stand_in.status = status;
+    stand_in.read_body = read_body;
+    stand_in.hold = hold;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    stand_in.fd = socket(AF_INET, SOCK_STREAM, 0);
+    bind(stand_in.fd, (struct sockaddr*)&addr, sizeof(addr));
+    listen(stand_in.fd, 1);
+    getsockname(stand_in.fd, (struct sockaddr*)&addr, &addr_len);
+    stand_in.port = ntohs(addr.sin_port);
+
+    pthread_create(&stand_in.thread, NULL, test_stand_in_thread, &stand_in);
+}
+
+static void test_stand_in_stop() {
+    stand_in.hold = 0;
+    shutdown(stand_in.fd, SHUT_RDWR);
+    pthread_join(stand_in.thread, NULL);
+    close(stand_in.fd);
+}
+
+static char *test_stand_in_url(char *url, const char *key) {
+    sprintf(url, "http://127.0.0.1:%d/%s", stand_in.port, key);
+    return url;
+}
+
+static int64_t test_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void stand_in_auth_func(oss_media_file_t *file) {
+    static char endpoint[64];
+
+    sprintf(endpoint, "127.0.0.1:%d", stand_in.port);
+    file->endpoint = endpoint;
+    file->is_cname = 1;
+    file->access_key_id = TEST_ACCESS_KEY_ID;
+    file->access_key_secret = TEST_ACCESS_KEY_SECRET;
+    file->token = NULL;
+    file->expiration = time(NULL) + 300;
+}
+
+void test_oss_media_chunked_put_write(CuTest *tc) {
+    int i;
+    int64_t ret;
+    char url[128];
+    uint8_t body[TEST_CHUNKED_BODY_SIZE];
+    oss_media_chunked_put_t *put;
+
+    for (i = 0; i < TEST_CHUNKED_BODY_SIZE; i++) {
+        body[i] = i * 13 & 0xFF;
+    }
+
+    test_stand_in_start(200, 1, 0);
+    put = oss_media_chunked_put_open(test_stand_in_url(url, "dir/put.ts"),
+                                     TEST_CHUNKED_PIPE_SIZE);
+    CuAssertTrue(tc, put != NULL);
+
+    // writes larger than the pipe wait for the request to take them
+    for (i = 0; i < TEST_CHUNKED_BODY_SIZE; i += 1500) {
+        ret = oss_media_chunked_put_write(put, body + i,
+                TEST_CHUNKED_BODY_SIZE - i < 1500 ?
+                TEST_CHUNKED_BODY_SIZE - i : 1500, 0);
+        CuAssertTrue(tc, ret > 0);
+    }
+    CuAssertIntEquals(tc, 0, oss_media_chunked_put_close(put, 0, 0));
+    test_stand_in_stop();
+
+    CuAssertTrue(tc, 0 == strncmp(stand_in.request, "PUT /dir/put.ts ", 16));
+    CuAssertTrue(tc, NULL != strstr(stand_in.request,
+                                    "Transfer-Encoding: chunked\r\n"));
+    CuAssertIntEquals(tc, 1, stand_in.complete);
+    CuAssertIntEquals(tc, TEST_CHUNKED_BODY_SIZE, stand_in.body_len);
+    CuAssertTrue(tc, 0 == memcmp(body, stand_in.body, sizeof(body)));
+}
+
+void test_oss_media_chunked_put_with_error_status(CuTest *tc) {
+    char url[128];
+    uint8_t body[100];
+    oss_media_chunked_put_t *put;
+
+    memset(body, 0x5a, sizeof(body));
+    test_stand_in_start(403, 0, 0);
+    put = oss_media_chunked_put_open(test_stand_in_url(url, "put.ts"),
+                                     TEST_CHUNKED_PIPE_SIZE);
+    CuAssertTrue(tc, put != NULL);
+
+    oss_media_chunked_put_write(put, body, sizeof(body), 0);
+    CuAssertIntEquals(tc, -1, oss_media_chunked_put_close(put, 0, 0));
+    test_stand_in_stop();
+}
+
+void test_oss_media_chunked_put_with_abort(CuTest *tc) {
+    int64_t ret;
+    char url[128];
+    uint8_t body[100];
+    oss_media_chunked_put_t *put;
+
+    memset(body, 0x5a, sizeof(body));
+    test_stand_in_start(200, 1, 0);
+    put = oss_media_chunked_put_open(test_stand_in_url(url, "put.ts"),
+                                     TEST_CHUNKED_PIPE_SIZE);
+    CuAssertTrue(tc, put != NULL);
+
+    ret = oss_media_chunked_put_write(put, body, sizeof(body), 0);
+    CuAssertIntEquals(tc, sizeof(body), ret);
+
+    // the body has no last chunk, so the object is not stored
+    CuAssertIntEquals(tc, -1, oss_media_chunked_put_close(put, 1, 0));
+    test_stand_in_stop();
+    CuAssertIntEquals(tc, 0, stand_in.complete);
+}
+
+void test_oss_media_chunked_put_with_deadline_exceeded(CuTest *tc) {
+    int i;
+    int64_t ret = 0;
+    char url[128];
+    uint8_t body[TEST_CHUNKED_BODY_SIZE];
+    oss_media_chunked_put_t *put;
+
+    memset(body, 0x5a, sizeof(body));
+    test_stand_in_start(200, 1, 1);
+    put = oss_media_chunked_put_open(test_stand_in_url(url, "put.ts"),
+                                     TEST_CHUNKED_PIPE_SIZE);
+    CuAssertTrue(tc, put != NULL);
+
+    // the stand-in does not read, the socket buffers fill up at last
+    for (i = 0; i < 4096 && ret != OSS_MEDIA_TIMEOUT; i++) {
+        ret = oss_media_chunked_put_write(put, body, sizeof(body),
+                                          test_now_us() + 100 * 1000);
+    }
+    CuAssertIntEquals(tc, OSS_MEDIA_TIMEOUT, ret);
+    ret = oss_media_chunked_put_write(put, body, 1, 0);
+    CuAssertIntEquals(tc, OSS_MEDIA_TIMEOUT, ret);
+
+    stand_in.hold = 0;
+    CuAssertIntEquals(tc, OSS_MEDIA_TIMEOUT,
+                      oss_media_chunked_put_close(put, 0, 0));
+    test_stand_in_stop();
+    CuAssertIntEquals(tc, 0, stand_in.complete);
+}
+
+void test_oss_media_chunked_put_close_with_deadline_exceeded(CuTest *tc) {
+    int64_t ret;
+    int64_t start;
+    char url[128];
+    uint8_t body[100];
+    oss_media_chunked_put_t *put;
+
+    memset(body, 0x5a, sizeof(body));
+    test_stand_in_start(200, 1, 1);
+    put = oss_media_chunked_put_open(test_stand_in_url(url, "put.ts"),
+                                     TEST_CHUNKED_PIPE_SIZE);
+    CuAssertTrue(tc, put != NULL);
+
+    ret = oss_media_chunked_put_write(put, body, sizeof(body), 0);
+    CuAssertIntEquals(tc, sizeof(body), ret);
+
+    // the stand-in holds the response, the close gives up at the deadline
+    start = test_now_us();
+    CuAssertIntEquals(tc, OSS_MEDIA_TIMEOUT,
+            oss_media_chunked_put_close(put, 0, start + 100 * 1000));
+    CuAssertTrue(tc, test_now_us() - start < 2000 * 1000);
+    test_stand_in_stop();
+}
+
+void test_oss_media_hls_write_frame_with_chunked(CuTest *tc) {
+    int i;
+    int ret;
+    uint8_t video[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+
+    test_stand_in_start(200, 1, 0);
+    file = oss_media_hls_open_chunked(TEST_BUCKET_NAME, "dir/chunked.ts",
+                                      stand_in_auth_func);
+    CuAssertTrue(tc, file != NULL);
+    CuAssertIntEquals(tc, 1, file->options.chunked);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.key = 1;
+    frame.pos = video;
+    frame.end = video + sizeof(video);
+    frame.pts = frame.dts = 5000;
+    ret = oss_media_hls_write_frame(&frame, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // the frame is on the wire before the file ends
+    for (i = 0; i < 2000 && stand_in.body_len < 3 * OSS_MEDIA_HLS_PACKET_SIZE;
+         i++)
+    {
+        usleep(1000);
+    }
+    CuAssertIntEquals(tc, 3 * OSS_MEDIA_HLS_PACKET_SIZE, stand_in.body_len);
+    CuAssertIntEquals(tc, 0, stand_in.complete);
+
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+    test_stand_in_stop();
+
+    CuAssertTrue(tc, 0 == strncmp(stand_in.request,
+                                  "PUT /dir/chunked.ts?", 20));
+    CuAssertIntEquals(tc, 1, stand_in.complete);
+    CuAssertIntEquals(tc, 0x47, stand_in.body[0]);
+}
+
+CuSuite *test_chunked()
+{
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, test_oss_media_chunked_put_write);
+    SUITE_ADD_TEST(suite, test_oss_media_chunked_put_with_error_status);
+    SUITE_ADD_TEST(suite, test_oss_media_chunked_put_with_abort);
+    SUITE_ADD_TEST(suite, test_oss_media_chunked_put_with_deadline_exceeded);
+    SUITE_ADD_TEST(suite, test_oss_media_chunked_put_close_with_deadline_exceeded);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_chunked);
+
+    return suite;
+}
@@ -2,7 +2,9 @@
 #include "test.h"
 #include "config.h"
 #include "src/oss_media_client.h"
+#include "src/oss_media_crc.h"
 #include <oss_c_sdk/aos_define.h>
+#include <unistd.h>
 
 int64_t write_file(const char* content);
 void delete_file(oss_media_file_t *file);
@@ -89,6 +91,8 @@ void test_append_file_succeeded(CuTest *tc) {
 
     CuAssertStrEquals(tc, "Appendable", stat.type);
     CuAssertIntEquals(tc, write_size * 2, stat.length);
+    CuAssertTrue(tc, stat.crc64_valid);
+    CuAssertTrue(tc, stat.crc64 == file->_stat.crc64);
 
     // close file
     delete_file(file);
@@ -97,6 +101,40 @@ void test_append_file_succeeded(CuTest *tc) {
     printf("%s ok\n", __FUNCTION__);
 }
 
+void test_append_file_failed_with_crc64_mismatch(CuTest *tc) {
+    int64_t write_size = 0;
+    oss_media_file_t *file = NULL;
+    char *content = NULL;
+    oss_media_file_stat_t stat;
+    int ret;
+
+    content = "hello oss media file\n";
+
+    file = oss_media_file_open(TEST_BUCKET_NAME, "oss_media_file.txt", 
+                               "a", auth_func);
+    CuAssertTrue(tc, NULL != file);
+
+    write_size = oss_media_file_write(file, content, strlen(content));
+    CuAssertIntEquals(tc, strlen(content), write_size);
+
+    // corrupt the running crc64, the crc64 of the server does not match
+    // the next append which lands, it must not be appended again
+    file->_stat.crc64 = 1;
+    write_size = oss_media_file_write(file, content, strlen(content));
+    CuAssertIntEquals(tc, OSS_MEDIA_CRC64_MISMATCH, write_size);
+
+    ret = oss_media_file_stat(file, &stat);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, strlen(content) * 2, stat.length);
+    CuAssertIntEquals(tc, stat.length, file->_stat.length);
+    CuAssertTrue(tc, stat.crc64 == file->_stat.crc64);
+
+    delete_file(file);
+    oss_media_file_close(file);
+
+    printf("%s ok\n", __FUNCTION__);
+}
+
 void test_write_file_failed_with_invalid_key(CuTest *tc) {
     int64_t write_size = 0;
     oss_media_file_t *file = NULL;
@@ -124,6 +162,35 @@ void test_write_file_failed_with_invalid_key(CuTest *tc) {
 }
 
 
+void test_write_file_failed_with_deadline_exceeded(CuTest *tc) {
+    int64_t write_size = 0;
+    oss_media_file_t *file = NULL;
+    char *content = NULL;
+
+    content = "hello oss media file\n";
+
+    // open file
+    file = oss_media_file_open(TEST_BUCKET_NAME, "oss_media_file", "w", auth_func);
+    CuAssertTrue(tc, NULL != file);
+
+    // write file after the deadline
+    oss_media_file_set_deadline(file, 1);
+    usleep(2000);
+    write_size = oss_media_file_write(file, content, strlen(content));
+    CuAssertIntEquals(tc, OSS_MEDIA_TIMEOUT, write_size);
+
+    // write file without deadline
+    oss_media_file_set_deadline(file, 0);
+    write_size = oss_media_file_write(file, content, strlen(content));
+    CuAssertIntEquals(tc, strlen(content), write_size);
+
+    // close file
+    delete_file(file);
+    oss_media_file_close(file);
+    
+    printf("%s ok\n", __FUNCTION__);
+}
+
 void test_write_file_failed_with_wrong_flag(CuTest *tc) {
     int64_t write_size = 0;
     oss_media_file_t *file = NULL;
@@ -242,6 +309,49 @@ void test_append_file_failed_with_appendable_cover_normal(CuTest *tc) {
     printf("%s ok\n", __FUNCTION__);
 }
 
+void test_put_file_cover_appendable(CuTest *tc) {
+    int64_t write_size = 0;
+    oss_media_file_t *file = NULL;
+    char *content = NULL;
+    oss_media_file_stat_t stat;
+    int ret;
+
+    content = "hello oss media file\n";
+
+    // open file
+    file = oss_media_file_open(TEST_BUCKET_NAME, "oss_media_file", "aw", auth_func);
+    CuAssertTrue(tc, NULL != file);
+
+    write_size = oss_media_file_write(file, content, strlen(content));
+    CuAssertIntEquals(tc, write_size, strlen(content));
+
+    // close file
+    oss_media_file_close(file);
+
+    // open file, nothing is requested before the write
+    file = oss_media_file_open(TEST_BUCKET_NAME, "oss_media_file", "p", auth_func);
+    CuAssertTrue(tc, NULL != file);
+    CuAssertIntEquals(tc, 0, file->_stat.length);
+
+    // every write replaces the object, so a retry is harmless
+    write_size = oss_media_file_write(file, content, strlen(content));
+    CuAssertIntEquals(tc, write_size, strlen(content));
+    write_size = oss_media_file_write(file, content, strlen(content));
+    CuAssertIntEquals(tc, write_size, strlen(content));
+
+    ret = oss_media_file_stat(file, &stat);
+    CuAssertIntEquals(tc, 0, ret);
+
+    CuAssertStrEquals(tc, "Normal", stat.type);
+    CuAssertIntEquals(tc, strlen(content), stat.length);
+
+    // close file and free
+    delete_file(file);
+    oss_media_file_close(file);
+
+    printf("%s ok\n", __FUNCTION__);
+}
+
 void test_read_file_succeeded(CuTest *tc) {
     int64_t write_size = 0;
     oss_media_file_t *file = NULL;
@@ -278,6 +388,37 @@ void test_read_file_succeeded(CuTest *tc) {
     printf("%s ok\n", __FUNCTION__);
 }
 
+void test_read_file_failed_with_crc64_mismatch(CuTest *tc) {
+    int64_t write_size = 0;
+    oss_media_file_t *file = NULL;
+    char *write_content = NULL;
+    char buf[64];
+    int64_t nread;
+    
+    write_content = "hello oss media file\n";
+    write_size = write_file(write_content);
+    CuAssertTrue(tc, write_size != -1);
+
+    // open file for read
+    file = oss_media_file_open(TEST_BUCKET_NAME, "oss_media_file", "r", auth_func);
+    CuAssertTrue(tc, NULL != file);
+    CuAssertTrue(tc, file->_stat.crc64_valid);
+    CuAssertTrue(tc, file->_stat.crc64 == 
+                 oss_media_crc64(0, write_content, strlen(write_content)));
+
+    // corrupt the running crc64, the whole file read must be rejected
+    file->read_crc64 = 1;
+    nread = oss_media_file_read(file, buf, sizeof(buf));
+    CuAssertIntEquals(tc, -1, nread);
+    CuAssertIntEquals(tc, 0, file->_stat.pos);
+
+    // close file
+    delete_file(file);
+    oss_media_file_close(file);
+
+    printf("%s ok\n", __FUNCTION__);
+}
+
 void test_read_part_file_succeeded(CuTest *tc) {
     int64_t write_size = 0;
     oss_media_file_t *file = NULL;
@@ -592,6 +733,7 @@ void test_append_file_with_error_handle(CuTest *tc) {
 
     // enter error handle, and ignore this write.
     file->_stat.length -= write_size;
+    file->_stat.crc64 = 0;
     CuAssertIntEquals(tc, file->_stat.length, 0);
     write_size = oss_media_file_write(file, content0, content_len);
     CuAssertIntEquals(tc, content_len, write_size);
@@ -636,6 +778,7 @@ void test_append_file_with_error_handle(CuTest *tc) {
     CuAssertIntEquals(tc, strncmp(buff, content0, content_len), 0);
     CuAssertIntEquals(tc, strncmp(buff + content_len, content1, content_len), 0);
     CuAssertIntEquals(tc, strncmp(buff + content_len*2, content2, content_len), 0);
+    CuAssertTrue(tc, file->read_crc64 == stat.crc64);
 
     delete_file(file);
     oss_media_file_close(file);
@@ -652,14 +795,18 @@ CuSuite *test_client()
     // write test
     SUITE_ADD_TEST(suite, test_write_file_succeeded);
     SUITE_ADD_TEST(suite, test_append_file_succeeded);
+    SUITE_ADD_TEST(suite, test_append_file_failed_with_crc64_mismatch);
     SUITE_ADD_TEST(suite, test_write_file_failed_with_wrong_flag);
     SUITE_ADD_TEST(suite, test_write_file_with_normal_cover_appendable);
     SUITE_ADD_TEST(suite, test_append_file_failed_with_appendable_cover_normal);
+    SUITE_ADD_TEST(suite, test_put_file_cover_appendable);
     SUITE_ADD_TEST(suite, test_write_file_failed_with_invalid_key);
+    SUITE_ADD_TEST(suite, test_write_file_failed_with_deadline_exceeded);
     
     // read test
     SUITE_ADD_TEST(suite, test_read_file_succeeded);
     SUITE_ADD_TEST(suite, test_read_part_file_succeeded);
+    SUITE_ADD_TEST(suite, test_read_file_failed_with_crc64_mismatch);
     SUITE_ADD_TEST(suite, test_read_file_failed_with_wrong_flag);
     SUITE_ADD_TEST(suite, test_read_file_failed_with_eof);
     SUITE_ADD_TEST(suite, test_read_file_failed_with_key_is_not_exist);
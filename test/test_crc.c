@@ -0,0 +1,64 @@
+#include "CuTest.h"
+#include <string.h>
+#include "test.h"
+#include "src/oss_media_crc.h"
+
+void test_oss_media_crc64(CuTest *tc) {
+    char *data = "123456789";
+
+    uint64_t crc64 = oss_media_crc64(0, data, strlen(data));
+    CuAssertTrue(tc, 0x995DC9BBDF1939FAULL == crc64);
+}
+
+void test_oss_media_crc64_with_empty(CuTest *tc) {
+    char *data = "123456789";
+
+    CuAssertTrue(tc, 0 == oss_media_crc64(0, data, 0));
+    CuAssertTrue(tc, 0x995DC9BBDF1939FAULL == 
+                 oss_media_crc64(0x995DC9BBDF1939FAULL, data, 0));
+}
+
+void test_oss_media_crc64_with_running(CuTest *tc) {
+    int i;
+    int len;
+    uint8_t data[1024];
+    uint64_t crc64;
+    uint64_t expected;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (i * 31 + 7) & 0xFF;
+    }
+    expected = oss_media_crc64(0, data, sizeof(data));
+
+    // split at every alignment, the running crc64 must be the same
+    for (len = 0; len < 17; len++) {
+        crc64 = oss_media_crc64(0, data, len);
+        crc64 = oss_media_crc64(crc64, data + len, sizeof(data) - len);
+        CuAssertTrue(tc, expected == crc64);
+    }
+}
+
+void test_oss_media_crc32(CuTest *tc) {
+    char *data = "xi'an-chengdu-hangzhou-beijing";
+    uint32_t crc32;
+
+    crc32 = oss_media_crc32(0xFFFFFFFF, data, strlen(data));
+    CuAssertIntEquals(tc, -1266222823, crc32);
+
+    // split in the middle of a 8 bytes block
+    crc32 = oss_media_crc32(0xFFFFFFFF, data, 11);
+    crc32 = oss_media_crc32(crc32, data + 11, strlen(data) - 11);
+    CuAssertIntEquals(tc, -1266222823, crc32);
+}
+
+CuSuite *test_crc()
+{
+    CuSuite* suite = CuSuiteNew();   
+
+    SUITE_ADD_TEST(suite, test_oss_media_crc64);
+    SUITE_ADD_TEST(suite, test_oss_media_crc64_with_empty);
+    SUITE_ADD_TEST(suite, test_oss_media_crc64_with_running);
+    SUITE_ADD_TEST(suite, test_oss_media_crc32);
+
+    return suite;
+}
@@ -0,0 +1,498 @@
+#include "CuTest.h"
+#include <string.h>
+#include "test.h"
+#include "src/oss_media_fmp4.c"
+
+static uint8_t fmp4_captured[64 * 1024];
+static int fmp4_captured_len;
+
+static int fmp4_capture_handler(oss_media_hls_file_t *file) {
+    int len = file->buffer->pos - file->buffer->start;
+
+    memcpy(fmp4_captured + fmp4_captured_len,
+           &file->buffer->buf[file->buffer->start], len);
+    fmp4_captured_len += len;
+    file->buffer->pos = file->buffer->start;
+
+    return 0;
+}
+
+static oss_media_hls_file_t *create_fmp4_file() {
+    oss_media_hls_file_t *file;
+
+    file = (oss_media_hls_file_t*)calloc(1, sizeof(oss_media_hls_file_t));
+    file->options.format = sf_fmp4;
+    file->options.handler_func = fmp4_capture_handler;
+    file->buffer = (oss_media_hls_buf_t*)calloc(1, sizeof(oss_media_hls_buf_t));
+    file->buffer->buf = (uint8_t*)oss_media_pool_alloc(
+            OSS_MEDIA_DEFAULT_WRITE_BUFFER);
+    file->buffer->end = OSS_MEDIA_DEFAULT_WRITE_BUFFER;
+
+    fmp4_captured_len = 0;
+    return file;
+}
+
+static void destroy_fmp4_file(oss_media_hls_file_t *file) {
+    oss_media_pool_free(file->buffer->buf);
+    free(file->buffer);
+    free(file->fmp4);
+    free(file);
+}
+
+/*
+ * sps are built with a bit writer, so the tests show the fields which
+ * the picture size comes from.
+ */
+typedef struct {
+    uint8_t buf[64];
+    int pos;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, uint32_t v, int n) {
+    while (n-- > 0) {
+        if ((v >> n) & 1) {
+            w->buf[w->pos / 8] |= 0x80 >> (w->pos % 8);
+        }
+        w->pos++;
+    }
+}
+
+static void put_ue(bit_writer_t *w, uint32_t v) {
+    int n = 0;
+    while (((v + 1) >> n) > 1) {
+        n++;
+    }
+    put_bits(w, 0, n);
+    put_bits(w, v + 1, n + 1);
+}
+
+// baseline 640x480
+static int make_sps_640x480(uint8_t *sps) {
+    bit_writer_t w;
+
+    memset(&w, 0, sizeof(w));
+    put_bits(&w, 0x67, 8);
+    put_bits(&w, 66, 8);        // profile
+    put_bits(&w, 0xC0, 8);
+    put_bits(&w, 30, 8);        // level
+    put_ue(&w, 0);              // sps id
+    put_ue(&w, 0);              // log2 max frame num
+    put_ue(&w, 0);              // poc type
+    put_ue(&w, 0);              // log2 max poc lsb
+    put_ue(&w, 1);              // max ref frames
+    put_bits(&w, 0, 1);
+    put_ue(&w, 39);             // 40 mbs
+    put_ue(&w, 29);             // 30 map units
+    put_bits(&w, 1, 1);         // frame mbs only
+    put_bits(&w, 1, 1);
+    put_bits(&w, 0, 1);         // no cropping
+    put_bits(&w, 0, 1);         // no vui
+    put_bits(&w, 1, 1);         // stop bit
+
+    memcpy(sps, w.buf, (w.pos + 7) / 8);
+    return (w.pos + 7) / 8;
+}
+
+// high profile 1920x1088 cropped to 1080
+static int make_sps_1080p(uint8_t *sps) {
+    bit_writer_t w;
+
+    memset(&w, 0, sizeof(w));
+    put_bits(&w, 0x67, 8);
+    put_bits(&w, 100, 8);
+    put_bits(&w, 0, 8);
+    put_bits(&w, 40, 8);
+    put_ue(&w, 0);
+    put_ue(&w, 1);              // chroma 4:2:0
+    put_ue(&w, 0);
+    put_ue(&w, 0);
+    put_bits(&w, 0, 1);
+    put_bits(&w, 0, 1);         // no scaling matrix
+    put_ue(&w, 0);
+    put_ue(&w, 0);
+    put_ue(&w, 0);
+    put_ue(&w, 4);
+    put_bits(&w, 0, 1);
+    put_ue(&w, 119);
+    put_ue(&w, 67);
+    put_bits(&w, 1, 1);
+    put_bits(&w, 1, 1);
+    put_bits(&w, 1, 1);         // cropping
+    put_ue(&w, 0);
+    put_ue(&w, 0);
+    put_ue(&w, 0);
+    put_ue(&w, 4);              // 8 lines at the bottom
+    put_bits(&w, 0, 1);
+    put_bits(&w, 1, 1);
+
+    memcpy(sps, w.buf, (w.pos + 7) / 8);
+    return (w.pos + 7) / 8;
+}
+
+static const uint8_t test_pps[] = {0x68, 0xCE, 0x38, 0x80};
+
+// aac lc, 48000Hz, stereo
+static int make_adts(uint8_t *p, int payload) {
+    int len = 7 + payload;
+    int i;
+
+    p[0] = 0xFF;
+    p[1] = 0xF1;
+    p[2] = (1 << 6) | (3 << 2);
+    p[3] = (2 << 6) | ((len >> 11) & 0x03);
+    p[4] = (len >> 3) & 0xFF;
+    p[5] = ((len & 0x07) << 5) | 0x1F;
+    p[6] = 0xFC;
+    for (i = 0; i < payload; i++) {
+        p[7 + i] = 0x80 | i;
+    }
+    return len;
+}
+
+// a key frame with sps and pps, then a slice
+static int make_key_frame(uint8_t *p) {
+    uint8_t *start = p;
+    int i;
+
+    memcpy(p, "\x00\x00\x00\x01", 4);
+    p += 4;
+    p += make_sps_640x480(p);
+    memcpy(p, "\x00\x00\x00\x01", 4);
+    p += 4;
+    memcpy(p, test_pps, sizeof(test_pps));
+    p += sizeof(test_pps);
+    memcpy(p, "\x00\x00\x01\x65", 4);
+    p += 4;
+    for (i = 0; i < 100; i++) {
+        *p++ = 0x80 | i;
+    }
+    return p - start;
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// the first box of type in [p, end), NULL if none
+static const uint8_t *find_box(const uint8_t *p, const uint8_t *end,
+                               const char *type)
+{
+    while (end - p >= 8) {
+        if (memcmp(p + 4, type, 4) == 0) {
+            return p;
+        }
+        p += get32(p);
+    }
+    return NULL;
+}
+
+// the box at path like "moov/trak/mdia", each level starts after the header
+static const uint8_t *find_path(const uint8_t *p, const uint8_t *end,
+                                const char *path)
+{
+    char type[5] = {0};
+
+    while (p != NULL) {
+        memcpy(type, path, 4);
+        p = find_box(p, end, type);
+        if (p == NULL || path[4] == '\0') {
+            return p;
+        }
+        end = p + get32(p);
+        p += 8;
+        path += 5;
+    }
+    return NULL;
+}
+
+void test_oss_media_fmp4_copy_nals(CuTest *tc) {
+    oss_media_fmp4_t fmp4;
+    uint8_t in[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10,
+                    0x00, 0x00, 0x01, 0x68, 0xCE, 0x38, 0x80,
+                    0x00, 0x00, 0x01, 0x65, 0xAA, 0x00, 0x00, 0x03, 0xBB,
+                    0x00};
+    uint8_t expected[] = {0x00, 0x00, 0x00, 0x02, 0x09, 0x10,
+                          0x00, 0x00, 0x00, 0x04, 0x68, 0xCE, 0x38, 0x80,
+                          0x00, 0x00, 0x00, 0x06, 0x65, 0xAA, 0x00, 0x00,
+                          0x03, 0xBB};
+    uint8_t out[64];
+    uint8_t *end;
+
+    memset(&fmp4, 0, sizeof(fmp4));
+    end = oss_media_fmp4_copy_nals(&fmp4, out, in, in + sizeof(in));
+
+    CuAssertIntEquals(tc, sizeof(expected), end - out);
+    CuAssertTrue(tc, 0 == memcmp(expected, out, sizeof(expected)));
+    CuAssertIntEquals(tc, 4, fmp4.pps_size);
+    CuAssertIntEquals(tc, 0, fmp4.sps_size);
+}
+
+void test_oss_media_fmp4_parse_sps(CuTest *tc) {
+    oss_media_fmp4_t fmp4;
+
+    memset(&fmp4, 0, sizeof(fmp4));
+    fmp4.sps_size = make_sps_640x480(fmp4.sps);
+    oss_media_fmp4_parse_sps(&fmp4);
+    CuAssertIntEquals(tc, 640, fmp4.width);
+    CuAssertIntEquals(tc, 480, fmp4.height);
+
+    memset(&fmp4, 0, sizeof(fmp4));
+    fmp4.sps_size = make_sps_1080p(fmp4.sps);
+    oss_media_fmp4_parse_sps(&fmp4);
+    CuAssertIntEquals(tc, 1920, fmp4.width);
+    CuAssertIntEquals(tc, 1080, fmp4.height);
+}
+
+void test_oss_media_fmp4_write_fragment(CuTest *tc) {
+    uint8_t video[256];
+    uint8_t audio[64];
+    uint8_t slice[] = {0x00, 0x00, 0x01, 0x41, 0x9A, 0x02};
+    int video_len, audio_len;
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+    const uint8_t *end, *moof, *mdat, *traf, *trun, *data;
+
+    file = create_fmp4_file();
+    video_len = make_key_frame(video);
+    audio_len = make_adts(audio, 10);
+    audio_len += make_adts(audio + audio_len, 20);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.pos = video;
+    frame.end = video + video_len;
+    frame.dts = 9000;
+    frame.pts = 12000;
+    frame.key = 1;
+    CuAssertIntEquals(tc, 0, oss_media_hls_write_frame(&frame, file));
+    CuAssertTrue(tc, frame.pos == frame.end);
+
+    frame.stream_type = st_aac;
+    frame.pos = audio;
+    frame.end = audio + audio_len;
+    frame.dts = 9000;
+    frame.pts = 9000;
+    CuAssertIntEquals(tc, 0, oss_media_hls_write_frame(&frame, file));
+
+    frame.stream_type = st_h264;
+    frame.pos = slice;
+    frame.end = slice + sizeof(slice);
+    frame.dts = 12000;
+    frame.pts = 12000;
+    frame.key = 0;
+    CuAssertIntEquals(tc, 0, oss_media_hls_write_frame(&frame, file));
+
+    CuAssertIntEquals(tc, 0, oss_media_hls_flush(file));
+    CuAssertIntEquals(tc, 0, file->fmp4->sample_count);
+
+    end = fmp4_captured + fmp4_captured_len;
+    moof = find_box(fmp4_captured, end, "moof");
+    CuAssertTrue(tc, moof == fmp4_captured);
+    mdat = find_box(moof, end, "mdat");
+    CuAssertTrue(tc, mdat == moof + get32(moof));
+    CuAssertIntEquals(tc, end - mdat, get32(mdat));
+    CuAssertIntEquals(tc, 1, get32(find_path(moof, end, "moof/mfhd") + 12));
+
+    // video: the key frame and the slice are split by the audio samples
+    traf = find_path(moof, end, "moof/traf");
+    CuAssertIntEquals(tc, 1, get32(find_path(traf, end, "traf/tfhd") + 12));
+    CuAssertIntEquals(tc, 0, get32(find_path(traf, end, "traf/tfdt") + 12));
+    CuAssertIntEquals(tc, 9000, get32(find_path(traf, end, "traf/tfdt") + 16));
+    trun = find_path(traf, end, "traf/trun");
+    CuAssertIntEquals(tc, 0x01000F01, get32(trun + 8));
+    CuAssertIntEquals(tc, 1, get32(trun + 12));
+    CuAssertIntEquals(tc, 3000, get32(trun + 20));
+    CuAssertIntEquals(tc, OSS_MEDIA_FMP4_SYNC_SAMPLE, get32(trun + 28));
+    CuAssertIntEquals(tc, 3000, get32(trun + 32));
+    data = moof + get32(trun + 16);
+    CuAssertTrue(tc, data == mdat + 8);
+    CuAssertIntEquals(tc, get32(trun + 24), 4 + get32(data)
+                      + 4 + get32(data + 4 + get32(data))
+                      + 4 + 101);
+
+    trun = find_box(trun + get32(trun), traf + get32(traf), "trun");
+    CuAssertIntEquals(tc, 1, get32(trun + 12));
+    CuAssertIntEquals(tc, 3000, get32(trun + 20));
+    CuAssertIntEquals(tc, 7, get32(trun + 24));
+    CuAssertIntEquals(tc, OSS_MEDIA_FMP4_NON_SYNC_SAMPLE, get32(trun + 28));
+    data = moof + get32(trun + 16);
+    CuAssertTrue(tc, 0 == memcmp("\x00\x00\x00\x03\x41\x9A\x02", data, 7));
+
+    // audio: two samples without adts headers
+    traf = find_box(traf + get32(traf), mdat, "traf");
+    CuAssertIntEquals(tc, 2, get32(find_path(traf, end, "traf/tfhd") + 12));
+    trun = find_path(traf, end, "traf/trun");
+    CuAssertIntEquals(tc, 0x00000301, get32(trun + 8));
+    CuAssertIntEquals(tc, 2, get32(trun + 12));
+    CuAssertIntEquals(tc, 1920, get32(trun + 20));
+    CuAssertIntEquals(tc, 10, get32(trun + 24));
+    CuAssertIntEquals(tc, 1920, get32(trun + 28));
+    CuAssertIntEquals(tc, 20, get32(trun + 32));
+    data = moof + get32(trun + 16);
+    CuAssertTrue(tc, 0 == memcmp(audio + 7, data, 10));
+    CuAssertTrue(tc, 0 == memcmp(audio + 24, data + 10, 20));
+
+    destroy_fmp4_file(file);
+}
+
+void test_oss_media_fmp4_write_fragment_with_full(CuTest *tc) {
+    uint8_t slice[] = {0x00, 0x00, 0x01, 0x41, 0x9A};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+    const uint8_t *end, *moof;
+    int i;
+
+    file = create_fmp4_file();
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.key = 0;
+    for (i = 0; i <= OSS_MEDIA_FMP4_MAX_SAMPLES; i++) {
+        frame.pos = slice;
+        frame.end = slice + sizeof(slice);
+        frame.dts = frame.pts = i * 3000;
+        CuAssertIntEquals(tc, 0, oss_media_hls_write_frame(&frame, file));
+    }
+    CuAssertIntEquals(tc, 1, file->fmp4->sample_count);
+    CuAssertIntEquals(tc, 0, oss_media_hls_flush(file));
+
+    // a full fragment is ended by the next sample
+    end = fmp4_captured + fmp4_captured_len;
+    moof = find_box(fmp4_captured, end, "moof");
+    CuAssertIntEquals(tc, 1, get32(find_path(moof, end, "moof/mfhd") + 12));
+    CuAssertIntEquals(tc, OSS_MEDIA_FMP4_MAX_SAMPLES,
+                      get32(find_path(moof, end, "moof/traf/trun") + 12));
+    moof = find_box(moof + get32(moof), end, "moof");
+    CuAssertTrue(tc, moof != NULL);
+    CuAssertIntEquals(tc, 2, get32(find_path(moof, end, "moof/mfhd") + 12));
+    CuAssertIntEquals(tc, 1, get32(find_path(moof, end, "moof/traf/trun") + 12));
+    CuAssertIntEquals(tc, OSS_MEDIA_FMP4_MAX_SAMPLES * 3000,
+                      get32(find_path(moof, end, "moof/traf/tfdt") + 16));
+
+    destroy_fmp4_file(file);
+}
+
+void test_oss_media_fmp4_write_frame_with_sample_aes(CuTest *tc) {
+    uint8_t slice[] = {0x00, 0x00, 0x01, 0x41, 0x9A};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+
+    file = create_fmp4_file();
+    file->options.encrypt = 1;
+    file->options.sample_aes = 1;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.pos = slice;
+    frame.end = slice + sizeof(slice);
+    frame.dts = frame.pts = 0;
+    frame.key = 1;
+    CuAssertIntEquals(tc, -1, oss_media_hls_write_frame(&frame, file));
+
+    destroy_fmp4_file(file);
+}
+
+void test_oss_media_fmp4_make_init(CuTest *tc) {
+    uint8_t video[256];
+    uint8_t audio[32];
+    uint8_t init[OSS_MEDIA_FMP4_MAX_INIT_SIZE];
+    uint8_t sps[32];
+    int sps_len, len;
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+    const uint8_t *end, *p;
+
+    file = create_fmp4_file();
+    CuAssertIntEquals(tc, -1, oss_media_fmp4_make_init(file->fmp4, init));
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.pos = video;
+    frame.end = video + make_key_frame(video);
+    frame.dts = frame.pts = 0;
+    frame.key = 1;
+    CuAssertIntEquals(tc, 0, oss_media_hls_write_frame(&frame, file));
+
+    frame.stream_type = st_aac;
+    frame.pos = audio;
+    frame.end = audio + make_adts(audio, 10);
+    CuAssertIntEquals(tc, 0, oss_media_hls_write_frame(&frame, file));
+
+    len = oss_media_fmp4_make_init(file->fmp4, init);
+    CuAssertTrue(tc, len > 0);
+    end = init + len;
+
+    p = find_box(init, end, "ftyp");
+    CuAssertTrue(tc, p == init);
+    CuAssertTrue(tc, 0 == memcmp("iso6", p + 8, 4));
+    p = find_box(p, end, "moov");
+    CuAssertIntEquals(tc, end - p, get32(p));
+    CuAssertIntEquals(tc, 3, get32(find_path(p, end, "moov/mvhd") + 104));
+
+    // video
+    p = find_path(p, end, "moov/trak");
+    CuAssertIntEquals(tc, 1, get32(find_path(p, end, "trak/tkhd") + 20));
+    CuAssertIntEquals(tc, 640 << 16, get32(find_path(p, end, "trak/tkhd") + 84));
+    CuAssertIntEquals(tc, 480 << 16, get32(find_path(p, end, "trak/tkhd") + 88));
+    CuAssertIntEquals(tc, OSS_MEDIA_FMP4_TIMESCALE,
+                      get32(find_path(p, end, "trak/mdia/mdhd") + 20));
+    CuAssertTrue(tc, 0 == memcmp("vide",
+                 find_path(p, end, "trak/mdia/hdlr") + 16, 4));
+    p = find_path(p, end, "trak/mdia/minf/stbl/stsd");
+    CuAssertIntEquals(tc, 1, get32(p + 12));
+    p += 16;
+    CuAssertTrue(tc, 0 == memcmp("avc1", p + 4, 4));
+    CuAssertIntEquals(tc, 640, (p[32] << 8) | p[33]);
+    CuAssertIntEquals(tc, 480, (p[34] << 8) | p[35]);
+    p = find_box(p + 86, p + get32(p), "avcC");
+    CuAssertTrue(tc, p != NULL);
+    sps_len = make_sps_640x480(sps);
+    CuAssertIntEquals(tc, 1, p[8]);
+    CuAssertIntEquals(tc, 66, p[9]);
+    CuAssertIntEquals(tc, 0xFF, p[12]);
+    CuAssertIntEquals(tc, 0xE1, p[13]);
+    CuAssertIntEquals(tc, sps_len, (p[14] << 8) | p[15]);
+    CuAssertTrue(tc, 0 == memcmp(sps, p + 16, sps_len));
+    CuAssertIntEquals(tc, 1, p[16 + sps_len]);
+    CuAssertIntEquals(tc, sizeof(test_pps),
+                      (p[17 + sps_len] << 8) | p[18 + sps_len]);
+    CuAssertTrue(tc, 0 == memcmp(test_pps, p + 19 + sps_len, sizeof(test_pps)));
+
+    // audio
+    p = find_path(init, end, "moov/trak");
+    p = find_box(p + get32(p), end, "trak");
+    CuAssertIntEquals(tc, 2, get32(find_path(p, end, "trak/tkhd") + 20));
+    CuAssertTrue(tc, 0 == memcmp("soun",
+                 find_path(p, end, "trak/mdia/hdlr") + 16, 4));
+    p = find_path(p, end, "trak/mdia/minf/stbl/stsd") + 16;
+    CuAssertTrue(tc, 0 == memcmp("mp4a", p + 4, 4));
+    CuAssertIntEquals(tc, 2, (p[24] << 8) | p[25]);
+    CuAssertIntEquals(tc, 48000 << 16, get32(p + 32));
+    p = find_box(p + 36, p + get32(p), "esds");
+    CuAssertTrue(tc, p != NULL);
+    CuAssertIntEquals(tc, get32(p), 12 + 2 + p[13]);
+    // lc, 48000Hz, stereo
+    CuAssertIntEquals(tc, 0x11, p[12 + 2 + 3 + 2 + 13 + 2]);
+    CuAssertIntEquals(tc, 0x90, p[12 + 2 + 3 + 2 + 13 + 3]);
+
+    p = find_path(init, end, "moov/mvex/trex");
+    CuAssertIntEquals(tc, 1, get32(p + 12));
+    p = find_box(p + get32(p), end, "trex");
+    CuAssertIntEquals(tc, 2, get32(p + 12));
+
+    destroy_fmp4_file(file);
+}
+
+CuSuite *test_fmp4()
+{
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, test_oss_media_fmp4_copy_nals);
+    SUITE_ADD_TEST(suite, test_oss_media_fmp4_parse_sps);
+    SUITE_ADD_TEST(suite, test_oss_media_fmp4_write_fragment);
+    SUITE_ADD_TEST(suite, test_oss_media_fmp4_write_fragment_with_full);
+    SUITE_ADD_TEST(suite, test_oss_media_fmp4_write_frame_with_sample_aes);
+    SUITE_ADD_TEST(suite, test_oss_media_fmp4_make_init);
+
+    return suite;
+}
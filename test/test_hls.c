@@ -7,6 +7,39 @@
 extern void delete_file(oss_media_file_t *file);
 static void auth_func(oss_media_file_t *file);
 static int oss_media_hls_fake_handler(oss_media_hls_file_t *file);
+static int oss_media_hls_capture_handler(oss_media_hls_file_t *file);
+static int oss_media_hls_count_handler(oss_media_hls_file_t *file);
+
+static uint8_t captured[16 * OSS_MEDIA_HLS_PACKET_SIZE];
+static int captured_len;
+static int captured_unaligned;
+static int handled_count;
+static int64_t handled_len;
+
+static const uint8_t test_key[OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE] = {
+    0x2b,0x7e,0x15,0x16,0x28,0xae,0xd2,0xa6,
+    0xab,0xf7,0x15,0x88,0x09,0xcf,0x4f,0x3c};
+static const uint8_t test_iv[OSS_MEDIA_HLS_ENCRYPT_IV_SIZE] = {
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,7};
+
+// what an encrypted ts must contain: the plain ts padded and encrypted
+static int make_encrypted(uint8_t *out, const uint8_t *plain, int len) {
+    oss_media_aes_t aes;
+    int pad = OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH 
+              - len % OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH;
+
+    memcpy(out, plain, len);
+    memset(out + len, pad, pad);
+    oss_media_aes_init(&aes, test_key, test_iv);
+    oss_media_aes_cbc_encrypt(&aes, out, len + pad);
+    return len + pad;
+}
+
+static void set_test_encrypt(oss_media_hls_file_t *file) {
+    file->options.encrypt = 1;
+    memcpy(file->options.key, test_key, sizeof(test_key));
+    memcpy(file->options.iv, test_iv, sizeof(test_iv));
+}
 
 void test_hls_setup(CuTest *tc) {
     aos_pool_t *p;
@@ -77,8 +110,53 @@ void test_oss_media_hls_write_pts(CuTest *tc) {
     free(start);
 }
 
-void test_oss_media_hls_encrypt_packet(CuTest *tc) {
-    CuAssertTrue(tc, 0);
+void test_oss_media_hls_call_handler_with_encrypt(CuTest *tc) {
+    int ret;
+    uint8_t plain[32];
+    uint8_t expected[48];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    set_test_encrypt(file);
+
+    memset(plain, 0x5a, sizeof(plain));
+    make_encrypted(expected, plain, sizeof(plain));
+
+    // the handler fails and keeps the data, which must stay encrypted once
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->frame_count = 1;
+    memcpy(&file->buffer->buf[file->buffer->pos], plain, 20);
+    file->buffer->pos += 20;
+    ret = oss_media_hls_call_handler(file, 0);
+    CuAssertIntEquals(tc, 1, ret);
+    CuAssertIntEquals(tc, 20, file->buffer->pos - file->buffer->start);
+    CuAssertIntEquals(tc, 16, file->encrypt.pos - file->buffer->start);
+
+    // only whole blocks are handed over, the tail is kept
+    file->options.handler_func = oss_media_hls_capture_handler;
+    captured_len = 0;
+    captured_unaligned = 0;
+    ret = oss_media_hls_call_handler(file, 0);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 16, captured_len);
+    CuAssertIntEquals(tc, 4, file->buffer->pos - file->buffer->start);
+    CuAssertIntEquals(tc, file->buffer->start, file->encrypt.pos);
+
+    memcpy(&file->buffer->buf[file->buffer->pos], plain + 20, 12);
+    file->buffer->pos += 12;
+    ret = oss_media_hls_call_handler(file, 0);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 32, captured_len);
+    CuAssertIntEquals(tc, file->buffer->start, file->buffer->pos);
+    CuAssertIntEquals(tc, 0, captured_unaligned);
+    CuAssertTrue(tc, 0 == memcmp(expected, captured, 32));
+
+    // close pads a whole block
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 48, captured_len);
+    CuAssertTrue(tc, 0 == memcmp(expected, captured, 48));
 }
 
 void test_oss_media_hls_write_hls_header(CuTest *tc) {
@@ -258,6 +336,58 @@ void test_oss_media_hls_write_pat_with_succeeded(CuTest *tc) {
     oss_media_hls_close(file);
 }
 
+void test_oss_media_hls_write_pat_with_continuity_counter(CuTest *tc) {
+    int i;
+    int ret;
+    oss_media_hls_file_t *file;
+    
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+
+    for (i = 0; i < 17; i++) {
+        ret = oss_media_hls_write_pat(file);
+        CuAssertIntEquals(tc, 0, ret);
+        CuAssertIntEquals(tc, 0x10 | (i & 0x0F), 
+                          file->buffer->buf[i * OSS_MEDIA_HLS_PACKET_SIZE + 3]);
+    }
+
+    // only the continuity counter differs between two pat packets
+    ret = memcmp(file->buffer->buf + 4, 
+                 file->buffer->buf + OSS_MEDIA_HLS_PACKET_SIZE + 4,
+                 OSS_MEDIA_HLS_PACKET_SIZE - 4);
+    CuAssertIntEquals(tc, 0, ret);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_pmt_with_pid_changed(CuTest *tc) {
+    int ret;
+    oss_media_hls_file_t *file;
+    
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->options.video_pid = 0x200;
+    file->options.audio_pid = 0x201;
+
+    ret = oss_media_hls_write_pmt(file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    uint8_t expected[] = {0x47,0x50,0x01,0x10,0x00,0x02,0xb0,0x17,
+                          0x00,0x01,0xc1,0x00,0x00,0xe2,0x00,0xf0,
+                          0x00,0x1b,0xe2,0x00,0xf0,0x00,0x0f,0xe2,
+                          0x01,0xf0,0x00};
+    ret = memcmp(expected, file->buffer->buf, sizeof(expected));
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 0x200, file->psi.video_pid);
+    CuAssertIntEquals(tc, 0x201, file->psi.audio_pid);
+
+    oss_media_hls_close(file);
+}
+
 void test_oss_media_hls_write_pmt_with_failed(CuTest *tc) {
     int ret;
     oss_media_hls_file_t *file;
@@ -391,8 +521,56 @@ void test_oss_media_hls_write_pat_and_pmt_succeeded(CuTest *tc) {
     oss_media_hls_close(file);
 }
 
+void test_oss_media_hls_write_pmt_with_audio_only(CuTest *tc) {
+    uint8_t *pmt;
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.audio_only = 1;
+    oss_media_hls_update_psi(file);
+
+    // the pcr is on the audio pid, which is the only stream
+    pmt = file->psi.pmt;
+    CuAssertIntEquals(tc, 18, ((pmt[6] & 0x0F) << 8) | pmt[7]);
+    CuAssertIntEquals(tc, file->options.audio_pid,
+                      ((pmt[13] & 0x1F) << 8) | pmt[14]);
+    CuAssertIntEquals(tc, 0x0f, pmt[17]);
+    CuAssertIntEquals(tc, file->options.audio_pid,
+                      ((pmt[18] & 0x1F) << 8) | pmt[19]);
+
+    oss_media_hls_close(file);
+}
+
 void test_oss_media_hls_write_pat_and_pmt_with_encrypt(CuTest *tc) {
-    CuAssertTrue(tc, 0);
+    int ret;
+    int expected_len;
+    uint8_t plain[2 * OSS_MEDIA_HLS_PACKET_SIZE];
+    uint8_t expected[2 * OSS_MEDIA_HLS_PACKET_SIZE + 16];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+    set_test_encrypt(file);
+
+    memcpy(plain, file->psi.pat, OSS_MEDIA_HLS_PACKET_SIZE);
+    memcpy(plain + OSS_MEDIA_HLS_PACKET_SIZE, file->psi.pmt, 
+           OSS_MEDIA_HLS_PACKET_SIZE);
+    expected_len = make_encrypted(expected, plain, sizeof(plain));
+    CuAssertIntEquals(tc, 384, expected_len);
+
+    ret = oss_media_hls_write_pat_and_pmt(file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    captured_len = 0;
+    captured_unaligned = 0;
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 0, captured_unaligned);
+    CuAssertIntEquals(tc, expected_len, captured_len);
+    CuAssertTrue(tc, 0 == memcmp(expected, captured, expected_len));
 }
 
 void test_oss_media_hls_ossfile_handler_without_handle(CuTest *tc) {
@@ -467,13 +645,15 @@ void test_oss_media_hls_ossfile_handler_failed(CuTest *tc) {
 
 void test_oss_media_hls_need_write_pat_and_pmt_is_true(CuTest *tc) {
     int ret;
+    oss_media_hls_frame_t frame;
     oss_media_hls_file_t *file;
 
     file = oss_media_hls_open(TEST_BUCKET_NAME, "test2.key", auth_func);
     CuAssertTrue(tc, file != NULL);
     
+    memset(&frame, 0, sizeof(frame));
     file->frame_count = 0;
-    ret = oss_media_hls_need_write_pat_and_pmt(file);
+    ret = oss_media_hls_need_write_pat_and_pmt(&frame, file);
     CuAssertIntEquals(tc, 1, ret);
     
     oss_media_hls_close(file);
@@ -481,15 +661,24 @@ void test_oss_media_hls_need_write_pat_and_pmt_is_true(CuTest *tc) {
 
 void test_oss_media_hls_need_write_pat_and_pmt_is_false(CuTest *tc) {
     int ret;
+    oss_media_hls_frame_t frame;
     oss_media_hls_file_t *file;
 
     file = oss_media_hls_open(TEST_BUCKET_NAME, "test2.key", auth_func);
     CuAssertTrue(tc, file != NULL);
     
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.key = 1;
     file->frame_count = 1;
-    ret = oss_media_hls_need_write_pat_and_pmt(file);
+    ret = oss_media_hls_need_write_pat_and_pmt(&frame, file);
     CuAssertIntEquals(tc, 0, ret);
 
+    // unless the key frame is recorded for an I-frame playlist
+    file->options.record_iframes = 1;
+    ret = oss_media_hls_need_write_pat_and_pmt(&frame, file);
+    CuAssertIntEquals(tc, 1, ret);
+
     oss_media_hls_close(file);
 }
 
@@ -567,6 +756,23 @@ void test_oss_media_hls_begin_m3u8(CuTest *tc) {
     oss_media_hls_close(file);
 }
 
+void test_oss_media_hls_begin_iframe_m3u8(CuTest *tc) {
+    oss_media_hls_file_t *file;
+    
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "test2.m3u8", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    oss_media_hls_begin_iframe_m3u8(10, 7, file);
+
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+                     "#EXT-X-MEDIA-SEQUENCE:7\n#EXT-X-VERSION:4\n"
+                     "#EXT-X-I-FRAMES-ONLY\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
 void test_oss_media_hls_end_m3u8(CuTest *tc) {
     oss_media_hls_file_t *file;
     
@@ -597,6 +803,8 @@ void test_oss_media_hls_write_m3u8_failed(CuTest *tc) {
     file->frame_count = 1;
 
     oss_media_hls_m3u8_info_t m3u8[1];
+
+    memset(m3u8, 0, sizeof(m3u8));
     m3u8[0].duration = 0;
     memcpy(m3u8[0].url, "1.ts", strlen("1.ts"));
     ret = oss_media_hls_write_m3u8(1, m3u8, file);
@@ -618,6 +826,8 @@ void test_oss_media_hls_write_m3u8_with_one_m3u8(CuTest *tc) {
     file->frame_count = 0;
 
     oss_media_hls_m3u8_info_t m3u8[1];
+
+    memset(m3u8, 0, sizeof(m3u8));
     m3u8[0].duration = 10;
     memcpy(m3u8[0].url, "1.ts", strlen("1.ts") + 1);
     ret = oss_media_hls_write_m3u8(1, m3u8, file);
@@ -643,6 +853,8 @@ void test_oss_media_hls_write_m3u8_with_two_m3u8(CuTest *tc) {
     file->frame_count = 0;
 
     oss_media_hls_m3u8_info_t m3u8[2];
+
+    memset(m3u8, 0, sizeof(m3u8));
     m3u8[0].duration = 10;
     memcpy(m3u8[0].url, "1.ts", strlen("1.ts") + 1);
     m3u8[1].duration = 8.4;
@@ -657,6 +869,200 @@ void test_oss_media_hls_write_m3u8_with_two_m3u8(CuTest *tc) {
     oss_media_hls_close(file);
 }
 
+void test_oss_media_hls_write_m3u8_with_reused_info(CuTest *tc) {
+    int ret = 0;
+
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    
+    file->buffer->end = file->buffer->pos + OSS_MEDIA_HLS_PACKET_SIZE - 1;
+    file->frame_count = 0;
+
+    oss_media_hls_m3u8_info_t m3u8[1];
+
+    memset(m3u8, 0, sizeof(m3u8));
+    m3u8[0].duration = 10;
+    memcpy(m3u8[0].url, "1.ts", strlen("1.ts") + 1);
+    ret = oss_media_hls_write_m3u8(1, m3u8, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // an info written again with a new url and duration gets new lines
+    m3u8[0].duration = 8.4;
+    memcpy(m3u8[0].url, "2.ts", strlen("2.ts") + 1);
+    file->frame_count = 0;
+    ret = oss_media_hls_write_m3u8(1, m3u8, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXTINF:10.000,\n1.ts\n#EXTINF:8.400,\n2.ts\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_master_m3u8(CuTest *tc) {
+    int ret = 0;
+    oss_media_hls_variant_t variants[2];
+
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->frame_count = 0;
+
+    memset(variants, 0, sizeof(variants));
+    variants[0].bandwidth = 2000000;
+    strcpy(variants[0].codecs, "avc1.42c01e,mp4a.40.2");
+    strcpy(variants[0].resolution, "640x480");
+    strcpy(variants[0].url, "av.m3u8");
+    variants[1].bandwidth = 64000;
+    strcpy(variants[1].url, "a.m3u8");
+    ret = oss_media_hls_write_master_m3u8(2, variants, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXTM3U\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=2000000,CODECS=\"avc1.42c01e,mp4a.40.2\","
+        "RESOLUTION=640x480\nav.m3u8\n"
+        "#EXT-X-STREAM-INF:BANDWIDTH=64000\na.m3u8\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_m3u8_with_byte_range(CuTest *tc) {
+    int ret = 0;
+
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->options.byte_range = 1;
+    oss_media_hls_begin_m3u8(10, 0, file);
+
+    oss_media_hls_m3u8_info_t m3u8[2];
+
+    memset(m3u8, 0, sizeof(m3u8));
+    m3u8[0].duration = 10;
+    m3u8[0].range_length = 75200;
+    memcpy(m3u8[0].url, "1.ts", strlen("1.ts") + 1);
+    m3u8[1].duration = 8.4;
+    m3u8[1].range_offset = 75200;
+    m3u8[1].range_length = 60160;
+    memcpy(m3u8[1].url, "1.ts", strlen("1.ts") + 1);
+    file->frame_count = 0;
+    ret = oss_media_hls_write_m3u8(2, m3u8, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+                     "#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:4\n"
+                     "#EXTINF:10.000,\n#EXT-X-BYTERANGE:75200@0\n1.ts\n"
+                     "#EXTINF:8.400,\n#EXT-X-BYTERANGE:60160@75200\n1.ts\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_end_segment(CuTest *tc) {
+    int ret;
+    uint8_t adts[] = {0xff, 0xf1, 0x50, 0x80, 0x01, 0x5f, 0xfc,
+                      0x21, 0x10, 0x05};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key10.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+    captured_len = 0;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_aac;
+    frame.pos = adts;
+    frame.end = adts + sizeof(adts);
+    ret = oss_media_hls_write_frame(&frame, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    ret = oss_media_hls_end_segment(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 3 * OSS_MEDIA_HLS_PACKET_SIZE, captured_len);
+    CuAssertIntEquals(tc, 0, file->frame_count);
+
+    // the next segment starts with PAT/PMT again
+    frame.pos = adts;
+    frame.pts = frame.dts = 1920;
+    ret = oss_media_hls_write_frame(&frame, file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 3 * OSS_MEDIA_HLS_PACKET_SIZE, file->buffer->pos);
+    CuAssertIntEquals(tc, OSS_MEDIA_PAT_PID, file->buffer->buf[2]);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_frame_with_single_put(CuTest *tc) {
+    int i;
+    int ret;
+    uint8_t data[2000];
+    oss_media_hls_frame_t frames[2];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open_single_put(TEST_BUCKET_NAME, "key11.ts",
+                                         auth_func);
+    CuAssertTrue(tc, file != NULL);
+    CuAssertStrEquals(tc, "p", file->file->mode);
+    CuAssertIntEquals(tc, 1, file->options.single_put);
+    file->options.handler_func = oss_media_hls_count_handler;
+    handled_count = 0;
+    handled_len = 0;
+
+    memset(data, 0xab, sizeof(data));
+    data[0] = 0x00;
+    data[1] = 0x00;
+    data[2] = 0x00;
+    data[3] = 0x01;
+    data[4] = 0x41;
+    memset(frames, 0, sizeof(frames));
+    frames[0].stream_type = st_h264;
+    frames[1].stream_type = st_h264;
+
+    // far more than the write buffer, one by one and in one go
+    for (i = 0; i < 200; i += 2) {
+        frames[0].pos = frames[1].pos = data;
+        frames[0].end = frames[1].end = data + sizeof(data);
+        frames[0].pts = frames[0].dts = i * 3600;
+        frames[1].pts = frames[1].dts = (i + 1) * 3600;
+        if (i < 100) {
+            ret = oss_media_hls_write_frame(&frames[0], file);
+            CuAssertIntEquals(tc, 0, ret);
+            ret = oss_media_hls_write_frame(&frames[1], file);
+        } else {
+            ret = oss_media_hls_write_frames(frames, 2, file);
+        }
+        CuAssertIntEquals(tc, 0, ret);
+    }
+    CuAssertTrue(tc, file->length > OSS_MEDIA_DEFAULT_WRITE_BUFFER);
+    CuAssertIntEquals(tc, (int)file->length, file->buffer->pos);
+
+    // nothing goes to oss before the end of the file
+    ret = oss_media_hls_flush(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 0, handled_count);
+
+    ret = oss_media_hls_end_segment(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 1, handled_count);
+    CuAssertTrue(tc, handled_len == (int64_t)file->length);
+
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 1, handled_count);
+}
+
 void test_oss_media_hls_close_failed(CuTest *tc) {
     int ret = 0;
 
@@ -695,7 +1101,8 @@ void test_oss_media_hls_write_frame_with_unsupport_stream_type(CuTest *tc) {
     CuAssertTrue(tc, file != NULL);
 
     oss_media_hls_frame_t frame;
-    frame.stream_type = st_mp3;
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = (stream_type_t)(st_h265 + 1);
     
     ret = oss_media_hls_write_frame(&frame, file);
     CuAssertIntEquals(tc, -1, ret);
@@ -715,6 +1122,7 @@ void test_oss_media_hls_write_frame_with_handle_file_failed(CuTest *tc) {
     uint8_t *buf = (uint8_t*)malloc(1024);
 
     oss_media_hls_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
     frame.stream_type = st_aac;
     frame.pos = buf;
     frame.end = buf + 100;
@@ -745,6 +1153,7 @@ void test_oss_media_hls_write_frame_with_h264(CuTest *tc) {
     uint8_t buf[] = {0x00, 0x00, 0x00, 0x01, 0x68, 0xee, 0x38, 0x30};
 
     oss_media_hls_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
     frame.stream_type = st_h264;
     frame.pos = buf;
     frame.end = buf + sizeof(buf);
@@ -817,6 +1226,103 @@ void test_oss_media_hls_write_frame_with_h264(CuTest *tc) {
     oss_media_hls_close(file);
 }
 
+void test_oss_media_hls_write_frame_with_h265(CuTest *tc) {
+    int ret = 0;
+    uint8_t *packet, *pes;
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key4.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.video_type = st_h265;
+
+    // an idr slice of hevc
+    uint8_t buf[] = {0x00, 0x00, 0x00, 0x01, 0x26, 0x01, 0xaf, 0x09};
+
+    oss_media_hls_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h265;
+    frame.pos = buf;
+    frame.end = buf + sizeof(buf);
+    frame.pts = 5000;
+    frame.dts = 5000;
+    frame.key = 0;
+    
+    ret = oss_media_hls_write_frame(&frame, file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE * 3,file->buffer->pos);
+    CuAssertIntEquals(tc, st_h265, file->psi.video_type);
+    
+    // the pmt has hevc with stream type 0x24
+    uint8_t expected[] = {0x47,0x50,0x01,0x10,0x00,0x02,0xb0,0x17,
+                          0x00,0x01,0xc1,0x00,0x00,0xe1,0x00,0xf0,
+                          0x00,0x24,0xe1,0x00,0xf0,0x00,0x0f,0xe1,
+                          0x01,0xf0,0x00};
+    ret = memcmp(expected, file->buffer->buf + OSS_MEDIA_HLS_PACKET_SIZE,
+                 sizeof(expected));
+    CuAssertIntEquals(tc, 0, ret);
+
+    // a video pes with pts and dts ends the packet of the video pid
+    packet = file->buffer->buf + OSS_MEDIA_HLS_PACKET_SIZE * 2;
+    pes = packet + OSS_MEDIA_HLS_PACKET_SIZE - 19 - sizeof(buf);
+    CuAssertIntEquals(tc, 0x41, packet[1]);
+    CuAssertIntEquals(tc, 0x00, packet[2]);
+    CuAssertIntEquals(tc, 0x00, pes[0]);
+    CuAssertIntEquals(tc, 0x00, pes[1]);
+    CuAssertIntEquals(tc, 0x01, pes[2]);
+    CuAssertIntEquals(tc, 0xe0, pes[3]);
+    CuAssertIntEquals(tc, 0xc0, pes[7]);
+    CuAssertTrue(tc, 0 == memcmp(buf, pes + 19, sizeof(buf)));
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_frame_with_mp3(CuTest *tc) {
+    int ret = 0;
+    uint8_t *packet, *pes;
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key4.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.audio_type = st_mp3;
+
+    uint8_t buf[] = {0xFF, 0xFB, 0x90, 0x00, 0x55, 0x55, 0x55, 0x55};
+
+    oss_media_hls_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_mp3;
+    frame.pos = buf;
+    frame.end = buf + sizeof(buf);
+    frame.pts = 5000;
+    frame.dts = 5000;
+    frame.key = 0;
+    
+    ret = oss_media_hls_write_frame(&frame, file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE * 3,file->buffer->pos);
+    CuAssertIntEquals(tc, st_mp3, file->psi.audio_type);
+    
+    // the pmt has mpeg-1 audio with stream type 0x03
+    uint8_t expected[] = {0x47,0x50,0x01,0x10,0x00,0x02,0xb0,0x17,
+                          0x00,0x01,0xc1,0x00,0x00,0xe1,0x00,0xf0,
+                          0x00,0x1b,0xe1,0x00,0xf0,0x00,0x03,0xe1,
+                          0x01,0xf0,0x00};
+    ret = memcmp(expected, file->buffer->buf + OSS_MEDIA_HLS_PACKET_SIZE,
+                 sizeof(expected));
+    CuAssertIntEquals(tc, 0, ret);
+
+    // an audio pes with pts only ends the packet of the audio pid
+    packet = file->buffer->buf + OSS_MEDIA_HLS_PACKET_SIZE * 2;
+    pes = packet + OSS_MEDIA_HLS_PACKET_SIZE - 14 - sizeof(buf);
+    CuAssertIntEquals(tc, 0x41, packet[1]);
+    CuAssertIntEquals(tc, 0x01, packet[2]);
+    CuAssertIntEquals(tc, 0x00, pes[0]);
+    CuAssertIntEquals(tc, 0x00, pes[1]);
+    CuAssertIntEquals(tc, 0x01, pes[2]);
+    CuAssertIntEquals(tc, 0xc0, pes[3]);
+    CuAssertIntEquals(tc, 0x80, pes[7]);
+    CuAssertTrue(tc, 0 == memcmp(buf, pes + 14, sizeof(buf)));
+
+    oss_media_hls_close(file);
+}
+
 void test_oss_media_hls_write_frame_with_aac(CuTest *tc) {
     /*
      * check point: 1, aac data. 2,without pat and pmt. 3,without adaptation
@@ -833,6 +1339,7 @@ void test_oss_media_hls_write_frame_with_aac(CuTest *tc) {
     uint8_t buf[] = {0xff, 0xf1, 0x6c, 0x80, 0x1f, 0xa1, 0xf0};
 
     oss_media_hls_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
     frame.stream_type = st_aac;
     frame.pos = buf;
     frame.end = buf + sizeof(buf);
@@ -889,6 +1396,7 @@ void test_oss_media_hls_write_frame_with_pes_overflow(CuTest *tc) {
     }
 
     oss_media_hls_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
     frame.stream_type = st_h264;
     frame.pos = buf;
     frame.end = buf + sizeof(buf);
@@ -937,12 +1445,1083 @@ void test_oss_media_hls_write_frame_with_pes_overflow(CuTest *tc) {
     oss_media_hls_close(file);
 }
 
-void test_oss_media_hls_write_frame_with_encrypt(CuTest *tc) {
-    CuAssertTrue(tc, 0);
-}
+void test_oss_media_hls_write_frame_with_one_byte_stuffing(CuTest *tc) {
+    /*
+     * check point: payload one byte short of the packet, the adaptation
+     * field is only its length byte
+     */
+    int i;
+    int ret = 0;
 
-static int oss_media_hls_fake_handler(oss_media_hls_file_t *file) {
-    return file->frame_count++ > 0;
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key7.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->frame_count = 1; // disable and pat/pmt table
+
+    uint8_t buf[OSS_MEDIA_HLS_PACKET_SIZE - 4 - 14 - 1];
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = i & 0xFF;
+    }
+
+    oss_media_hls_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_aac;
+    frame.pos = buf;
+    frame.end = buf + sizeof(buf);
+    frame.pts = 5000;
+    frame.dts = 5000;
+    frame.continuity_counter = 7;
+    frame.key = 0;
+    
+    ret = oss_media_hls_write_frame(&frame, file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE, file->buffer->pos);
+    CuAssertTrue(tc, frame.pos == frame.end);
+
+    uint8_t expected_frame_begin[] = {0x47,0x41,0x01,0x37,0x00,0x00,0x00,
+                                      0x01,0xc0,0x00,0xb1,0x80,0x80,0x05,
+                                      0x21,0x00,0x05,0x13,0x41};
+    for (i = 0; i < sizeof(expected_frame_begin); i++) 
+    {
+        CuAssertIntEquals(tc, expected_frame_begin[i], file->buffer->buf[i]);
+    }
+    for (i = 0; i < sizeof(buf); i++) 
+    {
+        CuAssertIntEquals(tc, buf[i], 
+                          file->buffer->buf[sizeof(expected_frame_begin) + i]);
+    }
+
+    oss_media_hls_flush(file);
+    delete_file(file->file);
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_escape_nal(CuTest *tc) {
+    uint8_t nal[] = {0x65,0x00,0x00,0x03,0x01,0x00,0x00,0x03,0x00,0x11};
+    uint8_t rbsp[] = {0x65,0x00,0x00,0x01,0x00,0x00,0x00,0x11};
+    uint8_t buf[32];
+    uint8_t *end;
+    size_t len;
+
+    len = oss_media_hls_unescape_nal(buf, nal, sizeof(nal));
+    CuAssertIntEquals(tc, sizeof(rbsp), len);
+    CuAssertTrue(tc, 0 == memcmp(rbsp, buf, len));
+
+    end = oss_media_hls_escape_nal(buf, rbsp, sizeof(rbsp));
+    CuAssertIntEquals(tc, sizeof(nal), end - buf);
+    CuAssertTrue(tc, 0 == memcmp(nal, buf, sizeof(nal)));
+}
+
+void test_oss_media_hls_sample_encrypt_h264(CuTest *tc) {
+    int i;
+    uint8_t frame[4 + 20 + 3 + 200 + 3 + 200 + 3 + 40];
+    uint8_t slice[200];
+    uint8_t expected[sizeof(frame) * 2];
+    uint8_t *p, *end;
+    oss_media_aes_t aes;
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    set_test_encrypt(file);
+    file->options.sample_aes = 1;
+    oss_media_hls_reserve_sample_buf(file, sizeof(expected));
+    oss_media_hls_start_encrypt(file);
+
+    // sps, two idr slices and a short slice
+    p = frame;
+    memcpy(p, "\x00\x00\x00\x01\x67", 5);
+    memset(p + 5, 0x11, 19);
+    p += 24;
+    for (i = 0; i < 2; i++) {
+        memcpy(p, "\x00\x00\x01\x65", 4);
+        memset(p + 4, 0x22, 199);
+        p += 203;
+    }
+    memcpy(p, "\x00\x00\x01\x41", 4);
+    memset(p + 4, 0x33, 39);
+
+    // 32 bytes clear, then one block of every ten, the last 8 bytes clear
+    slice[0] = 0x65;
+    memset(slice + 1, 0x22, 199);
+    oss_media_aes_init(&aes, test_key, test_iv);
+    oss_media_aes_cbc_encrypt(&aes, slice + 32, 16);
+
+    p = expected;
+    memcpy(p, frame, 24);
+    p += 24;
+    for (i = 0; i < 2; i++) {
+        memcpy(p, "\x00\x00\x01", 3);
+        p = oss_media_hls_escape_nal(p + 3, slice, sizeof(slice));
+    }
+    memcpy(p, frame + sizeof(frame) - 43, 43);
+    p += 43;
+
+    end = oss_media_hls_sample_encrypt_h264(file, frame, frame + sizeof(frame));
+    CuAssertIntEquals(tc, p - expected, end - file->encrypt.sample_buf);
+    CuAssertTrue(tc, 0 == memcmp(expected, file->encrypt.sample_buf,
+                                 p - expected));
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_sample_encrypt_aac(CuTest *tc) {
+    int i;
+    // aac lc, 44100, stereo, 63 bytes without crc
+    uint8_t header[] = {0xff,0xf1,0x50,0x80,0x07,0xff,0xfc};
+    uint8_t frame[2 * 63];
+    uint8_t expected[sizeof(frame)];
+    uint8_t *end;
+    oss_media_aes_t aes;
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    set_test_encrypt(file);
+    file->options.sample_aes = 1;
+    oss_media_hls_reserve_sample_buf(file, sizeof(frame));
+    oss_media_hls_start_encrypt(file);
+
+    for (i = 0; i < sizeof(frame); i++) {
+        frame[i] = i;
+    }
+    memcpy(frame, header, sizeof(header));
+    memcpy(frame + 63, header, sizeof(header));
+
+    // header and 16 bytes clear, 2 blocks encrypted, 8 bytes clear
+    memcpy(expected, frame, sizeof(frame));
+    for (i = 0; i < 2; i++) {
+        oss_media_aes_init(&aes, test_key, test_iv);
+        oss_media_aes_cbc_encrypt(&aes, expected + 63 * i + 23, 32);
+    }
+
+    end = oss_media_hls_sample_encrypt_aac(file, frame, frame + sizeof(frame));
+    CuAssertIntEquals(tc, sizeof(frame), end - file->encrypt.sample_buf);
+    CuAssertTrue(tc, 0 == memcmp(expected, file->encrypt.sample_buf,
+                                 sizeof(frame)));
+    CuAssertIntEquals(tc, 0x12, file->encrypt.audio_config[0]);
+    CuAssertIntEquals(tc, 0x10, file->encrypt.audio_config[1]);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_pmt_with_sample_aes(CuTest *tc) {
+    int ret;
+    oss_media_hls_file_t *file;
+    
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    set_test_encrypt(file);
+    file->options.sample_aes = 1;
+    file->encrypt.audio_config[0] = 0x12;
+    file->encrypt.audio_config[1] = 0x10;
+
+    ret = oss_media_hls_write_pmt(file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    uint8_t expected[] = {0x47,0x50,0x01,0x10,0x00,0x02,0xb0,0x33,
+                          0x00,0x01,0xc1,0x00,0x00,0xe1,0x00,0xf0,
+                          0x00,0xdb,0xe1,0x00,0xf0,0x06,0x0f,0x04,
+                          'z','a','v','c',0xcf,0xe1,0x01,0xf0,
+                          0x16,0x0f,0x04,'a','a','c','d',0x05,
+                          0x0e,'a','p','a','d','z','a','a',
+                          'c',0x00,0x00,0x01,0x02,0x12,0x10};
+    ret = memcmp(expected, file->buffer->buf, sizeof(expected));
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 1, file->psi.sample_aes);
+
+    oss_media_hls_close(file);
+}
+
+static void write_test_frames(oss_media_hls_file_t *file, int flush) {
+    int i;
+    uint8_t buf[1000];
+    oss_media_hls_frame_t frame;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = i & 0xFF;
+    }
+
+    // pat, pmt and one aac packet leave a partial block
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_aac;
+    frame.pos = buf;
+    frame.end = buf + 100;
+    frame.pts = 5000;
+    frame.dts = 5000;
+    frame.continuity_counter = 0;
+    frame.key = 0;
+    oss_media_hls_write_frame(&frame, file);
+
+    if (flush) {
+        oss_media_hls_flush(file);
+    }
+
+    frame.stream_type = st_h264;
+    frame.pos = buf;
+    frame.end = buf + sizeof(buf);
+    frame.continuity_counter = 0;
+    frame.key = 1;
+    oss_media_hls_write_frame(&frame, file);
+}
+
+void test_oss_media_hls_write_frame_with_encrypt(CuTest *tc) {
+    int ret;
+    int plain_len;
+    int expected_len;
+    uint8_t plain[sizeof(captured)];
+    uint8_t expected[sizeof(captured)];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key8.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+
+    captured_len = 0;
+    write_test_frames(file, 0);
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+    plain_len = captured_len;
+    memcpy(plain, captured, plain_len);
+    expected_len = make_encrypted(expected, plain, plain_len);
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key8.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+    set_test_encrypt(file);
+
+    captured_len = 0;
+    captured_unaligned = 0;
+    write_test_frames(file, 1);
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    CuAssertIntEquals(tc, 0, captured_unaligned);
+    CuAssertIntEquals(tc, expected_len, captured_len);
+    CuAssertTrue(tc, 0 == memcmp(expected, captured, expected_len));
+}
+
+static void make_test_batch(oss_media_hls_frame_t frames[4], uint8_t *buf) {
+    int i;
+    int sizes[4] = {500, 200, 600, 183};
+
+    memset(frames, 0, sizeof(oss_media_hls_frame_t) * 4);
+    for (i = 0; i < 4; i++) {
+        frames[i].stream_type = i % 2 == 0 ? st_h264 : st_aac;
+        frames[i].pos = buf;
+        frames[i].end = buf + sizes[i];
+        frames[i].pts = frames[i].dts = 5000 + i * 3000;
+        frames[i].continuity_counter = i;
+        frames[i].key = i == 0;
+    }
+}
+
+static int write_test_batch(oss_media_hls_file_t *file, int batch, int split,
+                            unsigned int buffer_size, uint8_t *out)
+{
+    int i;
+    uint8_t buf[600];
+    oss_media_hls_frame_t frames[4];
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = i & 0xFF;
+    }
+
+    file->options.handler_func = oss_media_hls_capture_handler;
+    file->options.pat_interval_frame_count = 2;
+    file->buffer->end = buffer_size;
+    captured_len = 0;
+
+    make_test_batch(frames, buf);
+    if (split) {
+        // the same bytes as prefix, body and suffix
+        for (i = 0; i < 4; i++) {
+            frames[i].prefix.pos = frames[i].pos;
+            frames[i].prefix.end = frames[i].pos + 6;
+            frames[i].suffix.pos = frames[i].end - 5;
+            frames[i].suffix.end = frames[i].end;
+            frames[i].pos += 6;
+            frames[i].end -= 5;
+        }
+    }
+    if (batch) {
+        if (0 != oss_media_hls_write_frames(frames, 4, file)) {
+            return -1;
+        }
+    } else {
+        for (i = 0; i < 4; i++) {
+            if (0 != oss_media_hls_write_frame(&frames[i], file)) {
+                return -1;
+            }
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        if (frames[i].pos != frames[i].end
+            || frames[i].prefix.pos != frames[i].prefix.end
+            || frames[i].suffix.pos != frames[i].suffix.end)
+        {
+            return -1;
+        }
+    }
+
+    oss_media_hls_flush(file);
+    memcpy(out, captured, captured_len);
+    return captured_len;
+}
+
+void test_oss_media_hls_write_frames(CuTest *tc) {
+    int expected_len;
+    int len;
+    uint8_t expected[sizeof(captured)];
+    uint8_t content[sizeof(captured)];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key11.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    expected_len = write_test_batch(file, 0, 0, OSS_MEDIA_DEFAULT_WRITE_BUFFER,
+                                    expected);
+    oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 15 * OSS_MEDIA_HLS_PACKET_SIZE, expected_len);
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key11.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    len = write_test_batch(file, 1, 0, OSS_MEDIA_DEFAULT_WRITE_BUFFER, content);
+    oss_media_hls_close(file);
+    CuAssertIntEquals(tc, expected_len, len);
+    CuAssertTrue(tc, 0 == memcmp(expected, content, len));
+
+    // frames larger than the buffer are written packet by packet
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key11.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    len = write_test_batch(file, 1, 0, 4 * OSS_MEDIA_HLS_PACKET_SIZE, content);
+    oss_media_hls_close(file);
+    CuAssertIntEquals(tc, expected_len, len);
+    CuAssertTrue(tc, 0 == memcmp(expected, content, len));
+}
+
+void test_oss_media_hls_write_frame_with_prefix(CuTest *tc) {
+    int expected_len;
+    int len;
+    uint8_t expected[sizeof(captured)];
+    uint8_t content[sizeof(captured)];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key11.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    expected_len = write_test_batch(file, 0, 0, OSS_MEDIA_DEFAULT_WRITE_BUFFER,
+                                    expected);
+    oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 15 * OSS_MEDIA_HLS_PACKET_SIZE, expected_len);
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key11.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    len = write_test_batch(file, 0, 1, OSS_MEDIA_DEFAULT_WRITE_BUFFER, content);
+    oss_media_hls_close(file);
+    CuAssertIntEquals(tc, expected_len, len);
+    CuAssertTrue(tc, 0 == memcmp(expected, content, len));
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key11.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    len = write_test_batch(file, 1, 1, 4 * OSS_MEDIA_HLS_PACKET_SIZE, content);
+    oss_media_hls_close(file);
+    CuAssertIntEquals(tc, expected_len, len);
+    CuAssertTrue(tc, 0 == memcmp(expected, content, len));
+}
+
+static int64_t write_test_large_frames(char *key, int upload_buffers,
+                                       uint8_t *out, int64_t size)
+{
+    int i;
+    int64_t length;
+    uint8_t *buf;
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+    oss_media_file_t *read_file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, key, auth_func);
+    file->options.upload_buffers = upload_buffers;
+    set_test_encrypt(file);
+
+    buf = (uint8_t*)malloc(64 * 1024);
+    for (i = 0; i < 64 * 1024; i++) {
+        buf[i] = i * 7;
+    }
+    memcpy(buf, "\x00\x00\x00\x01\x65", 5);
+
+    // three times the buffer, so that every buffer is in use
+    for (i = 0; i < 12; i++) {
+    memset(&frame, 0, sizeof(frame));
+        frame.stream_type = st_h264;
+        frame.pos = buf;
+        frame.end = buf + 64 * 1024 - i;
+        frame.pts = frame.dts = 5000 + i * 3600;
+        frame.key = i == 0;
+        frame.continuity_counter = i;
+        oss_media_hls_write_frame(&frame, file);
+    }
+    if (upload_buffers > 1 && file->uploader == NULL) {
+        free(buf);
+        oss_media_hls_close(file);
+        return -1;
+    }
+    oss_media_hls_close(file);
+    free(buf);
+
+    read_file = oss_media_file_open(TEST_BUCKET_NAME, key, "r", auth_func);
+    length = oss_media_file_read(read_file, out, size);
+    delete_file(read_file);
+    oss_media_file_close(read_file);
+    return length;
+}
+
+void test_oss_media_hls_write_frame_with_audio_pes(CuTest *tc) {
+    int i;
+    int ret;
+    uint8_t *packet;
+    uint8_t pts[5];
+    uint8_t adts[] = {0xff, 0xf1, 0x50, 0x80, 0x01, 0x5f, 0xfc,
+                      0x21, 0x10, 0x05};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key9.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+    file->options.hls_delay_ms = 0;
+    file->options.audio_pes_duration_ms = 50;
+    captured_len = 0;
+
+    // 3 frames of 21.3ms are within 50ms, the 4th starts the next pes
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_aac;
+    frame.continuity_counter = 3;
+    for (i = 0; i < 4; i++) {
+        frame.pos = adts;
+        frame.end = adts + sizeof(adts);
+        frame.pts = 1920 * i;
+        frame.dts = frame.pts;
+        ret = oss_media_hls_write_frame(&frame, file);
+        CuAssertIntEquals(tc, 0, ret);
+        CuAssertIntEquals(tc, i < 3 ? 4 : 5, frame.continuity_counter);
+        CuAssertIntEquals(tc, i < 3 ? 0 : 3 * OSS_MEDIA_HLS_PACKET_SIZE,
+                          file->buffer->pos);
+    }
+
+    ret = oss_media_hls_flush(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 4 * OSS_MEDIA_HLS_PACKET_SIZE, captured_len);
+
+    // one pes of 3 frames, after pat and pmt
+    packet = captured + 2 * OSS_MEDIA_HLS_PACKET_SIZE;
+    CuAssertIntEquals(tc, 0x41, packet[1]);
+    CuAssertIntEquals(tc, 0x33, packet[3]);
+    packet += OSS_MEDIA_HLS_PACKET_SIZE - 3 * sizeof(adts) - 14;
+    CuAssertIntEquals(tc, 0xc0, packet[3]);
+    CuAssertIntEquals(tc, 3 * sizeof(adts) + 8, packet[5]);
+    for (i = 0; i < 3; i++) {
+        CuAssertTrue(tc, 0 == memcmp(adts, packet + 14 + i * sizeof(adts),
+                                     sizeof(adts)));
+    }
+
+    // the pes of the last frame has its pts
+    packet = captured + 3 * OSS_MEDIA_HLS_PACKET_SIZE;
+    CuAssertIntEquals(tc, 0x34, packet[3]);
+    packet += OSS_MEDIA_HLS_PACKET_SIZE - sizeof(adts) - 14;
+    oss_media_hls_write_pts(pts, 2, 1920 * 3);
+    CuAssertTrue(tc, 0 == memcmp(pts, packet + 9, sizeof(pts)));
+    CuAssertTrue(tc, 0 == memcmp(adts, packet + 14, sizeof(adts)));
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_frame_with_iframes(CuTest *tc) {
+    int i;
+    int ret;
+    uint8_t video[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    oss_media_hls_frame_t frames[3];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key11.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+    file->options.record_iframes = 1;
+    captured_len = 0;
+
+    memset(frames, 0, sizeof(frames));
+    for (i = 0; i < 3; i++) {
+        frames[i].stream_type = st_h264;
+        frames[i].pos = video;
+        frames[i].end = video + sizeof(video);
+        frames[i].pts = frames[i].dts = 3600 * i;
+        frames[i].key = i != 1;
+    }
+    ret = oss_media_hls_write_frame(&frames[0], file);
+    CuAssertIntEquals(tc, 0, ret);
+    ret = oss_media_hls_write_frames(&frames[1], 2, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // each key frame is PAT, PMT and its pes, the other frame only a pes
+    CuAssertIntEquals(tc, 7 * OSS_MEDIA_HLS_PACKET_SIZE, file->length);
+    CuAssertIntEquals(tc, 2, file->iframe_count);
+    CuAssertIntEquals(tc, 0, file->iframes[0].pts);
+    CuAssertIntEquals(tc, 0, file->iframes[0].offset);
+    CuAssertIntEquals(tc, 3 * OSS_MEDIA_HLS_PACKET_SIZE,
+                      file->iframes[0].length);
+    CuAssertIntEquals(tc, 7200, file->iframes[1].pts);
+    CuAssertIntEquals(tc, 4 * OSS_MEDIA_HLS_PACKET_SIZE,
+                      file->iframes[1].offset);
+    CuAssertIntEquals(tc, 3 * OSS_MEDIA_HLS_PACKET_SIZE,
+                      file->iframes[1].length);
+    CuAssertIntEquals(tc, OSS_MEDIA_PAT_PID,
+            file->buffer->buf[file->iframes[1].offset + 2]);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_frame_with_upload_buffers(CuTest *tc) {
+    int64_t expected_len;
+    int64_t length;
+    int64_t size = 4 * OSS_MEDIA_DEFAULT_WRITE_BUFFER;
+    uint8_t *expected = (uint8_t*)malloc(size);
+    uint8_t *content = (uint8_t*)malloc(size);
+
+    expected_len = write_test_large_frames("key9.ts", 1, expected, size);
+    CuAssertTrue(tc, expected_len > 3 * OSS_MEDIA_DEFAULT_WRITE_BUFFER);
+
+    // a spare buffer is written while the others upload in background
+    length = write_test_large_frames("key10.ts", 2, content, size);
+    CuAssertIntEquals(tc, expected_len, length);
+    CuAssertTrue(tc, 0 == memcmp(expected, content, length));
+
+    length = write_test_large_frames("key10.ts", 
+                                     OSS_MEDIA_HLS_MAX_UPLOAD_BUFFERS + 1,
+                                     content, size);
+    CuAssertIntEquals(tc, expected_len, length);
+    CuAssertTrue(tc, 0 == memcmp(expected, content, length));
+
+    free(expected);
+    free(content);
+}
+
+void test_oss_media_hls_write_m3u8_with_key(CuTest *tc) {
+    int ret = 0;
+
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->frame_count = 0;
+
+    oss_media_hls_m3u8_info_t m3u8[4];
+
+    memset(m3u8, 0, sizeof(m3u8));
+    m3u8[0].duration = 10;
+    strcpy(m3u8[0].url, "1.ts");
+    strcpy(m3u8[0].key_uri, "1.key");
+    m3u8[1].duration = 10;
+    strcpy(m3u8[1].url, "2.ts");
+    strcpy(m3u8[1].key_uri, "1.key");
+    m3u8[2].duration = 10;
+    strcpy(m3u8[2].url, "3.ts");
+    strcpy(m3u8[2].key_uri, "3.key");
+    m3u8[3].duration = 10;
+    strcpy(m3u8[3].url, "4.ts");
+
+    oss_media_hls_begin_m3u8(10, 0, file);
+    ret = oss_media_hls_write_m3u8(4, m3u8, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+                     "#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:3\n"
+                     "#EXT-X-KEY:METHOD=AES-128,URI=\"1.key\"\n"
+                     "#EXTINF:10.000,\n1.ts\n"
+                     "#EXTINF:10.000,\n2.ts\n"
+                     "#EXT-X-KEY:METHOD=AES-128,URI=\"3.key\"\n"
+                     "#EXTINF:10.000,\n3.ts\n"
+                     "#EXT-X-KEY:METHOD=NONE\n"
+                     "#EXTINF:10.000,\n4.ts\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertIntEquals(tc, strlen(expected), file->buffer->pos);
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_m3u8_with_sample_aes(CuTest *tc) {
+    int ret = 0;
+
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->frame_count = 0;
+
+    oss_media_hls_m3u8_info_t m3u8[3];
+
+    memset(m3u8, 0, sizeof(m3u8));
+    m3u8[0].duration = 10;
+    strcpy(m3u8[0].url, "1.ts");
+    strcpy(m3u8[0].key_uri, "1.key");
+    m3u8[0].sample_aes = 1;
+    m3u8[1].duration = 10;
+    strcpy(m3u8[1].url, "2.ts");
+    strcpy(m3u8[1].key_uri, "1.key");
+    m3u8[1].sample_aes = 1;
+    m3u8[2].duration = 10;
+    strcpy(m3u8[2].url, "3.ts");
+    strcpy(m3u8[2].key_uri, "1.key");
+
+    oss_media_hls_begin_m3u8(10, 0, file);
+    ret = oss_media_hls_write_m3u8(3, m3u8, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+                     "#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:3\n"
+                     "#EXT-X-KEY:METHOD=SAMPLE-AES,URI=\"1.key\"\n"
+                     "#EXTINF:10.000,\n1.ts\n"
+                     "#EXTINF:10.000,\n2.ts\n"
+                     "#EXT-X-KEY:METHOD=AES-128,URI=\"1.key\"\n"
+                     "#EXTINF:10.000,\n3.ts\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertIntEquals(tc, strlen(expected), file->buffer->pos);
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_m3u8_with_map(CuTest *tc) {
+    int ret = 0;
+
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->options.format = sf_fmp4;
+    file->frame_count = 0;
+
+    oss_media_hls_m3u8_info_t m3u8[2];
+
+    memset(m3u8, 0, sizeof(m3u8));
+    m3u8[0].duration = 10;
+    strcpy(m3u8[0].url, "1.m4s");
+    strcpy(m3u8[0].key_uri, "1.key");
+    strcpy(m3u8[0].map_uri, "init.mp4");
+    m3u8[1].duration = 10;
+    strcpy(m3u8[1].url, "2.m4s");
+    strcpy(m3u8[1].key_uri, "1.key");
+    strcpy(m3u8[1].map_uri, "init.mp4");
+
+    oss_media_hls_begin_m3u8(10, 0, file);
+    ret = oss_media_hls_write_m3u8(2, m3u8, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+                     "#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:6\n"
+                     "#EXT-X-MAP:URI=\"init.mp4\"\n"
+                     "#EXT-X-KEY:METHOD=AES-128,URI=\"1.key\"\n"
+                     "#EXTINF:10.000,\n1.m4s\n"
+                     "#EXTINF:10.000,\n2.m4s\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertIntEquals(tc, strlen(expected), file->buffer->pos);
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_begin_ll_m3u8(CuTest *tc) {
+    oss_media_hls_file_t *file;
+    
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "test2.m3u8", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    oss_media_hls_begin_ll_m3u8(2, 5, 0.5, file);
+
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:2\n"
+                     "#EXT-X-MEDIA-SEQUENCE:5\n#EXT-X-VERSION:3\n"
+                     "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=1.500\n"
+                     "#EXT-X-PART-INF:PART-TARGET=0.500\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertIntEquals(tc, strlen(expected), file->buffer->pos);
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+    CuAssertIntEquals(tc, 5, (int)file->m3u8_sequence);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_write_ll_m3u8(CuTest *tc) {
+    int ret = 0;
+
+    oss_media_hls_file_t *file;
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->frame_count = 0;
+
+    oss_media_hls_m3u8_info_t m3u8[2];
+    oss_media_hls_part_info_t parts[4];
+
+    memset(m3u8, 0, sizeof(m3u8));
+    memset(parts, 0, sizeof(parts));
+    m3u8[0].duration = 1;
+    strcpy(m3u8[0].url, "5.ts");
+    // the segment being written has parts only
+    m3u8[1].url[0] = '\0';
+
+    parts[0].duration = 0.5;
+    strcpy(parts[0].url, "4.1.ts");
+    parts[0].sequence = 4;
+    parts[1].duration = 0.5;
+    strcpy(parts[1].url, "5.0.ts");
+    parts[1].independent = 1;
+    parts[1].sequence = 5;
+    parts[2].duration = 0.5;
+    strcpy(parts[2].url, "5.1.ts");
+    parts[2].sequence = 5;
+    parts[3].duration = 0.4;
+    strcpy(parts[3].url, "6.0.ts");
+    parts[3].independent = 1;
+    parts[3].sequence = 6;
+
+    oss_media_hls_begin_m3u8(1, 5, file);
+    file->buffer->pos = 0;
+    ret = oss_media_hls_write_ll_m3u8(2, m3u8, 4, parts, "6.1.ts", file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXT-X-PART:DURATION=0.500,URI=\"5.0.ts\","
+                     "INDEPENDENT=YES\n"
+                     "#EXT-X-PART:DURATION=0.500,URI=\"5.1.ts\"\n"
+                     "#EXTINF:1.000,\n5.ts\n"
+                     "#EXT-X-PART:DURATION=0.400,URI=\"6.0.ts\","
+                     "INDEPENDENT=YES\n"
+                     "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"6.1.ts\"\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertIntEquals(tc, strlen(expected), file->buffer->pos);
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_flush_with_part_timeout(CuTest *tc) {
+    int ret = 0;
+    oss_media_hls_file_t *file;
+    oss_media_file_t *part_file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "test_timeout.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    part_file = oss_media_file_open(TEST_BUCKET_NAME, "test_timeout.0.ts",
+                                    "aw", auth_func);
+    CuAssertTrue(tc, part_file != NULL);
+    file->part_file = part_file;
+
+    // no upload can be done in 1ms, the data is dropped from both files
+    file->options.write_timeout_ms = 1;
+    file->options.drop_on_timeout = 1;
+    memset(&file->buffer->buf[file->buffer->pos], 0x47,
+           OSS_MEDIA_HLS_PACKET_SIZE);
+    file->buffer->pos += OSS_MEDIA_HLS_PACKET_SIZE;
+    ret = oss_media_hls_flush(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, file->buffer->start, file->buffer->pos);
+    CuAssertIntEquals(tc, 0, file->file->_stat.length);
+    CuAssertIntEquals(tc, 0, part_file->_stat.length);
+
+    // without drop the data is kept, and goes to both files once
+    file->options.drop_on_timeout = 0;
+    memset(&file->buffer->buf[file->buffer->pos], 0x47,
+           OSS_MEDIA_HLS_PACKET_SIZE);
+    file->buffer->pos += OSS_MEDIA_HLS_PACKET_SIZE;
+    ret = oss_media_hls_flush(file);
+    CuAssertIntEquals(tc, OSS_MEDIA_TIMEOUT, ret);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE,
+                      file->buffer->pos - file->buffer->start);
+
+    file->options.write_timeout_ms = 0;
+    ret = oss_media_hls_flush(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE, file->file->_stat.length);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE, part_file->_stat.length);
+
+    file->part_file = NULL;
+    delete_file(part_file);
+    oss_media_file_close(part_file);
+    delete_file(file->file);
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_flush_with_segment_timeout(CuTest *tc) {
+    int ret = 0;
+    oss_media_hls_file_t *file;
+    oss_media_file_t *part_file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "test_timeout.ts", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    part_file = oss_media_file_open(TEST_BUCKET_NAME, "test_part.0.ts",
+                                    "aw", auth_func);
+    CuAssertTrue(tc, part_file != NULL);
+    file->part_file = part_file;
+
+    // the part has the data, the segment does not, so nothing is dropped
+    file->options.write_timeout_ms = 1;
+    file->options.drop_on_timeout = 1;
+    memset(&file->buffer->buf[file->buffer->pos], 0x47,
+           OSS_MEDIA_HLS_PACKET_SIZE);
+    file->buffer->pos += OSS_MEDIA_HLS_PACKET_SIZE;
+    ret = oss_media_hls_flush(file);
+    CuAssertIntEquals(tc, OSS_MEDIA_TIMEOUT, ret);
+    CuAssertIntEquals(tc, 0, file->file->_stat.length);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE, part_file->_stat.length);
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_PACKET_SIZE, file->buffer->part_len);
+    CuAssertIntEquals(tc, -1, oss_media_hls_set_part_file(file, NULL));
+
+    // the part only gets the data written after the timeout
+    memset(&file->buffer->buf[file->buffer->pos], 0x47,
+           OSS_MEDIA_HLS_PACKET_SIZE);
+    file->buffer->pos += OSS_MEDIA_HLS_PACKET_SIZE;
+    file->options.write_timeout_ms = 0;
+    ret = oss_media_hls_flush(file);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 2 * OSS_MEDIA_HLS_PACKET_SIZE,
+                      file->file->_stat.length);
+    CuAssertIntEquals(tc, 2 * OSS_MEDIA_HLS_PACKET_SIZE,
+                      part_file->_stat.length);
+    CuAssertIntEquals(tc, 0, file->buffer->part_len);
+
+    CuAssertIntEquals(tc, 0, oss_media_hls_set_part_file(file, NULL));
+    delete_file(part_file);
+    oss_media_file_close(part_file);
+    delete_file(file->file);
+    oss_media_hls_close(file);
+}
+
+void test_oss_media_hls_window(CuTest *tc) {
+    int ret = 0;
+    oss_media_hls_window_t window;
+    oss_media_hls_segment_t *segment;
+    const char *key_uri;
+
+    ret = oss_media_hls_window_init(&window, 3);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // the segments of a key share one copy of its uri
+    segment = oss_media_hls_window_push(&window, "1.key");
+    segment->index = 1;
+    key_uri = segment->key_uri;
+    CuAssertStrEquals(tc, "1.key", key_uri);
+    segment = oss_media_hls_window_push(&window, "1.key");
+    segment->index = 2;
+    CuAssertPtrEquals(tc, (void*)key_uri, (void*)segment->key_uri);
+    segment = oss_media_hls_window_push(&window, NULL);
+    segment->index = 3;
+    CuAssertTrue(tc, segment->key_uri == NULL);
+    CuAssertIntEquals(tc, 3, window.count);
+
+    // the oldest is dropped once the window is full
+    segment = oss_media_hls_window_push(&window, "1.key");
+    segment->index = 4;
+    CuAssertStrEquals(tc, "1.key", segment->key_uri);
+    segment = oss_media_hls_window_push(&window, "5.key");
+    segment->index = 5;
+    CuAssertIntEquals(tc, 3, window.count);
+    CuAssertTrue(tc, 3 == oss_media_hls_window_at(&window, 0)->index);
+    CuAssertTrue(tc, 4 == oss_media_hls_window_at(&window, 1)->index);
+    CuAssertTrue(tc, 5 == oss_media_hls_window_at(&window, 2)->index);
+    CuAssertStrEquals(tc, "1.key", oss_media_hls_window_at(&window, 1)->key_uri);
+    CuAssertStrEquals(tc, "5.key", window.key_uri);
+
+    segment = oss_media_hls_window_push(&window, "5.key");
+    segment->index = 6;
+    segment = oss_media_hls_window_push(&window, "5.key");
+    segment->index = 7;
+    CuAssertTrue(tc, 5 == oss_media_hls_window_at(&window, 0)->index);
+    CuAssertPtrEquals(tc, window.key_uri,
+            (void*)oss_media_hls_window_at(&window, 0)->key_uri);
+
+    // a wrapped ring keeps the order of its segments when it grows
+    ret = oss_media_hls_window_grow(&window, 5);
+    CuAssertIntEquals(tc, 0, ret);
+    segment = oss_media_hls_window_push(&window, NULL);
+    segment->index = 8;
+    CuAssertIntEquals(tc, 4, window.count);
+    CuAssertTrue(tc, 5 == oss_media_hls_window_at(&window, 0)->index);
+    CuAssertTrue(tc, 7 == oss_media_hls_window_at(&window, 2)->index);
+    CuAssertTrue(tc, 8 == oss_media_hls_window_at(&window, 3)->index);
+
+    oss_media_hls_window_pop(&window);
+    CuAssertIntEquals(tc, 3, window.count);
+    CuAssertTrue(tc, 6 == oss_media_hls_window_at(&window, 0)->index);
+
+    oss_media_hls_window_destroy(&window);
+    CuAssertTrue(tc, window.segments == NULL);
+}
+
+void test_oss_media_hls_write_window_m3u8(CuTest *tc) {
+    int ret = 0;
+    int i;
+    oss_media_hls_window_t window;
+    oss_media_hls_segment_t *segment;
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key", auth_func);
+    CuAssertTrue(tc, file != NULL);
+
+    file->options.handler_func = oss_media_hls_fake_handler;
+    file->frame_count = 0;
+
+    ret = oss_media_hls_window_init(&window, 3);
+    CuAssertIntEquals(tc, 0, ret);
+    strcpy(window.url_prefix, "http://bucket/test");
+    strcpy(window.url_suffix, ".ts");
+    for (i = 0; i < 4; i++) {
+        segment = oss_media_hls_window_push(&window, i < 2 ? "1.key" : NULL);
+        segment->index = i;
+        segment->duration = 10;
+    }
+
+    oss_media_hls_begin_m3u8(10, 1, file);
+    ret = oss_media_hls_write_window_m3u8(&window, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+                     "#EXT-X-MEDIA-SEQUENCE:1\n#EXT-X-VERSION:3\n"
+                     "#EXT-X-KEY:METHOD=AES-128,URI=\"1.key\"\n"
+                     "#EXTINF:10.000,\nhttp://bucket/test1.ts\n"
+                     "#EXT-X-KEY:METHOD=NONE\n"
+                     "#EXTINF:10.000,\nhttp://bucket/test2.ts\n"
+                     "#EXTINF:10.000,\nhttp://bucket/test3.ts\n";
+    uint8_t *result = &file->buffer->buf[file->buffer->start];
+    CuAssertIntEquals(tc, strlen(expected), file->buffer->pos);
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    // byte ranges of one url
+    oss_media_hls_window_destroy(&window);
+    ret = oss_media_hls_window_init(&window, 3);
+    CuAssertIntEquals(tc, 0, ret);
+    strcpy(window.url_prefix, "http://bucket/test");
+    strcpy(window.url_suffix, ".ts");
+    segment = oss_media_hls_window_push(&window, NULL);
+    segment->index = -1;
+    segment->duration = 10;
+    segment->range_offset = 188;
+    segment->range_length = 376;
+
+    file->buffer->pos = 0;
+    file->frame_count = 0;
+    ret = oss_media_hls_write_window_m3u8(&window, file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    expected = "#EXTINF:10.000,\n#EXT-X-BYTERANGE:376@188\n"
+               "http://bucket/test.ts\n";
+    result = &file->buffer->buf[file->buffer->start];
+    CuAssertIntEquals(tc, strlen(expected), file->buffer->pos);
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)result);
+
+    oss_media_hls_window_destroy(&window);
+    oss_media_hls_close(file);
+}
+
+static void write_test_fmp4_frames(oss_media_hls_file_t *file, int flush) {
+    int i;
+    uint8_t buf[1000];
+    oss_media_hls_frame_t frame;
+
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = (i & 0x7F) | 0x80;
+    }
+    memcpy(buf, "\x00\x00\x00\x01\x65", 5);
+
+    file->options.format = sf_fmp4;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.pos = buf;
+    frame.end = buf + sizeof(buf);
+    frame.pts = 5000;
+    frame.dts = 5000;
+    frame.key = 1;
+    oss_media_hls_write_frame(&frame, file);
+
+    if (flush) {
+        oss_media_hls_flush(file);
+    }
+
+    frame.pos = buf;
+    frame.end = buf + 101;
+    frame.pts = 8000;
+    frame.dts = 8000;
+    frame.key = 0;
+    oss_media_hls_write_frame(&frame, file);
+}
+
+void test_oss_media_hls_write_frame_with_fmp4_encrypt(CuTest *tc) {
+    int ret;
+    int plain_len;
+    int expected_len;
+    uint8_t plain[sizeof(captured)];
+    uint8_t expected[sizeof(captured)];
+    oss_media_hls_file_t *file;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key9.m4s", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+
+    captured_len = 0;
+    write_test_fmp4_frames(file, 1);
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+    plain_len = captured_len;
+    memcpy(plain, captured, plain_len);
+    expected_len = make_encrypted(expected, plain, plain_len);
+
+    // the partial block of the first fragment waits for the second one
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "key9.m4s", auth_func);
+    CuAssertTrue(tc, file != NULL);
+    file->options.handler_func = oss_media_hls_capture_handler;
+    set_test_encrypt(file);
+
+    captured_len = 0;
+    captured_unaligned = 0;
+    write_test_fmp4_frames(file, 1);
+    ret = oss_media_hls_close(file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    CuAssertIntEquals(tc, 0, captured_unaligned);
+    CuAssertIntEquals(tc, expected_len, captured_len);
+    CuAssertTrue(tc, 0 == memcmp(expected, captured, expected_len));
+}
+
+static int oss_media_hls_fake_handler(oss_media_hls_file_t *file) {
+    return file->frame_count++ > 0;
+}
+
+static int oss_media_hls_capture_handler(oss_media_hls_file_t *file) {
+    int len = file->buffer->pos - file->buffer->start;
+
+    if (len % OSS_MEDIA_HLS_ENCRYPT_PACKET_LENGTH != 0) {
+        captured_unaligned = 1;
+    }
+    memcpy(captured + captured_len, &file->buffer->buf[file->buffer->start], len);
+    captured_len += len;
+    file->buffer->pos = file->buffer->start;
+
+    return 0;
+}
+
+static int oss_media_hls_count_handler(oss_media_hls_file_t *file) {
+    // an empty buffer costs no request
+    if (file->buffer->pos > file->buffer->start) {
+        handled_count++;
+        handled_len += file->buffer->pos - file->buffer->start;
+    }
+    file->buffer->pos = file->buffer->start;
+
+    return 0;
 }
 
 static void auth_func(oss_media_file_t *file) {
@@ -966,7 +2545,7 @@ CuSuite *test_hls()
     SUITE_ADD_TEST(suite, test_calculate_crc32_with_empty);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pcr);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pts);
-    //SUITE_ADD_TEST(suite, test_oss_media_hls_encrypt_packet);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_call_handler_with_encrypt);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_hls_header);
     SUITE_ADD_TEST(suite, test_oss_media_hls_set_crc32);
     SUITE_ADD_TEST(suite, test_oss_media_handle_file_with_not_called);
@@ -974,12 +2553,15 @@ CuSuite *test_hls()
     SUITE_ADD_TEST(suite, test_oss_media_handle_file_with_called_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_with_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_with_succeeded);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_with_continuity_counter);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_pmt_with_pid_changed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pmt_with_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pmt_with_succeeded);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_and_pmt_with_pat_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_and_pmt_with_pmt_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_and_pmt_succeeded);
-    //SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_and_pmt_with_encrypt);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_pat_and_pmt_with_encrypt);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_pmt_with_audio_only);
     SUITE_ADD_TEST(suite, test_oss_media_hls_ossfile_handler_without_handle);
     SUITE_ADD_TEST(suite, test_oss_media_hls_ossfile_handler_succeeded);
     SUITE_ADD_TEST(suite, test_oss_media_hls_ossfile_handler_failed);
@@ -991,18 +2573,46 @@ CuSuite *test_hls()
     SUITE_ADD_TEST(suite, test_oss_media_hls_open_with_m3u8_file);
     SUITE_ADD_TEST(suite, test_oss_media_hls_open_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_begin_m3u8);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_begin_iframe_m3u8);
     SUITE_ADD_TEST(suite, test_oss_media_hls_end_m3u8);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_with_one_m3u8);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_with_two_m3u8);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_with_reused_info);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_master_m3u8);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_with_byte_range);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_end_segment);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_single_put);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_with_key);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_with_sample_aes);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_m3u8_with_map);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_begin_ll_m3u8);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_ll_m3u8);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_flush_with_part_timeout);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_flush_with_segment_timeout);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_window);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_window_m3u8);
     SUITE_ADD_TEST(suite, test_oss_media_hls_close_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_close_succeeded);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_unsupport_stream_type);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_handle_file_failed);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_h264);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_h265);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_mp3);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_aac);
     SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_pes_overflow);
-    //SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_encrypt);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_one_byte_stuffing);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_encrypt);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_audio_pes);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_iframes);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_upload_buffers);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frames);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_prefix);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_escape_nal);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_sample_encrypt_h264);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_sample_encrypt_aac);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_pmt_with_sample_aes);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_write_frame_with_fmp4_encrypt);
     
     SUITE_ADD_TEST(suite, test_hls_teardown);
     
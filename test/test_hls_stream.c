@@ -7,6 +7,7 @@
 extern void delete_file(oss_media_file_t *file);
 static void auth_func(oss_media_file_t *file);
 static int oss_media_hls_fake_handler(oss_media_hls_file_t *file);
+static int oss_media_hls_fake_key(int64_t sequence, oss_media_hls_key_t *key);
 
 void test_hls_stream_setup(CuTest *tc) {
     aos_pool_t *p;
@@ -36,6 +37,7 @@ void test_oss_media_get_digit_num(CuTest *tc) {
 
 void test_oss_media_hls_stream_open_with_vod(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test.m3u8";
@@ -74,6 +76,7 @@ void test_oss_media_hls_stream_open_with_vod(CuTest *tc) {
 
 void test_oss_media_hls_stream_open_with_live(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test.m3u8";
@@ -92,6 +95,10 @@ void test_oss_media_hls_stream_open_with_live(CuTest *tc) {
     CuAssertStrEquals(tc, "test0.ts", stream->ts_file->file->object_key);
     CuAssertStrEquals(tc, "test.m3u8", stream->m3u8_file->file->object_key);
     CuAssertStrEquals(tc, "w", stream->m3u8_file->file->mode);
+    CuAssertIntEquals(tc, 700000, stream->ts_file->options.write_timeout_ms);
+    CuAssertIntEquals(tc, 0, stream->ts_file->options.drop_on_timeout);
+    CuAssertIntEquals(tc, 700000, stream->m3u8_file->options.write_timeout_ms);
+    CuAssertIntEquals(tc, 1, stream->m3u8_file->options.drop_on_timeout);
     CuAssertIntEquals(tc, st_h264, stream->video_frame->stream_type);
     CuAssertIntEquals(tc, 1, stream->video_frame->continuity_counter);
     CuAssertIntEquals(tc, 1, stream->video_frame->key);
@@ -114,6 +121,7 @@ void test_oss_media_hls_stream_open_with_live(CuTest *tc) {
 
 void test_oss_media_hls_stream_open_with_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test";
     options.bucket_name = "not.exist";
     options.m3u8_name = "test.m3u8";
@@ -133,7 +141,7 @@ void test_oss_media_create_ts_full_url(CuTest *tc) {
     aos_pool_create(&pool, NULL);
 
     oss_media_file_t *file;
-    file = (oss_media_file_t*)malloc(sizeof(oss_media_file_t));
+    file = (oss_media_file_t*)calloc(1, sizeof(oss_media_file_t));
     file->endpoint = "oss.abc.com";
     file->bucket_name = "bucket-1";
     file->object_key = "key-1";
@@ -152,7 +160,7 @@ void test_oss_media_create_ts_full_url_with_prefix(CuTest *tc) {
     aos_pool_create(&pool, NULL);
 
     oss_media_file_t *file;
-    file = (oss_media_file_t*)malloc(sizeof(oss_media_file_t));
+    file = (oss_media_file_t*)calloc(1, sizeof(oss_media_file_t));
     file->endpoint = "https://oss.abc.com";
     file->bucket_name = "bucket-1";
     file->object_key = "key-1";
@@ -166,8 +174,59 @@ void test_oss_media_create_ts_full_url_with_prefix(CuTest *tc) {
     oss_media_file_close(file);
 }
 
+void test_oss_media_create_url(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 700;
+    options.hls_list_size = 5;
+    
+    int ret;
+    char url[OSS_MEDIA_M3U8_URL_LENGTH];
+    char long_key[OSS_MEDIA_M3U8_URL_LENGTH];
+    oss_media_hls_stream_t *stream;
+    oss_media_file_t *file;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+
+    file = stream->ts_file->file;
+    file->endpoint = "oss.abc.com";
+    file->bucket_name = "bucket-1";
+    file->object_key = "key-1";
+
+    ret = oss_media_create_url(url, file, stream);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertStrEquals(tc, "http://bucket-1.oss.abc.com/key-1", url);
+    CuAssertStrEquals(tc, "http://bucket-1.oss.abc.com/",
+                      stream->url_prefix.prefix);
+
+    // the prefix is made again for another bucket
+    file->bucket_name = "bucket-2";
+    ret = oss_media_create_url(url, file, stream);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertStrEquals(tc, "http://bucket-2.oss.abc.com/key-1", url);
+
+    memset(long_key, 'a', sizeof(long_key) - 1);
+    long_key[sizeof(long_key) - 1] = '\0';
+    file->object_key = long_key;
+    ret = oss_media_create_url(url, file, stream);
+    CuAssertIntEquals(tc, -1, ret);
+
+    file->object_key = "dir/test0.ts";
+    delete_file(stream->m3u8_file->file);
+
+    ret = oss_media_hls_stream_close(stream);
+    CuAssertIntEquals(tc, 0, ret);
+}
+
 void test_oss_media_set_m3u8_info(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "dir/test";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "dir/test.m3u8";
@@ -178,6 +237,8 @@ void test_oss_media_set_m3u8_info(CuTest *tc) {
     options.hls_list_size = 5;
     
     int ret;
+    char url[OSS_MEDIA_M3U8_URL_LENGTH];
+    oss_media_hls_segment_t *segment;
     oss_media_hls_stream_t *stream;
     stream = oss_media_hls_stream_open(auth_func, &options);
     CuAssertTrue(tc, stream != NULL);
@@ -185,11 +246,14 @@ void test_oss_media_set_m3u8_info(CuTest *tc) {
     stream->ts_file->file->endpoint = "oss.abc.com";
     stream->ts_file->file->bucket_name = "bucket-1";
 
-    oss_media_set_m3u8_info(0, 10.5, stream);
+    oss_media_set_m3u8_info(10.5, stream);
     
-    CuAssertDblEquals(tc, 10.5, stream->m3u8_infos[0].duration, 0.00001);
-    CuAssertStrEquals(tc, "http://bucket-1.oss.abc.com/dir/test0.ts", 
-                      stream->m3u8_infos[0].url);
+    segment = oss_media_hls_window_at(&stream->m3u8_window, 0);
+    CuAssertIntEquals(tc, 1, stream->m3u8_window.count);
+    CuAssertDblEquals(tc, 10.5, segment->duration, 0.00001);
+    sprintf(url, "%s%" APR_INT64_T_FMT "%s", stream->m3u8_window.url_prefix,
+            segment->index, stream->m3u8_window.url_suffix);
+    CuAssertStrEquals(tc, "http://bucket-1.oss.abc.com/dir/test0.ts", url);
 
     delete_file(stream->m3u8_file->file);
 
@@ -199,6 +263,7 @@ void test_oss_media_set_m3u8_info(CuTest *tc) {
 
 void test_oss_media_write_m3u8_for_vod(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "dir/test2-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "dir/test2.m3u8";
@@ -238,6 +303,7 @@ void test_oss_media_write_m3u8_for_vod(CuTest *tc) {
 
 void test_oss_media_write_m3u8_for_live(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "dir/test2-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "dir/test2.m3u8";
@@ -302,8 +368,522 @@ void test_oss_media_write_m3u8_for_live(CuTest *tc) {
     oss_media_hls_stream_close(stream);    
 }
 
+void test_oss_media_write_m3u8_with_key_rotation(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test6-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test6.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.hls_list_size = 3;
+    options.encrypt = 1;
+    options.key_rotate_segments = 2;
+    options.key_func = oss_media_hls_fake_key;
+    
+    int ret;
+    oss_media_hls_stream_t *stream;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertIntEquals(tc, 1, stream->ts_file->options.encrypt);
+    CuAssertIntEquals(tc, 0, stream->ts_file->options.key[0]);
+    CuAssertIntEquals(tc, 0, stream->ts_file->options.iv[15]);
+    CuAssertIntEquals(tc, 0, stream->key_sequence);
+    CuAssertIntEquals(tc, 0, stream->m3u8_file->options.encrypt);
+
+    stream->ts_file->file->endpoint = "oss.abc.com";
+    stream->ts_file->file->bucket_name = "bucket-1";
+    ret = oss_media_write_m3u8(8.9, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // the second ts keeps the key with its own iv
+    close_and_open_new_file(stream);
+    CuAssertIntEquals(tc, 0, stream->ts_file->options.key[0]);
+    CuAssertIntEquals(tc, 1, stream->ts_file->options.iv[15]);
+    stream->ts_file->file->endpoint = "oss.abc.com";
+    stream->ts_file->file->bucket_name = "bucket-1";
+    ret = oss_media_write_m3u8(7.2, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // the third ts rotates the key
+    close_and_open_new_file(stream);
+    CuAssertIntEquals(tc, 2, stream->ts_file->options.key[0]);
+    CuAssertIntEquals(tc, 2, stream->ts_file->options.iv[15]);
+    CuAssertIntEquals(tc, 2, stream->key_sequence);
+    stream->ts_file->file->endpoint = "oss.abc.com";
+    stream->ts_file->file->bucket_name = "bucket-1";
+    ret = oss_media_write_m3u8(5.3, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    close_and_open_new_file(stream);
+    stream->ts_file->file->endpoint = "oss.abc.com";
+    stream->ts_file->file->bucket_name = "bucket-1";
+    ret = oss_media_write_m3u8(5.6, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // every playlist names the key of its first ts
+    uint8_t *content = stream->m3u8_file->buffer->buf;
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n#"
+               "EXT-X-MEDIA-SEQUENCE:1\n#EXT-X-VERSION:3\n"
+               "#EXT-X-KEY:METHOD=AES-128,URI=\"https://key.abc.com/0\"\n"
+               "#EXTINF:7.200,\nhttp://bucket-1.oss.abc.com/dir/test6-1.ts\n"
+               "#EXT-X-KEY:METHOD=AES-128,URI=\"https://key.abc.com/2\"\n"
+               "#EXTINF:5.300,\nhttp://bucket-1.oss.abc.com/dir/test6-2.ts\n"
+               "#EXTINF:5.600,\nhttp://bucket-1.oss.abc.com/dir/test6-3.ts\n";
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)content);
+
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
+void test_oss_media_write_m3u8_with_sample_aes(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test8-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test8.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.hls_list_size = 3;
+    options.encrypt = 1;
+    options.sample_aes = 1;
+    options.key_func = oss_media_hls_fake_key;
+    
+    int ret;
+    oss_media_hls_stream_t *stream;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertIntEquals(tc, 1, stream->ts_file->options.encrypt);
+    CuAssertIntEquals(tc, 1, stream->ts_file->options.sample_aes);
+
+    stream->ts_file->file->endpoint = "oss.abc.com";
+    stream->ts_file->file->bucket_name = "bucket-1";
+    ret = oss_media_write_m3u8(8.9, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // the next ts knows the audio config for its first PMT
+    stream->ts_file->encrypt.audio_config[0] = 0x12;
+    stream->ts_file->encrypt.audio_config[1] = 0x10;
+    close_and_open_new_file(stream);
+    CuAssertIntEquals(tc, 1, stream->ts_file->options.sample_aes);
+    CuAssertIntEquals(tc, 0x12, stream->ts_file->encrypt.audio_config[0]);
+    CuAssertIntEquals(tc, 0x10, stream->ts_file->encrypt.audio_config[1]);
+    stream->ts_file->file->endpoint = "oss.abc.com";
+    stream->ts_file->file->bucket_name = "bucket-1";
+    ret = oss_media_write_m3u8(7.2, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    uint8_t *content = stream->m3u8_file->buffer->buf;
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n#"
+               "EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:3\n"
+               "#EXT-X-KEY:METHOD=SAMPLE-AES,URI=\"https://key.abc.com/0\"\n"
+               "#EXTINF:8.900,\nhttp://bucket-1.oss.abc.com/dir/test8-0.ts\n"
+               "#EXTINF:7.200,\nhttp://bucket-1.oss.abc.com/dir/test8-1.ts\n";
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)content);
+
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
+void test_oss_media_write_m3u8_with_fmp4(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test9-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test9.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.hls_list_size = 3;
+    options.format = sf_fmp4;
+    
+    int ret;
+    int64_t length;
+    uint8_t init[16];
+    // sps of baseline 640x480, pps and a slice
+    uint8_t video[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1E,
+                       0xF4, 0x05, 0x01, 0xEC, 0x80,
+                       0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x38, 0x80,
+                       0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    oss_media_hls_frame_t frame;
+    oss_media_file_t *init_file;
+    oss_media_hls_stream_t *stream;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertIntEquals(tc, sf_fmp4, stream->ts_file->options.format);
+    CuAssertIntEquals(tc, sf_fmp4, stream->m3u8_file->options.format);
+    CuAssertStrEquals(tc, "dir/test9-0.m4s", stream->ts_file->file->object_key);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.pos = video;
+    frame.end = video + sizeof(video);
+    frame.pts = frame.dts = 5000;
+    frame.key = 1;
+    ret = oss_media_hls_write_frame(&frame, stream->ts_file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // the init segment is saved with the first segment
+    ret = oss_media_hls_stream_flush(8.9, stream);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertTrue(tc, NULL != strstr(stream->map_uri, "/dir/test9-init.mp4"));
+
+    init_file = oss_media_file_open(TEST_BUCKET_NAME, "dir/test9-init.mp4", 
+                                    "r", auth_func);
+    CuAssertTrue(tc, init_file != NULL);
+    length = oss_media_file_read(init_file, init, sizeof(init));
+    CuAssertIntEquals(tc, sizeof(init), length);
+    CuAssertTrue(tc, 0 == memcmp("ftypiso6", init + 4, 8));
+
+    uint8_t *content = stream->m3u8_file->buffer->buf;
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n#"
+               "EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:6\n"
+               "#EXT-X-MAP:URI=\"";
+    CuAssertStrnEquals(tc, expected, strlen(expected), (char*)content);
+    CuAssertTrue(tc, NULL != strstr((char*)content, "/dir/test9-0.m4s\n"));
+
+    delete_file(init_file);
+    oss_media_file_close(init_file);
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
+void test_oss_media_write_m3u8_with_byte_range(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test-range";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test-range.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.hls_list_size = 3;
+    options.byte_range = 1;
+
+    int i;
+    int ret;
+    char line[128];
+    uint8_t video[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_stream_t *stream;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertStrEquals(tc, "dir/test-range.ts", 
+                      stream->ts_file->file->object_key);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.key = 1;
+    for (i = 0; i < 2; i++) {
+        frame.pos = video;
+        frame.end = video + sizeof(video);
+        frame.pts = frame.dts = 5000 + i * 900000;
+        ret = oss_media_hls_write_frame(&frame, stream->ts_file);
+        CuAssertIntEquals(tc, 0, ret);
+
+        ret = oss_media_hls_stream_flush(10, stream);
+        CuAssertIntEquals(tc, 0, ret);
+        ret = oss_media_next_range(stream);
+        CuAssertIntEquals(tc, 0, ret);
+    }
+
+    // both segments are in the one object, each starts with PAT/PMT
+    CuAssertStrEquals(tc, "dir/test-range.ts", 
+                      stream->ts_file->file->object_key);
+    CuAssertIntEquals(tc, 2, stream->ts_file_index - 1);
+    CuAssertIntEquals(tc, 6 * OSS_MEDIA_HLS_PACKET_SIZE, 
+                      stream->ts_file->file->_stat.length);
+    CuAssertIntEquals(tc, 6 * OSS_MEDIA_HLS_PACKET_SIZE, stream->range_offset);
+
+    char *content = (char*)stream->m3u8_file->buffer->buf;
+    CuAssertTrue(tc, NULL != strstr(content, "#EXT-X-VERSION:4\n"));
+    sprintf(line, "#EXT-X-BYTERANGE:%d@0\n", 3 * OSS_MEDIA_HLS_PACKET_SIZE);
+    CuAssertTrue(tc, NULL != strstr(content, line));
+    sprintf(line, "#EXT-X-BYTERANGE:%d@%d\n", 3 * OSS_MEDIA_HLS_PACKET_SIZE,
+            3 * OSS_MEDIA_HLS_PACKET_SIZE);
+    CuAssertTrue(tc, NULL != strstr(content, line));
+    CuAssertTrue(tc, NULL != strstr(content, "/dir/test-range.ts\n"));
+
+    delete_file(stream->ts_file->file);
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
+void test_oss_media_write_m3u8_with_single_put(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test-put-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test-put.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.hls_list_size = 3;
+    options.single_put = 1;
+    options.byte_range = 1;
+
+    int ret;
+    uint8_t video[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_stream_t *stream;
+
+    // a range is appended to the object of the segments before
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream == NULL);
+
+    options.byte_range = 0;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertStrEquals(tc, "p", stream->ts_file->file->mode);
+    CuAssertIntEquals(tc, 1, stream->ts_file->options.single_put);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.key = 1;
+    frame.pos = video;
+    frame.end = video + sizeof(video);
+    frame.pts = frame.dts = 5000;
+    ret = oss_media_hls_write_frame(&frame, stream->ts_file);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // the whole segment is put before the m3u8 lists it
+    ret = oss_media_hls_stream_flush(10, stream);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, stream->ts_file->buffer->start,
+                      stream->ts_file->buffer->pos);
+    CuAssertTrue(tc, NULL != strstr((char*)stream->m3u8_file->buffer->buf,
+                                    "/dir/test-put-0.ts\n"));
+    delete_file(stream->ts_file->file);
+
+    ret = close_and_open_new_file(stream);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertStrEquals(tc, "dir/test-put-1.ts",
+                      stream->ts_file->file->object_key);
+    CuAssertStrEquals(tc, "p", stream->ts_file->file->mode);
+
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
+void test_oss_media_hls_stream_open_with_chunked_failed(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test-chunked-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test-chunked.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 25;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 2;
+    options.hls_list_size = 3;
+    options.chunked = 1;
+
+    // each segment is one put, none of these fit into it
+    options.single_put = 1;
+    CuAssertTrue(tc, NULL == oss_media_hls_stream_open(auth_func, &options));
+    options.single_put = 0;
+    options.byte_range = 1;
+    CuAssertTrue(tc, NULL == oss_media_hls_stream_open(auth_func, &options));
+    options.byte_range = 0;
+    options.part_time_ms = 500;
+    CuAssertTrue(tc, NULL == oss_media_hls_stream_open(auth_func, &options));
+    options.part_time_ms = 0;
+    options.format = sf_fmp4;
+    CuAssertTrue(tc, NULL == oss_media_hls_stream_open(auth_func, &options));
+}
+
+void test_oss_media_write_iframe_m3u8(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test-iframe-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test-iframe.m3u8";
+    options.iframe_m3u8_name = "dir/test-iframe-iframes.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 25;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.hls_list_size = 1;
+
+    int i;
+    int ret;
+    uint8_t video[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_stream_t *stream;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertTrue(tc, stream->iframe_m3u8_file != NULL);
+
+    // a key frame, another frame and a key frame in 0.12s
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    stream->current_file_begin_pts = 5000;
+    for (i = 0; i < 3; i++) {
+        frame.pos = video;
+        frame.end = video + sizeof(video);
+        frame.pts = frame.dts = 5000 + i * 3600;
+        frame.key = i != 1;
+        ret = oss_media_hls_write_frame(&frame, stream->ts_file);
+        CuAssertIntEquals(tc, 0, ret);
+    }
+    ret = oss_media_hls_stream_flush(0.12, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    char *content = (char*)stream->iframe_m3u8_file->buffer->buf;
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+                     "#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:4\n"
+                     "#EXT-X-I-FRAMES-ONLY\n"
+                     "#EXTINF:0.080,\n#EXT-X-BYTERANGE:564@0\n";
+    CuAssertStrnEquals(tc, expected, strlen(expected), content);
+    CuAssertTrue(tc, NULL != strstr(content, 
+                "/dir/test-iframe-0.ts\n#EXTINF:0.040,\n"
+                "#EXT-X-BYTERANGE:564@752\n"));
+
+    // the key frames of the segment out of the window are dropped
+    ret = close_and_open_new_file(stream);
+    CuAssertIntEquals(tc, 0, ret);
+    stream->current_file_begin_pts = 15800;
+    frame.pos = video;
+    frame.pts = frame.dts = 15800;
+    frame.key = 1;
+    ret = oss_media_hls_write_frame(&frame, stream->ts_file);
+    CuAssertIntEquals(tc, 0, ret);
+    ret = oss_media_hls_stream_flush(0.04, stream);
+    CuAssertIntEquals(tc, 0, ret);
+
+    CuAssertIntEquals(tc, 1, stream->iframe_window.count);
+    CuAssertIntEquals(tc, 2, stream->iframe_sequence);
+    content = (char*)stream->iframe_m3u8_file->buffer->buf;
+    expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n"
+               "#EXT-X-MEDIA-SEQUENCE:2\n#EXT-X-VERSION:4\n"
+               "#EXT-X-I-FRAMES-ONLY\n"
+               "#EXTINF:0.040,\n#EXT-X-BYTERANGE:564@0\n";
+    CuAssertStrnEquals(tc, expected, strlen(expected), content);
+    CuAssertTrue(tc, NULL != strstr(content, "/dir/test-iframe-1.ts\n"));
+
+    delete_file(stream->ts_file->file);
+    delete_file(stream->m3u8_file->file);
+    delete_file(stream->iframe_m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
+void test_oss_media_write_m3u8_with_parts(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test10-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test10.m3u8";
+    options.is_live = 1;
+    options.video_frame_rate = 25;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.hls_list_size = 3;
+    options.part_time_ms = 500;
+    
+    int i;
+    int ret;
+    uint8_t video[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84};
+    oss_media_hls_frame_t frame;
+    oss_media_hls_stream_t *stream;
+
+    // a part of AES-128 can not be decrypted alone
+    options.encrypt = 1;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream == NULL);
+
+    options.encrypt = 0;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertStrEquals(tc, "dir/test10-0.0.ts", stream->part_name);
+    CuAssertTrue(tc, stream->ts_file->part_file != NULL);
+
+    frame.stream_type = st_h264;
+    frame.pos = video;
+    frame.end = video + sizeof(video);
+    for (i = 0; i < 13; i++) {
+        frame.pts = frame.dts = i * 3600;
+        frame.key = i == 0;
+        ret = oss_media_write_stream_frame(&frame, stream);
+        CuAssertIntEquals(tc, 0, ret);
+    }
+
+    // the 13th frame would make the first part longer than 500ms
+    CuAssertIntEquals(tc, 1, stream->part_count);
+    CuAssertIntEquals(tc, 0, (int)stream->parts[0].sequence);
+    CuAssertIntEquals(tc, 1, stream->parts[0].independent);
+    CuAssertStrEquals(tc, "dir/test10-0.1.ts", stream->part_name);
+    CuAssertStrEquals(tc, "dir/test10-0.ts", stream->ts_file->file->object_key);
+
+    char *content = (char*)stream->m3u8_file->buffer->buf;
+    char *expected = "#EXTM3U\n#EXT-X-TARGETDURATION:10\n#"
+               "EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-VERSION:3\n"
+               "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=1.500\n"
+               "#EXT-X-PART-INF:PART-TARGET=0.500\n"
+               "#EXT-X-PART:DURATION=0.480,URI=\"";
+    CuAssertStrnEquals(tc, expected, strlen(expected), content);
+    CuAssertTrue(tc, NULL != strstr(content, 
+                "/dir/test10-0.0.ts\",INDEPENDENT=YES\n"
+                "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\""));
+    CuAssertTrue(tc, NULL != strstr(content, "/dir/test10-0.1.ts\"\n"));
+    CuAssertTrue(tc, NULL == strstr(content, "#EXTINF"));
+
+    // the segment lists its parts and the first part of the next one
+    ret = oss_media_hls_stream_flush(0.52, stream);
+    CuAssertIntEquals(tc, 0, ret);
+    CuAssertIntEquals(tc, 2, stream->part_count);
+    CuAssertTrue(tc, NULL != strstr(content, 
+                "/dir/test10-0.1.ts\"\n#EXTINF:0.520,\n"));
+    CuAssertTrue(tc, NULL != strstr(content, "/dir/test10-1.0.ts\"\n"));
+
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
+void test_oss_media_create_key(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "dir/test7-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "dir/test7.m3u8";
+    options.is_live = 0;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 10;
+    options.encrypt = 1;
+    
+    int64_t length;
+    uint8_t key[OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE + 1];
+    oss_media_file_t *key_file;
+    oss_media_hls_stream_t *stream;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertTrue(tc, NULL != strstr(stream->key.uri, "/dir/test7-0.key"));
+    CuAssertTrue(tc, 0 == memcmp(stream->key.key, stream->ts_file->options.key,
+                                 OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE));
+
+    // the random key is saved next to the ts files
+    key_file = oss_media_file_open(TEST_BUCKET_NAME, "dir/test7-0.key", 
+                                   "r", auth_func);
+    CuAssertTrue(tc, key_file != NULL);
+    length = oss_media_file_read(key_file, key, sizeof(key));
+    CuAssertIntEquals(tc, OSS_MEDIA_HLS_ENCRYPT_KEY_SIZE, length);
+    CuAssertTrue(tc, 0 == memcmp(stream->key.key, key, length));
+
+    delete_file(key_file);
+    oss_media_file_close(key_file);
+    oss_media_hls_stream_close(stream);
+}
+
 void test_oss_media_write_m3u8_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "dir/test2-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "dir/test2.m3u8";
@@ -331,6 +911,7 @@ void test_oss_media_write_m3u8_failed(CuTest *tc) {
 
 void test_close_and_open_new_file_with_close_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "dir/test3-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "dir/test3.m3u8";
@@ -361,6 +942,7 @@ void test_close_and_open_new_file_with_open_failed(CuTest *tc) {
     memcpy(bucket, TEST_BUCKET_NAME, strlen(TEST_BUCKET_NAME) + 1);
 
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "dir/test4-";
     options.bucket_name = bucket;
     options.m3u8_name = "dir/test4.m3u8";
@@ -387,6 +969,7 @@ void test_close_and_open_new_file_with_open_failed(CuTest *tc) {
 
 void test_close_and_open_new_file(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "dir/test5-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "dir/test5.m3u8";
@@ -413,6 +996,7 @@ void test_close_and_open_new_file(CuTest *tc) {
 
 void test_oss_media_hls_stream_flush_with_write_ts_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test6-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test6.m3u8";
@@ -441,6 +1025,7 @@ void test_oss_media_hls_stream_flush_with_write_ts_failed(CuTest *tc) {
 
 void test_oss_media_hls_stream_flush_with_write_m3u8_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test6-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test7.m3u8";
@@ -470,6 +1055,7 @@ void test_oss_media_hls_stream_flush(CuTest *tc) {
     char *ts_content = "abc";
 
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test36-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test36.m3u8";
@@ -581,6 +1167,7 @@ void test_oss_media_get_samples_per_frame_with_aac(CuTest *tc) {
 
 void test_oss_media_write_stream_frame_with_write_frame_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test7-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test7.m3u8";
@@ -602,7 +1189,7 @@ void test_oss_media_write_stream_frame_with_write_frame_failed(CuTest *tc) {
     oss_media_hls_frame_t frame;
     frame.pts = 5000;
     frame.dts = 5000;
-    frame.stream_type = st_mp3;
+    frame.stream_type = (stream_type_t)(st_h265 + 1);
     uint8_t buf[] = "12323423423";
     frame.pos = buf;
     frame.end = buf + sizeof(buf);
@@ -616,6 +1203,7 @@ void test_oss_media_write_stream_frame_with_write_frame_failed(CuTest *tc) {
 
 void test_oss_media_write_stream_frame_with_flush_ts_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test8-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test8.m3u8";
@@ -650,6 +1238,7 @@ void test_oss_media_write_stream_frame_with_flush_ts_failed(CuTest *tc) {
 
 void test_oss_media_write_stream_frame_with_new_file_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test9-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test9.m3u8";
@@ -682,6 +1271,7 @@ void test_oss_media_write_stream_frame_with_new_file_failed(CuTest *tc) {
 
 void test_oss_media_write_stream_frame_succeeded(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test10-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test10.m3u8";
@@ -727,6 +1317,7 @@ void test_oss_media_get_video_frame_with_no_data(CuTest *tc) {
 
 void test_oss_media_get_video_frame_with_no_consume(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test11-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test11.m3u8";
@@ -755,6 +1346,7 @@ void test_oss_media_get_video_frame_with_no_consume(CuTest *tc) {
 
 void test_oss_media_get_video_frame_with_get_first_frame(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test12-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test12.m3u8";
@@ -790,6 +1382,7 @@ void test_oss_media_get_video_frame_with_get_first_frame(CuTest *tc) {
 
 void test_oss_media_get_video_frame_with_get_last_frame(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test33-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test33.m3u8";
@@ -822,6 +1415,63 @@ void test_oss_media_get_video_frame_with_get_last_frame(CuTest *tc) {
     oss_media_hls_stream_close(stream);    
 }
 
+void test_oss_media_get_video_frame_with_h265(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "test34-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "test34.m3u8";
+    options.is_live = 0;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 24000;
+    options.hls_time = 5;
+    options.video_type = st_h265;
+    
+    int ret;
+    oss_media_hls_stream_t *stream;
+
+    // no hvc1 sample entry for fmp4
+    options.format = sf_fmp4;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream == NULL);
+
+    options.format = sf_ts;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertIntEquals(tc, st_h265, stream->video_frame->stream_type);
+    CuAssertIntEquals(tc, st_h265, stream->ts_file->options.video_type);
+    
+    // aud, vps, idr slice, aud, trail slice
+    uint8_t buf[] = {0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50,
+                     0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0c,
+                     0x00, 0x00, 0x00, 0x01, 0x26, 0x01, 0x80, 0xaa,
+                     0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50,
+                     0x00, 0x00, 0x00, 0x01, 0x02, 0x01, 0x80, 0xbb};
+
+    stream->video_frame->end = buf;
+    stream->video_frame->pos = buf;
+    
+    ret = oss_media_get_video_frame(buf, sizeof(buf), stream);
+    CuAssertIntEquals(tc, 1, ret);
+    CuAssertPtrEquals(tc, buf, stream->video_frame->pos);
+    CuAssertPtrEquals(tc, buf + 22, stream->video_frame->end);
+    CuAssertIntEquals(tc, 1, stream->video_frame->key);
+    CuAssertIntEquals(tc, ft_aud, stream->video_frame->frame_type);
+
+    stream->video_frame->pos = stream->video_frame->end;
+    ret = oss_media_get_video_frame(buf, sizeof(buf), stream);
+    CuAssertIntEquals(tc, 1, ret);
+    CuAssertPtrEquals(tc, buf + 22, stream->video_frame->pos);
+    CuAssertPtrEquals(tc, buf + sizeof(buf), stream->video_frame->end);
+    CuAssertIntEquals(tc, 0, stream->video_frame->key);
+    CuAssertIntEquals(tc, ft_aud, stream->video_frame->frame_type);
+
+    oss_media_hls_stream_flush(10, stream);
+    delete_file(stream->ts_file->file);
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
 void test_oss_media_get_audio_frame_with_no_data(CuTest *tc) {
     oss_media_hls_stream_t stream;
     uint8_t *buf;
@@ -832,6 +1482,7 @@ void test_oss_media_get_audio_frame_with_no_data(CuTest *tc) {
 
 void test_oss_media_get_audio_frame_with_no_consume(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test14-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test14.m3u8";
@@ -859,6 +1510,7 @@ void test_oss_media_get_audio_frame_with_no_consume(CuTest *tc) {
 
 void test_oss_media_get_audio_frame_with_get_first_frame(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test15-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test15.m3u8";
@@ -872,7 +1524,7 @@ void test_oss_media_get_audio_frame_with_get_first_frame(CuTest *tc) {
     stream = oss_media_hls_stream_open(auth_func, &options);
     CuAssertTrue(tc, stream != NULL);
     
-    uint8_t buf[] = {0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+    uint8_t buf[] = {0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
                      0xFF, 0xF1};
     
     stream->audio_frame->end = buf;
@@ -893,8 +1545,67 @@ void test_oss_media_get_audio_frame_with_get_first_frame(CuTest *tc) {
     oss_media_hls_stream_close(stream);
 }
 
+void test_oss_media_get_audio_frame_with_mp3(CuTest *tc) {
+    oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.ts_name_prefix = "test35-";
+    options.bucket_name = TEST_BUCKET_NAME;
+    options.m3u8_name = "test35.m3u8";
+    options.is_live = 0;
+    options.video_frame_rate = 33;
+    options.audio_sample_rate = 44100;
+    options.hls_time = 5;
+    options.audio_type = st_mp3;
+    
+    int ret;
+    uint8_t buf[417 + 208 + 2];
+    oss_media_hls_stream_t *stream;
+
+    // no mp3 format for fmp4
+    options.format = sf_fmp4;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream == NULL);
+
+    options.format = sf_ts;
+    stream = oss_media_hls_stream_open(auth_func, &options);
+    CuAssertTrue(tc, stream != NULL);
+    CuAssertIntEquals(tc, st_mp3, stream->audio_frame->stream_type);
+    CuAssertIntEquals(tc, st_mp3, stream->ts_file->options.audio_type);
+    
+    // mpeg-1 layer 3 of 128kbps at 44.1kHz, mpeg-2 layer 3 of 64kbps 
+    // at 22.05kHz, and the start of the next header
+    memset(buf, 0, sizeof(buf));
+    buf[0] = 0xFF; buf[1] = 0xFB; buf[2] = 0x90;
+    buf[417] = 0xFF; buf[418] = 0xF3; buf[419] = 0x80;
+    buf[625] = 0xFF; buf[626] = 0xFB;
+    
+    stream->audio_frame->end = buf;
+    stream->audio_frame->pos = buf;
+    
+    ret = oss_media_get_audio_frame(buf, sizeof(buf), stream);
+    CuAssertIntEquals(tc, 1, ret);
+    CuAssertPtrEquals(tc, buf, stream->audio_frame->pos);
+    CuAssertPtrEquals(tc, buf + 417, stream->audio_frame->end);
+    CuAssertIntEquals(tc, 5000 + 90000 * 1152 / 44100,
+                      stream->audio_frame->pts);
+
+    stream->audio_frame->pos = stream->audio_frame->end;
+    ret = oss_media_get_audio_frame(buf, sizeof(buf), stream);
+    CuAssertIntEquals(tc, 1, ret);
+    CuAssertPtrEquals(tc, buf + 417, stream->audio_frame->pos);
+    CuAssertPtrEquals(tc, buf + 625, stream->audio_frame->end);
+    CuAssertIntEquals(tc, 5000 + 90000 * 1152 / 44100 + 90000 * 576 / 22050,
+                      stream->audio_frame->pts);
+
+    oss_media_hls_stream_flush(10, stream);
+    delete_file(stream->ts_file->file);
+    delete_file(stream->m3u8_file->file);
+    oss_media_hls_stream_close(stream);
+}
+
 void test_oss_media_get_audio_frame_with_get_last_frame(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test23-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test23.m3u8";
@@ -969,6 +1680,7 @@ void test_oss_media_sync_pts_dts_with_sync_audio(CuTest *tc) {
 
 void test_oss_media_hls_stream_write_with_no_video_audio(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test24-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test24.m3u8";
@@ -996,6 +1708,7 @@ void test_oss_media_hls_stream_write_with_no_video_audio(CuTest *tc) {
 
 void test_oss_media_hls_stream_write_with_only_video(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test43-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test43.m3u8";
@@ -1025,6 +1738,7 @@ void test_oss_media_hls_stream_write_with_only_video(CuTest *tc) {
 
 void test_oss_media_hls_stream_write_with_only_audio(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test16-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test16.m3u8";
@@ -1034,7 +1748,7 @@ void test_oss_media_hls_stream_write_with_only_audio(CuTest *tc) {
     options.hls_time = 5;
 
     uint8_t *video_buf;
-    uint8_t audio_buf[] = {0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+    uint8_t audio_buf[] = {0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
                      0xFF, 0xF1};
     
     int ret;
@@ -1054,6 +1768,7 @@ void test_oss_media_hls_stream_write_with_only_audio(CuTest *tc) {
 
 void test_oss_media_hls_stream_write(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test53-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test53.m3u8";
@@ -1065,10 +1780,10 @@ void test_oss_media_hls_stream_write(CuTest *tc) {
     uint8_t video_buf[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10, 0xfa,
                            0x00, 0x00, 0x00, 0x01, 0x81, 0x1f, 0xff,
                            0x00, 0x00, 0x00, 0x01, 0x63, 0xba, 0xfa};
-    uint8_t audio_buf[] = {0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
+    uint8_t audio_buf[] = {0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
 
     
     int ret;
@@ -1089,6 +1804,7 @@ void test_oss_media_hls_stream_write(CuTest *tc) {
 
 void test_oss_media_hls_stream_write_with_same_pts(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test63-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test63.m3u8";
@@ -1101,10 +1817,10 @@ void test_oss_media_hls_stream_write_with_same_pts(CuTest *tc) {
                            0x00, 0x00, 0x00, 0x01, 0x81, 0x1f, 0xff,
                            0x00, 0x00, 0x00, 0x01, 0x63, 0xba, 0xfa};
     
-    uint8_t audio_buf[] = {0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
+    uint8_t audio_buf[] = {0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
     int ret;
     oss_media_hls_stream_t *stream;
     stream = oss_media_hls_stream_open(auth_func, &options);
@@ -1123,6 +1839,7 @@ void test_oss_media_hls_stream_write_with_same_pts(CuTest *tc) {
 
 void test_oss_media_hls_stream_write_no_aud(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test73-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test73.m3u8";
@@ -1136,10 +1853,10 @@ void test_oss_media_hls_stream_write_no_aud(CuTest *tc) {
                            0x00, 0x00, 0x00, 0x01, 0x82, 0x1f, 0xff,
                            0x00, 0x00, 0x00, 0x01, 0x63, 0xba, 0xfa};
     
-    uint8_t audio_buf[] = {0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
+    uint8_t audio_buf[] = {0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
     int ret;
     oss_media_hls_stream_t *stream;
     stream = oss_media_hls_stream_open(auth_func, &options);
@@ -1158,6 +1875,7 @@ void test_oss_media_hls_stream_write_no_aud(CuTest *tc) {
 
 void test_oss_media_hls_stream_write_failed(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test16-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test16.m3u8";
@@ -1190,8 +1908,159 @@ void test_oss_media_hls_stream_write_failed(CuTest *tc) {
     oss_media_hls_stream_close(stream);
 }
 
+void test_oss_media_get_codecs(CuTest *tc) {
+    char codec[32];
+    uint8_t sps[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10,
+                     0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1E,
+                     0xF4, 0x05, 0x01, 0xEC, 0x80};
+    // main profile, level 3.1, with emulation prevention bytes
+    uint8_t hevc_sps[] = {0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x01,
+                          0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+                          0x03, 0x00, 0x00, 0x03, 0x00, 0x5d, 0xa0};
+    uint8_t adts[] = {0xFF, 0xF1, 0x50, 0x80, 0x01, 0x1F, 0xFC, 0x00};
+    oss_media_hls_frame_t frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.stream_type = st_h264;
+    frame.pos = sps;
+    frame.end = sps + sizeof(sps);
+    codec[0] = '\0';
+    oss_media_get_video_codec(&frame, codec, sizeof(codec));
+    CuAssertStrEquals(tc, "avc1.42c01e", codec);
+
+    frame.stream_type = st_h265;
+    frame.pos = hevc_sps;
+    frame.end = hevc_sps + sizeof(hevc_sps);
+    oss_media_get_video_codec(&frame, codec, sizeof(codec));
+    CuAssertStrEquals(tc, "hvc1.1.6.L93.90", codec);
+
+    // no sps, nothing is found
+    codec[0] = '\0';
+    frame.end = hevc_sps + 4;
+    oss_media_get_video_codec(&frame, codec, sizeof(codec));
+    CuAssertStrEquals(tc, "", codec);
+
+    frame.stream_type = st_aac;
+    frame.pos = adts;
+    frame.end = adts + sizeof(adts);
+    oss_media_get_audio_codec(&frame, codec, sizeof(codec));
+    CuAssertStrEquals(tc, "mp4a.40.2", codec);
+
+    frame.stream_type = st_mp3;
+    oss_media_get_audio_codec(&frame, codec, sizeof(codec));
+    CuAssertStrEquals(tc, "mp4a.40.34", codec);
+}
+
+void test_oss_media_hls_packager(CuTest *tc) {
+    oss_media_hls_rendition_t renditions[2];
+    oss_media_hls_packager_options_t options;
+    memset(&options, 0, sizeof(options));
+    memset(renditions, 0, sizeof(renditions));
+    options.stream.bucket_name = TEST_BUCKET_NAME;
+    options.stream.is_live = 0;
+    options.stream.video_frame_rate = 25;
+    options.stream.audio_sample_rate = 24000;
+    options.stream.hls_time = 1;
+    options.master_m3u8_name = "dir/test-abr.m3u8";
+    options.renditions = renditions;
+    options.rendition_count = 2;
+    renditions[0].ts_name_prefix = "dir/test-abr-av-";
+    renditions[0].m3u8_name = "dir/test-abr-av.m3u8";
+    renditions[0].bandwidth = 2000000;
+    renditions[0].resolution = "640x480";
+    renditions[1].ts_name_prefix = "dir/test-abr-a-";
+    renditions[1].m3u8_name = "dir/test-abr-a.m3u8";
+    renditions[1].audio_only = 1;
+    renditions[1].bandwidth = 64000;
+    renditions[1].resolution = "640x480";
+
+    // 30 frames of 25fps starting with sps and an idr, 30 of aac
+    uint8_t key[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10,
+                     0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1E,
+                     0xF4, 0x05, 0x01, 0xEC, 0x80,
+                     0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x38, 0x80,
+                     0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0xff};
+    uint8_t other[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10,
+                       0x00, 0x00, 0x00, 0x01, 0x41, 0x9a, 0x21, 0xff};
+    uint8_t adts[] = {0xFF, 0xF1, 0x50, 0x80, 0x01, 0x1F, 0xFC, 0x00};
+    uint8_t video[sizeof(key) + 29 * sizeof(other)];
+    uint8_t audio[30 * sizeof(adts)];
+    int i;
+    int ret;
+    char *content;
+    oss_media_hls_stream_t *av, *a;
+    oss_media_hls_packager_t *packager;
+
+    memcpy(video, key, sizeof(key));
+    for (i = 0; i < 29; i++) {
+        memcpy(video + sizeof(key) + i * sizeof(other), other, sizeof(other));
+    }
+    for (i = 0; i < 30; i++) {
+        memcpy(audio + i * sizeof(adts), adts, sizeof(adts));
+    }
+
+    packager = oss_media_hls_packager_open(auth_func, &options);
+    CuAssertTrue(tc, packager != NULL);
+    av = packager->streams[0];
+    a = packager->streams[1];
+    CuAssertIntEquals(tc, 0, av->ts_file->options.audio_only);
+    CuAssertIntEquals(tc, 1, a->ts_file->options.audio_only);
+
+    ret = oss_media_hls_packager_write(video, sizeof(video),
+                                       audio, sizeof(audio), packager);
+    CuAssertIntEquals(tc, 0, ret);
+
+    // both cut their first segment at 1s, the audio only one at the next
+    // audio frame, and the master is written by then
+    CuAssertIntEquals(tc, 2, av->ts_file_index);
+    CuAssertIntEquals(tc, 2, a->ts_file_index);
+    CuAssertDblEquals(tc, 1.0,
+            oss_media_hls_window_at(&av->m3u8_window, 0)->duration, 0.00001);
+    CuAssertDblEquals(tc, 1.024,
+            oss_media_hls_window_at(&a->m3u8_window, 0)->duration, 0.00001);
+    CuAssertIntEquals(tc, 1, packager->master_written);
+
+    content = (char*)packager->master_file->buffer->buf;
+    CuAssertTrue(tc, NULL != strstr(content, "#EXT-X-STREAM-INF:"
+                "BANDWIDTH=2000000,CODECS=\"avc1.42c01e,mp4a.40.2\","
+                "RESOLUTION=640x480\n"));
+    CuAssertTrue(tc, NULL != strstr(content, "/dir/test-abr-av.m3u8\n"
+                "#EXT-X-STREAM-INF:BANDWIDTH=64000,CODECS=\"mp4a.40.2\"\n"));
+    CuAssertTrue(tc, NULL != strstr(content, "/dir/test-abr-a.m3u8\n"));
+
+    delete_file(packager->master_file->file);
+    delete_file(av->ts_file->file);
+    delete_file(a->ts_file->file);
+    ret = oss_media_hls_packager_close(packager);
+    CuAssertIntEquals(tc, 0, ret);
+}
+
+void test_oss_media_hls_packager_open_with_two_video_renditions(CuTest *tc) {
+    oss_media_hls_rendition_t renditions[2];
+    oss_media_hls_packager_options_t options;
+    oss_media_hls_packager_t *packager;
+    memset(&options, 0, sizeof(options));
+    memset(renditions, 0, sizeof(renditions));
+    options.stream.bucket_name = TEST_BUCKET_NAME;
+    options.stream.is_live = 0;
+    options.stream.hls_time = 1;
+    options.master_m3u8_name = "dir/test-abr.m3u8";
+    options.renditions = renditions;
+    options.rendition_count = 2;
+    renditions[0].ts_name_prefix = "dir/test-abr-high-";
+    renditions[0].m3u8_name = "dir/test-abr-high.m3u8";
+    renditions[0].bandwidth = 2000000;
+    renditions[1].ts_name_prefix = "dir/test-abr-low-";
+    renditions[1].m3u8_name = "dir/test-abr-low.m3u8";
+    renditions[1].bandwidth = 500000;
+
+    packager = oss_media_hls_packager_open(auth_func, &options);
+    CuAssertTrue(tc, packager == NULL);
+}
+
 void test_oss_media_hls_stream_close_for_vod(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test20-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test20.m3u8";
@@ -1205,8 +2074,8 @@ void test_oss_media_hls_stream_close_for_vod(CuTest *tc) {
                            0x00, 0x00, 0x00, 0x01, 0x63, 0xba, 0xfa,
                            0x00, 0x00, 0x00, 0x01, 0xaa, 0xcc, 0xdd};
     
-    uint8_t audio_buf[] = {0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
+    uint8_t audio_buf[] = {0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
     int ret;
     oss_media_hls_stream_t *stream;
     stream = oss_media_hls_stream_open(auth_func, &options);
@@ -1273,6 +2142,7 @@ void test_oss_media_hls_stream_close_for_vod(CuTest *tc) {
 
 void test_oss_media_hls_stream_close_for_live(CuTest *tc) {
     oss_media_hls_stream_options_t options;
+    memset(&options, 0, sizeof(options));
     options.ts_name_prefix = "test21-";
     options.bucket_name = TEST_BUCKET_NAME;
     options.m3u8_name = "test21.m3u8";
@@ -1287,8 +2157,8 @@ void test_oss_media_hls_stream_close_for_live(CuTest *tc) {
                            0x00, 0x00, 0x00, 0x01, 0x63, 0xba, 0xfa,
                            0x00, 0x00, 0x00, 0x01, 0xaa, 0xcc, 0xdd};
     
-    uint8_t audio_buf[] = {0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
-                           0xFF, 0xF0, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
+    uint8_t audio_buf[] = {0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00,
+                           0xFF, 0xF1, 0x00, 0x00, 0x01, 0x10, 0xFF, 0x00};
     int ret;
     oss_media_hls_stream_t *stream;
     stream = oss_media_hls_stream_open(auth_func, &options);
@@ -1333,6 +2203,12 @@ static int oss_media_hls_fake_handler(oss_media_hls_file_t *file) {
     return file->frame_count++ > 0;
 }
 
+static int oss_media_hls_fake_key(int64_t sequence, oss_media_hls_key_t *key) {
+    memset(key->key, sequence, sizeof(key->key));
+    sprintf(key->uri, "https://key.abc.com/%"APR_INT64_T_FMT, sequence);
+    return 0;
+}
+
 static void auth_func(oss_media_file_t *file) {
     file->endpoint = TEST_OSS_ENDPOINT;
     file->is_cname = 0;
@@ -1356,9 +2232,19 @@ CuSuite *test_hls_stream()
     SUITE_ADD_TEST(suite, test_oss_media_hls_stream_open_with_failed);
     SUITE_ADD_TEST(suite, test_oss_media_create_ts_full_url);
     SUITE_ADD_TEST(suite, test_oss_media_create_ts_full_url_with_prefix);
+    SUITE_ADD_TEST(suite, test_oss_media_create_url);
     SUITE_ADD_TEST(suite, test_oss_media_set_m3u8_info);
     SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_for_vod);
     SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_for_live);
+    SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_with_key_rotation);
+    SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_with_sample_aes);
+    SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_with_fmp4);
+    SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_with_byte_range);
+    SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_with_single_put);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_stream_open_with_chunked_failed);
+    SUITE_ADD_TEST(suite, test_oss_media_write_iframe_m3u8);
+    SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_with_parts);
+    SUITE_ADD_TEST(suite, test_oss_media_create_key);
     SUITE_ADD_TEST(suite, test_oss_media_write_m3u8_failed);
     SUITE_ADD_TEST(suite, test_close_and_open_new_file_with_close_failed);
     SUITE_ADD_TEST(suite, test_close_and_open_new_file_with_open_failed);
@@ -1380,9 +2266,11 @@ CuSuite *test_hls_stream()
     SUITE_ADD_TEST(suite, test_oss_media_get_video_frame_with_no_consume);
     SUITE_ADD_TEST(suite, test_oss_media_get_video_frame_with_get_first_frame);
     SUITE_ADD_TEST(suite, test_oss_media_get_video_frame_with_get_last_frame);
+    SUITE_ADD_TEST(suite, test_oss_media_get_video_frame_with_h265);
     SUITE_ADD_TEST(suite, test_oss_media_get_audio_frame_with_no_data);
     SUITE_ADD_TEST(suite, test_oss_media_get_audio_frame_with_no_consume);
     SUITE_ADD_TEST(suite, test_oss_media_get_audio_frame_with_get_first_frame);
+    SUITE_ADD_TEST(suite, test_oss_media_get_audio_frame_with_mp3);
     SUITE_ADD_TEST(suite, test_oss_media_get_audio_frame_with_get_last_frame);
     SUITE_ADD_TEST(suite, test_oss_media_sync_pts_dts_with_sync_video);
     SUITE_ADD_TEST(suite, test_oss_media_sync_pts_dts_with_sync_audio);
@@ -1393,6 +2281,9 @@ CuSuite *test_hls_stream()
     SUITE_ADD_TEST(suite, test_oss_media_hls_stream_write_with_same_pts);
     SUITE_ADD_TEST(suite, test_oss_media_hls_stream_write_no_aud);
     SUITE_ADD_TEST(suite, test_oss_media_hls_stream_write_failed);
+    SUITE_ADD_TEST(suite, test_oss_media_get_codecs);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_packager);
+    SUITE_ADD_TEST(suite, test_oss_media_hls_packager_open_with_two_video_renditions);
     SUITE_ADD_TEST(suite, test_oss_media_hls_stream_close_for_vod);
     SUITE_ADD_TEST(suite, test_oss_media_hls_stream_close_for_live);
     
@@ -0,0 +1,146 @@
+#include "CuTest.h"
+#include <stdlib.h>
+#include <string.h>
+#include "src/oss_media_nal.c"
+
+extern int oss_media_get_h264_idr_offsets(const void *buf, int nbyte,
+                                          int idrs[], int nidrs, int *size);
+
+#define TEST_NAL_BUF_SIZE 300
+
+static const uint8_t *test_find_start_code_bytewise(const uint8_t *p,
+                                                    const uint8_t *end)
+{
+    for (; end - p >= 3; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+    }
+    return end;
+}
+
+// few distinct bytes, so that start codes and near misses are everywhere
+static void test_fill_nal_buf(uint8_t *buf, int len, uint32_t seed)
+{
+    static const uint8_t bytes[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0xFF};
+    int i;
+
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = bytes[(seed >> 16) % sizeof(bytes)];
+    }
+}
+
+static void test_find_start_code_with(CuTest *tc,
+                                      oss_media_find_start_code_fn_t find)
+{
+    uint8_t buf[TEST_NAL_BUF_SIZE];
+    const uint8_t *p, *end;
+    int seed, begin, len;
+
+    for (seed = 0; seed < 20; seed++) {
+        test_fill_nal_buf(buf, sizeof(buf), seed);
+        for (begin = 0; begin < 40; begin++) {
+            for (len = 0; begin + len <= (int)sizeof(buf); len += 7) {
+                end = buf + begin + len;
+                for (p = buf + begin; p < end; p++) {
+                    CuAssertPtrEquals(tc,
+                            (void*)test_find_start_code_bytewise(p, end),
+                            (void*)find(p, end));
+                    p = test_find_start_code_bytewise(p, end);
+                }
+            }
+        }
+    }
+}
+
+void test_oss_media_find_start_code(CuTest *tc) {
+    uint8_t buf[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10, 0x00, 0x00, 0x01};
+
+    CuAssertPtrEquals(tc, buf + 1,
+            (void*)oss_media_find_start_code(buf, buf + sizeof(buf)));
+    CuAssertPtrEquals(tc, buf + 6,
+            (void*)oss_media_find_start_code(buf + 2, buf + sizeof(buf)));
+    CuAssertPtrEquals(tc, buf + 8,
+            (void*)oss_media_find_start_code(buf + 2, buf + 8));
+
+    test_find_start_code_with(tc, oss_media_find_start_code_c);
+#ifdef OSS_MEDIA_NAL_SIMD
+    if (__builtin_cpu_supports("sse2")) {
+        test_find_start_code_with(tc, oss_media_find_start_code_sse2);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        test_find_start_code_with(tc, oss_media_find_start_code_avx2);
+    }
+#endif
+}
+
+void test_oss_media_find_nals(CuTest *tc) {
+    uint8_t buf[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0x10,
+                     0x00, 0x00, 0x01, 0x67, 0x42,
+                     0x00, 0x00, 0x00, 0x00, 0x01, 0x65, 0x88,
+                     0x00, 0x00, 0x00};
+    oss_media_nal_t nals[4];
+    const uint8_t *next;
+    int n;
+
+    n = oss_media_find_nals(buf, buf + sizeof(buf), nals, 4, &next);
+    CuAssertIntEquals(tc, 3, n);
+    CuAssertPtrEquals(tc, buf, (void*)nals[0].start);
+    CuAssertPtrEquals(tc, buf + 4, (void*)nals[0].header);
+    CuAssertIntEquals(tc, 9, OSS_MEDIA_H264_NAL_TYPE(nals[0].head));
+    CuAssertPtrEquals(tc, buf + 6, (void*)nals[1].start);
+    CuAssertIntEquals(tc, 7, OSS_MEDIA_H264_NAL_TYPE(nals[1].head));
+    CuAssertPtrEquals(tc, buf + 12, (void*)nals[2].start);
+    CuAssertPtrEquals(tc, buf + 16, (void*)nals[2].header);
+    CuAssertIntEquals(tc, 5, OSS_MEDIA_H264_NAL_TYPE(nals[2].head));
+    CuAssertPtrEquals(tc, buf + 16, (void*)OSS_MEDIA_NAL_HEADER(buf + 12));
+    // the zeros at the end may start a code
+    CuAssertPtrEquals(tc, buf + 18, (void*)next);
+
+    // a full batch goes on after the last header
+    n = oss_media_find_nals(buf, buf + sizeof(buf), nals, 2, &next);
+    CuAssertIntEquals(tc, 2, n);
+    CuAssertPtrEquals(tc, buf + 9, (void*)next);
+    n = oss_media_find_nals(next, buf + sizeof(buf), nals, 2, &next);
+    CuAssertIntEquals(tc, 1, n);
+    CuAssertPtrEquals(tc, buf + 12, (void*)nals[0].start);
+
+    // a code without its header is left to the next scan
+    n = oss_media_find_nals(buf, buf + 16, nals, 4, &next);
+    CuAssertIntEquals(tc, 2, n);
+    CuAssertPtrEquals(tc, buf + 12, (void*)next);
+}
+
+void test_oss_media_get_h264_idr_offsets(CuTest *tc) {
+    uint8_t buf[] = {0x00, 0x00, 0x00, 0x01, 0x67, 0x42,
+                     0x00, 0x00, 0x00, 0x01, 0x65, 0x88,
+                     0x00, 0x00, 0x01, 0x41, 0x9a,
+                     0x00, 0x00, 0x01, 0x25, 0x88,
+                     0x00, 0x00};
+    int idrs[4];
+    int size;
+    int ret;
+
+    ret = oss_media_get_h264_idr_offsets(buf, sizeof(buf), idrs, 4, &size);
+    CuAssertIntEquals(tc, 2, size);
+    CuAssertIntEquals(tc, 7, idrs[0]);
+    CuAssertIntEquals(tc, 17, idrs[1]);
+    CuAssertIntEquals(tc, 22, ret);
+
+    ret = oss_media_get_h264_idr_offsets(buf, sizeof(buf), idrs, 1, &size);
+    CuAssertIntEquals(tc, 1, size);
+    CuAssertIntEquals(tc, 7, idrs[0]);
+    CuAssertIntEquals(tc, 7, ret);
+}
+
+CuSuite *test_nal()
+{
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, test_oss_media_find_start_code);
+    SUITE_ADD_TEST(suite, test_oss_media_find_nals);
+    SUITE_ADD_TEST(suite, test_oss_media_get_h264_idr_offsets);
+
+    return suite;
+}
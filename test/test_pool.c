@@ -0,0 +1,126 @@
+#include "CuTest.h"
+#include <string.h>
+#include "test.h"
+#include "src/oss_media_pool.h"
+
+/* hls files do not use this class */
+#define TEST_POOL_SIZE (1024 * 1024)
+#define TEST_POOL_CLASS 8
+
+static oss_media_pool_stats_t get_test_class_stats() {
+    oss_media_pool_stats_t stats[OSS_MEDIA_POOL_CLASSES];
+
+    oss_media_pool_get_stats(stats);
+    return stats[TEST_POOL_CLASS];
+}
+
+void test_oss_media_pool_alloc(CuTest *tc) {
+    void *buf;
+    void *reused;
+    oss_media_pool_stats_t before, stats;
+
+    before = get_test_class_stats();
+    CuAssertIntEquals(tc, TEST_POOL_SIZE, (int)before.size);
+
+    // a smaller size is rounded up to the class
+    buf = oss_media_pool_alloc(TEST_POOL_SIZE - 100);
+    CuAssertTrue(tc, buf != NULL);
+    memset(buf, 0x5a, TEST_POOL_SIZE);
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, before.in_use + 1, stats.in_use);
+    CuAssertTrue(tc, stats.peak >= stats.in_use);
+
+    // the freed buffer is idle and handed out again
+    oss_media_pool_free(buf);
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, before.in_use, stats.in_use);
+    CuAssertIntEquals(tc, before.idle + 1, stats.idle);
+
+    reused = oss_media_pool_alloc(TEST_POOL_SIZE);
+    CuAssertPtrEquals(tc, buf, reused);
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, before.idle, stats.idle);
+
+    oss_media_pool_free(reused);
+    oss_media_pool_free(NULL);
+}
+
+void test_oss_media_pool_realloc(CuTest *tc) {
+    int i;
+    uint8_t *buf;
+    uint8_t *grown;
+
+    buf = (uint8_t*)oss_media_pool_realloc(NULL, 1000);
+    CuAssertTrue(tc, buf != NULL);
+    for (i = 0; i < 1000; i++) {
+        buf[i] = i & 0xFF;
+    }
+
+    // the class has room for it
+    CuAssertPtrEquals(tc, buf, oss_media_pool_realloc(buf, 4096));
+
+    grown = (uint8_t*)oss_media_pool_realloc(buf, 4097);
+    CuAssertTrue(tc, grown != NULL);
+    for (i = 0; i < 1000; i++) {
+        CuAssertIntEquals(tc, i & 0xFF, grown[i]);
+    }
+
+    // beyond the largest class it is malloced, and kept the same way
+    buf = (uint8_t*)oss_media_pool_realloc(grown, 5 * 1024 * 1024);
+    CuAssertTrue(tc, buf != NULL);
+    for (i = 0; i < 1000; i++) {
+        CuAssertIntEquals(tc, i & 0xFF, buf[i]);
+    }
+    oss_media_pool_free(buf);
+}
+
+void test_oss_media_pool_reserve(CuTest *tc) {
+    int i;
+    void *bufs[3];
+    oss_media_pool_stats_t stats;
+
+    CuAssertIntEquals(tc, -1,
+            oss_media_pool_reserve(5 * 1024 * 1024, 1, 1));
+
+    // prefaulted buffers are idle, not in use
+    CuAssertIntEquals(tc, 0, oss_media_pool_reserve(TEST_POOL_SIZE, 2, 5));
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, 2, stats.max_idle);
+    CuAssertTrue(tc, stats.idle == 2);
+
+    // no more than the cap is kept
+    for (i = 0; i < 3; i++) {
+        bufs[i] = oss_media_pool_alloc(TEST_POOL_SIZE);
+        CuAssertTrue(tc, bufs[i] != NULL);
+    }
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, 0, stats.idle);
+    CuAssertTrue(tc, stats.peak >= 3);
+    for (i = 0; i < 3; i++) {
+        oss_media_pool_free(bufs[i]);
+    }
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, 2, stats.idle);
+
+    // a lower cap drops idle buffers at once
+    CuAssertIntEquals(tc, 0, oss_media_pool_reserve(TEST_POOL_SIZE, 1, 0));
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, 1, stats.idle);
+
+    oss_media_pool_trim();
+    stats = get_test_class_stats();
+    CuAssertIntEquals(tc, 0, stats.idle);
+    CuAssertIntEquals(tc, 0, oss_media_pool_reserve(TEST_POOL_SIZE,
+            OSS_MEDIA_DEFAULT_POOL_IDLE, 0));
+}
+
+CuSuite *test_pool()
+{
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, test_oss_media_pool_alloc);
+    SUITE_ADD_TEST(suite, test_oss_media_pool_realloc);
+    SUITE_ADD_TEST(suite, test_oss_media_pool_reserve);
+
+    return suite;
+}
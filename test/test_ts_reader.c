@@ -0,0 +1,301 @@
+#include "CuTest.h"
+#include <string.h>
+#include "test.h"
+#include "config.h"
+#include "src/oss_media_ts_reader.c"
+
+extern void delete_file(oss_media_file_t *file);
+static void auth_func(oss_media_file_t *file);
+
+#define TEST_TS_FRAME_COUNT 4
+/* longer than the 16 bits length of a pes */
+#define TEST_TS_LARGE_FRAME_SIZE (100 * 1024)
+
+static uint8_t ts_captured[256 * 1024];
+static int ts_captured_len;
+static uint8_t large_frame[TEST_TS_LARGE_FRAME_SIZE];
+
+static int ts_capture_handler(oss_media_hls_file_t *file) {
+    int len = file->buffer->pos - file->buffer->start;
+
+    memcpy(ts_captured + ts_captured_len,
+           &file->buffer->buf[file->buffer->start], len);
+    ts_captured_len += len;
+    file->buffer->pos = file->buffer->start;
+
+    return 0;
+}
+
+// a key frame, an adts frame, a frame of unknown pes length, an adts frame
+static void make_test_frames(oss_media_hls_frame_t frames[]) {
+    static uint8_t idr[] = {0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x21};
+    static uint8_t adts[] = {0xff, 0xf1, 0x50, 0x80, 0x01, 0x3f, 0xfc,
+                             0x21, 0x10, 0x05};
+    int i;
+
+    for (i = 0; i < TEST_TS_LARGE_FRAME_SIZE; i++) {
+        large_frame[i] = i * 7 & 0xFF;
+    }
+    large_frame[0] = 0x00;
+    large_frame[1] = 0x00;
+    large_frame[2] = 0x00;
+    large_frame[3] = 0x01;
+    large_frame[4] = 0x41;
+
+    memset(frames, 0, TEST_TS_FRAME_COUNT * sizeof(oss_media_hls_frame_t));
+    frames[0].stream_type = st_h264;
+    frames[0].pos = idr;
+    frames[0].end = idr + sizeof(idr);
+    frames[0].pts = 9000;
+    frames[0].dts = 6000;
+    frames[0].key = 1;
+
+    frames[1].stream_type = st_aac;
+    frames[1].pos = adts;
+    frames[1].end = adts + sizeof(adts);
+    frames[1].pts = 6500;
+    frames[1].dts = 6500;
+
+    frames[2].stream_type = st_h264;
+    frames[2].pos = large_frame;
+    frames[2].end = large_frame + sizeof(large_frame);
+    frames[2].pts = 12000;
+    frames[2].dts = 9000;
+
+    frames[3].stream_type = st_aac;
+    frames[3].pos = adts;
+    frames[3].end = adts + sizeof(adts);
+    frames[3].pts = 8548;
+    frames[3].dts = 8548;
+}
+
+// mux the test frames, the continuity counters go on from frame to frame
+static int write_test_frames(oss_media_hls_file_t *file,
+                             oss_media_hls_frame_t frames[])
+{
+    uint32_t video_cc = 0, audio_cc = 0;
+    oss_media_hls_frame_t frame;
+    int i;
+
+    for (i = 0; i < TEST_TS_FRAME_COUNT; i++) {
+        frame = frames[i];
+        frame.continuity_counter = frame.stream_type == st_aac ?
+                                   audio_cc : video_cc;
+        if (0 != oss_media_hls_write_frame(&frame, file)) {
+            return -1;
+        }
+        if (frame.stream_type == st_aac) {
+            audio_cc = frame.continuity_counter;
+        } else {
+            video_cc = frame.continuity_counter;
+        }
+    }
+    return oss_media_hls_flush(file);
+}
+
+static int make_test_ts(oss_media_hls_frame_t frames[], uint64_t *delay) {
+    oss_media_hls_file_t *file;
+    int ret;
+
+    file = oss_media_hls_open(TEST_BUCKET_NAME, "ts_reader.ts", auth_func);
+    if (file == NULL) {
+        return -1;
+    }
+    file->options.handler_func = ts_capture_handler;
+    ts_captured_len = 0;
+
+    make_test_frames(frames);
+    ret = write_test_frames(file, frames);
+    *delay = file->options.hls_delay_ms;
+
+    oss_media_hls_close(file);
+    return ret;
+}
+
+static void assert_frame_equals(CuTest *tc, oss_media_hls_frame_t *expected,
+                                uint64_t delay, oss_media_hls_frame_t *frame)
+{
+    CuAssertIntEquals(tc, expected->stream_type, frame->stream_type);
+    CuAssertTrue(tc, expected->pts + delay == frame->pts);
+    if (expected->stream_type == st_h264) {
+        CuAssertTrue(tc, expected->dts + delay == frame->dts);
+    } else {
+        CuAssertTrue(tc, frame->pts == frame->dts);
+    }
+    CuAssertIntEquals(tc, expected->key, frame->key);
+    CuAssertIntEquals(tc, expected->end - expected->pos,
+                      frame->end - frame->pos);
+    CuAssertTrue(tc, 0 == memcmp(expected->pos, frame->pos,
+                                 frame->end - frame->pos));
+}
+
+void test_oss_media_ts_reader_find_sync(CuTest *tc) {
+    uint8_t buf[3 * OSS_MEDIA_HLS_PACKET_SIZE];
+    const uint8_t *end = buf + sizeof(buf);
+
+    memset(buf, 0, sizeof(buf));
+    CuAssertPtrEquals(tc, (void*)end,
+                      (void*)oss_media_ts_reader_find_sync(buf, end));
+
+    // a 0x47 without another one a packet later is in the payload
+    buf[10] = 0x47;
+    buf[20] = 0x47;
+    buf[20 + OSS_MEDIA_HLS_PACKET_SIZE] = 0x47;
+    CuAssertPtrEquals(tc, buf + 20,
+                      (void*)oss_media_ts_reader_find_sync(buf, end));
+
+    // the last packet can not be checked
+    end = buf + 20 + 2 * OSS_MEDIA_HLS_PACKET_SIZE;
+    CuAssertPtrEquals(tc, buf + 20 + OSS_MEDIA_HLS_PACKET_SIZE,
+            (void*)oss_media_ts_reader_find_sync(buf + 21, end));
+}
+
+void test_oss_media_ts_reader_read_frame(CuTest *tc) {
+    oss_media_hls_frame_t frames[TEST_TS_FRAME_COUNT];
+    oss_media_hls_frame_t frame;
+    oss_media_ts_reader_t *reader;
+    uint64_t delay;
+    int i;
+
+    CuAssertIntEquals(tc, 0, make_test_ts(frames, &delay));
+
+    reader = oss_media_ts_reader_open(ts_captured, ts_captured_len);
+    CuAssertTrue(tc, reader != NULL);
+
+    // the large frame ends with the pes of the next key frame, or the ts
+    for (i = 0; i < TEST_TS_FRAME_COUNT; i++) {
+        CuAssertIntEquals(tc, 1, oss_media_ts_reader_read_frame(reader, &frame));
+        assert_frame_equals(tc, &frames[i == 2 ? 3 : i == 3 ? 2 : i],
+                            delay, &frame);
+    }
+    CuAssertIntEquals(tc, 0, oss_media_ts_reader_read_frame(reader, &frame));
+
+    CuAssertIntEquals(tc, st_h264, reader->video.stream_type);
+    CuAssertIntEquals(tc, OSS_MEDIA_DEFAULT_VIDEO_PID, reader->video.pid);
+    CuAssertIntEquals(tc, OSS_MEDIA_DEFAULT_AUDIO_PID, reader->audio.pid);
+    CuAssertTrue(tc, reader->stats.packets
+                     == ts_captured_len / OSS_MEDIA_HLS_PACKET_SIZE);
+    CuAssertIntEquals(tc, 0, (int)reader->stats.skipped_bytes);
+    CuAssertIntEquals(tc, 0, reader->stats.continuity_errors);
+    CuAssertIntEquals(tc, 0, reader->stats.crc_errors);
+
+    oss_media_ts_reader_close(reader);
+}
+
+void test_oss_media_ts_reader_read_frame_with_lost_packet(CuTest *tc) {
+    static uint8_t ts[sizeof(ts_captured) + 100];
+    oss_media_hls_frame_t frames[TEST_TS_FRAME_COUNT];
+    oss_media_hls_frame_t frame;
+    oss_media_ts_reader_t *reader;
+    uint64_t delay;
+    int len, lost;
+
+    CuAssertIntEquals(tc, 0, make_test_ts(frames, &delay));
+
+    // garbage in front, and a packet of the large frame lost
+    memset(ts, 0x47, 100);
+    ts[50] = 0;
+    len = 100;
+    lost = 10 * OSS_MEDIA_HLS_PACKET_SIZE;
+    memcpy(ts + len, ts_captured, lost);
+    len += lost;
+    memcpy(ts + len, ts_captured + lost + OSS_MEDIA_HLS_PACKET_SIZE,
+           ts_captured_len - lost - OSS_MEDIA_HLS_PACKET_SIZE);
+    len += ts_captured_len - lost - OSS_MEDIA_HLS_PACKET_SIZE;
+
+    reader = oss_media_ts_reader_open(ts, len);
+    CuAssertTrue(tc, reader != NULL);
+
+    CuAssertIntEquals(tc, 1, oss_media_ts_reader_read_frame(reader, &frame));
+    assert_frame_equals(tc, &frames[0], delay, &frame);
+    CuAssertIntEquals(tc, 1, oss_media_ts_reader_read_frame(reader, &frame));
+    assert_frame_equals(tc, &frames[1], delay, &frame);
+    CuAssertIntEquals(tc, 1, oss_media_ts_reader_read_frame(reader, &frame));
+    assert_frame_equals(tc, &frames[3], delay, &frame);
+
+    // the large frame is dropped
+    CuAssertIntEquals(tc, 0, oss_media_ts_reader_read_frame(reader, &frame));
+    CuAssertIntEquals(tc, 1, reader->stats.continuity_errors);
+    CuAssertIntEquals(tc, 100, (int)reader->stats.skipped_bytes);
+
+    oss_media_ts_reader_close(reader);
+}
+
+void test_oss_media_ts_reader_read_frame_with_bad_crc(CuTest *tc) {
+    oss_media_hls_frame_t frames[TEST_TS_FRAME_COUNT];
+    oss_media_hls_frame_t frame;
+    oss_media_ts_reader_t *reader;
+    uint64_t delay;
+
+    CuAssertIntEquals(tc, 0, make_test_ts(frames, &delay));
+
+    // without pmt the pids of the streams are unknown
+    ts_captured[OSS_MEDIA_HLS_PACKET_SIZE + 20] ^= 0x01;
+
+    reader = oss_media_ts_reader_open(ts_captured, ts_captured_len);
+    CuAssertTrue(tc, reader != NULL);
+    CuAssertIntEquals(tc, 0, oss_media_ts_reader_read_frame(reader, &frame));
+    CuAssertIntEquals(tc, 1, reader->stats.crc_errors);
+    CuAssertIntEquals(tc, 0, reader->video.pid);
+
+    oss_media_ts_reader_close(reader);
+}
+
+void test_oss_media_ts_reader_open_file(CuTest *tc) {
+    oss_media_hls_frame_t frames[TEST_TS_FRAME_COUNT];
+    oss_media_hls_frame_t frame;
+    oss_media_ts_reader_t *reader;
+    oss_media_hls_file_t *hls_file;
+    oss_media_file_t *file;
+    uint64_t delay;
+    int i;
+
+    hls_file = oss_media_hls_open(TEST_BUCKET_NAME, "ts_reader.ts", auth_func);
+    CuAssertTrue(tc, hls_file != NULL);
+    make_test_frames(frames);
+    CuAssertIntEquals(tc, 0, write_test_frames(hls_file, frames));
+    delay = hls_file->options.hls_delay_ms;
+    CuAssertIntEquals(tc, 0, oss_media_hls_close(hls_file));
+
+    file = oss_media_file_open(TEST_BUCKET_NAME, "ts_reader.ts", "r",
+                               auth_func);
+    CuAssertTrue(tc, file != NULL);
+    reader = oss_media_ts_reader_open_file(file);
+    CuAssertTrue(tc, reader != NULL);
+
+    for (i = 0; i < TEST_TS_FRAME_COUNT; i++) {
+        CuAssertIntEquals(tc, 1, oss_media_ts_reader_read_frame(reader, &frame));
+        assert_frame_equals(tc, &frames[i == 2 ? 3 : i == 3 ? 2 : i],
+                            delay, &frame);
+    }
+    CuAssertIntEquals(tc, 0, oss_media_ts_reader_read_frame(reader, &frame));
+    CuAssertIntEquals(tc, 0, reader->stats.continuity_errors);
+
+    oss_media_ts_reader_close(reader);
+    delete_file(file);
+    oss_media_file_close(file);
+}
+
+static void auth_func(oss_media_file_t *file) {
+    file->endpoint = TEST_OSS_ENDPOINT;
+    file->is_cname = 0;
+    file->access_key_id = TEST_ACCESS_KEY_ID;
+    file->access_key_secret = TEST_ACCESS_KEY_SECRET;
+    file->token = NULL; //SAMPLE_STS_TOKEN; // if use sts token
+
+    // expiration 300 sec.
+    file->expiration = time(NULL) + 300;
+}
+
+CuSuite *test_ts_reader()
+{
+    CuSuite* suite = CuSuiteNew();
+
+    SUITE_ADD_TEST(suite, test_oss_media_ts_reader_find_sync);
+    SUITE_ADD_TEST(suite, test_oss_media_ts_reader_read_frame);
+    SUITE_ADD_TEST(suite, test_oss_media_ts_reader_read_frame_with_lost_packet);
+    SUITE_ADD_TEST(suite, test_oss_media_ts_reader_read_frame_with_bad_crc);
+    SUITE_ADD_TEST(suite, test_oss_media_ts_reader_open_file);
+
+    return suite;
+}